@@ -15,6 +15,10 @@ end
 % folder in cui ci sono i file ats (cambiala per il tuo caso) 
 atsDir = 'C:\Users\d016781\Dropbox (Politecnico Di Torino Studenti)\Termografia_Santoro\Razza_0210';
 
+% per tutta la campagna senza matlab (piu' file in parallelo, ripresa dopo
+% un'interruzione, risultati in un solo file): script/ThermoBatch job.txt,
+% vedi ThermoBatch.h per il job e readBatchResults per leggere i risultati
+
 % folder in cui salvare tutto (cambiala per il tuo caso)
 saveDir = 'C:\Users\d016781\Dropbox (Politecnico Di Torino Studenti)\Termografia_Santoro\Razza_0210\saves';
 xlsFile = 'nomeFile.xls';
@@ -25,26 +29,68 @@ xlsFile = fullfile(saveDir, xlsFile);
 searchFile = fullfile(atsDir,'*.ats');
 lista = dir(searchFile);
 
+% indice di similarita' della campagna: ogni prova aggiunge le sue mappe di
+% ampiezza e fase, e riporta le prove gia' analizzate piu' simili
+% (MapIndexMex('query', idx, nome, k) anche a posteriori)
+mapIndex = MapIndexMex('open', fullfile(saveDir,'campaign.mapidx'));
+
+% true per il profilo di ogni file: tempi, memoria e thread di ogni fase in
+% <nome>_profile.json e la timeline in <nome>_trace.json (chrome://tracing)
+profiling = false;
+
 for fileIdx = 1:length(lista)
     fileAts = fullfile(lista(fileIdx).folder, lista(fileIdx).name);
     baseName = lista(fileIdx).name(1:find(lista(fileIdx).name == '.',1)-1);
-    ta = TermoAnalizer(fileAts, fullfile(saveDir,baseName));
+    if profiling
+        events = fullfile(saveDir,[baseName '_events.ndjson']);
+        if exist(events, 'file')
+            delete(events);
+        end
+        setenv('THERMO_PROFILE', events);
+    end
+    % cerco la finestra del laser in streaming e carico solo quella
+    v = FlirMovieReader(fileAts);
+    v.unit = 'temperatureFactory';
+    [frame_start,frame_end] = v.findExcitation(100);
+    delete(v);
+    ta = TermoAnalizer(fileAts, fullfile(saveDir,baseName), [frame_start frame_end]);
 
-    [frame_start,frame_end]=ta.cercaPeriodo(100); 
+    % [frame_start,frame_end]=ta.cercaPeriodo(100); 
 
     freq=2;
-    ta.LockInAmplifier(freq,frame_start,frame_end)
+    ta.LockInAmplifier(freq,1,frame_end-frame_start+1)
 
     mmpxratio=30/240;%% 
     tol=0.1;
     % tol2=0.05, 
     
     % [Cut_x,yp,Cut_y,xp] =  ta.LockinResults(freq,xc,yc,mmpxratio,tol)
-    [Cut_x,yp,Cut_y,xp]=ta.LockinAmplifierResults(freq,mmpxratio,tol,1);
+    [Cut_x,yp,Cut_y,xp,xc,yc,jobs]=ta.LockinAmplifierResults(freq,mmpxratio,tol,2);
+    % immagini del file (mappe e tagli) scritte in parallelo da
+    % MapRenderMex senza aprire figure
+    MapRenderMex(jobs);
+
+    % LockInAmplifier lascia una mappa sola, LockIn una per frequenza
+    if size(ta.P,3)>1
+        [~,k]=min(abs(ta.f_c2-freq));
+        A=ta.A(:,:,k);P=ta.P(:,:,k);
+    else
+        A=ta.A;P=ta.P;
+    end
+    MapIndexMex('add', mapIndex, baseName, A, P, struct('xc',xc,'yc',yc));
+    similar = MapIndexMex('query', mapIndex, baseName, 3);
+    fprintf('%s: prove simili %s\n', baseName, strjoin({similar.name}, ', '));
 
     data={lista(fileIdx).name(1:find(lista(fileIdx).name == '.',1)-1), ...
         55, 10};
 
     xlswrite(xlsFile, data, 'Foglio 1', ['A' num2str(fileIdx)]);
 
+    if profiling
+        ta.profileReport(fullfile(saveDir,[baseName '_profile.json']), fullfile(saveDir,[baseName '_trace.json']));
+        setenv('THERMO_PROFILE', '');
+    end
 end
+
+MapIndexMex('save', mapIndex);
+MapIndexMex('delete', mapIndex);
@@ -0,0 +1,45 @@
+function res = AnalisiStreaming(source, nodes, opts)
+%AnalisiStreaming esegue un grafo di operatori (lettura, ricampionamento,
+%filtri, lock-in, TSR, statistiche, ...) con una sola lettura del file,
+%a blocchi di frame, senza caricare il video in memoria (PipelineMex)
+%   source e' il nome di un file ATS oppure un cubo r x c x n (con
+%   opts.time o opts.fs)
+%   nodes e' un array di struct, uno per operatore: nodes(k).op e' il
+%   nome ('window', 'resample', 'wiener', 'iir', 'register', 'lockin',
+%   'stats', 'tsr', 'hotzone'), nodes(k).input e' 0 per la sorgente o
+%   l'indice del nodo da cui prende i frame; gli altri campi sono i
+%   parametri, vedi PipelineMex. I rami con lo stesso ingresso
+%   condividono la stessa decodifica.
+%   nodes(k).name (opzionale) e' il nome del campo di res con il
+%   risultato del nodo, default node<k>
+%   opts (opzionale): blockSize, memory (MB), fs, frames [primo ultimo],
+%   unit, temperatureType
+%
+%   Esempio, lock-in e mappa del massimo sulla finestra dell'eccitazione:
+%   nodes = struct('op', {'window', 'lockin', 'stats'}, 'input', {0, 1, 1}, ...
+%       'first', {tIni, [], []}, 'last', {tEnd, [], []}, 'freqs', {[], [0.5 1 2], []}, ...
+%       'name', {'', 'lockin', 'stats'});
+%   res = AnalisiStreaming('prova.ats', nodes);
+
+if ~exist("opts", "var") || isempty(opts)
+    opts = struct();
+end
+
+names = cell(numel(nodes), 1);
+for k = 1:numel(nodes)
+    names{k} = sprintf('node%d', k);
+    if isfield(nodes, 'name') && ~isempty(nodes(k).name)
+        names{k} = nodes(k).name;
+    end
+end
+if isfield(nodes, 'name')
+    nodes = rmfield(nodes, 'name');
+end
+
+out = PipelineMex(source, nodes, opts);
+
+res = struct();
+for k = 1:numel(out)
+    res.(names{k}) = out{k};
+end
+end
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "tc.file/tc.file.h"
+#include "ThermoCatalog.h"
+#include <cstdio>
+
+//	ATS recordings into the campaign catalog (ThermoCatalog.h)
+//
+//	only the header and the first frame are read: size, frames, data type, the frame info of the first frame (FrameRate,
+//	Time, ...), the object parameters (object.emissivity, ...) and the presets (presets.count, presets.initial,
+//	presets.available). a recording already indexed with the same size and modification time is skipped, so scanning a
+//	campaign folder again only reads the new files. the files are indexed in transactions of 256.
+
+inline const char *CatalogDataTypeName(tc::EDataType type)
+{
+	switch (type) {
+		case tc::dtInt8:	return "int8";
+		case tc::dtUInt8:	return "uint8";
+		case tc::dtInt16:	return "int16";
+		case tc::dtUInt16:	return "uint16";
+		case tc::dtInt32:	return "int32";
+		case tc::dtUInt32:	return "uint32";
+		case tc::dtInt64:	return "int64";
+		case tc::dtUInt64:	return "uint64";
+		case tc::dtFlt32:	return "single";
+		case tc::dtFlt64:	return "double";
+		default:			return "other";
+	}
+}
+
+inline std::string CatalogNumber(double value)
+{
+	char	text[32];
+
+	snprintf(text, sizeof(text), "%.17g", value);
+
+	return text;
+}
+
+inline bool ReadRecordingHeader(const std::string &path, SCatalogRecording &recording, std::string &error)
+{
+	tc::file::CImagerFile							file;
+	tc::reduce::CFrameInfoReduceObjectPtr			frameInfo;
+	tc::reduce::CObjectParametersReduceObjectPtr	objPar;
+	bool											available[tc::psCount] = { false };
+
+	recording.path = path;
+	recording.metadata.clear();
+	if (!CatalogFileStamp(path, recording.bytes, recording.mtime) ||
+		!file.Open(tc::fileSystem(), tc::CString(tc::CStringA(path.c_str())))) {
+		error = "Failed to open file: " + path + ".";
+		return false;
+	}
+	recording.rows = file.height();
+	recording.cols = file.width();
+	recording.frames = file.numFrames();
+	recording.dataType = CatalogDataTypeName(file.dataType());
+	recording.frameRate = NAN;
+
+	if (file.numFrames() > 0 && file.GetFrame(0))
+		frameInfo = file.reduceObjects().GetFrameInfo(file.preset());
+	if (!(frameInfo == NULL)) {
+		for (tc::UInt32 i = 0; i < frameInfo->NumEntries(); ++i) {
+			std::string		name = tc::CStringA(frameInfo->GetNameAt(i)).c_str();
+
+			recording.metadata[name] = frameInfo->GetValueAt(i).GetUTF8().c_str();
+		}
+		if (recording.metadata.count("FrameRate") != 0)
+			recording.frameRate = atof(recording.metadata["FrameRate"].c_str());
+	}
+	objPar = file.reduceObjects().GetObjectParameters();
+	if (!(objPar == NULL)) {
+		recording.metadata["object.emissivity"] = CatalogNumber(objPar->emissivity);
+		recording.metadata["object.distance"] = CatalogNumber(objPar->distance);
+		recording.metadata["object.reflectedTemp"] = CatalogNumber(objPar->reflectedTemp);
+		recording.metadata["object.atmosphereTemp"] = CatalogNumber(objPar->atmosphereTemp);
+		recording.metadata["object.extOpticsTemp"] = CatalogNumber(objPar->extOpticsTemp);
+		recording.metadata["object.extOpticsTransmission"] = CatalogNumber(objPar->extOpticsTransmission);
+		recording.metadata["object.relativeHumidity"] = CatalogNumber(objPar->relativeHumidity);
+	}
+	recording.metadata["presets.count"] = CatalogNumber((double)file.numPresets());
+	recording.metadata["presets.initial"] = CatalogNumber((double)file.GetInitialPreset());
+	if (file.GetAvailablePresets(available)) {
+		std::string		list;
+
+		for (int p = 0; p < tc::psCount; ++p)
+			if (available[p])
+				list += (list.empty() ? "" : ",") + std::to_string(p);
+		recording.metadata["presets.available"] = list;
+	}
+
+	return true;
+}
+
+//	indexes the files not indexed yet (all of them with force), numIndexed are the ones read. a file that cannot be read
+//	is skipped and reported in error, the scan goes on
+inline bool ScanRecordings(CThermoCatalog &catalog, const std::vector<std::string> &files, bool force, size_t &numIndexed,
+	std::string &error)
+{
+	size_t		inTransaction = 0;
+
+	numIndexed = 0;
+	error.clear();
+	for (size_t i = 0; i < files.size(); ++i) {
+		SCatalogRecording	recording;
+		int64_t				bytes, mtime, id;
+		std::string			message;
+
+		if (!force && CatalogFileStamp(files[i], bytes, mtime) && catalog.IsIndexed(files[i], bytes, mtime, id))
+			continue;
+		if (!ReadRecordingHeader(files[i], recording, message)) {
+			error += (error.empty() ? "" : " ") + message;
+			continue;
+		}
+		if (inTransaction == 0 && !catalog.Begin()) {
+			error = catalog.error();
+			return false;
+		}
+		if (!catalog.IndexRecording(recording, id)) {
+			error = catalog.error();
+			catalog.Rollback();
+			return false;
+		}
+		++numIndexed;
+		if (++inTransaction == 256) {
+			if (!catalog.Commit()) {
+				error = catalog.error();
+				catalog.Rollback();
+				return false;
+			}
+			inTransaction = 0;
+		}
+	}
+	if (inTransaction > 0 && !catalog.Commit()) {
+		error = catalog.error();
+		catalog.Rollback();
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,92 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "mex.h"
+#include "MexHelpers.h"
+#include "ThermalContrast.h"
+#include "ThermoProfiler.h"
+
+//	mex ContrastMex.cpp
+
+//	res = ContrastMex(cube, t, opts)
+//	thermal contrast maps of the rows x cols x n sequence (double or single) with the n frame times t [s], in one pass
+//	(see ThermalContrast.h). opts is an optional struct with
+//		region			[r0 r1 c0 c1] rows and columns (1 based, inclusive) of the sound area
+//		backgroundRadius	without a region, the sound reference of each pixel is the box mean of 2 r + 1 pixels (20)
+//		baselineFrames	frames averaged into T0 (0, the cube is already a rise)
+//		normFrame		1 based frame of the normalised contrast, after the baseline frames (0 for none)
+//		minDelta		smallest rise used as a divisor [K] (0.01)
+//		sign			1 tracks the largest contrast, -1 the smallest, 0 the largest magnitude (1)
+//	res has the extreme contrast maps absolute, running, normalised, the times they were reached tAbsolute, tRunning,
+//	tNormalised [s] (NaN where the contrast was never defined) and sound, the n x 1 rise of the sound area (mean of the
+//	background for backgroundRadius)
+
+//	the mex entry point
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	if (nrhs < 2 || nrhs > 3 || nlhs > 1)
+		mexErrMsgTxt("Must have 2-3 inputs and 0-1 outputs.");
+
+	CThermoStage		stage("contrast", "ContrastMex", (double)mxGetElementSize(prhs[0]) * mxGetNumberOfElements(prhs[0]));
+
+	const mxArray		*cube = prhs[0];
+	const mxArray		*opts = nrhs > 2 ? prhs[2] : NULL;
+	const mwSize		*dims = mxGetDimensions(cube);
+	size_t				rows = dims[0], cols = dims[1];
+	size_t				numPixels = rows * cols;
+	size_t				numFrames = numPixels > 0 ? mxGetNumberOfElements(cube) / numPixels : 0;
+	const double		*t = mxGetDoubleInput(prhs[1], "t");
+	const mxArray		*region = mxGetOptionField(opts, "region");
+	SContrastParams		params;
+
+	if (mxIsComplex(cube) || (!mxIsDouble(cube) && !mxIsSingle(cube)) || mxGetNumberOfDimensions(cube) > 3)
+		mexErrMsgTxt("cube must be a real double or single rows x cols x n array.");
+	if (mxGetNumberOfElements(prhs[1]) != numFrames)
+		mexErrMsgTxt("Need one time per frame.");
+
+	params.reference = SContrastParams::crBackground;
+	params.r0 = params.r1 = params.c0 = params.c1 = 0;
+	if (region != NULL && !mxIsEmpty(region)) {
+		const double	*r = mxGetDoubleInput(region, "region");
+
+		if (mxGetNumberOfElements(region) != 4 || r[0] < 1.0 || r[2] < 1.0)
+			mexErrMsgTxt("region must be [r0 r1 c0 c1], 1 based.");
+		params.reference = SContrastParams::crRegion;
+		params.r0 = (size_t)r[0] - 1;
+		params.r1 = (size_t)r[1] - 1;
+		params.c0 = (size_t)r[2] - 1;
+		params.c1 = (size_t)r[3] - 1;
+	}
+	params.backgroundRadius = (size_t)mxGetOption(opts, "backgroundRadius", 20.0);
+	params.baselineFrames = (size_t)mxGetOption(opts, "baselineFrames", 0.0);
+	params.normFrame = (int64_t)mxGetOption(opts, "normFrame", 0.0) - 1;
+	params.minDelta = mxGetOption(opts, "minDelta", 0.01);
+	params.sign = (int)mxGetOption(opts, "sign", 1.0);
+
+	CThermalContrast	contrast(rows, cols, params);
+	bool				ok;
+
+	if (!contrast.valid())
+		mexErrMsgTxt(contrast.error().c_str());
+	if (mxIsDouble(cube))
+		ok = contrast.Push((const double *)mxGetData(cube), t, numFrames);
+	else
+		ok = contrast.Push((const float *)mxGetData(cube), t, numFrames);
+	if (!ok)
+		mexErrMsgTxt(contrast.error().c_str());
+
+	const char		*fields[] = { "absolute", "running", "normalised", "tAbsolute", "tRunning", "tNormalised", "sound" };
+	mxArray			*res = mxCreateStructMatrix(1, 1, sizeof(fields) / sizeof(fields[0]), fields);
+
+	for (size_t k = 0; k < CThermalContrast::ctCount; ++k) {
+		const std::vector<float>	&best = contrast.maxContrast((CThermalContrast::EContrast)k);
+		mxArray						*map = mxCreateDoubleMatrix(rows, cols, mxREAL);
+
+		std::copy(best.begin(), best.end(), mxGetPr(map));
+		mxSetFieldByNumber(res, 0, (int)k, map);
+		mxSetFieldByNumber(res, 0, (int)(k + CThermalContrast::ctCount),
+			mxCreateDoubleMatrixFrom(contrast.timeOfMax((CThermalContrast::EContrast)k).data(), rows, cols));
+	}
+	mxSetFieldByNumber(res, 0, 6, mxCreateDoubleColumn(contrast.sound()));
+
+	plhs[0] = res;
+}
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+//	streaming version of TermoAnalizer.cercaPeriodo
+//
+//	cercaPeriodo needs the whole cube: it looks for the hottest pixel, takes the onset as the first sample above
+//	mean + 3 sigma of the first nframe samples and then walks windows of nframe samples as long as the last peak
+//	keeps growing. the hottest pixel is only known at the end of the recording, so here every pixel runs the same
+//	onset/peak state machine while the frames are streamed and the winner is picked in Finish(). memory is a few
+//	planes plus the first 'window' frames, which are buffered to compute the baseline statistic.
+//	all indices are 0 based, the matlab side adds one.
+
+struct SExcitationWindow
+{
+	int64_t		onset;				//	first frame above the baseline threshold, -1 if none
+	int64_t		lastPeak;			//	frame of the last growing modulation peak, -1 if none
+	size_t		row;				//	excitation pixel (hottest over the whole recording)
+	size_t		col;
+	double		maxValue;			//	value of the hottest sample
+	double		threshold;			//	onset threshold of the excitation pixel
+	size_t		numFrames;			//	frames seen
+};
+
+class CExcitationDetector
+{
+public:
+	enum EOnsetMethod
+	{
+		omStd,						//	mean + k * std, same as cercaPeriodo with k = 3
+		omMad,						//	median + k * 1.4826 * mad, not fooled by spikes in the baseline
+	};
+
+private:
+	//	per pixel state of the cercaPeriodo window walk
+	struct SPixelState
+	{
+		int64_t		onset;
+		int64_t		winStart;		//	ii in cercaPeriodo
+		int64_t		winIdx;			//	last index of the window maximum
+		int64_t		peakIdx;		//	jj in cercaPeriodo
+		float		winMax;
+		float		peakValue;
+		bool		done;
+	};
+
+	size_t						mWidth;
+	size_t						mHeight;
+	size_t						mWindow;
+	EOnsetMethod				mMethod;
+	double						mK;
+	size_t						mNumFrames;
+	bool						mHaveThreshold;
+	std::vector<float>			mBaseline;		//	first mWindow frames, row major, frame after frame
+	std::vector<double>			mThreshold;
+	std::vector<float>			mRunMax;
+	std::vector<SPixelState>	mState;
+
+	void Advance(size_t pix, int64_t frame, float value)
+	{
+		SPixelState		&s = mState[pix];
+
+		if (s.done)
+			return;
+
+		if (s.onset < 0) {
+			if (value > mThreshold[pix]) {
+				s.onset = frame;
+				s.winStart = frame;
+				s.winIdx = frame;
+				s.peakIdx = frame;
+				s.winMax = value;
+				s.peakValue = value;
+			}
+			return;
+		}
+
+		//	>= keeps the last occurrence like find(..., 1, 'last')
+		if (value >= s.winMax) {
+			s.winMax = value;
+			s.winIdx = frame;
+		}
+
+		if (frame == s.winStart + (int64_t)mWindow)
+			CloseWindow(s, frame, value);
+	}
+
+	//	the window [ii, ii+nframe] is complete, the next one starts on its last sample
+	void CloseWindow(SPixelState &s, int64_t frame, float value)
+	{
+		if (s.winMax >= s.peakValue) {
+			s.peakIdx = s.winIdx;
+			s.peakValue = s.winMax;
+		} else {
+			s.done = true;
+			return;
+		}
+
+		s.winStart = frame;
+		s.winIdx = frame;
+		s.winMax = value;
+	}
+
+	void ComputeThresholds(size_t frames)
+	{
+		size_t				n = mWidth * mHeight;
+		std::vector<float>	series(frames);
+
+		for (size_t pix = 0; pix < n; ++pix) {
+			for (size_t f = 0; f < frames; ++f)
+				series[f] = mBaseline[f * n + pix];
+
+			if (mMethod == omMad) {
+				size_t		mid = frames / 2;
+				double		median, mad;
+
+				std::nth_element(series.begin(), series.begin() + mid, series.end());
+				median = series[mid];
+				if (frames % 2 == 0)
+					median = 0.5 * (median + *std::max_element(series.begin(), series.begin() + mid));
+				for (size_t f = 0; f < frames; ++f)
+					series[f] = (float)fabs(series[f] - median);
+				std::nth_element(series.begin(), series.begin() + mid, series.end());
+				mad = series[mid];
+				if (frames % 2 == 0)
+					mad = 0.5 * (mad + *std::max_element(series.begin(), series.begin() + mid));
+				mThreshold[pix] = median + mK * 1.4826 * mad;
+			} else {
+				double		mean = 0.0, m2 = 0.0;
+
+				//	welford, var() in matlab normalizes by N-1
+				for (size_t f = 0; f < frames; ++f) {
+					double		delta = series[f] - mean;
+
+					mean += delta / (double)(f + 1);
+					m2 += delta * (series[f] - mean);
+				}
+				mThreshold[pix] = mean + mK * sqrt(frames > 1 ? m2 / (double)(frames - 1) : 0.0);
+			}
+		}
+
+		mHaveThreshold = true;
+
+		//	the laser may already be on inside the baseline window, replay it
+		for (size_t f = 0; f < frames; ++f) {
+			const float		*frame = &mBaseline[f * n];
+
+			for (size_t pix = 0; pix < n; ++pix)
+				Advance(pix, (int64_t)f, frame[pix]);
+		}
+
+		mBaseline.clear();
+		mBaseline.shrink_to_fit();
+	}
+
+public:
+	CExcitationDetector(size_t width, size_t height, size_t window, EOnsetMethod method = omStd, double k = 3.0) :
+		mWidth(width),
+		mHeight(height),
+		mWindow(window < 1 ? 1 : window),
+		mMethod(method),
+		mK(k),
+		mNumFrames(0),
+		mHaveThreshold(false),
+		mBaseline(mWindow * width * height),
+		mThreshold(width * height),
+		mRunMax(width * height, -INFINITY)
+	{
+		SPixelState		init = { -1, -1, -1, -1, 0.0f, 0.0f, false };
+
+		mState.assign(width * height, init);
+	}
+
+	//	frame is row major, width * height samples
+	template <typename kind>
+	void Push(const kind *frame)
+	{
+		size_t		n = mWidth * mHeight;
+
+		for (size_t pix = 0; pix < n; ++pix) {
+			float		value = (float)frame[pix];
+
+			if (value > mRunMax[pix])
+				mRunMax[pix] = value;
+		}
+
+		if (!mHaveThreshold) {
+			float		*dest = &mBaseline[mNumFrames * n];
+
+			for (size_t pix = 0; pix < n; ++pix)
+				dest[pix] = (float)frame[pix];
+
+			if (++mNumFrames == mWindow)
+				ComputeThresholds(mWindow);
+			return;
+		}
+
+		for (size_t pix = 0; pix < n; ++pix)
+			Advance(pix, (int64_t)mNumFrames, (float)frame[pix]);
+
+		++mNumFrames;
+	}
+
+	size_t numFrames() const
+	{
+		return mNumFrames;
+	}
+
+	bool Finish(SExcitationWindow &result)
+	{
+		size_t		n = mWidth * mHeight;
+		size_t		best = n;
+
+		if (mNumFrames == 0)
+			return false;
+
+		if (!mHaveThreshold)
+			ComputeThresholds(mNumFrames);
+
+		//	ties go to the first pixel in column major order, like find() on the max map
+		for (size_t pix = 0; pix < n; ++pix) {
+			if (best == n || mRunMax[pix] > mRunMax[best]) {
+				best = pix;
+			} else if (mRunMax[pix] == mRunMax[best]) {
+				size_t	col = pix % mWidth, bestCol = best % mWidth;
+
+				if (col < bestCol || (col == bestCol && pix < best))
+					best = pix;
+			}
+		}
+
+		SPixelState		&s = mState[best];
+
+		//	the recording ended inside an open window, cercaPeriodo truncates it to the last sample
+		if (s.onset >= 0 && !s.done)
+			CloseWindow(s, (int64_t)mNumFrames - 1, s.winMax);
+
+		result.onset = s.onset;
+		result.lastPeak = s.onset >= 0 ? s.peakIdx : -1;
+		result.row = best / mWidth;
+		result.col = best % mWidth;
+		result.maxValue = mRunMax[best];
+		result.threshold = mThreshold[best];
+		result.numFrames = mNumFrames;
+
+		return true;
+	}
+};
@@ -0,0 +1,57 @@
+function info = ExportVideo(source, fileName, opts, frames, unit)
+%ExportVideo video in falsi colori di un cubo o di un file ATS, senza
+%surf/drawnow frame per frame (VideoExportMex)
+%   source e' un cubo r x c x n oppure il nome di un file ATS, letto a
+%   blocchi con FlirMovieReader senza caricarlo tutto in memoria
+%   fileName e' il video da scrivere (.mp4 per h264, .avi o .mkv per ffv1)
+%   opts (opzionale) sono le opzioni di VideoExportMex: codec, fps, crf,
+%   preset, palette, range [lo hi] o percentile [lo hi] (default [2 98]
+%   sul primo blocco), batch
+%   frames (opzionale, solo per i file) e' [primo ultimo] frame
+%   unit (opzionale, solo per i file) e' l'unita' del reader, default
+%   'temperatureFactory'
+%   info ha numFrames e l'intervallo di colori usato (lo, hi)
+
+if ~exist("opts", "var") || isempty(opts)
+    opts = struct();
+end
+if ~exist("frames", "var") || isempty(frames)
+    frames = [1 Inf];
+end
+if ~exist("unit", "var")
+    unit = 'temperatureFactory';
+end
+if isfield(opts, 'batch')
+    block = opts.batch*4;
+else
+    block = 256;
+end
+
+if isnumeric(source)
+    h = VideoExportMex('new', fileName, size(source,1), size(source,2), opts);
+    for ii = 1:block:size(source,3)
+        VideoExportMex('push', h, source(:,:,ii:min(ii+block-1,end)));
+    end
+    info = VideoExportMex('close', h);
+    return
+end
+
+v = FlirMovieReader(source);
+v.unit = unit;
+frame = step(v, frames(1)-1);
+h = VideoExportMex('new', fileName, size(frame,1), size(frame,2), opts);
+buffer = zeros(size(frame,1), size(frame,2), block, 'like', frame);
+buffer(:,:,1) = frame;
+count = 1;
+while ~isDone(v) && v.frameIndex+1 < frames(2)
+    if count == block
+        VideoExportMex('push', h, buffer);
+        count = 0;
+    end
+    count = count+1;
+    buffer(:,:,count) = step(v);
+end
+VideoExportMex('push', h, buffer(:,:,1:count));
+info = VideoExportMex('close', h);
+delete(v);
+end
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vector>
+#include <complex>
+#include <cmath>
+#include <cstddef>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+//	radix-2 FFT for the batched pixel transforms
+//
+//	one plan per length (a power of two) holds the bit reversal permutation and the twiddles, Forward / Inverse run
+//	in place and the plan is read only afterwards, so the worker threads share it. real signals go two at a time
+//	through one complex transform (a + ib) and are split with the symmetry of the real spectrum.
+
+inline size_t NextPow2(size_t n)
+{
+	size_t		p = 1;
+
+	while (p < n)
+		p <<= 1;
+
+	return p;
+}
+
+class CFftPlan
+{
+private:
+	size_t								mSize;
+	std::vector<size_t>					mReverse;
+	std::vector<std::complex<double> >	mTwiddle;		//	exp(-2 pi i k / n), k < n / 2
+
+	void Transform(std::complex<double> *data, bool inverse) const
+	{
+		for (size_t i = 0; i < mSize; ++i)
+			if (i < mReverse[i])
+				std::swap(data[i], data[mReverse[i]]);
+
+		for (size_t len = 2; len <= mSize; len <<= 1) {
+			size_t		half = len / 2, stride = mSize / len;
+
+			for (size_t start = 0; start < mSize; start += len) {
+				for (size_t k = 0; k < half; ++k) {
+					std::complex<double>	w = inverse ? std::conj(mTwiddle[k * stride]) : mTwiddle[k * stride];
+					std::complex<double>	a = data[start + k], b = data[start + k + half] * w;
+
+					data[start + k] = a + b;
+					data[start + k + half] = a - b;
+				}
+			}
+		}
+	}
+
+public:
+	CFftPlan(size_t size = 1) :
+		mSize(NextPow2(size)),
+		mReverse(mSize),
+		mTwiddle(mSize / 2 + 1)
+	{
+		int		bits = 0;
+
+		while (((size_t)1 << bits) < mSize)
+			++bits;
+		for (size_t i = 0; i < mSize; ++i) {
+			size_t		r = 0;
+
+			for (int b = 0; b < bits; ++b)
+				if (i & ((size_t)1 << b))
+					r |= (size_t)1 << (bits - 1 - b);
+			mReverse[i] = r;
+		}
+		for (size_t k = 0; k < mTwiddle.size(); ++k)
+			mTwiddle[k] = std::polar(1.0, -2.0 * M_PI * (double)k / (double)mSize);
+	}
+
+	size_t size() const
+	{
+		return mSize;
+	}
+
+	void Forward(std::complex<double> *data) const
+	{
+		Transform(data, false);
+	}
+
+	//	unnormalized, divide by size() to get the signal back
+	void Inverse(std::complex<double> *data) const
+	{
+		Transform(data, true);
+	}
+
+	//	spectra of two real signals a and b (size() samples each), bins 0..size()/2 go to specA and specB
+	void ForwardRealPair(const double *a, const double *b, std::complex<double> *specA, std::complex<double> *specB,
+		std::vector<std::complex<double> > &work) const
+	{
+		work.resize(mSize);
+		for (size_t i = 0; i < mSize; ++i)
+			work[i] = std::complex<double>(a[i], b != NULL ? b[i] : 0.0);
+		Forward(work.data());
+
+		for (size_t k = 0; k <= mSize / 2; ++k) {
+			std::complex<double>	z = work[k], zc = std::conj(work[(mSize - k) & (mSize - 1)]);
+
+			specA[k] = 0.5 * (z + zc);
+			if (specB != NULL)
+				specB[k] = std::complex<double>(0.0, -0.5) * (z - zc);
+		}
+	}
+};
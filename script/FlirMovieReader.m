@@ -62,6 +62,14 @@ classdef FlirMovieReader < handle
 			FlirMovieReaderMex('reset', obj.impl);
 		end
 
+		% Find the laser excitation window in one pass over the movie, before loading anything
+		% [tIni, tEnd, info] = findExcitation(obj, nframe, method, k)
+		% nframe and tEnd follow TermoAnalizer.cercaPeriodo, method is 'std' (default, mean + k*std)
+		% or 'mad' (median + k*1.4826*mad), k defaults to 3. Frames are 1 based, the movie is rewound.
+		function varargout = findExcitation(obj, varargin)
+			[varargout{1:nargout}] = FlirMovieReaderMex('findExcitation', obj.impl, varargin{:});
+		end
+
 		% Revert back object parameters specified in the file
 		function resetObjectParameters(obj)
 			FlirMovieReaderMex('resetObjectParameters', obj.impl);
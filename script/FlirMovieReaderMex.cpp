@@ -1,7 +1,10 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include "mex.h"
+#include "MexHelpers.h"
 #include "tc.file/tc.file.h"
+#include "ExcitationDetector.h"
+#include "ThermoProfiler.h"
 #include <typeinfo>
 
 //	mex FlirMovieReaderMex.cpp -I%FILESDKDIR%include -L%FILESDKDIR%bin/x64/Release -ltc.lib -ltc.file.lib -ltc.reduce.lib
@@ -117,6 +120,49 @@ mxArray *MarshalImage(tc::STypedData data, tc::UInt32 width, tc::UInt32 height)
 	return ret;
 }
 
+//	hands a frame to a streaming consumer exposing a templated Push(const kind *), data stays row major
+template <class kconsumer>
+void PushImage(kconsumer &consumer, tc::STypedData data)
+{
+	switch (data.Type) {
+		case tc::dtInt8:
+			consumer.Push(data.pInt8);
+			break;
+		case tc::dtUInt8:
+			consumer.Push(data.pUInt8);
+			break;
+		case tc::dtInt16:
+			consumer.Push(data.pInt16);
+			break;
+		case tc::dtUInt16:
+			consumer.Push(data.pUInt16);
+			break;
+		case tc::dtInt32:
+			consumer.Push(data.pInt32);
+			break;
+		case tc::dtUInt32:
+			consumer.Push(data.pUInt32);
+			break;
+		case tc::dtInt64:
+			consumer.Push(data.pInt64);
+			break;
+		case tc::dtUInt64:
+			consumer.Push(data.pUInt64);
+			break;
+		case tc::dtFlt32:
+			consumer.Push(data.pFlt32);
+			break;
+		case tc::dtFlt64:
+			consumer.Push(data.pFlt64);
+			break;
+		case tc::dtRGB24:
+		case tc::dtRGB48:
+		default:
+			mexErrMsgTxt("Unsupported image data format.");
+			break;
+	}
+}
+
 mxArray *MarshalImage(tc::ITypedBufferPtr data, tc::UInt32 width, tc::UInt32 height)
 {
 	if (data == NULL)
@@ -197,39 +243,7 @@ kind mxGetNumeric(const mxArray *ar)
 	return ret;
 }
 
-//	enum parsing utility functions and enum definitions
-struct SEnumInfo
-{
-	const char	*name;
-	int			value;
-};
-
-int ParseEnum(SEnumInfo info[], const char *name)
-{
-	int		i = 0;
-
-	while (info[i].name != NULL) {
-		if (_stricmp(info[i].name, name) == 0)
-			return info[i].value;
-		++i;
-	}
-
-	return info[i].value;
-}
-
-const char *EnumToString(SEnumInfo info[], int value)
-{
-	int		i = 0;
-
-	while (info[i].name != NULL) {
-		if (info[i].value == value)
-			return info[i].name;
-		++i;
-	}
-
-	return "error";
-}
-
+//	enum definitions
 SEnumInfo	UnitEnumInfo[] = {
 	{ "counts",					tc::unitCounts },
 	{ "radianceUser",			tc::unitRadianceUser },
@@ -254,6 +268,12 @@ SEnumInfo	TemperatureTypeEnumInfo[] = {
 	{ NULL,						tc::ttError },
 };
 
+SEnumInfo	OnsetMethodEnumInfo[] = {
+	{ "std",					CExcitationDetector::omStd },
+	{ "mad",					CExcitationDetector::omMad },
+	{ NULL,						-1 },
+};
+
 SEnumInfo	DataTypeEnumInfo[] = {
 	{ "int8",					tc::dtInt8 },
 	{ "uint8",					tc::dtUInt8 },
@@ -491,6 +511,45 @@ public:
 		mNextFrameNumber = 0;
 	}
 
+	//	single pass over the whole movie, see ExcitationDetector.h. the movie is rewound before and after
+	mxArray *findExcitation(tc::UInt32 window, const char *_method, double k)
+	{
+		int					method = ParseEnum(OnsetMethodEnumInfo, _method);
+		SExcitationWindow	result;
+		mxArray				*ret;
+
+		if (method < 0)
+			mexErrMsgTxt("Unknown onset method.");
+
+		CExcitationDetector		detector(mFile.width(), mFile.height(), window, (CExcitationDetector::EOnsetMethod)method, k);
+
+		Reset();
+		while (!isDone()) {
+			if (!Step())
+				mexErrMsgTxt("Step failed.");
+			PushImage(detector, mFile.final()->typedData());
+		}
+		Reset();
+
+		if (!detector.Finish(result))
+			mexErrMsgTxt("Empty movie.");
+
+		const char		*fields[] = { "tIni", "tEnd", "row", "col", "maxValue", "threshold", "numFrames" };
+
+		ret = mxCreateStructMatrix(1, 1, sizeof(fields) / sizeof(fields[0]), fields);
+
+		//	1 based frame and pixel indices, NaN when the threshold is never crossed
+		mxSetFieldByNumber(ret, 0, 0, mxCreateDoubleScalar(result.onset < 0 ? mxGetNaN() : (double)(result.onset + 1)));
+		mxSetFieldByNumber(ret, 0, 1, mxCreateDoubleScalar(result.lastPeak < 0 ? mxGetNaN() : (double)(result.lastPeak + 1)));
+		mxSetFieldByNumber(ret, 0, 2, mxCreateDoubleScalar((double)(result.row + 1)));
+		mxSetFieldByNumber(ret, 0, 3, mxCreateDoubleScalar((double)(result.col + 1)));
+		mxSetFieldByNumber(ret, 0, 4, mxCreateDoubleScalar(result.maxValue));
+		mxSetFieldByNumber(ret, 0, 5, mxCreateDoubleScalar(result.threshold));
+		mxSetFieldByNumber(ret, 0, 6, mxCreateDoubleScalar((double)result.numFrames));
+
+		return ret;
+	}
+
 	void ResetObjectParameters()
 	{
 		mFile.DefaultObjectParameters();
@@ -667,71 +726,6 @@ public:
 	}
 };
 
-//	wraps a c++ object into a matlab array
-struct SMatWrapper
-{
-	intptr_t	ptr;
-	size_t		typeLen;
-	char		typeName[];
-};
-
-template <class kind>
-mxArray *WrapObject(kind *obj)
-{
-	const char	*typeName = typeid(kind).name();
-	size_t		typeLen = strlen(typeName) + 1;
-	mxArray		*ret;
-	SMatWrapper	*wrapper;
-
-	ret = mxCreateNumericMatrix(1, sizeof(SMatWrapper) + typeLen, mxUINT8_CLASS, mxREAL);
-	wrapper = (SMatWrapper *)mxGetData(ret);
-
-	wrapper->ptr = (intptr_t)obj;
-	wrapper->typeLen = typeLen;
-	strcpy(wrapper->typeName, typeName);
-
-	mexLock();
-
-	return ret;
-}
-
-template <class kind>
-kind *GetObject(const mxArray *ar)
-{
-	const char	*typeName = typeid(kind).name();
-	size_t		typeLen = strlen(typeName) + 1;
-	SMatWrapper	*wrapper;
-
-	if (mxGetNumberOfElements(ar) != sizeof(SMatWrapper) + typeLen || mxGetClassID(ar) != mxUINT8_CLASS || mxIsComplex(ar))
-		mexErrMsgTxt("Invalid handle.");
-
-	wrapper = (SMatWrapper *)mxGetData(ar);
-
-	if (wrapper->typeLen != typeLen || strcmp(wrapper->typeName, typeName) != 0)
-		mexErrMsgTxt("Invalid handle.");
-
-	return (kind *)wrapper->ptr;
-}
-
-template <class kind>
-void UnwrapObject(const mxArray *ar)
-{
-	const char	*typeName = typeid(kind).name();
-	size_t		typeLen = strlen(typeName) + 1;
-	SMatWrapper	*wrapper;
-
-	if (mxGetNumberOfElements(ar) != sizeof(SMatWrapper) + typeLen || mxGetClassID(ar) != mxUINT8_CLASS || mxIsComplex(ar))
-		mexErrMsgTxt("Invalid handle.");
-
-	wrapper = (SMatWrapper *)mxGetData(ar);
-
-	if (wrapper->typeLen != typeLen || strcmp(wrapper->typeName, typeName) != 0)
-		mexErrMsgTxt("Invalid handle.");
-
-	memset(mxGetData(ar), 0, sizeof(SMatWrapper) + typeLen);
-	mexUnlock();
-}
-
 //	the mex entry point
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 {
@@ -855,6 +849,26 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 			plhs[1] = file->metaData();
 		if (nlhs > 2)
 			plhs[2] = file->status();
+	} else if (strcmp(command, "findExcitation") == 0) {
+		if ((nlhs < 0 || nlhs > 3) || (nrhs < 3 || nrhs > 5))
+			mexErrMsgTxt("Must have 3-5 inputs and 0-3 outputs.");
+
+		mxArray			*window;
+		CThermoStage	stage("findExcitation", "FlirMovieReaderMex");
+
+		window = file->findExcitation(mxGetNumeric<tc::UInt32>(prhs[2]),
+			nrhs > 3 ? mxGetString(prhs[3]).c_str() : "std",
+			nrhs > 4 ? mxGetNumeric<double>(prhs[4]) : 3.0);
+		if (nlhs > 1) {
+			plhs[0] = mxDuplicateArray(mxGetFieldByNumber(window, 0, 0));
+			plhs[1] = mxDuplicateArray(mxGetFieldByNumber(window, 0, 1));
+			if (nlhs > 2)
+				plhs[2] = window;
+			else
+				mxDestroyArray(window);
+		} else {
+			plhs[0] = window;
+		}
 	} else if (strcmp(command, "reset") == 0) {
 		if (nlhs != 0 || nrhs != 2)
 			mexErrMsgTxt("Must have 2 inputs and 0 outputs.");
@@ -0,0 +1,345 @@
+#pragma once
+
+#include "Fft.h"
+#include "ThermoParallel.h"
+#include <vector>
+#include <complex>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <limits>
+
+//	sub-pixel frame registration (drift compensation) by phase correlation
+//
+//	the frame (mean removed, hann window, zero padded to powers of two) is transformed, multiplied by the conjugate
+//	spectrum of the template and normalized to (about) unit magnitude; the inverse transform peaks at the translation of the
+//	frame with respect to the template, refined below the pixel with a parabola through the peak and its neighbours
+//	along each axis. the template is either fixed (a reference frame) or running: after each frame it moves towards
+//	the registered frame by alpha. frames are resampled with a separable bilinear or bicubic (keys) kernel: a pure
+//	translation has the same weights for every pixel, so a column is a few weighted sums of shifted source columns,
+//	contiguous loops the compiler vectorizes. samples needing pixels outside the frame are NaN. with a fixed template
+//	the frames of a block are registered in parallel, a running template makes them sequential (the transforms of a
+//	frame are then split over the cores). shifts are in pixels, dx along the columns, positive when the content
+//	moved to larger indices.
+
+struct SRegistrationParams
+{
+	enum ETemplate
+	{
+		tpReference = 0,
+		tpRunning
+	};
+
+	enum EInterp
+	{
+		ipNone = 0,					//	shifts only, frames are not resampled
+		ipBilinear,
+		ipBicubic
+	};
+
+	ETemplate	templ;
+	double		alpha;				//	running template update
+	EInterp		interp;
+	double		maxShift;			//	peak search radius [px], 0 for the whole correlation
+};
+
+struct SFrameShift
+{
+	double		dx;
+	double		dy;
+	double		peak;				//	height of the correlation peak, higher is a better match
+};
+
+class CFrameRegistration
+{
+private:
+	typedef std::complex<double>	complex;
+
+	size_t					mRows;
+	size_t					mCols;
+	SRegistrationParams		mParams;
+	CFftPlan				mPlanY;			//	along the columns (contiguous)
+	CFftPlan				mPlanX;
+	std::vector<double>		mWinY;
+	std::vector<double>		mWinX;
+	std::vector<complex>	mRefSpec;		//	conjugate template spectrum
+	std::vector<double>		mTemplate;
+	bool					mHasRef;
+
+	void UpdateReference()
+	{
+		mRefSpec.resize(padRows() * padCols());
+		Spectrum(mTemplate.data(), mRefSpec.data(), true);
+		for (size_t i = 0; i < mRefSpec.size(); ++i)
+			mRefSpec[i] = std::conj(mRefSpec[i]);
+		mHasRef = true;
+	}
+
+	size_t padRows() const
+	{
+		return mPlanY.size();
+	}
+
+	size_t padCols() const
+	{
+		return mPlanX.size();
+	}
+
+	//	2-D transform of the padded, column major spectrum; only the first cols columns may be non zero on the forward pass
+	void Transform2(complex *data, bool inverse, size_t cols, bool parallel) const
+	{
+		size_t		pr = padRows(), pc = padCols();
+
+		auto columns = [&](size_t begin, size_t end) {
+			for (size_t x = begin; x < end; ++x) {
+				if (inverse)
+					mPlanY.Inverse(data + x * pr);
+				else
+					mPlanY.Forward(data + x * pr);
+			}
+		};
+		auto rows = [&](size_t begin, size_t end) {
+			std::vector<complex>	line(pc);
+
+			for (size_t y = begin; y < end; ++y) {
+				for (size_t x = 0; x < pc; ++x)
+					line[x] = data[y + x * pr];
+				if (inverse)
+					mPlanX.Inverse(line.data());
+				else
+					mPlanX.Forward(line.data());
+				for (size_t x = 0; x < pc; ++x)
+					data[y + x * pr] = line[x];
+			}
+		};
+
+		if (inverse) {
+			//	rows first, so the padding columns of the forward pass are not needed
+			parallel ? ParallelFor(pr, 16, rows) : rows(0, pr);
+			parallel ? ParallelFor(pc, 16, columns) : columns(0, pc);
+		}
+		else {
+			parallel ? ParallelFor(cols, 16, columns) : columns(0, cols);
+			parallel ? ParallelFor(pr, 16, rows) : rows(0, pr);
+		}
+	}
+
+	template <typename kind>
+	void Spectrum(const kind *frame, complex *spec, bool parallel) const
+	{
+		size_t		pr = padRows(), n = mRows * mCols;
+		double		mean = 0.0;
+		size_t		count = 0;
+
+		for (size_t i = 0; i < n; ++i) {
+			double		v = (double)frame[i];
+
+			if (std::isfinite(v)) {
+				mean += v;
+				++count;
+			}
+		}
+		mean = count > 0 ? mean / (double)count : 0.0;
+
+		std::fill(spec, spec + pr * padCols(), complex(0.0, 0.0));
+		for (size_t x = 0; x < mCols; ++x) {
+			for (size_t y = 0; y < mRows; ++y) {
+				double		v = (double)frame[y + x * mRows];
+
+				spec[y + x * pr] = std::isfinite(v) ? (v - mean) * mWinY[y] * mWinX[x] : 0.0;
+			}
+		}
+
+		Transform2(spec, false, mCols, parallel);
+	}
+
+	//	spec is the frame spectrum, overwritten by the correlation surface
+	SFrameShift Correlate(complex *spec, bool parallel) const
+	{
+		size_t			pr = padRows(), pc = padCols(), n = pr * pc;
+		SFrameShift		shift = { 0.0, 0.0, 0.0 };
+		double			level = 0.0;
+
+		//	the magnitude is floored at 1% of its maximum, bins with no signal would otherwise weigh as much as the rest
+		for (size_t i = 0; i < n; ++i) {
+			spec[i] *= mRefSpec[i];
+			level = std::max(level, std::abs(spec[i]));
+		}
+		level = level > 0.0 ? 1e-2 * level : 1.0;
+		for (size_t i = 0; i < n; ++i)
+			spec[i] /= std::abs(spec[i]) + level;
+		Transform2(spec, true, pc, parallel);
+
+		double		best = -std::numeric_limits<double>::infinity();
+		size_t		by = 0, bx = 0;
+		double		radius = mParams.maxShift > 0.0 ? mParams.maxShift : (double)std::max(pr, pc);
+
+		for (size_t x = 0; x < pc; ++x) {
+			double		sx = x < pc / 2 ? (double)x : (double)x - (double)pc;
+
+			if (std::fabs(sx) > radius)
+				continue;
+			for (size_t y = 0; y < pr; ++y) {
+				double		sy = y < pr / 2 ? (double)y : (double)y - (double)pr;
+				double		v = spec[y + x * pr].real();
+
+				if (std::fabs(sy) <= radius && v > best) {
+					best = v;
+					by = y;
+					bx = x;
+				}
+			}
+		}
+
+		auto at = [&](size_t y, size_t x) {
+			return spec[(y % pr) + (x % pc) * pr].real();
+		};
+		auto vertex = [](double l, double c, double r) {
+			double		d = l - 2.0 * c + r;
+
+			return d < 0.0 ? std::max(-0.5, std::min(0.5, 0.5 * (l - r) / d)) : 0.0;
+		};
+
+		shift.dy = (by < pr / 2 ? (double)by : (double)by - (double)pr) + vertex(at(by + pr - 1, bx), best, at(by + 1, bx));
+		shift.dx = (bx < pc / 2 ? (double)bx : (double)bx - (double)pc) + vertex(at(by, bx + pc - 1), best, at(by, bx + 1));
+		shift.peak = best / (double)n;
+
+		return shift;
+	}
+
+	//	dst(y, x) = src(y + dy, x + dx)
+	template <typename kind, typename out>
+	void Warp(const kind *src, const SFrameShift &shift, SRegistrationParams::EInterp interp, out *dst, std::vector<double> &column) const
+	{
+		int			taps = interp == SRegistrationParams::ipBicubic ? 4 : 2;
+		double		wx[4], wy[4];
+		double		fx = floor(shift.dx), fy = floor(shift.dy);
+		ptrdiff_t	ox = (ptrdiff_t)fx - (taps / 2 - 1), oy = (ptrdiff_t)fy - (taps / 2 - 1);
+
+		auto weights = [&](double t, double *w) {
+			if (taps == 2) {
+				w[0] = 1.0 - t;
+				w[1] = t;
+				return;
+			}
+			//	keys cubic, a = -0.5
+			for (int k = 0; k < 4; ++k) {
+				double		d = std::fabs((double)(k - 1) - t);
+
+				w[k] = d <= 1.0 ? (1.5 * d - 2.5) * d * d + 1.0 : d < 2.0 ? ((-0.5 * d + 2.5) * d - 4.0) * d + 2.0 : 0.0;
+			}
+		};
+
+		weights(shift.dx - fx, wx);
+		weights(shift.dy - fy, wy);
+
+		//	rows whose taps all fall inside the frame
+		ptrdiff_t	yLo = std::max<ptrdiff_t>(0, -oy), yHi = std::min<ptrdiff_t>((ptrdiff_t)mRows, (ptrdiff_t)mRows - oy - taps + 1);
+		out			nan = std::numeric_limits<out>::quiet_NaN();
+
+		column.resize(mRows);
+		for (size_t x = 0; x < mCols; ++x) {
+			out			*d = dst + x * mRows;
+			ptrdiff_t	x0 = (ptrdiff_t)x + ox;
+
+			if (x0 < 0 || x0 + taps > (ptrdiff_t)mCols || yLo >= yHi) {
+				std::fill(d, d + mRows, nan);
+				continue;
+			}
+
+			std::fill(column.begin() + yLo, column.begin() + yHi, 0.0);
+			for (int j = 0; j < taps; ++j) {
+				for (int i = 0; i < taps; ++i) {
+					double			w = wx[j] * wy[i];
+					const kind		*s = src + (x0 + j) * (ptrdiff_t)mRows + oy + i;
+					double			*c = column.data();
+
+					for (ptrdiff_t y = yLo; y < yHi; ++y)
+						c[y] += w * (double)s[y];
+				}
+			}
+
+			std::fill(d, d + yLo, nan);
+			for (ptrdiff_t y = yLo; y < yHi; ++y)
+				d[y] = (out)column[y];
+			std::fill(d + yHi, d + mRows, nan);
+		}
+	}
+
+public:
+	CFrameRegistration(size_t rows, size_t cols, const SRegistrationParams &params) :
+		mRows(rows),
+		mCols(cols),
+		mParams(params),
+		mPlanY(rows),
+		mPlanX(cols),
+		mWinY(rows),
+		mWinX(cols),
+		mHasRef(false)
+	{
+		for (size_t y = 0; y < rows; ++y)
+			mWinY[y] = rows > 1 ? 0.5 - 0.5 * cos(2.0 * M_PI * (double)y / (double)(rows - 1)) : 1.0;
+		for (size_t x = 0; x < cols; ++x)
+			mWinX[x] = cols > 1 ? 0.5 - 0.5 * cos(2.0 * M_PI * (double)x / (double)(cols - 1)) : 1.0;
+	}
+
+	bool hasReference() const
+	{
+		return mHasRef;
+	}
+
+	template <typename kind>
+	void SetReference(const kind *frame)
+	{
+		mTemplate.assign(frame, frame + mRows * mCols);
+		UpdateReference();
+	}
+
+	//	registers numFrames frames; the first frame ever pushed is the reference unless one was set. registered
+	//	(numFrames frames) may be NULL, it is not written either with ipNone
+	template <typename kind, typename out>
+	void Push(const kind *frames, size_t numFrames, out *registered, SFrameShift *shifts)
+	{
+		size_t		n = mRows * mCols;
+		bool		warp = registered != NULL && mParams.interp != SRegistrationParams::ipNone;
+
+		if (numFrames == 0)
+			return;
+		if (!mHasRef)
+			SetReference(frames);
+
+		if (mParams.templ == SRegistrationParams::tpReference) {
+			ParallelFor(numFrames, 1, [&](size_t begin, size_t end) {
+				std::vector<complex>	spec(padRows() * padCols());
+				std::vector<double>		column;
+
+				for (size_t f = begin; f < end; ++f) {
+					Spectrum(frames + f * n, spec.data(), false);
+					shifts[f] = Correlate(spec.data(), false);
+					if (warp)
+						Warp(frames + f * n, shifts[f], mParams.interp, registered + f * n, column);
+				}
+			});
+			return;
+		}
+
+		std::vector<complex>	spec(padRows() * padCols());
+		std::vector<double>		column, aligned(n);
+
+		for (size_t f = 0; f < numFrames; ++f) {
+			Spectrum(frames + f * n, spec.data(), true);
+			shifts[f] = Correlate(spec.data(), true);
+
+			//	the template follows the registered frame, resampled even when only the shifts are wanted
+			Warp(frames + f * n, shifts[f], mParams.interp == SRegistrationParams::ipNone ? SRegistrationParams::ipBilinear : mParams.interp,
+				aligned.data(), column);
+			if (warp)
+				std::copy(aligned.begin(), aligned.end(), registered + f * n);
+
+			for (size_t i = 0; i < n; ++i)
+				if (std::isfinite(aligned[i]))
+					mTemplate[i] += mParams.alpha * (aligned[i] - mTemplate[i]);
+			UpdateReference();
+		}
+	}
+};
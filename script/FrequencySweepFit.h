@@ -0,0 +1,136 @@
+#pragma once
+
+#include "RadialDiffusivity.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+//	joint diffusivity fit over several lock-in frequencies
+//
+//	the phase slope of a thermal wave is m = sqrt(pi f / D), so along each ray the slopes measured at the different
+//	frequencies lie on a line through the origin when plotted against sqrt(f): m = s sqrt(f) and D = pi / s^2.
+//	each frequency is run through CRadialDiffusivity, then s is fitted per ray (weighted by the ray R^2) and pooled
+//	over all rays. the per ray joint slopes also give a joint anisotropy ellipse.
+
+struct SSweepRay
+{
+	double		angle;
+	double		slope;				//	s in m = s sqrt(f) [rad/mm/sqrt(Hz)]
+	double		r2;					//	of m against sqrt(f)
+	double		d;					//	pi / s^2 [mm^2/s]
+	size_t		numFreqs;			//	frequencies with a valid slope on this ray
+};
+
+struct SSweepFit
+{
+	std::vector<SSweepRay>	rays;
+	std::vector<double>		freqD;			//	median ray diffusivity of each frequency
+	double					slope;			//	pooled over rays and frequencies
+	double					r2;
+	double					d;
+	SAnisotropy				ellipse;
+};
+
+inline double MedianOf(std::vector<double> values)
+{
+	values.erase(std::remove_if(values.begin(), values.end(), [](double v) { return !std::isfinite(v); }), values.end());
+	if (values.empty())
+		return NAN;
+
+	size_t		mid = values.size() / 2;
+
+	std::nth_element(values.begin(), values.begin() + mid, values.end());
+	if (values.size() % 2 == 1)
+		return values[mid];
+
+	return 0.5 * (values[mid] + *std::max_element(values.begin(), values.begin() + mid));
+}
+
+//	sweep[k] holds the radial fit at freqs[k], all with the same number of rays
+inline bool FitFrequencySweep(const std::vector<CRadialDiffusivity> &sweep, const std::vector<double> &freqs, SSweepFit &out)
+{
+	size_t		numFreqs = sweep.size();
+	size_t		numRays = numFreqs > 0 ? sweep[0].rays().size() : 0;
+
+	if (numFreqs == 0 || numFreqs != freqs.size())
+		return false;
+	for (size_t k = 0; k < numFreqs; ++k)
+		if (sweep[k].rays().size() != numRays)
+			return false;
+
+	std::vector<SRayFit>	ellipseRays(numRays);
+	double					pw = 0.0, pxy = 0.0, pxx = 0.0, pyy = 0.0, py = 0.0;
+
+	out.rays.resize(numRays);
+	out.freqD.resize(numFreqs);
+
+	for (size_t k = 0; k < numFreqs; ++k) {
+		std::vector<double>		d(numRays);
+
+		for (size_t r = 0; r < numRays; ++r)
+			d[r] = sweep[k].rays()[r].dPhase;
+		out.freqD[k] = MedianOf(d);
+	}
+
+	for (size_t r = 0; r < numRays; ++r) {
+		double		sw = 0.0, sxy = 0.0, sxx = 0.0, syy = 0.0, sy = 0.0, meanR2 = 0.0;
+		size_t		used = 0, samples = 0;
+		SSweepRay	&ray = out.rays[r];
+
+		for (size_t k = 0; k < numFreqs; ++k) {
+			const SRayFit	&fit = sweep[k].rays()[r];
+			double			w = fit.r2Phase;
+			double			x = sqrt(freqs[k]), y = fabs(fit.slopePhase);
+
+			ray.angle = fit.angle;
+			if (fit.numValid < 3 || !std::isfinite(y) || !(w > 0.0))
+				continue;
+			sw += w;
+			sxy += w * x * y;
+			sxx += w * x * x;
+			syy += w * y * y;
+			sy += w * y;
+			meanR2 += w;
+			samples += fit.numValid;
+			++used;
+		}
+
+		pw += sw;
+		pxy += sxy;
+		pxx += sxx;
+		pyy += syy;
+		py += sy;
+
+		ray.numFreqs = used;
+		ray.slope = ray.r2 = ray.d = NAN;
+		if (used > 0 && sxx > 0.0) {
+			double		ssTot = syy - sy * sy / sw;
+			double		ssRes = syy - sxy * sxy / sxx;
+
+			ray.slope = sxy / sxx;
+			ray.d = M_PI / (ray.slope * ray.slope);
+			ray.r2 = ssTot > 0.0 ? 1.0 - ssRes / ssTot : 1.0;
+			meanR2 /= (double)used;
+		}
+
+		//	the ellipse fit works on m^2 / (pi f), feed it s with f = 1
+		ellipseRays[r].angle = ray.angle;
+		ellipseRays[r].slopePhase = ray.slope;
+		ellipseRays[r].r2Phase = used > 0 ? meanR2 : 0.0;
+		ellipseRays[r].numValid = samples;
+	}
+
+	out.slope = out.r2 = out.d = NAN;
+	if (pxx > 0.0) {
+		double		ssTot = pyy - py * py / pw;
+		double		ssRes = pyy - pxy * pxy / pxx;
+
+		out.slope = pxy / pxx;
+		out.d = M_PI / (out.slope * out.slope);
+		out.r2 = ssTot > 0.0 ? 1.0 - ssRes / ssTot : 1.0;
+	}
+
+	FitDiffusivityEllipse(ellipseRays, 1.0, out.ellipse);
+
+	return true;
+}
@@ -0,0 +1,399 @@
+#pragma once
+
+#include "ThermoParallel.h"
+#include "SmallLinearAlgebra.h"
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+//	heat source (inverse) mapping
+//
+//	the heat equation with a volumetric source, rho c dT/dt = k lap(T) + q, read backwards gives per pixel and frame
+//		q = rhoC (dT/dt - alpha lap(T))
+//	both derivatives come from savitzky-golay filters: dT/dt from a polynomial of the given order over 2 halfWidth + 1
+//	frames, lap(T) from quadratic fits over 2 spatialHalfWidth + 1 pixels along each axis (halfWidth 1 is the 5 point
+//	laplacian) applied to the temporally smoothed frame. the first and last halfWidth frames use the same window
+//	evaluated off centre, so every input frame gets a source frame. borders replicate the edge pixels (no heat flux).
+//	with frame times the temporal filters are fitted on the actual times of each window, so dropped or irregular frames
+//	do not scale dT/dt, and each frame weighs half the time between its neighbours in the integral.
+//	frames are column major rows x cols (matlab), mmpx is the pixel size [mm], alpha [mm^2/s], q comes out in
+//	rhoC K/s (rhoC = 1 gives the source as a heating rate, rho c in J/(mm^3 K) gives W/mm^3).
+//	the engine keeps the last 2 halfWidth + 1 frames in a ring and computes each source frame in one fused sweep: the
+//	frame is cut into strips of columns, each strip smooths its columns plus the halo in time, filters along the
+//	contiguous rows and combines the columns into q, all inside a buffer of the strip that stays in cache. strips run
+//	in parallel and every inner loop runs over contiguous rows so the compiler vectorizes it.
+
+struct SHeatSourceParams
+{
+	double		fs;						//	frame rate [Hz]
+	size_t		halfWidth;				//	temporal window 2 halfWidth + 1 frames
+	size_t		order;					//	temporal polynomial order
+	size_t		spatialHalfWidth;		//	spatial window 2 spatialHalfWidth + 1 pixels
+	double		diffusivity;			//	alpha [mm^2/s]
+	double		mmpx;					//	[mm/px]
+	double		rhoC;
+};
+
+//	least squares polynomial coefficients over the n samples at positions x: the derivative-th derivative at 0 of the
+//	polynomial of the given order fitted to the samples
+inline bool PolynomialFilter(const double *x, size_t n, size_t order, size_t derivative, double *coeffs)
+{
+	size_t				m = order + 1;
+	std::vector<double>	a(m * m, 0.0), z(m, 0.0);
+	double				factorial = 1.0;
+
+	if (order >= n || derivative > order)
+		return false;
+
+	//	normal equations of the polynomial in x, the derivative at 0 is d! times coefficient d
+	for (size_t i = 0; i < n; ++i)
+		for (size_t r = 0; r < m; ++r)
+			for (size_t c = 0; c < m; ++c)
+				a[r * m + c] += pow(x[i], (double)(r + c));
+	if (!CholeskyFactor(a.data(), m))
+		return false;
+	for (size_t k = 2; k <= derivative; ++k)
+		factorial *= (double)k;
+	z[derivative] = factorial;
+	CholeskySolve(a.data(), z.data(), m);
+
+	for (size_t i = 0; i < n; ++i) {
+		double		p = 1.0, c = 0.0;
+
+		for (size_t r = 0; r < m; ++r, p *= x[i])
+			c += z[r] * p;
+		coeffs[i] = c;
+	}
+
+	return true;
+}
+
+//	savitzky-golay coefficients over 2 halfWidth + 1 samples, evaluated offset samples from the centre: the
+//	derivative-th derivative (per sample) of the least squares polynomial of the given order
+inline bool SavitzkyGolay(size_t halfWidth, size_t order, int offset, size_t derivative, double *coeffs)
+{
+	size_t				n = 2 * halfWidth + 1;
+	std::vector<double>	x(n);
+
+	for (size_t i = 0; i < n; ++i)
+		x[i] = (double)i - (double)halfWidth - (double)offset;
+
+	return PolynomialFilter(x.data(), n, order, derivative, coeffs);
+}
+
+class CHeatSource
+{
+private:
+	size_t					mRows;
+	size_t					mCols;
+	SHeatSourceParams		mParams;
+	size_t					mWindow;			//	2 halfWidth + 1
+	size_t					mStripCols;
+	std::vector<double>		mSmooth;			//	per offset (-halfWidth..halfWidth) window coefficients
+	std::vector<double>		mSlope;				//	same, d/dt [1/s]
+	std::vector<double>		mTimeSmooth;		//	coefficients of the current window on the frame times
+	std::vector<double>		mTimeSlope;
+	bool					mFrameTimes;		//	pushed with times, the filters follow them
+	std::vector<double>		mSpatialSmooth;		//	2 spatialHalfWidth + 1 coefficients
+	std::vector<double>		mSpatialCurve;		//	d2/dx2 [1/mm^2]
+	std::vector<float>		mRing;				//	mWindow frames
+	std::vector<double>		mTimes;
+	std::vector<float>		mStrips;			//	per strip: smoothed, row smoothed and row curvature columns
+	std::vector<float>		mOut;
+	std::vector<double>		mIntegral;
+	int64_t					mNumFrames;
+	int64_t					mNumOut;
+	std::string				mError;
+
+	size_t numStrips() const
+	{
+		return (mCols + mStripCols - 1) / mStripCols;
+	}
+
+	double Time(int64_t index) const
+	{
+		return mTimes[(size_t)(index % (int64_t)mWindow)];
+	}
+
+	//	temporal filters of the window on its frame times, in units of the mean frame spacing for the conditioning
+	bool TimeFilters(int64_t first, int64_t index)
+	{
+		std::vector<double>		x(mWindow);
+		double					step = (Time(first + (int64_t)mWindow - 1) - Time(first)) / (double)(mWindow - 1);
+
+		for (size_t k = 0; k < mWindow; ++k)
+			x[k] = (Time(first + (int64_t)k) - Time(index)) / step;
+		if (!PolynomialFilter(x.data(), mWindow, mParams.order, 0, mTimeSmooth.data()) ||
+			!PolynomialFilter(x.data(), mWindow, mParams.order, 1, mTimeSlope.data()))
+			return false;
+		for (size_t k = 0; k < mWindow; ++k)
+			mTimeSlope[k] /= step;
+
+		return true;
+	}
+
+	//	source frame of window frames first..first + mWindow - 1 at offset from their centre into mOut
+	bool Compute(int64_t first, int offset)
+	{
+		int64_t			index = first + (int64_t)mParams.halfWidth + offset;
+		size_t			h = mParams.spatialHalfWidth, span = 2 * h + 1, rows = mRows;
+		const double	*smooth = &mSmooth[(size_t)(offset + (int)mParams.halfWidth) * mWindow];
+		const double	*slope = &mSlope[(size_t)(offset + (int)mParams.halfWidth) * mWindow];
+		float			alpha = (float)mParams.diffusivity, rhoC = (float)mParams.rhoC;
+		std::vector<const float *>	taps(mWindow);
+
+		if (mFrameTimes) {
+			if (!TimeFilters(first, index)) {
+				mError = "The frame times of a window are degenerate.";
+				return false;
+			}
+			smooth = mTimeSmooth.data();
+			slope = mTimeSlope.data();
+		}
+
+		for (size_t k = 0; k < mWindow; ++k)
+			taps[k] = &mRing[(size_t)((first + (int64_t)k) % (int64_t)mWindow) * mRows * mCols];
+
+		ParallelFor(numStrips(), 1, [&](size_t begin, size_t end) {
+			for (size_t strip = begin; strip < end; ++strip) {
+				size_t		c0 = strip * mStripCols, c1 = std::min(c0 + mStripCols, mCols);
+				size_t		width = mStripCols + 2 * h;
+				float		*buffer = &mStrips[strip * 3 * width * rows];
+				float		*smoothed = buffer, *rowSmooth = buffer + width * rows, *rowCurve = buffer + 2 * width * rows;
+
+				//	temporal smoothing of the strip and its halo, edge columns replicated
+				for (size_t j = 0; j < c1 - c0 + 2 * h; ++j) {
+					long		c = std::min(std::max((long)(c0 + j) - (long)h, 0L), (long)mCols - 1);
+					float		*dest = smoothed + j * rows;
+
+					std::fill(dest, dest + rows, 0.0f);
+					for (size_t k = 0; k < mWindow; ++k) {
+						const float		*src = taps[k] + (size_t)c * rows;
+						float			w = (float)smooth[k];
+
+						for (size_t r = 0; r < rows; ++r)
+							dest[r] += w * src[r];
+					}
+				}
+
+				//	along the rows, edge rows replicated
+				for (size_t j = 0; j < c1 - c0 + 2 * h; ++j) {
+					const float		*src = smoothed + j * rows;
+					float			*s = rowSmooth + j * rows, *d = rowCurve + j * rows;
+
+					for (size_t r = 0; r < rows; ++r) {
+						s[r] = 0.0f;
+						d[r] = 0.0f;
+					}
+					for (size_t i = 0; i < span; ++i) {
+						float		ws = (float)mSpatialSmooth[i], wd = (float)mSpatialCurve[i];
+						long		shift = (long)i - (long)h;
+						size_t		lo = (size_t)std::min(std::max(-shift, 0L), (long)rows);
+						size_t		hi = (size_t)std::max(std::min((long)rows - shift, (long)rows), (long)lo);
+
+						for (size_t r = 0; r < lo; ++r) {
+							s[r] += ws * src[0];
+							d[r] += wd * src[0];
+						}
+						for (size_t r = lo; r < hi; ++r) {
+							s[r] += ws * src[r + shift];
+							d[r] += wd * src[r + shift];
+						}
+						for (size_t r = hi; r < rows; ++r) {
+							s[r] += ws * src[rows - 1];
+							d[r] += wd * src[rows - 1];
+						}
+					}
+				}
+
+				//	along the columns, then q from the temporal slope
+				for (size_t c = c0; c < c1; ++c) {
+					float		*out = &mOut[c * rows];
+					size_t		j0 = c - c0;
+
+					for (size_t r = 0; r < rows; ++r)
+						out[r] = 0.0f;
+					for (size_t i = 0; i < span; ++i) {
+						const float		*s = rowSmooth + (j0 + i) * rows, *d = rowCurve + (j0 + i) * rows;
+						float			ws = (float)mSpatialSmooth[i], wd = (float)mSpatialCurve[i];
+
+						for (size_t r = 0; r < rows; ++r)
+							out[r] += ws * d[r] + wd * s[r];
+					}
+					for (size_t r = 0; r < rows; ++r)
+						out[r] *= -alpha;
+					for (size_t k = 0; k < mWindow; ++k) {
+						const float		*src = taps[k] + c * rows;
+						float			w = (float)slope[k];
+
+						for (size_t r = 0; r < rows; ++r)
+							out[r] += w * src[r];
+					}
+					for (size_t r = 0; r < rows; ++r)
+						out[r] *= rhoC;
+				}
+			}
+		});
+
+		//	half the time between the neighbours, one sided at the ends of the window (1 / fs without times)
+		int64_t			prev = std::max(index - 1, first), next = std::min(index + 1, first + (int64_t)mWindow - 1);
+		const double	dt = (Time(next) - Time(prev)) / (double)(next - prev);
+
+		for (size_t p = 0; p < mRows * mCols; ++p)
+			mIntegral[p] += (double)mOut[p] * dt;
+
+		return true;
+	}
+
+	template <class kfn>
+	bool Emit(int64_t first, int offset, kfn emit)
+	{
+		int64_t		index = first + (int64_t)mParams.halfWidth + offset;
+
+		if (!Compute(first, offset))
+			return false;
+		emit(index, Time(index), (const float *)mOut.data());
+		++mNumOut;
+
+		return true;
+	}
+
+public:
+	CHeatSource(size_t rows, size_t cols, const SHeatSourceParams &params) :
+		mRows(rows),
+		mCols(cols),
+		mParams(params),
+		mWindow(2 * params.halfWidth + 1),
+		mStripCols(16),
+		mFrameTimes(false),
+		mNumFrames(0),
+		mNumOut(0)
+	{
+		size_t		span = 2 * params.spatialHalfWidth + 1;
+		double		dx2 = params.mmpx * params.mmpx;
+
+		if (!(params.fs > 0.0) || !(params.mmpx > 0.0))
+			mError = "fs and mmpx must be positive.";
+		else if (params.order < 1 || params.order >= mWindow)
+			mError = "The temporal order must be at least 1 and less than 2 halfWidth + 1.";
+		else if (params.spatialHalfWidth < 1)
+			mError = "spatialHalfWidth must be at least 1.";
+		if (!mError.empty())
+			return;
+
+		mSmooth.resize(mWindow * mWindow);
+		mSlope.resize(mWindow * mWindow);
+		for (size_t o = 0; o < mWindow; ++o) {
+			int		offset = (int)o - (int)params.halfWidth;
+
+			SavitzkyGolay(params.halfWidth, params.order, offset, 0, &mSmooth[o * mWindow]);
+			SavitzkyGolay(params.halfWidth, params.order, offset, 1, &mSlope[o * mWindow]);
+			for (size_t k = 0; k < mWindow; ++k)
+				mSlope[o * mWindow + k] *= params.fs;
+		}
+		mSpatialSmooth.resize(span);
+		mSpatialCurve.resize(span);
+		SavitzkyGolay(params.spatialHalfWidth, 2, 0, 0, mSpatialSmooth.data());
+		SavitzkyGolay(params.spatialHalfWidth, 2, 0, 2, mSpatialCurve.data());
+		for (size_t i = 0; i < span; ++i)
+			mSpatialCurve[i] /= dx2;
+
+		mRing.resize(mWindow * rows * cols);
+		mTimes.resize(mWindow);
+		mTimeSmooth.resize(mWindow);
+		mTimeSlope.resize(mWindow);
+		mStrips.resize(numStrips() * 3 * (mStripCols + 2 * params.spatialHalfWidth) * rows);
+		mOut.resize(rows * cols);
+		mIntegral.assign(rows * cols, 0.0);
+	}
+
+	bool valid() const
+	{
+		return mError.empty();
+	}
+
+	//	numFrames frames with their times [s] (NULL for k / fs, the same for every push), emit(index, time, q) gets the
+	//	source frames in order as soon as their window is complete, q is only valid during the call
+	template <typename kind, class kfn>
+	bool Push(const kind *frames, const double *times, size_t numFrames, kfn emit)
+	{
+		if (!mError.empty())
+			return false;
+
+		size_t		numPixels = mRows * mCols;
+
+		if (mNumFrames == 0)
+			mFrameTimes = times != NULL;
+		for (size_t f = 0; f < numFrames; ++f) {
+			size_t		slot = (size_t)(mNumFrames % (int64_t)mWindow);
+			double		t = times != NULL ? times[f] : (double)mNumFrames / mParams.fs;
+
+			if (mNumFrames > 0 && !(t > Time(mNumFrames - 1))) {
+				mError = "Frame times must increase.";
+				return false;
+			}
+			std::transform(frames + f * numPixels, frames + (f + 1) * numPixels, &mRing[slot * numPixels], [](kind v) { return (float)v; });
+			mTimes[slot] = t;
+			++mNumFrames;
+
+			//	the first full window also covers the frames before its centre
+			int64_t		first = mNumFrames - (int64_t)mWindow;
+
+			if (first == 0) {
+				for (int offset = -(int)mParams.halfWidth; offset <= 0; ++offset)
+					if (!Emit(first, offset, emit))
+						return false;
+			}
+			else if (first > 0 && !Emit(first, 0, emit))
+				return false;
+		}
+
+		return true;
+	}
+
+	//	the frames after the centre of the last window, false if there were fewer frames than one window
+	template <class kfn>
+	bool Finish(kfn emit)
+	{
+		if (!mError.empty())
+			return false;
+		if (mNumFrames < (int64_t)mWindow) {
+			mError = "Need at least 2 halfWidth + 1 frames.";
+			return false;
+		}
+		for (int offset = 1; offset <= (int)mParams.halfWidth; ++offset)
+			if (!Emit(mNumFrames - (int64_t)mWindow, offset, emit))
+				return false;
+
+		return true;
+	}
+
+	size_t rows() const
+	{
+		return mRows;
+	}
+
+	size_t cols() const
+	{
+		return mCols;
+	}
+
+	int64_t numFrames() const
+	{
+		return mNumFrames;
+	}
+
+	//	sum of q dt over the source frames so far [rhoC K]
+	const std::vector<double> &integral() const
+	{
+		return mIntegral;
+	}
+
+	const std::string &error() const
+	{
+		return mError;
+	}
+};
@@ -0,0 +1,100 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "mex.h"
+#include "MexHelpers.h"
+#include "HeatSource.h"
+#include "ThermoProfiler.h"
+#include <cstring>
+
+//	mex HeatSourceMex.cpp
+
+//	res = HeatSourceMex(cube, fs, diffusivity, mmpxratio, opts)
+//	res = HeatSourceMex(cube, t, diffusivity, mmpxratio, opts)
+//	heat source estimate q = rhoC (dT/dt - alpha lap(T)) of every pixel and frame (see HeatSource.h). cube is the
+//	rows x cols x n sequence (double or single) sampled at fs [Hz] or at the n increasing frame times t [s] (dropped or
+//	irregular frames), diffusivity is alpha [mm^2/s], mmpxratio the pixel size [mm]. opts is an optional struct with
+//	halfWidth (temporal window 2 halfWidth + 1 frames, 3), order (of the temporal fit, 2), spatialHalfWidth (1, the 5
+//	point laplacian), rhoC (1, q in K/s) and output ('cube' or 'map'). res has integral (rows x cols, sum of q dt), t
+//	(the n frame times, from the first frame with fs) and, for 'cube', q (rows x cols x n single)
+
+//	the mex entry point
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	if (nrhs < 4 || nrhs > 5 || nlhs > 1)
+		mexErrMsgTxt("Must have 4-5 inputs and 0-1 outputs.");
+
+	CThermoStage		stage("heatSource", "HeatSourceMex", (double)mxGetElementSize(prhs[0]) * mxGetNumberOfElements(prhs[0]));
+
+	const mxArray		*cube = prhs[0];
+	const mxArray		*opts = nrhs > 4 ? prhs[4] : NULL;
+	const mwSize		*dims = mxGetDimensions(cube);
+	size_t				rows = dims[0], cols = dims[1];
+	size_t				numPixels = rows * cols;
+	size_t				numFrames = numPixels > 0 ? mxGetNumberOfElements(cube) / numPixels : 0;
+	std::string			output = mxGetOption(opts, "output", "cube");
+	SHeatSourceParams	params;
+	std::vector<double>	frameTimes;
+
+	if (mxIsComplex(cube) || (!mxIsDouble(cube) && !mxIsSingle(cube)) || mxGetNumberOfDimensions(cube) > 3)
+		mexErrMsgTxt("cube must be a real double or single rows x cols x n array.");
+	if (output != "cube" && output != "map")
+		mexErrMsgTxt("output must be 'cube' or 'map'.");
+
+	if (mxGetNumberOfElements(prhs[1]) > 1) {
+		const double	*t = mxGetDoubleInput(prhs[1], "t");
+
+		if (mxGetNumberOfElements(prhs[1]) != numFrames)
+			mexErrMsgTxt("Need fs or one time per frame.");
+		frameTimes.assign(t, t + numFrames);
+		params.fs = (double)(numFrames - 1) / (frameTimes.back() - frameTimes.front());
+	}
+	else
+		params.fs = mxGetScalarInput(prhs[1], "fs");
+	params.diffusivity = mxGetScalarInput(prhs[2], "diffusivity");
+	params.mmpx = mxGetScalarInput(prhs[3], "mmpxratio");
+	params.halfWidth = (size_t)mxGetOption(opts, "halfWidth", 3.0);
+	params.order = (size_t)mxGetOption(opts, "order", 2.0);
+	params.spatialHalfWidth = (size_t)mxGetOption(opts, "spatialHalfWidth", 1.0);
+	params.rhoC = mxGetOption(opts, "rhoC", 1.0);
+
+	CHeatSource			engine(rows, cols, params);
+	mxArray				*q = NULL;
+	float				*qData = NULL;
+	std::vector<double>	times(numFrames);
+	bool				ok;
+
+	if (!engine.valid())
+		mexErrMsgTxt(engine.error().c_str());
+	if (output == "cube") {
+		mwSize		qDims[3] = { rows, cols, numFrames };
+
+		q = mxCreateNumericArray(3, qDims, mxSINGLE_CLASS, mxREAL);
+		qData = (float *)mxGetData(q);
+	}
+
+	auto emit = [&](int64_t index, double t, const float *source) {
+		times[(size_t)index] = t;
+		if (qData != NULL)
+			memcpy(qData + (size_t)index * numPixels, source, numPixels * sizeof(float));
+	};
+
+	if (mxIsDouble(cube))
+		ok = engine.Push((const double *)mxGetData(cube), frameTimes.empty() ? NULL : frameTimes.data(), numFrames, emit);
+	else
+		ok = engine.Push((const float *)mxGetData(cube), frameTimes.empty() ? NULL : frameTimes.data(), numFrames, emit);
+	if (!ok || !engine.Finish(emit)) {
+		if (q != NULL)
+			mxDestroyArray(q);
+		mexErrMsgTxt(engine.error().c_str());
+	}
+
+	const char		*fields[] = { "integral", "t", "q" };
+	mxArray			*res = mxCreateStructMatrix(1, 1, q != NULL ? 3 : 2, fields);
+
+	mxSetFieldByNumber(res, 0, 0, mxCreateDoubleMatrixFrom(engine.integral().data(), rows, cols));
+	mxSetFieldByNumber(res, 0, 1, mxCreateDoubleColumn(times));
+	if (q != NULL)
+		mxSetFieldByNumber(res, 0, 2, q);
+
+	plhs[0] = res;
+}
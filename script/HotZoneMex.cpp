@@ -0,0 +1,183 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "mex.h"
+#include "MexHelpers.h"
+#include "HotZoneTracker.h"
+
+//	mex HotZoneMex.cpp
+
+//	h = HotZoneMex('new', rows, cols, isotherms, opts)	opts (optional): mmpxratio (1), connectivity (8), minArea (1) [px]
+//	HotZoneMex('push', h, frames)						frames rows x cols x n (double, single, uint16 or int16)
+//	res = HotZoneMex('result', h)						one element per isotherm, time series of the largest component
+//	HotZoneMex('delete', h)
+//
+//	res(k).area, xc, yc, eqDiameter, perimeter, track, maxT	numFrames x 1, largest component (NaN when nothing is hot)
+//	res(k).totalArea, numComponents							numFrames x 1, all components above the isotherm
+//	res(k).components	table [frame track area xc yc eqDiameter perimeter maxT], every component of every frame
+//	positions are 1 based pixels, sizes in mm (mm^2) scaled by mmpxratio
+
+class CMatHotZone
+{
+private:
+	size_t				mRows;
+	size_t				mCols;
+	double				mMmpx;
+	std::vector<double>	mIsotherms;
+	CHotZoneTracker		mTracker;
+
+public:
+	CMatHotZone(size_t rows, size_t cols, const std::vector<double> &isotherms, const SHotZoneParams &params, double mmpx) :
+		mRows(rows),
+		mCols(cols),
+		mMmpx(mmpx),
+		mIsotherms(isotherms),
+		mTracker(rows, cols, isotherms, params)
+	{
+	}
+
+	void Push(const mxArray *frames)
+	{
+		const mwSize	*dims = mxGetDimensions(frames);
+		size_t			numFrames = mxGetNumberOfElements(frames) / (mRows * mCols);
+
+		if (dims[0] != mRows || dims[1] != mCols || numFrames * mRows * mCols != mxGetNumberOfElements(frames))
+			mexErrMsgTxt("Frames do not match the map size.");
+		if (mxIsComplex(frames))
+			mexErrMsgTxt("Must not be complex.");
+
+		switch (mxGetClassID(frames)) {
+			case mxDOUBLE_CLASS:
+				mTracker.Push((const double *)mxGetData(frames), numFrames);
+				break;
+			case mxSINGLE_CLASS:
+				mTracker.Push((const float *)mxGetData(frames), numFrames);
+				break;
+			case mxUINT16_CLASS:
+				mTracker.Push((const uint16_t *)mxGetData(frames), numFrames);
+				break;
+			case mxINT16_CLASS:
+				mTracker.Push((const int16_t *)mxGetData(frames), numFrames);
+				break;
+			default:
+				mexErrMsgTxt("Unsupported type.");
+				break;
+		}
+	}
+
+	mxArray *result()
+	{
+		const char							*fields[] = { "isotherm", "area", "xc", "yc", "eqDiameter", "perimeter", "track", "maxT",
+												"totalArea", "numComponents", "components" };
+		const size_t						numSeries = 9;
+		const std::vector<SHotComponent>	&all = mTracker.components();
+		size_t								numIso = mIsotherms.size(), numFrames = (size_t)mTracker.numFrames();
+		mxArray								*ret = mxCreateStructMatrix(numIso, 1, sizeof(fields) / sizeof(fields[0]), fields);
+		double								area = mMmpx * mMmpx;
+
+		for (size_t k = 0; k < numIso; ++k) {
+			double		*series[numSeries];
+			size_t		count = 0, row = 0;
+
+			for (size_t s = 0; s < numSeries; ++s) {
+				mxArray		*ar = mxCreateDoubleMatrix(numFrames, 1, mxREAL);
+
+				series[s] = mxGetPr(ar);
+				for (size_t f = 0; f < numFrames; ++f)
+					series[s][f] = s < 7 ? mxGetNaN() : 0.0;
+				mxSetFieldByNumber(ret, k, s + 1, ar);
+			}
+			for (size_t c = 0; c < all.size(); ++c)
+				count += all[c].isotherm == k ? 1 : 0;
+
+			mxArray		*table = mxCreateDoubleMatrix(count, 8, mxREAL);
+			double		*t = mxGetPr(table);
+
+			for (size_t c = 0; c < all.size(); ++c) {
+				const SHotComponent		&hc = all[c];
+				size_t					f = (size_t)hc.frame;
+				double					d = 2.0 * sqrt(hc.area / M_PI) * mMmpx;
+				double					values[] = { (double)f + 1.0, (double)hc.track + 1.0, hc.area * area, hc.xc + 1.0,
+											hc.yc + 1.0, d, hc.perimeter * mMmpx, hc.maxValue };
+
+				if (hc.isotherm != k)
+					continue;
+				for (size_t col = 0; col < 8; ++col)
+					t[row + col * count] = values[col];
+				++row;
+
+				series[7][f] += hc.area * area;
+				series[8][f] += 1.0;
+				if (!(series[0][f] >= hc.area * area)) {
+					series[0][f] = hc.area * area;
+					series[1][f] = hc.xc + 1.0;
+					series[2][f] = hc.yc + 1.0;
+					series[3][f] = d;
+					series[4][f] = hc.perimeter * mMmpx;
+					series[5][f] = (double)hc.track + 1.0;
+					series[6][f] = hc.maxValue;
+				}
+			}
+
+			mxSetFieldByNumber(ret, k, 0, mxCreateDoubleScalar(mIsotherms[k]));
+			mxSetFieldByNumber(ret, k, 10, table);
+		}
+
+		return ret;
+	}
+};
+
+//	the mex entry point
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	char			command[64];
+	CMatHotZone		*zone;
+
+	if (nrhs < 1 || mxGetString(prhs[0], command, sizeof(command)) != 0)
+		mexErrMsgTxt("First argument must be a command string.");
+
+	if (strcmp(command, "new") == 0) {
+		if (nlhs != 1 || nrhs < 4 || nrhs > 5)
+			mexErrMsgTxt("Must have 4-5 inputs and 1 output.");
+
+		const double		*iso = mxGetDoubleInput(prhs[3], "isotherms");
+		size_t				numIso = mxGetNumberOfElements(prhs[3]);
+		const mxArray		*opts = nrhs > 4 ? prhs[4] : NULL;
+		SHotZoneParams		params;
+		double				connectivity = mxGetOption(opts, "connectivity", 8.0);
+		double				mmpx = mxGetOption(opts, "mmpxratio", 1.0);
+
+		if (numIso == 0)
+			mexErrMsgTxt("Need at least one isotherm.");
+		if (connectivity != 4.0 && connectivity != 8.0)
+			mexErrMsgTxt("connectivity must be 4 or 8.");
+		if (!(mmpx > 0.0))
+			mexErrMsgTxt("mmpxratio must be positive.");
+		params.eightConnected = connectivity == 8.0;
+		params.minArea = (size_t)std::max(mxGetOption(opts, "minArea", 1.0), 1.0);
+
+		zone = new CMatHotZone((size_t)mxGetScalarInput(prhs[1], "rows"), (size_t)mxGetScalarInput(prhs[2], "cols"),
+			std::vector<double>(iso, iso + numIso), params, mmpx);
+		plhs[0] = WrapObject(zone);
+		return;
+	}
+
+	if (nrhs < 2)
+		mexErrMsgTxt("Second argument must be a handle.");
+
+	zone = GetObject<CMatHotZone>(prhs[1]);		//	won't get past here if GetObject fails
+
+	if (strcmp(command, "delete") == 0) {
+		UnwrapObject<CMatHotZone>(prhs[1]);
+		delete zone;
+	} else if (strcmp(command, "push") == 0) {
+		if (nlhs != 0 || nrhs != 3)
+			mexErrMsgTxt("Must have 3 inputs and 0 outputs.");
+		zone->Push(prhs[2]);
+	} else if (strcmp(command, "result") == 0) {
+		if (nlhs != 1 || nrhs != 2)
+			mexErrMsgTxt("Must have 2 inputs and 1 outputs.");
+		plhs[0] = zone->result();
+	} else {
+		mexErrMsgTxt("Unknown command.");
+	}
+}
@@ -0,0 +1,267 @@
+#pragma once
+
+#include "ThermoParallel.h"
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <unordered_map>
+
+//	hot zone segmentation and tracking (weld nugget growth in RSW recordings)
+//
+//	each frame is thresholded at every isotherm and the pixels at or above it are labelled with a two pass union-find
+//	scan (4 or 8 connectivity) along the columns of the matlab frame, where memory is contiguous. per component the
+//	scan collects area, centroid, boundary pixels and peak temperature. components are tracked frame to frame by
+//	pixel overlap: a component continues the track of the previous component it overlaps most, merges keep the
+//	largest overlap and splits start new tracks. the (frame, isotherm) labellings of a pushed block run in parallel,
+//	only the track assignment is sequential. coordinates are 0 based pixels, x along the columns.
+
+struct SHotComponent
+{
+	int64_t		frame;
+	size_t		isotherm;
+	int64_t		track;
+	double		area;				//	[px]
+	double		xc;
+	double		yc;
+	double		perimeter;			//	boundary pixels (4-neighbour outside the component)
+	double		maxValue;
+};
+
+struct SHotZoneParams
+{
+	bool		eightConnected;
+	size_t		minArea;			//	smaller components are dropped [px]
+};
+
+class CHotZoneTracker
+{
+private:
+	struct SLabelling
+	{
+		std::vector<int32_t>		labels;			//	0 background, otherwise index + 1 into components
+		std::vector<SHotComponent>	components;
+	};
+
+	size_t					mRows;
+	size_t					mCols;
+	std::vector<double>		mIsotherms;
+	SHotZoneParams			mParams;
+	int64_t					mNumFrames;
+	int64_t					mNextTrack;
+	std::vector<SLabelling>	mPrevious;			//	last labelling of each isotherm
+	std::vector<SHotComponent>	mComponents;	//	everything found so far, frame after frame
+
+	static int32_t Find(std::vector<int32_t> &parent, int32_t i)
+	{
+		while (parent[i] != i) {
+			parent[i] = parent[parent[i]];
+			i = parent[i];
+		}
+
+		return i;
+	}
+
+	static void Union(std::vector<int32_t> &parent, int32_t a, int32_t b)
+	{
+		a = Find(parent, a);
+		b = Find(parent, b);
+		if (a < b)
+			parent[b] = a;
+		else if (b < a)
+			parent[a] = b;
+	}
+
+	template <typename kind>
+	void Label(const kind *frame, double level, SLabelling &out) const
+	{
+		size_t					n = mRows * mCols;
+		std::vector<int32_t>	parent(1, 0);
+		std::vector<int32_t>	&labels = out.labels;
+
+		labels.assign(n, 0);
+
+		//	first pass: provisional labels from the already visited neighbours (up, left, and the left diagonals)
+		for (size_t x = 0; x < mCols; ++x) {
+			for (size_t y = 0; y < mRows; ++y) {
+				size_t		i = y + x * mRows;
+				int32_t		neighbours[4];
+				int			count = 0;
+
+				if (!((double)frame[i] >= level))
+					continue;
+				if (y > 0 && labels[i - 1] != 0)
+					neighbours[count++] = labels[i - 1];
+				if (x > 0 && labels[i - mRows] != 0)
+					neighbours[count++] = labels[i - mRows];
+				if (mParams.eightConnected && x > 0) {
+					if (y > 0 && labels[i - mRows - 1] != 0)
+						neighbours[count++] = labels[i - mRows - 1];
+					if (y + 1 < mRows && labels[i - mRows + 1] != 0)
+						neighbours[count++] = labels[i - mRows + 1];
+				}
+
+				if (count == 0) {
+					labels[i] = (int32_t)parent.size();
+					parent.push_back(labels[i]);
+					continue;
+				}
+				labels[i] = neighbours[0];
+				for (int k = 1; k < count; ++k) {
+					Union(parent, labels[i], neighbours[k]);
+					labels[i] = std::min(labels[i], neighbours[k]);
+				}
+			}
+		}
+
+		//	second pass: final labels and component statistics
+		std::vector<int32_t>		index(parent.size(), -1);
+		std::vector<SHotComponent>	all;
+
+		for (size_t x = 0; x < mCols; ++x) {
+			for (size_t y = 0; y < mRows; ++y) {
+				size_t		i = y + x * mRows;
+
+				if (labels[i] == 0)
+					continue;
+
+				int32_t		root = Find(parent, labels[i]);
+
+				if (index[root] < 0) {
+					SHotComponent	c = { mNumFrames, 0, -1, 0.0, 0.0, 0.0, 0.0, -INFINITY };
+
+					index[root] = (int32_t)all.size();
+					all.push_back(c);
+				}
+
+				SHotComponent	&c = all[index[root]];
+				double			v = (double)frame[i];
+				bool			boundary = y == 0 || x == 0 || y + 1 == mRows || x + 1 == mCols ||
+									!((double)frame[i - 1] >= level) || !((double)frame[i + 1] >= level) ||
+									!((double)frame[i - mRows] >= level) || !((double)frame[i + mRows] >= level);
+
+				labels[i] = index[root] + 1;
+				c.area += 1.0;
+				c.xc += (double)x;
+				c.yc += (double)y;
+				c.perimeter += boundary ? 1.0 : 0.0;
+				c.maxValue = std::max(c.maxValue, v);
+			}
+		}
+
+		//	drop the small components and renumber
+		std::vector<int32_t>	keep(all.size() + 1, 0);
+
+		out.components.clear();
+		for (size_t k = 0; k < all.size(); ++k) {
+			if (all[k].area < (double)std::max<size_t>(mParams.minArea, 1))
+				continue;
+			all[k].xc /= all[k].area;
+			all[k].yc /= all[k].area;
+			out.components.push_back(all[k]);
+			keep[k + 1] = (int32_t)out.components.size();
+		}
+		for (size_t i = 0; i < n; ++i)
+			labels[i] = keep[labels[i]];
+	}
+
+	//	track ids of current from the overlaps with previous
+	void Match(const SLabelling &previous, SLabelling &current)
+	{
+		std::unordered_map<int64_t, double>		overlap;
+		std::vector<int64_t>					bestPrev(current.components.size(), -1);
+		std::vector<double>						bestOverlap(current.components.size(), 0.0);
+		std::vector<double>						claimed(previous.components.size(), 0.0);
+		size_t									n = current.labels.size();
+
+		if (!previous.labels.empty()) {
+			for (size_t i = 0; i < n; ++i)
+				if (current.labels[i] != 0 && previous.labels[i] != 0)
+					overlap[((int64_t)current.labels[i] << 32) | previous.labels[i]] += 1.0;
+		}
+
+		for (auto it = overlap.begin(); it != overlap.end(); ++it) {
+			size_t		c = (size_t)(it->first >> 32) - 1, p = (size_t)(it->first & 0xffffffff) - 1;
+
+			if (it->second > bestOverlap[c]) {
+				bestOverlap[c] = it->second;
+				bestPrev[c] = (int64_t)p;
+			}
+		}
+
+		//	a previous track goes to the current component overlapping it most, the others start new tracks
+		for (size_t c = 0; c < current.components.size(); ++c)
+			if (bestPrev[c] >= 0)
+				claimed[bestPrev[c]] = std::max(claimed[bestPrev[c]], bestOverlap[c]);
+		for (size_t c = 0; c < current.components.size(); ++c) {
+			if (bestPrev[c] >= 0 && claimed[bestPrev[c]] == bestOverlap[c]) {
+				current.components[c].track = previous.components[bestPrev[c]].track;
+				claimed[bestPrev[c]] = INFINITY;
+			}
+			else
+				current.components[c].track = mNextTrack++;
+		}
+	}
+
+public:
+	CHotZoneTracker(size_t rows, size_t cols, const std::vector<double> &isotherms, const SHotZoneParams &params) :
+		mRows(rows),
+		mCols(cols),
+		mIsotherms(isotherms),
+		mParams(params),
+		mNumFrames(0),
+		mNextTrack(0),
+		mPrevious(isotherms.size())
+	{
+	}
+
+	//	numFrames frames of rows x cols samples, one after the other
+	template <typename kind>
+	void Push(const kind *frames, size_t numFrames)
+	{
+		size_t						numIso = mIsotherms.size(), n = mRows * mCols;
+		std::vector<SLabelling>		block(numFrames * numIso);
+		int64_t						first = mNumFrames;
+
+		ParallelFor(block.size(), 1, [&](size_t begin, size_t end) {
+			for (size_t t = begin; t < end; ++t) {
+				size_t		f = t / numIso, k = t % numIso;
+
+				Label(frames + f * n, mIsotherms[k], block[t]);
+				for (size_t c = 0; c < block[t].components.size(); ++c) {
+					block[t].components[c].frame = first + (int64_t)f;
+					block[t].components[c].isotherm = k;
+				}
+			}
+		});
+
+		for (size_t f = 0; f < numFrames; ++f) {
+			for (size_t k = 0; k < numIso; ++k) {
+				SLabelling	&current = block[f * numIso + k];
+
+				Match(mPrevious[k], current);
+				mComponents.insert(mComponents.end(), current.components.begin(), current.components.end());
+				mPrevious[k].labels.swap(current.labels);
+				mPrevious[k].components.swap(current.components);
+			}
+		}
+
+		mNumFrames += (int64_t)numFrames;
+	}
+
+	int64_t numFrames() const
+	{
+		return mNumFrames;
+	}
+
+	size_t numIsotherms() const
+	{
+		return mIsotherms.size();
+	}
+
+	const std::vector<SHotComponent> &components() const
+	{
+		return mComponents;
+	}
+};
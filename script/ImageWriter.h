@@ -0,0 +1,373 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+//	self contained PNG and TIFF writers for the headless reports
+//
+//	images are 8 bit RGBA, row major, top row first. PNG rows get the adaptive filter of the PNG spec (the filter
+//	with the smallest sum of absolute differences) and are deflated with LZ77 and the fixed huffman codes, which is
+//	plenty for rendered maps with large flat areas. TIFF is baseline, uncompressed, one strip, unassociated alpha.
+//	no zlib / libpng / libtiff headers are needed.
+
+struct SImage
+{
+	size_t					width;
+	size_t					height;
+	std::vector<uint8_t>	rgba;
+
+	SImage(size_t w = 0, size_t h = 0, uint32_t color = 0xffffffff) :
+		width(w),
+		height(h),
+		rgba(w * h * 4)
+	{
+		for (size_t i = 0; i < w * h; ++i) {
+			rgba[i * 4 + 0] = (uint8_t)(color >> 24);
+			rgba[i * 4 + 1] = (uint8_t)(color >> 16);
+			rgba[i * 4 + 2] = (uint8_t)(color >> 8);
+			rgba[i * 4 + 3] = (uint8_t)color;
+		}
+	}
+
+	uint8_t *At(size_t x, size_t y)
+	{
+		return &rgba[(y * width + x) * 4];
+	}
+};
+
+class CDeflate
+{
+private:
+	std::vector<uint8_t>	&mOut;
+	uint32_t				mBits;
+	int						mCount;
+
+	void Bits(uint32_t value, int count)
+	{
+		mBits |= value << mCount;
+		mCount += count;
+		while (mCount >= 8) {
+			mOut.push_back((uint8_t)mBits);
+			mBits >>= 8;
+			mCount -= 8;
+		}
+	}
+
+	//	huffman codes go out most significant bit first
+	void Code(uint32_t code, int count)
+	{
+		uint32_t	rev = 0;
+
+		for (int i = 0; i < count; ++i)
+			rev |= ((code >> i) & 1) << (count - 1 - i);
+		Bits(rev, count);
+	}
+
+	void Literal(int value)
+	{
+		if (value < 144)
+			Code(0x30 + value, 8);
+		else if (value < 256)
+			Code(0x190 + value - 144, 9);
+		else if (value < 280)
+			Code(value - 256, 7);
+		else
+			Code(0xc0 + value - 280, 8);
+	}
+
+	void Match(int length, int distance)
+	{
+		static const int	lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83,
+								99, 115, 131, 163, 195, 227, 258 };
+		static const int	lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		static const int	distBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537,
+								2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		static const int	distExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+		int					l = 28, d = 29;
+
+		while (lengthBase[l] > length)
+			--l;
+		while (distBase[d] > distance)
+			--d;
+		Literal(257 + l);
+		Bits((uint32_t)(length - lengthBase[l]), lengthExtra[l]);
+		Code((uint32_t)d, 5);
+		Bits((uint32_t)(distance - distBase[d]), distExtra[d]);
+	}
+
+public:
+	CDeflate(std::vector<uint8_t> &out) :
+		mOut(out),
+		mBits(0),
+		mCount(0)
+	{
+	}
+
+	//	one final block with the fixed codes, hash chains over 3 byte prefixes in a 32k window
+	void Compress(const uint8_t *data, size_t size)
+	{
+		const int			window = 32768, maxChain = 32, hashSize = 1 << 15;
+		std::vector<int>	head(hashSize, -1), prev(size, -1);
+		size_t				i = 0;
+
+		auto hash = [&](size_t p) { return (int)(((data[p] << 10) ^ (data[p + 1] << 5) ^ data[p + 2]) & (hashSize - 1)); };
+		auto insert = [&](size_t p) {
+			if (p + 2 < size) {
+				int		h = hash(p);
+
+				prev[p] = head[h];
+				head[h] = (int)p;
+			}
+		};
+
+		Bits(1, 1);
+		Bits(1, 2);
+
+		while (i < size) {
+			int		bestLength = 0, bestDistance = 0;
+
+			if (i + 2 < size) {
+				int		candidate = head[hash(i)];
+				int		limit = (int)std::min<size_t>(258, size - i);
+
+				for (int chain = 0; candidate >= 0 && (int)i - candidate <= window && chain < maxChain; ++chain) {
+					int		length = 0;
+
+					while (length < limit && data[candidate + length] == data[i + length])
+						++length;
+					if (length > bestLength) {
+						bestLength = length;
+						bestDistance = (int)i - candidate;
+						if (length == limit)
+							break;
+					}
+					candidate = prev[candidate];
+				}
+			}
+
+			if (bestLength >= 3) {
+				Match(bestLength, bestDistance);
+				for (int k = 0; k < bestLength; ++k)
+					insert(i + k);
+				i += bestLength;
+			}
+			else {
+				Literal(data[i]);
+				insert(i);
+				++i;
+			}
+		}
+
+		Literal(256);
+		if (mCount > 0)
+			Bits(0, 8 - mCount);
+	}
+};
+
+struct SCrcTable
+{
+	uint32_t	table[256];
+
+	SCrcTable()
+	{
+		for (uint32_t n = 0; n < 256; ++n) {
+			uint32_t	c = n;
+
+			for (int k = 0; k < 8; ++k)
+				c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+	}
+};
+
+inline uint32_t Crc32(const uint8_t *data, size_t size, uint32_t crc = 0)
+{
+	static const SCrcTable	crcTable;		//	thread safe initialization, files are written in parallel
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i)
+		crc = crcTable.table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+
+	return ~crc;
+}
+
+inline uint32_t Adler32(const uint8_t *data, size_t size)
+{
+	uint32_t	a = 1, b = 0;
+
+	for (size_t i = 0; i < size; ) {
+		size_t		end = std::min(size, i + 5552);
+
+		for (; i < end; ++i) {
+			a += data[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+
+	return (b << 16) | a;
+}
+
+inline void PutBE32(std::vector<uint8_t> &out, uint32_t v)
+{
+	out.push_back((uint8_t)(v >> 24));
+	out.push_back((uint8_t)(v >> 16));
+	out.push_back((uint8_t)(v >> 8));
+	out.push_back((uint8_t)v);
+}
+
+inline void PngChunk(std::vector<uint8_t> &out, const char *type, const std::vector<uint8_t> &data)
+{
+	size_t		start;
+
+	PutBE32(out, (uint32_t)data.size());
+	start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data.begin(), data.end());
+	PutBE32(out, Crc32(&out[start], out.size() - start));
+}
+
+inline void EncodePng(const SImage &image, std::vector<uint8_t> &out)
+{
+	static const uint8_t	signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	size_t					stride = image.width * 4;
+	std::vector<uint8_t>	header, raw, z;
+	std::vector<uint8_t>	candidate[5];
+
+	PutBE32(header, (uint32_t)image.width);
+	PutBE32(header, (uint32_t)image.height);
+	header.push_back(8);				//	bit depth
+	header.push_back(6);				//	RGBA
+	header.push_back(0);
+	header.push_back(0);
+	header.push_back(0);
+
+	raw.reserve((stride + 1) * image.height);
+	for (int f = 0; f < 5; ++f)
+		candidate[f].resize(stride);
+
+	for (size_t y = 0; y < image.height; ++y) {
+		const uint8_t	*row = &image.rgba[y * stride];
+		const uint8_t	*up = y > 0 ? row - stride : NULL;
+		int				best = 0;
+		long			bestCost = -1;
+
+		for (size_t i = 0; i < stride; ++i) {
+			int		a = i >= 4 ? row[i - 4] : 0;
+			int		b = up != NULL ? up[i] : 0;
+			int		c = i >= 4 && up != NULL ? up[i - 4] : 0;
+			int		p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+
+			candidate[0][i] = row[i];
+			candidate[1][i] = (uint8_t)(row[i] - a);
+			candidate[2][i] = (uint8_t)(row[i] - b);
+			candidate[3][i] = (uint8_t)(row[i] - ((a + b) >> 1));
+			candidate[4][i] = (uint8_t)(row[i] - (pa <= pb && pa <= pc ? a : pb <= pc ? b : c));
+		}
+		for (int f = 0; f < 5; ++f) {
+			long	cost = 0;
+
+			for (size_t i = 0; i < stride; ++i)
+				cost += candidate[f][i] < 128 ? candidate[f][i] : 256 - candidate[f][i];
+			if (bestCost < 0 || cost < bestCost) {
+				bestCost = cost;
+				best = f;
+			}
+		}
+		raw.push_back((uint8_t)best);
+		raw.insert(raw.end(), candidate[best].begin(), candidate[best].end());
+	}
+
+	z.push_back(0x78);
+	z.push_back(0x01);
+	CDeflate(z).Compress(raw.data(), raw.size());
+	PutBE32(z, Adler32(raw.data(), raw.size()));
+
+	out.assign(signature, signature + 8);
+	PngChunk(out, "IHDR", header);
+	PngChunk(out, "IDAT", z);
+	PngChunk(out, "IEND", std::vector<uint8_t>());
+}
+
+inline void EncodeTiff(const SImage &image, std::vector<uint8_t> &out)
+{
+	struct SEntry { uint16_t tag, type; uint32_t count, value; };
+
+	uint32_t	pixels = (uint32_t)(image.width * image.height * 4);
+	uint32_t	bitsOffset = 8, dataOffset = 16;
+	uint32_t	ifdOffset = dataOffset + pixels + (pixels & 1);
+	SEntry		entries[] = {
+		{ 256, 4, 1, (uint32_t)image.width },		//	ImageWidth
+		{ 257, 4, 1, (uint32_t)image.height },		//	ImageLength
+		{ 258, 3, 4, bitsOffset },					//	BitsPerSample 8,8,8,8
+		{ 259, 3, 1, 1 },							//	no compression
+		{ 262, 3, 1, 2 },							//	RGB
+		{ 273, 4, 1, dataOffset },					//	StripOffsets
+		{ 277, 3, 1, 4 },							//	SamplesPerPixel
+		{ 278, 4, 1, (uint32_t)image.height },		//	RowsPerStrip
+		{ 279, 4, 1, pixels },						//	StripByteCounts
+		{ 284, 3, 1, 1 },							//	chunky
+		{ 338, 3, 1, 2 }							//	ExtraSamples: unassociated alpha
+	};
+	uint16_t	numEntries = (uint16_t)(sizeof(entries) / sizeof(entries[0]));
+
+	auto put16 = [&](uint16_t v) { out.push_back((uint8_t)v); out.push_back((uint8_t)(v >> 8)); };
+	auto put32 = [&](uint32_t v) { put16((uint16_t)v); put16((uint16_t)(v >> 16)); };
+
+	out.clear();
+	out.push_back('I');
+	out.push_back('I');
+	put16(42);
+	put32(ifdOffset);
+	for (int i = 0; i < 4; ++i)
+		put16(8);
+	out.insert(out.end(), image.rgba.begin(), image.rgba.end());
+	if (pixels & 1)
+		out.push_back(0);
+
+	put16(numEntries);
+	for (uint16_t i = 0; i < numEntries; ++i) {
+		put16(entries[i].tag);
+		put16(entries[i].type);
+		put32(entries[i].count);
+		//	short values are left justified in the value field
+		if (entries[i].type == 3 && entries[i].count == 1) {
+			put16((uint16_t)entries[i].value);
+			put16(0);
+		}
+		else
+			put32(entries[i].value);
+	}
+	put32(0);
+}
+
+//	format from the extension: .tif / .tiff, anything else is PNG
+inline bool WriteImage(const std::string &fileName, const SImage &image)
+{
+	std::vector<uint8_t>	out;
+	size_t					dot = fileName.find_last_of('.');
+	std::string				ext = dot == std::string::npos ? "" : fileName.substr(dot + 1);
+
+	for (size_t i = 0; i < ext.size(); ++i)
+		ext[i] = (char)tolower((unsigned char)ext[i]);
+
+	if (ext == "tif" || ext == "tiff")
+		EncodeTiff(image, out);
+	else
+		EncodePng(image, out);
+
+	FILE	*fp = fopen(fileName.c_str(), "wb");
+
+	if (fp == NULL)
+		return false;
+
+	bool	ok = fwrite(out.data(), 1, out.size(), fp) == out.size();
+
+	return fclose(fp) == 0 && ok;
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include "tc.file/tc.file.h"
+#include "ThermoPipeline.h"
+#include "ThermoKernels.h"
+#include <string>
+#include <cmath>
+#include <cstdlib>
+
+//	ATS (FLIR file sdk) frames as a source of the streaming graph
+//
+//	frames are decoded in the requested unit and turned column major as they are read (by ThermoKernels.h for 16 bit
+//	and float data), the time of each frame comes from the Time entry of the frame info (day:hh:mm:ss.ssssss, as parsed
+//	by TermoAnalizer) relative to the first frame read, or from the frame index and FrameRate when the entry is missing.
+//	blocks are numbered from 0 at the first frame read, like the times, so windows downstream count from there.
+
+class CImagerFileSource : public CFrameSource
+{
+private:
+	tc::file::CImagerFile	mFile;
+	size_t					mRows;
+	size_t					mCols;
+	tc::UInt32				mFirst;				//	first frame to read, block 0
+	tc::UInt32				mNext;
+	tc::UInt32				mEnd;				//	one past the last frame to read
+	double					mStart;
+	double					mFrameRate;
+	bool					mOpen;
+
+	template <typename kind>
+	static void Transpose(float *dest, const kind *src, size_t width, size_t height)
+	{
+		for (size_t y = 0; y < height; ++y)
+			for (size_t x = 0; x < width; ++x)
+				dest[x * height + y] = (float)src[y * width + x];
+	}
+
+	bool Copy(float *dest, tc::STypedData data)
+	{
+		size_t		width = mCols, height = mRows;
+
+		switch (data.Type) {
+			case tc::dtInt8:
+				Transpose(dest, data.pInt8, width, height);
+				break;
+			case tc::dtUInt8:
+				Transpose(dest, data.pUInt8, width, height);
+				break;
+			case tc::dtInt16:
+				Transpose(dest, data.pInt16, width, height);
+				break;
+			case tc::dtUInt16:
+				ThermoKernels().transposeU16(dest, (const uint16_t *)data.pUInt16, width, height);
+				break;
+			case tc::dtInt32:
+				Transpose(dest, data.pInt32, width, height);
+				break;
+			case tc::dtUInt32:
+				Transpose(dest, data.pUInt32, width, height);
+				break;
+			case tc::dtFlt32:
+				ThermoKernels().transposeF32(dest, (const float *)data.pFlt32, width, height);
+				break;
+			case tc::dtFlt64:
+				Transpose(dest, data.pFlt64, width, height);
+				break;
+			default:
+				mError = "Unsupported image data format.";
+				return false;
+		}
+
+		return true;
+	}
+
+	//	seconds of the day from the frame info, NaN when there is no usable Time entry
+	double FrameTime()
+	{
+		tc::reduce::CFrameInfoReduceObjectPtr	frameInfo = mFile.reduceObjects().GetFrameInfo(mFile.preset());
+
+		if (frameInfo == NULL)
+			return NAN;
+		for (tc::UInt32 i = 0; i < frameInfo->NumEntries(); ++i) {
+			if (!frameInfo->GetNameAt(i).EqualsNoCase(L"Time"))
+				continue;
+
+			std::string		value = frameInfo->GetValueAt(i).GetUTF8().c_str();
+			size_t			s = value.rfind(':'), m = s == std::string::npos ? s : value.rfind(':', s - 1);
+			size_t			h = m == std::string::npos || m == 0 ? std::string::npos : value.rfind(':', m - 1);
+
+			if (h == std::string::npos)
+				return NAN;
+
+			return atof(value.substr(h + 1, m - h - 1).c_str()) * 3600.0 + atof(value.substr(m + 1, s - m - 1).c_str()) * 60.0 +
+				atof(value.substr(s + 1).c_str());
+		}
+
+		return NAN;
+	}
+
+public:
+	//	frames first..last (0 based, inclusive, clamped to the movie), frameRate is used when frames carry no time
+	CImagerFileSource(const char *filename, tc::EUnit unit, tc::ETempType tempType, tc::UInt32 first, tc::UInt32 last, double frameRate) :
+		mRows(0),
+		mCols(0),
+		mFirst(first),
+		mNext(first),
+		mEnd(0),
+		mStart(NAN),
+		mFrameRate(frameRate),
+		mOpen(false)
+	{
+		if (!mFile.Open(tc::fileSystem(), tc::CString(tc::CStringA(filename)))) {
+			mError = std::string("Failed to open file: ") + filename + ".";
+			return;
+		}
+		if (!mFile.SetUnit(unit, tempType)) {
+			mError = "SetUnit failed.";
+			return;
+		}
+		mRows = mFile.height();
+		mCols = mFile.width();
+		mEnd = last < mFile.numFrames() ? last + 1 : mFile.numFrames();
+		mOpen = true;
+	}
+
+	bool isOpen() const
+	{
+		return mOpen;
+	}
+
+	size_t rows() const
+	{
+		return mRows;
+	}
+
+	size_t cols() const
+	{
+		return mCols;
+	}
+
+	size_t numFrames() const
+	{
+		return mOpen && mNext < mEnd ? mEnd - mNext : 0;
+	}
+
+	SFrameBlockPtr Read(CBlockAllocator &alloc, size_t maxFrames)
+	{
+		size_t		n = mOpen && mNext < mEnd ? std::min<size_t>(maxFrames, mEnd - mNext) : 0, pixels = rows() * cols();
+
+		if (n == 0)
+			return SFrameBlockPtr();
+
+		std::shared_ptr<SFrameBlock>	block = alloc.Allocate(rows(), cols(), n, (int64_t)(mNext - mFirst));
+
+		for (size_t f = 0; f < n; ++f, ++mNext) {
+			double		t;
+
+			if (!mFile.GetFrame(mNext)) {
+				mError = "GetFrame failed.";
+				return SFrameBlockPtr();
+			}
+			if (!Copy(&block->data[f * pixels], mFile.final()->typedData()))
+				return SFrameBlockPtr();
+
+			t = FrameTime();
+			if (std::isnan(t))
+				t = mFrameRate > 0.0 ? (double)mNext / mFrameRate : (double)mNext;
+			if (std::isnan(mStart))
+				mStart = t;
+			block->time[f] = t - mStart;
+		}
+
+		return block;
+	}
+};
+
+//	unit and temperature type by the names FlirMovieReader uses, tc::unitError and tc::ttError when unknown
+inline tc::EUnit ImagerUnit(const std::string &name)
+{
+	static const struct { const char *name; tc::EUnit unit; }	units[] = {
+		{ "counts",					tc::unitCounts },
+		{ "radianceUser",			tc::unitRadianceUser },
+		{ "temperatureUser",		tc::unitTemperatureUser },
+		{ "objectSignal",			tc::unitObjectSignal },
+		{ "radianceFactory",		tc::unitRadianceFactory },
+		{ "temperatureFactory",		tc::unitTemperatureFactory },
+	};
+
+	for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); ++i)
+		if (name == units[i].name)
+			return units[i].unit;
+
+	return tc::unitError;
+}
+
+inline tc::ETempType ImagerTempType(const std::string &name)
+{
+	static const struct { const char *name; tc::ETempType type; }	types[] = {
+		{ "celsius",				tc::ttCelsius },
+		{ "fahrenheit",				tc::ttFahrenheit },
+		{ "kelvin",					tc::ttKelvin },
+		{ "rankine",				tc::ttRankine },
+	};
+
+	for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i)
+		if (name == types[i].name)
+			return types[i].type;
+
+	return tc::ttError;
+}
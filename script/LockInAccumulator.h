@@ -0,0 +1,173 @@
+#pragma once
+
+#include "ThermoParallel.h"
+#include "ThermoKernels.h"
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+//	streaming multi-frequency lock-in
+//
+//	TermoAnalizer.LockInAmplifier computes, per pixel and for one frequency,
+//		X = mean((T - mean(T)) .* 2cos(2 pi f t)),  Y = mean((T - mean(T)) .* 2sin(2 pi f t))
+//	which only needs running sums: sum(T), sum(T 2cos), sum(T 2sin), sum(2cos), sum(2sin) and the count, since
+//	sum((T - Tm) c) = sum(T c) - Tm sum(c). the accumulator keeps those sums for every requested frequency so all of
+//	them come out of a single pass over the frames, and frames can be pushed in blocks as they are decoded.
+//	each frequency may be restricted to a window of frames (stepped excitation), frames are counted from 0 in push
+//	order. pixel order is whatever the caller uses, the planes keep it.
+
+class CLockInAccumulator
+{
+private:
+	size_t					mNumPixels;
+	std::vector<double>		mFreqs;
+	std::vector<int64_t>	mFirst;			//	per frequency frame window, inclusive
+	std::vector<int64_t>	mLast;
+	int64_t					mNumFrames;
+	std::vector<double>		mSumX;			//	numFreqs planes
+	std::vector<double>		mSumXC;
+	std::vector<double>		mSumXS;
+	std::vector<double>		mSumC;			//	per frequency scalars
+	std::vector<double>		mSumS;
+	std::vector<int64_t>	mCount;
+
+	//	sumX += x, sumXC += x c, sumXS += x s over n samples, float frames through the simd kernel
+	template <typename kind>
+	static void Mac(const kind *x, size_t n, double c, double s, double *sumX, double *sumXC, double *sumXS)
+	{
+		for (size_t p = 0; p < n; ++p) {
+			double		v = (double)x[p];
+
+			sumX[p] += v;
+			sumXC[p] += v * c;
+			sumXS[p] += v * s;
+		}
+	}
+
+	static void Mac(const float *x, size_t n, double c, double s, double *sumX, double *sumXC, double *sumXS)
+	{
+		ThermoKernels().lockInMac(x, n, c, s, sumX, sumXC, sumXS);
+	}
+
+public:
+	CLockInAccumulator(size_t numPixels, const std::vector<double> &freqs) :
+		mNumPixels(numPixels),
+		mFreqs(freqs),
+		mFirst(freqs.size(), 0),
+		mLast(freqs.size(), INT64_MAX),
+		mNumFrames(0),
+		mSumX(freqs.size() * numPixels, 0.0),
+		mSumXC(freqs.size() * numPixels, 0.0),
+		mSumXS(freqs.size() * numPixels, 0.0),
+		mSumC(freqs.size(), 0.0),
+		mSumS(freqs.size(), 0.0),
+		mCount(freqs.size(), 0)
+	{
+	}
+
+	void SetWindow(size_t freq, int64_t first, int64_t last)
+	{
+		mFirst[freq] = first;
+		mLast[freq] = last;
+	}
+
+	//	numFrames frames of numPixels samples each, frame after frame, with their times in seconds
+	template <typename kind>
+	void Push(const kind *frames, const double *times, size_t numFrames)
+	{
+		size_t					numFreqs = mFreqs.size();
+		std::vector<double>		c(numFreqs * numFrames), s(numFreqs * numFrames);
+		std::vector<char>		use(numFreqs * numFrames);
+
+		//	references are the same for every pixel, 0 marks frames outside the window of that frequency
+		for (size_t k = 0; k < numFreqs; ++k) {
+			for (size_t f = 0; f < numFrames; ++f) {
+				int64_t		index = mNumFrames + (int64_t)f;
+				double		w = 2.0 * M_PI * mFreqs[k] * times[f];
+				size_t		i = k * numFrames + f;
+
+				use[i] = index >= mFirst[k] && index <= mLast[k];
+				c[i] = use[i] ? 2.0 * cos(w) : 0.0;
+				s[i] = use[i] ? 2.0 * sin(w) : 0.0;
+				if (use[i]) {
+					mSumC[k] += c[i];
+					mSumS[k] += s[i];
+					++mCount[k];
+				}
+			}
+		}
+
+		//	pixel chunks in parallel, each chunk runs over the whole block so the planes stay in cache
+		ParallelFor(mNumPixels, 4096, [&](size_t begin, size_t end) {
+			for (size_t k = 0; k < numFreqs; ++k) {
+				double		*sumX = &mSumX[k * mNumPixels];
+				double		*sumXC = &mSumXC[k * mNumPixels];
+				double		*sumXS = &mSumXS[k * mNumPixels];
+
+				for (size_t f = 0; f < numFrames; ++f) {
+					size_t			i = k * numFrames + f;
+					const kind		*x = frames + f * mNumPixels;
+					double			ck = c[i], sk = s[i];
+
+					if (use[i])
+						Mac(x + begin, end - begin, ck, sk, sumX + begin, sumXC + begin, sumXS + begin);
+				}
+			}
+		});
+
+		mNumFrames += (int64_t)numFrames;
+	}
+
+	size_t numFreqs() const
+	{
+		return mFreqs.size();
+	}
+
+	double freq(size_t k) const
+	{
+		return mFreqs[k];
+	}
+
+	size_t numPixels() const
+	{
+		return mNumPixels;
+	}
+
+	int64_t count(size_t freq) const
+	{
+		return mCount[freq];
+	}
+
+	//	in-phase and quadrature planes of one frequency, NaN if no frame fell in its window
+	void Result(size_t freq, double *x, double *y, double *amp, double *phase) const
+	{
+		double			n = (double)mCount[freq];
+		const double	*sumX = &mSumX[freq * mNumPixels];
+		const double	*sumXC = &mSumXC[freq * mNumPixels];
+		const double	*sumXS = &mSumXS[freq * mNumPixels];
+
+		for (size_t p = 0; p < mNumPixels; ++p) {
+			double		xp = NAN, yp = NAN;
+
+			if (n > 0) {
+				double		mean = sumX[p] / n;
+
+				xp = (sumXC[p] - mean * mSumC[freq]) / n;
+				yp = (sumXS[p] - mean * mSumS[freq]) / n;
+			}
+			if (x != NULL)
+				x[p] = xp;
+			if (y != NULL)
+				y[p] = yp;
+			if (amp != NULL)
+				amp[p] = sqrt(xp * xp + yp * yp);
+			if (phase != NULL)
+				phase[p] = atan2(yp, xp);
+		}
+	}
+};
@@ -0,0 +1,61 @@
+function res = LockInSweepFile(fileNames, freqs, frames, unit)
+%LockInSweepFile lock-in a piu' frequenze direttamente dal file, senza
+%caricare il cubo in memoria (una sola lettura per file)
+%   fileNames e' il nome di un file ATS o una cell di nomi (una
+%   registrazione per frequenza o gruppo di frequenze)
+%   freqs sono le frequenze [Hz]; con piu' file e' una cell con le
+%   frequenze di ogni file
+%   frames (opzionale) e' [primo ultimo] frame, o una cell con una
+%   finestra per file, ad esempio da FlirMovieReader.findExcitation
+%   unit (opzionale) e' l'unita' del reader, default 'temperatureFactory'
+%   res ha A, P (r x c x numero totale di frequenze), freqs e numSamples,
+%   pronti per LockInSweepMex('fit', res.A, res.P, res.freqs, ...)
+
+if ~iscell(fileNames)
+    fileNames = {fileNames};
+    freqs = {freqs};
+    if exist("frames", "var")
+        frames = {frames};
+    end
+end
+if ~exist("frames", "var") || isempty(frames)
+    frames = repmat({[1 Inf]}, size(fileNames));
+end
+if ~exist("unit", "var")
+    unit = 'temperatureFactory';
+end
+
+res = [];
+for ii = 1:numel(fileNames)
+    v = FlirMovieReader(fileNames{ii});
+    v.unit = unit;
+    [frame, metadata] = step(v, frames{ii}(1)-1);
+    t0 = frameTime(metadata);
+
+    h = LockInSweepMex('new', size(frame,1), size(frame,2), freqs{ii}(:));
+    LockInSweepMex('push', h, frame, 0);
+    while ~isDone(v) && v.frameIndex+1 < frames{ii}(2)
+        [frame, metadata] = step(v);
+        LockInSweepMex('push', h, frame, frameTime(metadata)-t0);
+    end
+    r = LockInSweepMex('result', h);
+    LockInSweepMex('delete', h);
+    delete(v);
+
+    if isempty(res)
+        res = r;
+    else
+        res.A = cat(3, res.A, r.A);
+        res.P = cat(3, res.P, r.P);
+        res.X = cat(3, res.X, r.X);
+        res.Y = cat(3, res.Y, r.Y);
+        res.freqs = [res.freqs; r.freqs];
+        res.numSamples = [res.numSamples; r.numSamples];
+    end
+end
+end
+
+% stesso tempo usato nel costruttore di TermoAnalizer
+function t = frameTime(metadata)
+t = str2double(metadata.Time(5:6))*60*60+str2double(metadata.Time(8:9))*60+str2double(metadata.Time(11:end));
+end
@@ -0,0 +1,265 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "mex.h"
+#include "MexHelpers.h"
+#include "LockInAccumulator.h"
+#include "FrequencySweepFit.h"
+#include "ThermoProfiler.h"
+
+//	mex LockInSweepMex.cpp
+
+//	h = LockInSweepMex('new', rows, cols, freqs, windows)	windows (optional) is numFreqs x 2, 1 based frames [first last]
+//	LockInSweepMex('push', h, frames, t)					frames rows x cols x n (single or double), t n times [s]
+//	res = LockInSweepMex('result', h)						A, P, X, Y as rows x cols x numFreqs
+//	LockInSweepMex('delete', h)
+//	fit = LockInSweepMex('fit', A, P, freqs, xc, yc, mmpxratio, opts)	joint fit, opts as in RadialDiffusivityMex
+
+//	keeps the map size next to the accumulator so results come back with the right shape
+class CMatLockInSweep
+{
+private:
+	size_t					mRows;
+	size_t					mCols;
+	CLockInAccumulator		mAcc;
+
+public:
+	CMatLockInSweep(size_t rows, size_t cols, const std::vector<double> &freqs) :
+		mRows(rows),
+		mCols(cols),
+		mAcc(rows * cols, freqs)
+	{
+	}
+
+	void SetWindow(size_t freq, double first, double last)
+	{
+		mAcc.SetWindow(freq, (int64_t)first - 1, std::isinf(last) ? INT64_MAX : (int64_t)last - 1);
+	}
+
+	void Push(const mxArray *frames, const mxArray *times)
+	{
+		const mwSize	*dims = mxGetDimensions(frames);
+		size_t			numFrames = mxGetNumberOfElements(frames) / (mRows * mCols);
+
+		if (dims[0] != mRows || dims[1] != mCols || numFrames * mRows * mCols != mxGetNumberOfElements(frames))
+			mexErrMsgTxt("Frames do not match the map size.");
+		if (mxGetNumberOfElements(times) != numFrames)
+			mexErrMsgTxt("Need one time per frame.");
+
+		const double	*t = mxGetDoubleInput(times, "t");
+
+		if (mxIsComplex(frames))
+			mexErrMsgTxt("Must not be complex.");
+
+		switch (mxGetClassID(frames)) {
+			case mxDOUBLE_CLASS:
+				mAcc.Push((const double *)mxGetData(frames), t, numFrames);
+				break;
+			case mxSINGLE_CLASS:
+				mAcc.Push((const float *)mxGetData(frames), t, numFrames);
+				break;
+			case mxUINT16_CLASS:
+				mAcc.Push((const uint16_t *)mxGetData(frames), t, numFrames);
+				break;
+			case mxINT16_CLASS:
+				mAcc.Push((const int16_t *)mxGetData(frames), t, numFrames);
+				break;
+			default:
+				mexErrMsgTxt("Unsupported type.");
+				break;
+		}
+	}
+
+	mxArray *result()
+	{
+		const char	*fields[] = { "A", "P", "X", "Y", "freqs", "numSamples" };
+		mxArray		*ret = mxCreateStructMatrix(1, 1, sizeof(fields) / sizeof(fields[0]), fields);
+		mwSize		dims[3] = { mRows, mCols, mAcc.numFreqs() };
+		mxArray		*amp = mxCreateNumericArray(3, dims, mxDOUBLE_CLASS, mxREAL);
+		mxArray		*phase = mxCreateNumericArray(3, dims, mxDOUBLE_CLASS, mxREAL);
+		mxArray		*x = mxCreateNumericArray(3, dims, mxDOUBLE_CLASS, mxREAL);
+		mxArray		*y = mxCreateNumericArray(3, dims, mxDOUBLE_CLASS, mxREAL);
+		mxArray		*freqs = mxCreateDoubleMatrix(mAcc.numFreqs(), 1, mxREAL);
+		mxArray		*count = mxCreateDoubleMatrix(mAcc.numFreqs(), 1, mxREAL);
+		size_t		n = mRows * mCols;
+
+		for (size_t k = 0; k < mAcc.numFreqs(); ++k) {
+			mAcc.Result(k, mxGetPr(x) + k * n, mxGetPr(y) + k * n, mxGetPr(amp) + k * n, mxGetPr(phase) + k * n);
+			mxGetPr(freqs)[k] = mAcc.freq(k);
+			mxGetPr(count)[k] = (double)mAcc.count(k);
+		}
+
+		mxSetFieldByNumber(ret, 0, 0, amp);
+		mxSetFieldByNumber(ret, 0, 1, phase);
+		mxSetFieldByNumber(ret, 0, 2, x);
+		mxSetFieldByNumber(ret, 0, 3, y);
+		mxSetFieldByNumber(ret, 0, 4, freqs);
+		mxSetFieldByNumber(ret, 0, 5, count);
+
+		return ret;
+	}
+};
+
+static std::vector<double> GetFreqs(const mxArray *ar)
+{
+	const double	*data = mxGetDoubleInput(ar, "freqs");
+	size_t			n = mxGetNumberOfElements(ar);
+
+	if (n == 0)
+		mexErrMsgTxt("Need at least one frequency.");
+	for (size_t k = 0; k < n; ++k)
+		if (!(data[k] > 0.0))
+			mexErrMsgTxt("Frequencies must be positive.");
+
+	return std::vector<double>(data, data + n);
+}
+
+static mxArray *Fit(int nrhs, const mxArray *prhs[])
+{
+	if (nrhs < 7 || nrhs > 8)
+		mexErrMsgTxt("Must have 7-8 inputs.");
+
+	const double			*amp = mxGetDoubleInput(prhs[1], "A");
+	const double			*phase = mxGetDoubleInput(prhs[2], "P");
+	std::vector<double>		freqs = GetFreqs(prhs[3]);
+	size_t					rows = mxGetM(prhs[1]);
+	size_t					cols = freqs.empty() ? 0 : mxGetNumberOfElements(prhs[1]) / (rows * freqs.size());
+	const mxArray			*opts = nrhs > 7 ? prhs[7] : NULL;
+	SRadialParams			params;
+
+	if (rows * cols * freqs.size() != mxGetNumberOfElements(prhs[1]) || mxGetNumberOfElements(prhs[2]) != mxGetNumberOfElements(prhs[1]))
+		mexErrMsgTxt("A and P must be rows x cols x numFreqs.");
+
+	params.xc = mxGetScalarInput(prhs[4], "xc") - 1.0;
+	params.yc = mxGetScalarInput(prhs[5], "yc") - 1.0;
+	params.mmpx = mxGetScalarInput(prhs[6], "mmpxratio");
+	params.step = mxGetOption(opts, "step", 0.5);
+	params.numRays = (size_t)mxGetOption(opts, "numRays", 180.0);
+	params.tol = mxGetOption(opts, "tol", 0.0);
+	params.rStart = mxGetOption(opts, "rStart", 0.0);
+	params.rEnd = mxGetOption(opts, "rEnd", params.mmpx * std::min(std::min(params.xc, (double)cols - 1.0 - params.xc),
+		std::min(params.yc, (double)rows - 1.0 - params.yc)));
+
+	std::vector<CRadialDiffusivity>		sweep(freqs.size());
+	SSweepFit							fit;
+	size_t								n = rows * cols;
+
+	for (size_t k = 0; k < freqs.size(); ++k) {
+		params.freq = freqs[k];
+		if (!sweep[k].Run(phase + k * n, amp + k * n, rows, cols, params))
+			mexErrMsgTxt("Invalid fit range or sampling parameters.");
+	}
+
+	if (!FitFrequencySweep(sweep, freqs, fit))
+		mexErrMsgTxt("Sweep fit failed.");
+
+	const char	*fields[] = { "D", "slope", "R2", "angle", "Dray", "slopeRay", "R2ray", "freqs", "Dfreq", "ellipse", "ellipseFreq" };
+	mxArray		*ret = mxCreateStructMatrix(1, 1, sizeof(fields) / sizeof(fields[0]), fields);
+	size_t		numRays = fit.rays.size();
+	mxArray		*angle = mxCreateDoubleMatrix(numRays, 1, mxREAL);
+	mxArray		*dRay = mxCreateDoubleMatrix(numRays, 1, mxREAL);
+	mxArray		*slopeRay = mxCreateDoubleMatrix(numRays, 1, mxREAL);
+	mxArray		*r2Ray = mxCreateDoubleMatrix(numRays, 1, mxREAL);
+	const char	*ellipseFields[] = { "valid", "Dmax", "Dmin", "theta", "Dx", "Dy", "R2" };
+	mxArray		*ellipseFreq = mxCreateStructMatrix(freqs.size(), 1, sizeof(ellipseFields) / sizeof(ellipseFields[0]), ellipseFields);
+
+	for (size_t r = 0; r < numRays; ++r) {
+		mxGetPr(angle)[r] = fit.rays[r].angle;
+		mxGetPr(dRay)[r] = fit.rays[r].d;
+		mxGetPr(slopeRay)[r] = fit.rays[r].slope;
+		mxGetPr(r2Ray)[r] = fit.rays[r].r2;
+	}
+
+	for (size_t k = 0; k <= freqs.size(); ++k) {
+		const SAnisotropy	&an = k < freqs.size() ? sweep[k].anisotropy() : fit.ellipse;
+		mxArray				*dest = ellipseFreq;
+		size_t				index = k;
+
+		//	the last round fills the joint ellipse
+		if (k == freqs.size()) {
+			dest = mxCreateStructMatrix(1, 1, sizeof(ellipseFields) / sizeof(ellipseFields[0]), ellipseFields);
+			index = 0;
+			mxSetFieldByNumber(ret, 0, 9, dest);
+		}
+		mxSetFieldByNumber(dest, index, 0, mxCreateLogicalScalar(an.valid));
+		mxSetFieldByNumber(dest, index, 1, mxCreateDoubleScalar(an.dMax));
+		mxSetFieldByNumber(dest, index, 2, mxCreateDoubleScalar(an.dMin));
+		mxSetFieldByNumber(dest, index, 3, mxCreateDoubleScalar(an.theta));
+		mxSetFieldByNumber(dest, index, 4, mxCreateDoubleScalar(an.dx));
+		mxSetFieldByNumber(dest, index, 5, mxCreateDoubleScalar(an.dy));
+		mxSetFieldByNumber(dest, index, 6, mxCreateDoubleScalar(an.r2));
+	}
+
+	mxSetFieldByNumber(ret, 0, 0, mxCreateDoubleScalar(fit.d));
+	mxSetFieldByNumber(ret, 0, 1, mxCreateDoubleScalar(fit.slope));
+	mxSetFieldByNumber(ret, 0, 2, mxCreateDoubleScalar(fit.r2));
+	mxSetFieldByNumber(ret, 0, 3, angle);
+	mxSetFieldByNumber(ret, 0, 4, dRay);
+	mxSetFieldByNumber(ret, 0, 5, slopeRay);
+	mxSetFieldByNumber(ret, 0, 6, r2Ray);
+	mxSetFieldByNumber(ret, 0, 7, mxCreateDoubleColumn(freqs));
+	mxSetFieldByNumber(ret, 0, 8, mxCreateDoubleColumn(fit.freqD));
+	mxSetFieldByNumber(ret, 0, 10, ellipseFreq);
+
+	return ret;
+}
+
+//	the mex entry point
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	char				command[64];
+	CMatLockInSweep		*sweep;
+
+	if (nrhs < 1 || mxGetString(prhs[0], command, sizeof(command)) != 0)
+		mexErrMsgTxt("First argument must be a command string.");
+
+	if (strcmp(command, "new") == 0) {
+		if (nlhs != 1 || nrhs < 4 || nrhs > 5)
+			mexErrMsgTxt("Must have 4-5 inputs and 1 output.");
+
+		std::vector<double>		freqs = GetFreqs(prhs[3]);
+
+		sweep = new CMatLockInSweep((size_t)mxGetScalarInput(prhs[1], "rows"), (size_t)mxGetScalarInput(prhs[2], "cols"), freqs);
+		if (nrhs > 4 && !mxIsEmpty(prhs[4])) {
+			const double	*windows = mxGetDoubleInput(prhs[4], "windows");
+
+			if (mxGetM(prhs[4]) != freqs.size() || mxGetN(prhs[4]) != 2) {
+				delete sweep;
+				mexErrMsgTxt("windows must be numFreqs x 2.");
+			}
+			for (size_t k = 0; k < freqs.size(); ++k)
+				sweep->SetWindow(k, windows[k], windows[k + freqs.size()]);
+		}
+		plhs[0] = WrapObject(sweep);
+		return;
+	}
+
+	if (strcmp(command, "fit") == 0) {
+		if (nlhs > 1)
+			mexErrMsgTxt("Must have 0-1 outputs.");
+		plhs[0] = Fit(nrhs, prhs);
+		return;
+	}
+
+	if (nrhs < 2)
+		mexErrMsgTxt("Second argument must be a handle.");
+
+	sweep = GetObject<CMatLockInSweep>(prhs[1]);		//	won't get past here if GetObject fails
+
+	if (strcmp(command, "delete") == 0) {
+		UnwrapObject<CMatLockInSweep>(prhs[1]);
+		delete sweep;
+	} else if (strcmp(command, "push") == 0) {
+		if (nlhs != 0 || nrhs != 4)
+			mexErrMsgTxt("Must have 4 inputs and 0 outputs.");
+
+		CThermoStage	stage("lockin", "LockInSweepMex", (double)mxGetElementSize(prhs[2]) * mxGetNumberOfElements(prhs[2]));
+
+		sweep->Push(prhs[2], prhs[3]);
+	} else if (strcmp(command, "result") == 0) {
+		if (nlhs != 1 || nrhs != 2)
+			mexErrMsgTxt("Must have 2 inputs and 1 outputs.");
+		plhs[0] = sweep->result();
+	} else {
+		mexErrMsgTxt("Unknown command.");
+	}
+}
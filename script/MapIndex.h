@@ -0,0 +1,665 @@
+#pragma once
+
+#include "ThermoParallel.h"
+#include <vector>
+#include <string>
+#include <random>
+#include <fstream>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include <unordered_map>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MAP_INDEX_SSE2
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+//	similarity index of result maps
+//
+//	every processed test is stored as a compact descriptor of its amplitude and phase maps, taken on the disk of
+//	radius R around the spot centre (the largest disk inside the map unless given), so tests recorded with a different
+//	framing or magnification still compare. per map:
+//		grid		the map box-averaged on grid x grid cells over the square around the disk, z-normalised
+//		radial		the mean over radialBins annuli of the disk, z-normalised
+//		zernike		magnitudes of the zernike moments up to zernikeOrder (n >= 1) of the z-normalised map on the disk,
+//					rotation invariant, scaled to unit length
+//	each block is divided by the square root of its size so they weigh the same in the euclidean distance. NaN pixels
+//	(below the amplitude tolerance) are left out. queries scan the descriptors with sse2 in parallel chunks; once the
+//	index holds autoBuild entries (or after Build) an inverted file answers them instead: k-means centroids over the
+//	descriptors, each entry in the list of its nearest centroid, and a query scans only the lists of the probes
+//	nearest centroids. the index lives in one binary file, the inverted file is rebuilt after loading.
+
+struct SMapIndexLayout
+{
+	uint32_t	grid;
+	uint32_t	radialBins;
+	uint32_t	zernikeOrder;
+};
+
+struct SMapMatch
+{
+	size_t		entry;
+	double		distance;
+};
+
+class CMapIndex
+{
+private:
+	struct SEntry
+	{
+		std::string		name;
+		std::string		label;
+	};
+
+	SMapIndexLayout						mLayout;
+	size_t								mDim;				//	padded to 4
+	std::vector<SEntry>					mEntries;
+	std::unordered_map<std::string, size_t>	mByName;
+	std::vector<float>					mData;				//	mDim per entry
+	std::vector<double>					mRadial;			//	zernike radial polynomial coefficients
+	std::vector<float>					mCentroids;			//	inverted file
+	std::vector<std::vector<uint32_t>>	mLists;
+	size_t								mProbes;
+	size_t								mAutoBuild;
+	std::string							mError;
+
+	size_t numZernike() const
+	{
+		size_t		count = 0;
+
+		for (size_t n = 1; n <= mLayout.zernikeOrder; ++n)
+			count += n / 2 + 1;
+
+		return count;
+	}
+
+	size_t mapDim() const
+	{
+		return (size_t)mLayout.grid * mLayout.grid + mLayout.radialBins + numZernike();
+	}
+
+	static void Normalise(float *v, size_t n, const std::vector<char> &valid)
+	{
+		double		sum = 0.0, sum2 = 0.0, count = 0.0;
+
+		for (size_t i = 0; i < n; ++i) {
+			if (valid[i]) {
+				sum += v[i];
+				sum2 += (double)v[i] * v[i];
+				count += 1.0;
+			}
+		}
+
+		double		mean = count > 0.0 ? sum / count : 0.0;
+		double		sd = count > 1.0 ? sqrt(std::max(sum2 / count - mean * mean, 0.0)) : 0.0;
+		double		scale = sd > 0.0 ? 1.0 / sd : 0.0;
+
+		for (size_t i = 0; i < n; ++i)
+			v[i] = valid[i] ? (float)((v[i] - mean) * scale) : 0.0f;
+	}
+
+	//	descriptor of one map into out (mapDim values)
+	void DescribeMap(const double *map, size_t rows, size_t cols, double xc, double yc, double radius, float *out) const
+	{
+		size_t					grid = mLayout.grid, bins = mLayout.radialBins, order = mLayout.zernikeOrder;
+		std::vector<double>		cellSum(grid * grid, 0.0), cellCount(grid * grid, 0.0), binSum(bins, 0.0), binCount(bins, 0.0);
+		double					sum = 0.0, sum2 = 0.0, count = 0.0;
+
+		//	map statistics on the disk, for the z-normalised zernike input
+		for (size_t c = 0; c < cols; ++c) {
+			for (size_t r = 0; r < rows; ++r) {
+				double		v = map[r + c * rows], dx = (double)c - xc, dy = (double)r - yc;
+
+				if (std::isnan(v) || dx * dx + dy * dy >= radius * radius)
+					continue;
+				sum += v;
+				sum2 += v * v;
+				count += 1.0;
+			}
+		}
+
+		double		mean = count > 0.0 ? sum / count : 0.0;
+		double		sd = count > 1.0 ? sqrt(std::max(sum2 / count - mean * mean, 0.0)) : 0.0;
+		double		scale = sd > 0.0 ? 1.0 / sd : 0.0;
+		size_t		nz = numZernike();
+		std::vector<double>		zRe(nz, 0.0), zIm(nz, 0.0), rPow(order + 1), cPow(order + 1), sPow(order + 1);
+
+		for (size_t c = 0; c < cols; ++c) {
+			for (size_t r = 0; r < rows; ++r) {
+				double		v = map[r + c * rows], dx = ((double)c - xc) / radius, dy = ((double)r - yc) / radius;
+
+				if (std::isnan(v) || fabs(dx) >= 1.0 || fabs(dy) >= 1.0)
+					continue;
+
+				size_t		gx = std::min((size_t)((dx + 1.0) * 0.5 * (double)grid), grid - 1);
+				size_t		gy = std::min((size_t)((dy + 1.0) * 0.5 * (double)grid), grid - 1);
+				double		rho = sqrt(dx * dx + dy * dy);
+
+				cellSum[gx * grid + gy] += v;
+				cellCount[gx * grid + gy] += 1.0;
+				if (rho >= 1.0)
+					continue;
+
+				size_t		b = std::min((size_t)(rho * (double)bins), bins - 1);
+				double		z = (v - mean) * scale;
+
+				binSum[b] += v;
+				binCount[b] += 1.0;
+
+				//	e^(-i m theta) by powers of (dx - i dy) / rho
+				double		cr = rho > 0.0 ? dx / rho : 1.0, ci = rho > 0.0 ? -dy / rho : 0.0;
+
+				rPow[0] = 1.0;
+				cPow[0] = 1.0;
+				sPow[0] = 0.0;
+				for (size_t k = 1; k <= order; ++k) {
+					rPow[k] = rPow[k - 1] * rho;
+					cPow[k] = cPow[k - 1] * cr - sPow[k - 1] * ci;
+					sPow[k] = cPow[k - 1] * ci + sPow[k - 1] * cr;
+				}
+
+				const double	*coeff = &mRadial[0];
+				size_t			i = 0;
+
+				for (size_t n = 1; n <= order; ++n) {
+					for (size_t m = n % 2; m <= n; m += 2, ++i) {
+						double		radial = 0.0;
+
+						for (size_t s = 0; s <= (n - m) / 2; ++s)
+							radial += *coeff++ * rPow[n - 2 * s];
+						zRe[i] += z * radial * cPow[m];
+						zIm[i] += z * radial * sPow[m];
+					}
+				}
+			}
+		}
+
+		std::vector<char>	valid(grid * grid);
+		float				*gridOut = out, *radialOut = out + grid * grid, *zernikeOut = radialOut + bins;
+
+		for (size_t i = 0; i < grid * grid; ++i) {
+			valid[i] = cellCount[i] > 0.0;
+			gridOut[i] = valid[i] ? (float)(cellSum[i] / cellCount[i]) : 0.0f;
+		}
+		Normalise(gridOut, grid * grid, valid);
+
+		valid.assign(bins, 0);
+		for (size_t i = 0; i < bins; ++i) {
+			valid[i] = binCount[i] > 0.0;
+			radialOut[i] = valid[i] ? (float)(binSum[i] / binCount[i]) : 0.0f;
+		}
+		Normalise(radialOut, bins, valid);
+
+		double		norm = 0.0;
+		size_t		i = 0;
+
+		for (size_t n = 1; n <= order; ++n) {
+			for (size_t m = n % 2; m <= n; m += 2, ++i) {
+				zernikeOut[i] = (float)((double)(n + 1) * sqrt(zRe[i] * zRe[i] + zIm[i] * zIm[i]));
+				norm += (double)zernikeOut[i] * zernikeOut[i];
+			}
+		}
+		for (i = 0; i < nz; ++i)
+			zernikeOut[i] = norm > 0.0 ? (float)(zernikeOut[i] / sqrt(norm)) : 0.0f;
+
+		//	equal weight per block
+		for (i = 0; i < grid * grid; ++i)
+			gridOut[i] /= (float)grid;
+		for (i = 0; i < bins; ++i)
+			radialOut[i] /= (float)sqrt((double)bins);
+	}
+
+	static float SquaredDistance(const float *a, const float *b, size_t n)
+	{
+		size_t		i = 0;
+		float		sum = 0.0f;
+
+#ifdef MAP_INDEX_SSE2
+		__m128		acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+
+		for (; i + 8 <= n; i += 8) {
+			__m128		d0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+			__m128		d1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+		}
+
+		float		lanes[4];
+
+		_mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+		sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+		for (; i < n; ++i)
+			sum += (a[i] - b[i]) * (a[i] - b[i]);
+
+		return sum;
+	}
+
+	size_t NearestCentroid(const float *v) const
+	{
+		size_t		best = 0;
+		float		bestDist = INFINITY;
+
+		for (size_t c = 0; c < mLists.size(); ++c) {
+			float		d = SquaredDistance(v, &mCentroids[c * mDim], mDim);
+
+			if (d < bestDist) {
+				bestDist = d;
+				best = c;
+			}
+		}
+
+		return best;
+	}
+
+	//	the k nearest of the candidate entries (all when candidates is NULL), chunks in parallel, merged in order
+	void Scan(const float *query, size_t k, const std::vector<uint32_t> *candidates, size_t skip, std::vector<SMapMatch> &matches) const
+	{
+		size_t								count = candidates != NULL ? candidates->size() : mEntries.size();
+		size_t								grain = 1024, numChunks = (count + grain - 1) / grain;
+		std::vector<std::vector<SMapMatch>>	partial(numChunks);
+
+		auto byDistance = [](const SMapMatch &a, const SMapMatch &b) {
+			return a.distance < b.distance || (a.distance == b.distance && a.entry < b.entry);
+		};
+
+		ParallelFor(numChunks, 1, [&](size_t begin, size_t end) {
+			for (size_t chunk = begin; chunk < end; ++chunk) {
+				std::vector<SMapMatch>	&best = partial[chunk];
+
+				for (size_t j = chunk * grain; j < std::min((chunk + 1) * grain, count); ++j) {
+					size_t		e = candidates != NULL ? (size_t)(*candidates)[j] : j;
+
+					if (e == skip)
+						continue;
+
+					SMapMatch	m = { e, (double)SquaredDistance(query, &mData[e * mDim], mDim) };
+
+					if (best.size() < k) {
+						best.push_back(m);
+						std::push_heap(best.begin(), best.end(), byDistance);
+					}
+					else if (byDistance(m, best.front())) {
+						std::pop_heap(best.begin(), best.end(), byDistance);
+						best.back() = m;
+						std::push_heap(best.begin(), best.end(), byDistance);
+					}
+				}
+			}
+		});
+
+		for (size_t c = 0; c < numChunks; ++c)
+			matches.insert(matches.end(), partial[c].begin(), partial[c].end());
+		std::sort(matches.begin(), matches.end(), byDistance);
+		if (matches.size() > k)
+			matches.resize(k);
+		for (size_t i = 0; i < matches.size(); ++i)
+			matches[i].distance = sqrt(matches[i].distance);
+	}
+
+	void SetLayout(const SMapIndexLayout &layout)
+	{
+		mLayout = layout;
+		mDim = (2 * mapDim() + 3) / 4 * 4;
+
+		//	R_nm(rho) = sum_s (-1)^s (n - s)! / (s! ((n + m) / 2 - s)! ((n - m) / 2 - s)!) rho^(n - 2s)
+		mRadial.clear();
+		for (size_t n = 1; n <= layout.zernikeOrder; ++n) {
+			for (size_t m = n % 2; m <= n; m += 2) {
+				for (size_t s = 0; s <= (n - m) / 2; ++s) {
+					double		coeff = std::tgamma((double)(n - s) + 1.0) / (std::tgamma((double)s + 1.0) *
+									std::tgamma((double)((n + m) / 2 - s) + 1.0) * std::tgamma((double)((n - m) / 2 - s) + 1.0));
+
+					mRadial.push_back(s % 2 == 0 ? coeff : -coeff);
+				}
+			}
+		}
+	}
+
+public:
+	CMapIndex(const SMapIndexLayout &layout) :
+		mProbes(0),
+		mAutoBuild(10000)
+	{
+		SetLayout(layout);
+	}
+
+	const SMapIndexLayout &layout() const
+	{
+		return mLayout;
+	}
+
+	size_t dim() const
+	{
+		return mDim;
+	}
+
+	size_t size() const
+	{
+		return mEntries.size();
+	}
+
+	const std::string &name(size_t entry) const
+	{
+		return mEntries[entry].name;
+	}
+
+	const std::string &label(size_t entry) const
+	{
+		return mEntries[entry].label;
+	}
+
+	const float *descriptor(size_t entry) const
+	{
+		return &mData[entry * mDim];
+	}
+
+	//	entry of that name, size() if none
+	size_t Find(const std::string &name) const
+	{
+		auto		it = mByName.find(name);
+
+		return it != mByName.end() ? it->second : mEntries.size();
+	}
+
+	bool built() const
+	{
+		return !mLists.empty();
+	}
+
+	//	queries go through the inverted file from this many entries on, 0 never
+	void SetAutoBuild(size_t entries)
+	{
+		mAutoBuild = entries;
+	}
+
+	//	descriptor (dim() values) of the amplitude and phase maps, column major rows x cols. xc, yc is the 0 based spot
+	//	centre, NaN for the amplitude weighted centroid of the pixels over half the amplitude range, radius [px] the
+	//	disk described, 0 for the largest inside the map
+	bool Describe(const double *amp, const double *phase, size_t rows, size_t cols, double xc, double yc, double radius,
+		std::vector<float> &desc)
+	{
+		if (std::isnan(xc) || std::isnan(yc)) {
+			double		lo = INFINITY, hi = -INFINITY, sx = 0.0, sy = 0.0, sw = 0.0;
+
+			for (size_t p = 0; p < rows * cols; ++p) {
+				if (!std::isnan(amp[p])) {
+					lo = std::min(lo, amp[p]);
+					hi = std::max(hi, amp[p]);
+				}
+			}
+			for (size_t c = 0; c < cols; ++c) {
+				for (size_t r = 0; r < rows; ++r) {
+					double		w = amp[r + c * rows] - 0.5 * (lo + hi);
+
+					if (w > 0.0) {
+						sx += w * (double)c;
+						sy += w * (double)r;
+						sw += w;
+					}
+				}
+			}
+			if (!(sw > 0.0)) {
+				mError = "The amplitude map has no spot.";
+				return false;
+			}
+			xc = sx / sw;
+			yc = sy / sw;
+		}
+		if (!(radius > 0.0))
+			radius = std::min(std::min(xc, (double)cols - 1.0 - xc), std::min(yc, (double)rows - 1.0 - yc));
+		if (!(radius >= 2.0)) {
+			mError = "The spot is too close to the border of the map.";
+			return false;
+		}
+
+		desc.assign(mDim, 0.0f);
+		DescribeMap(amp, rows, cols, xc, yc, radius, desc.data());
+		DescribeMap(phase, rows, cols, xc, yc, radius, desc.data() + mapDim());
+
+		return true;
+	}
+
+	//	adds or replaces the entry of that name
+	void Add(const std::string &name, const std::string &label, const std::vector<float> &desc)
+	{
+		size_t		e = Find(name);
+
+		if (e == mEntries.size()) {
+			SEntry		entry = { name, label };
+
+			mEntries.push_back(entry);
+			mByName[name] = e;
+			mData.insert(mData.end(), desc.begin(), desc.begin() + mDim);
+			if (built())
+				mLists[NearestCentroid(desc.data())].push_back((uint32_t)e);
+		}
+		else {
+			mEntries[e].label = label;
+			std::copy(desc.begin(), desc.begin() + mDim, mData.begin() + e * mDim);
+			if (built()) {
+				for (size_t c = 0; c < mLists.size(); ++c)
+					mLists[c].erase(std::remove(mLists[c].begin(), mLists[c].end(), (uint32_t)e), mLists[c].end());
+				mLists[NearestCentroid(desc.data())].push_back((uint32_t)e);
+			}
+		}
+	}
+
+	//	false if there is no such entry. the inverted file is dropped, entries after it move down by one
+	bool Remove(const std::string &name)
+	{
+		size_t		e = Find(name);
+
+		if (e == mEntries.size())
+			return false;
+		mEntries.erase(mEntries.begin() + e);
+		mByName.erase(name);
+		for (auto &it : mByName)
+			if (it.second > e)
+				--it.second;
+		mData.erase(mData.begin() + e * mDim, mData.begin() + (e + 1) * mDim);
+		mCentroids.clear();
+		mLists.clear();
+
+		return true;
+	}
+
+	//	k-means inverted file of numLists lists (0 for sqrt(size())), probes lists per query (0 for an eighth). the
+	//	centroids are trained on at most 64 entries per list, then every entry goes to the list of its nearest one
+	bool Build(size_t numLists, size_t probes, size_t iterations = 10)
+	{
+		size_t		n = mEntries.size();
+
+		if (numLists == 0)
+			numLists = (size_t)sqrt((double)n);
+		numLists = std::min(numLists, n);
+		if (numLists == 0) {
+			mError = "The index is empty.";
+			return false;
+		}
+		mProbes = probes > 0 ? std::min(probes, numLists) : std::max<size_t>(1, numLists / 8);
+
+		//	fixed seed, a rebuild gives the same lists
+		std::mt19937				rng(1);
+		std::vector<uint32_t>		train(n);
+
+		for (size_t e = 0; e < n; ++e)
+			train[e] = (uint32_t)e;
+		std::shuffle(train.begin(), train.end(), rng);
+		train.resize(std::min(n, 64 * numLists));
+
+		//	k-means++ seeding
+		size_t					numTrain = train.size();
+		std::vector<float>		nearest(numTrain, INFINITY);
+		std::vector<uint32_t>	assign(numTrain, 0);
+
+		mCentroids.assign(numLists * mDim, 0.0f);
+		std::copy(descriptor(train[0]), descriptor(train[0]) + mDim, &mCentroids[0]);
+		for (size_t c = 1; c < numLists; ++c) {
+			ParallelFor(numTrain, 256, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i)
+					nearest[i] = std::min(nearest[i], SquaredDistance(descriptor(train[i]), &mCentroids[(c - 1) * mDim], mDim));
+			});
+
+			double		total = 0.0;
+
+			for (size_t i = 0; i < numTrain; ++i)
+				total += nearest[i];
+
+			double		pick = std::uniform_real_distribution<double>(0.0, total)(rng);
+			size_t		i = 0;
+
+			for (; i + 1 < numTrain && pick > nearest[i]; ++i)
+				pick -= nearest[i];
+			std::copy(descriptor(train[i]), descriptor(train[i]) + mDim, &mCentroids[c * mDim]);
+		}
+
+		mLists.assign(numLists, std::vector<uint32_t>());
+		for (size_t it = 0; it < iterations; ++it) {
+			ParallelFor(numTrain, 64, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i)
+					assign[i] = (uint32_t)NearestCentroid(descriptor(train[i]));
+			});
+
+			std::vector<double>		sums(numLists * mDim, 0.0);
+			std::vector<size_t>		counts(numLists, 0);
+
+			for (size_t i = 0; i < numTrain; ++i) {
+				const float		*v = descriptor(train[i]);
+				double			*sum = &sums[assign[i] * mDim];
+
+				for (size_t d = 0; d < mDim; ++d)
+					sum[d] += v[d];
+				++counts[assign[i]];
+			}
+			for (size_t c = 0; c < numLists; ++c)
+				if (counts[c] > 0)
+					for (size_t d = 0; d < mDim; ++d)
+						mCentroids[c * mDim + d] = (float)(sums[c * mDim + d] / (double)counts[c]);
+		}
+
+		std::vector<uint32_t>	list(n);
+
+		ParallelFor(n, 64, [&](size_t begin, size_t end) {
+			for (size_t e = begin; e < end; ++e)
+				list[e] = (uint32_t)NearestCentroid(descriptor(e));
+		});
+		for (size_t e = 0; e < n; ++e)
+			mLists[list[e]].push_back((uint32_t)e);
+
+		return true;
+	}
+
+	//	k nearest entries of the descriptor, skip leaves one entry out (a query by an entry of the index), exact scans
+	//	every entry even when the inverted file exists
+	void Search(const std::vector<float> &desc, size_t k, size_t skip, bool exact, std::vector<SMapMatch> &matches)
+	{
+		matches.clear();
+		if (k == 0)
+			return;
+		if (!exact && !built() && mAutoBuild > 0 && mEntries.size() >= mAutoBuild)
+			Build(0, 0);
+		if (exact || !built()) {
+			Scan(desc.data(), k, NULL, skip, matches);
+			return;
+		}
+
+		std::vector<SMapMatch>		lists;
+		std::vector<uint32_t>		candidates;
+
+		for (size_t c = 0; c < mLists.size(); ++c) {
+			SMapMatch	m = { c, (double)SquaredDistance(desc.data(), &mCentroids[c * mDim], mDim) };
+
+			lists.push_back(m);
+		}
+		std::partial_sort(lists.begin(), lists.begin() + mProbes, lists.end(), [](const SMapMatch &a, const SMapMatch &b) {
+			return a.distance < b.distance;
+		});
+		for (size_t i = 0; i < mProbes; ++i)
+			candidates.insert(candidates.end(), mLists[lists[i].entry].begin(), mLists[lists[i].entry].end());
+		Scan(desc.data(), k, &candidates, skip, matches);
+	}
+
+	bool Save(const std::string &fileName)
+	{
+		std::ofstream	file(fileName, std::ios::binary | std::ios::trunc);
+		uint32_t		header[5] = { mLayout.grid, mLayout.radialBins, mLayout.zernikeOrder, (uint32_t)mDim, (uint32_t)mEntries.size() };
+
+		if (!file) {
+			mError = "Cannot write " + fileName + ".";
+			return false;
+		}
+		file.write("MAPIDX1", 8);
+		file.write((const char *)header, sizeof(header));
+		for (size_t e = 0; e < mEntries.size(); ++e) {
+			uint32_t	lengths[2] = { (uint32_t)mEntries[e].name.size(), (uint32_t)mEntries[e].label.size() };
+
+			file.write((const char *)lengths, sizeof(lengths));
+			file.write(mEntries[e].name.data(), lengths[0]);
+			file.write(mEntries[e].label.data(), lengths[1]);
+			file.write((const char *)&mData[e * mDim], mDim * sizeof(float));
+		}
+		if (!file) {
+			mError = "Cannot write " + fileName + ".";
+			return false;
+		}
+
+		return true;
+	}
+
+	//	replaces the content with the file, whose layout becomes the layout of the index
+	bool Load(const std::string &fileName)
+	{
+		std::ifstream	file(fileName, std::ios::binary);
+		char			magic[8];
+		uint32_t		header[5];
+
+		if (!file.read(magic, 8) || memcmp(magic, "MAPIDX1", 8) != 0 || !file.read((char *)header, sizeof(header))) {
+			mError = fileName + " is not a map index.";
+			return false;
+		}
+		SMapIndexLayout		layout = { header[0], header[1], header[2] };
+
+		SetLayout(layout);
+		if (mDim != header[3]) {
+			mError = fileName + " is corrupt.";
+			return false;
+		}
+		mEntries.resize(header[4]);
+		mByName.clear();
+		mData.resize((size_t)header[4] * mDim);
+		mCentroids.clear();
+		mLists.clear();
+		for (size_t e = 0; e < mEntries.size(); ++e) {
+			uint32_t	lengths[2];
+
+			if (!file.read((char *)lengths, sizeof(lengths))) {
+				mError = fileName + " is truncated.";
+				return false;
+			}
+			mEntries[e].name.resize(lengths[0]);
+			mEntries[e].label.resize(lengths[1]);
+			if (!file.read(&mEntries[e].name[0], lengths[0]) || !file.read(&mEntries[e].label[0], lengths[1]) ||
+				!file.read((char *)&mData[e * mDim], mDim * sizeof(float))) {
+				mError = fileName + " is truncated.";
+				return false;
+			}
+			mByName[mEntries[e].name] = e;
+		}
+
+		return true;
+	}
+
+	const std::string &error() const
+	{
+		return mError;
+	}
+};
@@ -0,0 +1,201 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "mex.h"
+#include "MexHelpers.h"
+#include "MapIndex.h"
+
+//	mex MapIndexMex.cpp
+
+//	h = MapIndexMex('open', file, opts)				loads the index file, or starts an empty one saved there. opts (optional,
+//													new index only): grid (16), radialBins (32), zernikeOrder (8),
+//													autoBuild (10000 entries, 0 never)
+//	MapIndexMex('add', h, name, A, P, opts)			adds (or replaces) the test name with its amplitude and phase maps.
+//													opts (optional): xc, yc (1 based spot centre, default the amplitude
+//													centroid), radius [px] (0, the largest disk in the map), label ('')
+//	res = MapIndexMex('query', h, A, P, k, opts)		the k tests most similar to the maps. opts as for 'add', plus exact
+//	res = MapIndexMex('query', h, name, k, opts)		(false, the inverted file once built) and for a test of the index
+//	MapIndexMex('remove', h, name)
+//	MapIndexMex('build', h, numLists, probes)		inverted file of numLists lists (0, sqrt of the entries), each query
+//													scanning probes of them (0, an eighth)
+//	MapIndexMex('save', h, file)					file optional, the one given to 'open'
+//	info = MapIndexMex('info', h)					count, dim, built, names, labels
+//	MapIndexMex('delete', h)
+//
+//	res is k x 1 with name, label and distance (euclidean, between descriptors, see MapIndex.h), nearest first
+
+class CMatMapIndex
+{
+private:
+	std::string		mFile;
+	CMapIndex		mIndex;
+
+public:
+	CMatMapIndex(const std::string &file, const SMapIndexLayout &layout) :
+		mFile(file),
+		mIndex(layout)
+	{
+	}
+
+	CMapIndex &index()
+	{
+		return mIndex;
+	}
+
+	const std::string &file() const
+	{
+		return mFile;
+	}
+
+	void Describe(const mxArray *amp, const mxArray *phase, const mxArray *opts, std::vector<float> &desc)
+	{
+		size_t		rows = mxGetM(amp), cols = mxGetN(amp);
+		double		xc = mxGetOption(opts, "xc", mxGetNaN()) - 1.0, yc = mxGetOption(opts, "yc", mxGetNaN()) - 1.0;
+
+		if (mxGetNumberOfDimensions(amp) != 2 || mxGetM(phase) != rows || mxGetN(phase) != cols || mxGetNumberOfDimensions(phase) != 2)
+			mexErrMsgTxt("A and P must be rows x cols maps of the same size.");
+		if (!mIndex.Describe(mxGetDoubleInput(amp, "A"), mxGetDoubleInput(phase, "P"), rows, cols, xc, yc,
+			mxGetOption(opts, "radius", 0.0), desc))
+			mexErrMsgTxt(mIndex.error().c_str());
+	}
+
+	mxArray *result(const std::vector<SMapMatch> &matches)
+	{
+		const char		*fields[] = { "name", "label", "distance" };
+		mxArray			*ret = mxCreateStructMatrix(matches.size(), 1, 3, fields);
+
+		for (size_t i = 0; i < matches.size(); ++i) {
+			mxSetFieldByNumber(ret, i, 0, mxCreateString(mIndex.name(matches[i].entry).c_str()));
+			mxSetFieldByNumber(ret, i, 1, mxCreateString(mIndex.label(matches[i].entry).c_str()));
+			mxSetFieldByNumber(ret, i, 2, mxCreateDoubleScalar(matches[i].distance));
+		}
+
+		return ret;
+	}
+
+	mxArray *info()
+	{
+		const char		*fields[] = { "count", "dim", "built", "names", "labels" };
+		mxArray			*ret = mxCreateStructMatrix(1, 1, 5, fields);
+		mxArray			*names = mxCreateCellMatrix(mIndex.size(), 1), *labels = mxCreateCellMatrix(mIndex.size(), 1);
+
+		for (size_t e = 0; e < mIndex.size(); ++e) {
+			mxSetCell(names, e, mxCreateString(mIndex.name(e).c_str()));
+			mxSetCell(labels, e, mxCreateString(mIndex.label(e).c_str()));
+		}
+		mxSetFieldByNumber(ret, 0, 0, mxCreateDoubleScalar((double)mIndex.size()));
+		mxSetFieldByNumber(ret, 0, 1, mxCreateDoubleScalar((double)mIndex.dim()));
+		mxSetFieldByNumber(ret, 0, 2, mxCreateLogicalScalar(mIndex.built()));
+		mxSetFieldByNumber(ret, 0, 3, names);
+		mxSetFieldByNumber(ret, 0, 4, labels);
+
+		return ret;
+	}
+};
+
+//	the mex entry point
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	char			command[64];
+	CMatMapIndex	*index;
+
+	if (nrhs < 1 || mxGetString(prhs[0], command, sizeof(command)) != 0)
+		mexErrMsgTxt("First argument must be a command string.");
+
+	if (strcmp(command, "open") == 0) {
+		if (nlhs != 1 || nrhs < 2 || nrhs > 3)
+			mexErrMsgTxt("Must have 2-3 inputs and 1 output.");
+
+		std::string			file = mxGetStdString(prhs[1], "file");
+		const mxArray		*opts = nrhs > 2 ? prhs[2] : NULL;
+		SMapIndexLayout		layout;
+
+		layout.grid = (uint32_t)mxGetOption(opts, "grid", 16.0);
+		layout.radialBins = (uint32_t)mxGetOption(opts, "radialBins", 32.0);
+		layout.zernikeOrder = (uint32_t)mxGetOption(opts, "zernikeOrder", 8.0);
+		if (layout.grid < 2 || layout.radialBins < 2 || layout.zernikeOrder < 1)
+			mexErrMsgTxt("Need grid and radialBins of 2 or more and a zernikeOrder of 1 or more.");
+
+		index = new CMatMapIndex(file, layout);
+		if (std::ifstream(file).good() && !index->index().Load(file)) {
+			std::string		message = index->index().error();
+
+			delete index;
+			mexErrMsgTxt(message.c_str());
+		}
+		index->index().SetAutoBuild((size_t)mxGetOption(opts, "autoBuild", 10000.0));
+		plhs[0] = WrapObject(index);
+		return;
+	}
+
+	if (nrhs < 2)
+		mexErrMsgTxt("Second argument must be a handle.");
+
+	index = GetObject<CMatMapIndex>(prhs[1]);		//	won't get past here if GetObject fails
+
+	CMapIndex				&idx = index->index();
+	std::vector<float>		desc;
+
+	if (strcmp(command, "delete") == 0) {
+		UnwrapObject<CMatMapIndex>(prhs[1]);
+		delete index;
+	} else if (strcmp(command, "add") == 0) {
+		if (nlhs != 0 || nrhs < 5 || nrhs > 6)
+			mexErrMsgTxt("Must have 5-6 inputs and 0 outputs.");
+
+		const mxArray		*opts = nrhs > 5 ? prhs[5] : NULL;
+
+		index->Describe(prhs[3], prhs[4], opts, desc);
+		idx.Add(mxGetStdString(prhs[2], "name"), mxGetOption(opts, "label", ""), desc);
+	} else if (strcmp(command, "query") == 0) {
+		if (nlhs != 1 || nrhs < 4)
+			mexErrMsgTxt("Must have a name or A and P, k, optional opts, and 1 output.");
+
+		bool			byName = mxIsChar(prhs[2]);
+		size_t			first = byName ? 3 : 4;
+
+		if (nrhs < (int)first + 1 || nrhs > (int)first + 2)
+			mexErrMsgTxt("Must have a name or A and P, k, optional opts, and 1 output.");
+
+		const mxArray			*opts = nrhs > (int)first + 1 ? prhs[first + 1] : NULL;
+		double					numNearest = mxGetScalarInput(prhs[first], "k");
+		std::vector<SMapMatch>	matches;
+
+		if (!(numNearest >= 1.0) || std::isinf(numNearest))
+			mexErrMsgTxt("k must be a finite number, at least 1.");
+
+		size_t					k = (size_t)numNearest, skip = idx.size();
+
+		if (byName) {
+			skip = idx.Find(mxGetStdString(prhs[2], "name"));
+			if (skip == idx.size())
+				mexErrMsgTxt("No such test in the index.");
+			desc.assign(idx.descriptor(skip), idx.descriptor(skip) + idx.dim());
+		}
+		else
+			index->Describe(prhs[2], prhs[3], opts, desc);
+		idx.Search(desc, k, skip, mxGetOption(opts, "exact", 0.0) != 0.0, matches);
+		plhs[0] = index->result(matches);
+	} else if (strcmp(command, "remove") == 0) {
+		if (nlhs != 0 || nrhs != 3)
+			mexErrMsgTxt("Must have 3 inputs and 0 outputs.");
+		if (!idx.Remove(mxGetStdString(prhs[2], "name")))
+			mexErrMsgTxt("No such test in the index.");
+	} else if (strcmp(command, "build") == 0) {
+		if (nlhs != 0 || nrhs < 2 || nrhs > 4)
+			mexErrMsgTxt("Must have 2-4 inputs and 0 outputs.");
+		if (!idx.Build(nrhs > 2 ? (size_t)mxGetScalarInput(prhs[2], "numLists") : 0,
+			nrhs > 3 ? (size_t)mxGetScalarInput(prhs[3], "probes") : 0))
+			mexErrMsgTxt(idx.error().c_str());
+	} else if (strcmp(command, "save") == 0) {
+		if (nlhs != 0 || nrhs < 2 || nrhs > 3)
+			mexErrMsgTxt("Must have 2-3 inputs and 0 outputs.");
+		if (!idx.Save(nrhs > 2 ? mxGetStdString(prhs[2], "file") : index->file()))
+			mexErrMsgTxt(idx.error().c_str());
+	} else if (strcmp(command, "info") == 0) {
+		if (nlhs != 1 || nrhs != 2)
+			mexErrMsgTxt("Must have 2 inputs and 1 outputs.");
+		plhs[0] = index->info();
+	} else {
+		mexErrMsgTxt("Unknown command.");
+	}
+}
@@ -0,0 +1,177 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "mex.h"
+#include "MexHelpers.h"
+#include "MapRenderer.h"
+#include "ThermoParallel.h"
+#include "ThermoProfiler.h"
+
+//	mex MapRenderMex.cpp
+
+//	ok = MapRenderMex(jobs)
+//	renders each element of the struct array jobs to an image file (.png, or .tif / .tiff), files in parallel.
+//	every job has a field file and either
+//		map			2-D map, NaN pixels are transparent. optional fields: palette ('parula', 'jet', 'hot', 'gray',
+//					'ironblack'), clim [lo hi], mmpxratio (axes in mm), zoom, title, xlabel, ylabel, clabel
+//		panels		struct array of stacked line plots with x (vector), y (vector or matrix, one series per column),
+//					title, xlabel, ylabel. optional job fields width and height (default 640 x 640)
+//	without output arguments a file that cannot be written is an error, otherwise ok tells which files were written
+
+SEnumInfo	PaletteEnumInfo[] = {
+	{ "parula",					palParula },
+	{ "jet",					palJet },
+	{ "hot",					palHot },
+	{ "gray",					palGray },
+	{ "ironblack",				palIronBlack },
+	{ NULL,						-1 },
+};
+
+//	everything is copied out of the mxArrays before the workers start, the mex api is not thread safe
+struct SRenderJob
+{
+	std::string					file;
+	bool						isMap;
+	std::vector<double>			map;
+	size_t						rows;
+	size_t						cols;
+	SMapStyle					style;
+	std::vector<SPlotPanel>		panels;
+	size_t						width;
+	size_t						height;
+};
+
+static std::vector<double> CopyDoubles(const mxArray *ar, const char *name)
+{
+	const double	*data = mxGetDoubleInput(ar, name);
+
+	return std::vector<double>(data, data + mxGetNumberOfElements(ar));
+}
+
+static void ParsePanels(const mxArray *panels, std::vector<SPlotPanel> &out)
+{
+	if (!mxIsStruct(panels))
+		mexErrMsgTxt("panels must be a struct array.");
+
+	out.resize(mxGetNumberOfElements(panels));
+	for (size_t p = 0; p < out.size(); ++p) {
+		const mxArray	*x = mxGetField(panels, p, "x");
+		const mxArray	*y = mxGetField(panels, p, "y");
+
+		if (y == NULL)
+			mexErrMsgTxt("Every panel needs a field y.");
+
+		std::vector<double>		yData = CopyDoubles(y, "y");
+		size_t					length = mxGetM(y) == 1 ? mxGetN(y) : mxGetM(y);
+		size_t					numSeries = mxGetM(y) == 1 ? 1 : mxGetN(y);
+		std::vector<double>		xData;
+
+		if (x != NULL && !mxIsEmpty(x)) {
+			xData = CopyDoubles(x, "x");
+			if (xData.size() != length)
+				mexErrMsgTxt("x must have one value per row of y.");
+		}
+		else {
+			for (size_t i = 0; i < length; ++i)
+				xData.push_back((double)(i + 1));
+		}
+
+		for (size_t s = 0; s < numSeries; ++s) {
+			SPlotSeries		series;
+
+			series.x = xData;
+			series.y.assign(yData.begin() + s * length, yData.begin() + (s + 1) * length);
+			out[p].series.push_back(series);
+		}
+		out[p].title = mxGetOption(panels, "title", "", p);
+		out[p].xLabel = mxGetOption(panels, "xlabel", "", p);
+		out[p].yLabel = mxGetOption(panels, "ylabel", "", p);
+	}
+}
+
+static void ParseJob(const mxArray *jobs, size_t index, SRenderJob &job)
+{
+	const mxArray	*map = mxGetField(jobs, index, "map");
+	const mxArray	*panels = mxGetField(jobs, index, "panels");
+
+	job.file = mxGetOption(jobs, "file", "", index);
+	if (job.file.empty())
+		mexErrMsgTxt("Every job needs a file name.");
+
+	job.isMap = map != NULL && !mxIsEmpty(map);
+	if (job.isMap) {
+		const mxArray	*clim = mxGetField(jobs, index, "clim");
+		std::string		palette = mxGetOption(jobs, "palette", "parula", index);
+
+		if (mxGetNumberOfDimensions(map) != 2)
+			mexErrMsgTxt("map must be a 2-D array.");
+		job.map = CopyDoubles(map, "map");
+		job.rows = mxGetM(map);
+		job.cols = mxGetN(map);
+		job.style.palette = (EPalette)ParseEnum(PaletteEnumInfo, palette.c_str());
+		if ((int)job.style.palette < 0)
+			mexErrMsgTxt("Unknown palette.");
+		job.style.lo = job.style.hi = mxGetNaN();
+		if (clim != NULL && !mxIsEmpty(clim)) {
+			if (mxGetNumberOfElements(clim) != 2)
+				mexErrMsgTxt("clim must be [lo hi].");
+			job.style.lo = mxGetDoubleInput(clim, "clim")[0];
+			job.style.hi = mxGetDoubleInput(clim, "clim")[1];
+		}
+		job.style.mmpx = mxGetOption(jobs, "mmpxratio", 0.0, index);
+		job.style.zoom = (int)mxGetOption(jobs, "zoom", 0.0, index);
+		job.style.title = mxGetOption(jobs, "title", "", index);
+		job.style.xLabel = mxGetOption(jobs, "xlabel", job.style.mmpx > 0.0 ? "X [mm]" : "X [px]", index);
+		job.style.yLabel = mxGetOption(jobs, "ylabel", job.style.mmpx > 0.0 ? "Y [mm]" : "Y [px]", index);
+		job.style.cLabel = mxGetOption(jobs, "clabel", "", index);
+	}
+	else if (panels != NULL) {
+		ParsePanels(panels, job.panels);
+		job.width = (size_t)mxGetOption(jobs, "width", 640.0, index);
+		job.height = (size_t)mxGetOption(jobs, "height", 640.0, index);
+	}
+	else
+		mexErrMsgTxt("Every job needs either a map or panels.");
+}
+
+//	the mex entry point
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	if (nrhs != 1 || nlhs > 1)
+		mexErrMsgTxt("Must have 1 input and 0-1 outputs.");
+	if (!mxIsStruct(prhs[0]))
+		mexErrMsgTxt("jobs must be a struct array.");
+
+	CThermoStage		stage("render", "MapRenderMex");
+
+	size_t						numJobs = mxGetNumberOfElements(prhs[0]);
+	std::vector<SRenderJob>		jobs(numJobs);
+	std::vector<char>			ok(numJobs, 0);
+
+	for (size_t k = 0; k < numJobs; ++k)
+		ParseJob(prhs[0], k, jobs[k]);
+
+	ParallelFor(numJobs, 1, [&](size_t begin, size_t end) {
+		for (size_t k = begin; k < end; ++k) {
+			const SRenderJob	&job = jobs[k];
+			SImage				image = job.isMap ? RenderMap(job.map.data(), job.rows, job.cols, job.style) :
+									RenderPlot(job.panels, job.width, job.height);
+
+			ok[k] = WriteImage(job.file, image);
+		}
+	});
+
+	if (nlhs == 0) {
+		for (size_t k = 0; k < numJobs; ++k) {
+			if (!ok[k]) {
+				std::string		msg = "Cannot write " + jobs[k].file + ".";
+
+				mexErrMsgTxt(msg.c_str());
+			}
+		}
+		return;
+	}
+
+	plhs[0] = mxCreateLogicalMatrix(numJobs, 1);
+	for (size_t k = 0; k < numJobs; ++k)
+		mxGetLogicals(plhs[0])[k] = ok[k] != 0;
+}
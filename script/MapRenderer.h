@@ -0,0 +1,464 @@
+#pragma once
+
+#include "ImageWriter.h"
+#include "Palette.h"
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+
+//	headless rendering of maps and line plots
+//
+//	LockinAmplifierResults builds matlab figures (surf + savefig) for every file of a batch, which needs a display and
+//	dominates the batch time. these helpers draw the same content straight into an RGBA image: a colour mapped map
+//	with NaN pixels left transparent, colour bar, axes in mm from mmpxratio and a title, or stacked line plot panels
+//	with axes and labels. text uses a built in 5x7 bitmap font. maps come in matlab column major order and are drawn
+//	like view([0,-90]): first row on top, first column on the left.
+
+static const uint8_t Font5x7[95][7] = {
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	//	space
+	{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 },	//	!
+	{ 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x00 },	//	"
+	{ 0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a },	//	#
+	{ 0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04 },	//	$
+	{ 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 },	//	%
+	{ 0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d },	//	&
+	{ 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00 },	//	'
+	{ 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 },	//	(
+	{ 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 },	//	)
+	{ 0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00 },	//	*
+	{ 0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00 },	//	+
+	{ 0x00, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x08 },	//	,
+	{ 0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00 },	//	-
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c },	//	.
+	{ 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 },	//	/
+	{ 0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e },	//	0
+	{ 0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e },	//	1
+	{ 0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f },	//	2
+	{ 0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e },	//	3
+	{ 0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02 },	//	4
+	{ 0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e },	//	5
+	{ 0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e },	//	6
+	{ 0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },	//	7
+	{ 0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e },	//	8
+	{ 0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c },	//	9
+	{ 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00 },	//	:
+	{ 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x04, 0x08 },	//	;
+	{ 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 },	//	<
+	{ 0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00 },	//	=
+	{ 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 },	//	>
+	{ 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 },	//	?
+	{ 0x0e, 0x11, 0x01, 0x0d, 0x15, 0x15, 0x0e },	//	@
+	{ 0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 },	//	A
+	{ 0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e },	//	B
+	{ 0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e },	//	C
+	{ 0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c },	//	D
+	{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f },	//	E
+	{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10 },	//	F
+	{ 0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f },	//	G
+	{ 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 },	//	H
+	{ 0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e },	//	I
+	{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c },	//	J
+	{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 },	//	K
+	{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f },	//	L
+	{ 0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11 },	//	M
+	{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 },	//	N
+	{ 0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e },	//	O
+	{ 0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10 },	//	P
+	{ 0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d },	//	Q
+	{ 0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11 },	//	R
+	{ 0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e },	//	S
+	{ 0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },	//	T
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e },	//	U
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04 },	//	V
+	{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a },	//	W
+	{ 0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11 },	//	X
+	{ 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04, 0x04 },	//	Y
+	{ 0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f },	//	Z
+	{ 0x07, 0x04, 0x04, 0x04, 0x04, 0x04, 0x07 },	//	[
+	{ 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 },	//	backslash
+	{ 0x1c, 0x04, 0x04, 0x04, 0x04, 0x04, 0x1c },	//	]
+	{ 0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00 },	//	^
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f },	//	_
+	{ 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00 },	//	`
+	{ 0x00, 0x00, 0x0e, 0x01, 0x0f, 0x11, 0x0f },	//	a
+	{ 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1e },	//	b
+	{ 0x00, 0x00, 0x0e, 0x10, 0x10, 0x11, 0x0e },	//	c
+	{ 0x01, 0x01, 0x0d, 0x13, 0x11, 0x11, 0x0f },	//	d
+	{ 0x00, 0x00, 0x0e, 0x11, 0x1f, 0x10, 0x0e },	//	e
+	{ 0x06, 0x09, 0x08, 0x1c, 0x08, 0x08, 0x08 },	//	f
+	{ 0x00, 0x0f, 0x11, 0x11, 0x0f, 0x01, 0x0e },	//	g
+	{ 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11 },	//	h
+	{ 0x04, 0x00, 0x0c, 0x04, 0x04, 0x04, 0x0e },	//	i
+	{ 0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0c },	//	j
+	{ 0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12 },	//	k
+	{ 0x0c, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e },	//	l
+	{ 0x00, 0x00, 0x1a, 0x15, 0x15, 0x11, 0x11 },	//	m
+	{ 0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11 },	//	n
+	{ 0x00, 0x00, 0x0e, 0x11, 0x11, 0x11, 0x0e },	//	o
+	{ 0x00, 0x00, 0x1e, 0x11, 0x1e, 0x10, 0x10 },	//	p
+	{ 0x00, 0x00, 0x0d, 0x13, 0x0f, 0x01, 0x01 },	//	q
+	{ 0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10 },	//	r
+	{ 0x00, 0x00, 0x0f, 0x10, 0x0e, 0x01, 0x1e },	//	s
+	{ 0x08, 0x08, 0x1c, 0x08, 0x08, 0x09, 0x06 },	//	t
+	{ 0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0d },	//	u
+	{ 0x00, 0x00, 0x11, 0x11, 0x11, 0x0a, 0x04 },	//	v
+	{ 0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0a },	//	w
+	{ 0x00, 0x00, 0x11, 0x0a, 0x04, 0x0a, 0x11 },	//	x
+	{ 0x00, 0x00, 0x11, 0x11, 0x0f, 0x01, 0x0e },	//	y
+	{ 0x00, 0x00, 0x1f, 0x02, 0x04, 0x08, 0x1f },	//	z
+	{ 0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02 },	//	{
+	{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },	//	|
+	{ 0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08 },	//	}
+	{ 0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00 }	//	~
+};
+
+struct SMapStyle
+{
+	EPalette		palette;
+	double			lo;					//	colour range, NaN for the finite min / max of the map
+	double			hi;
+	double			mmpx;				//	axis scale [mm/px], 0 for pixel axes
+	int				zoom;				//	screen pixels per map pixel, 0 picks one so the map is about 480 px wide
+	std::string		title;
+	std::string		xLabel;
+	std::string		yLabel;
+	std::string		cLabel;				//	colour bar label
+};
+
+struct SPlotSeries
+{
+	std::vector<double>		x;
+	std::vector<double>		y;			//	NaN breaks the line
+};
+
+struct SPlotPanel
+{
+	std::vector<SPlotSeries>	series;
+	std::string					title;
+	std::string					xLabel;
+	std::string					yLabel;
+};
+
+class CCanvas
+{
+private:
+	SImage		&mImage;
+
+public:
+	CCanvas(SImage &image) :
+		mImage(image)
+	{
+	}
+
+	void Pixel(long x, long y, uint32_t color)
+	{
+		if (x < 0 || y < 0 || x >= (long)mImage.width || y >= (long)mImage.height)
+			return;
+
+		uint8_t		*p = mImage.At((size_t)x, (size_t)y);
+
+		p[0] = (uint8_t)(color >> 24);
+		p[1] = (uint8_t)(color >> 16);
+		p[2] = (uint8_t)(color >> 8);
+		p[3] = (uint8_t)color;
+	}
+
+	void Fill(long x, long y, long w, long h, uint32_t color)
+	{
+		for (long j = y; j < y + h; ++j)
+			for (long i = x; i < x + w; ++i)
+				Pixel(i, j, color);
+	}
+
+	void Rect(long x, long y, long w, long h, uint32_t color)
+	{
+		Fill(x, y, w, 1, color);
+		Fill(x, y + h - 1, w, 1, color);
+		Fill(x, y, 1, h, color);
+		Fill(x + w - 1, y, 1, h, color);
+	}
+
+	void Line(long x0, long y0, long x1, long y1, uint32_t color)
+	{
+		long	dx = labs(x1 - x0), dy = -labs(y1 - y0);
+		long	sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1;
+		long	err = dx + dy;
+
+		for (;;) {
+			Pixel(x0, y0, color);
+			if (x0 == x1 && y0 == y1)
+				break;
+
+			long	e2 = 2 * err;
+
+			if (e2 >= dy) {
+				err += dy;
+				x0 += sx;
+			}
+			if (e2 <= dx) {
+				err += dx;
+				y0 += sy;
+			}
+		}
+	}
+
+	static long TextWidth(const std::string &text, int scale)
+	{
+		return text.empty() ? 0 : (long)(text.size() * 6 - 1) * scale;
+	}
+
+	//	top left corner at x, y. vertical text runs bottom to top starting at x, y (its bottom left corner)
+	void Text(long x, long y, const std::string &text, uint32_t color, int scale = 1, bool vertical = false)
+	{
+		for (size_t k = 0; k < text.size(); ++k) {
+			int			c = (unsigned char)text[k];
+			const uint8_t	*glyph = Font5x7[c >= 32 && c < 127 ? c - 32 : '?' - 32];
+			long		offset = (long)k * 6 * scale;
+
+			for (int row = 0; row < 7; ++row) {
+				for (int col = 0; col < 5; ++col) {
+					if (!(glyph[row] & (0x10 >> col)))
+						continue;
+					if (vertical)
+						Fill(x + row * scale, y - offset - (col + 1) * scale, scale, scale, color);
+					else
+						Fill(x + offset + col * scale, y + row * scale, scale, scale, color);
+				}
+			}
+		}
+	}
+};
+
+//	about maxTicks round values (1, 2, 5 times a power of ten) covering [lo, hi]
+inline std::vector<double> NiceTicks(double lo, double hi, int maxTicks, double &step)
+{
+	std::vector<double>		ticks;
+
+	if (!(hi > lo)) {
+		step = 1.0;
+		ticks.push_back(lo);
+		return ticks;
+	}
+
+	double		raw = (hi - lo) / std::max(maxTicks - 1, 1);
+	double		magnitude = pow(10.0, floor(log10(raw)));
+	double		norm = raw / magnitude;
+
+	step = (norm <= 1.0 ? 1.0 : norm <= 2.0 ? 2.0 : norm <= 5.0 ? 5.0 : 10.0) * magnitude;
+	for (double v = ceil(lo / step - 1e-9) * step; v <= hi + step * 1e-9; v += step)
+		ticks.push_back(fabs(v) < step * 1e-9 ? 0.0 : v);
+
+	return ticks;
+}
+
+inline std::string TickLabel(double value, double step)
+{
+	char	buffer[32];
+	int		decimals = step >= 1.0 ? 0 : (int)ceil(-log10(step) - 1e-9);
+
+	snprintf(buffer, sizeof(buffer), "%.*f", std::min(decimals, 6), value);
+
+	return buffer;
+}
+
+const uint32_t	RenderBlack = 0x000000ff;
+const uint32_t	RenderWhite = 0xffffffff;
+const uint32_t	RenderGrid = 0xdcdcdcff;
+
+//	colour mapped map with colour bar and mm axes
+inline SImage RenderMap(const double *map, size_t rows, size_t cols, const SMapStyle &style)
+{
+	CPalette	palette(style.palette);
+	double		lo = style.lo, hi = style.hi;
+	int			zoom = style.zoom > 0 ? style.zoom : std::max(1, (int)(480 / std::max(cols, (size_t)1)));
+	double		unit = style.mmpx > 0.0 ? style.mmpx : 1.0;
+	long		mapW = (long)cols * zoom, mapH = (long)rows * zoom;
+	long		left = 56, top = style.title.empty() ? 12 : 32, barGap = 16, barW = 16, right = 64, bottom = 40;
+	SImage		image((size_t)(left + mapW + barGap + barW + right), (size_t)(top + mapH + bottom), RenderWhite);
+	CCanvas		canvas(image);
+
+	if (std::isnan(lo) || std::isnan(hi)) {
+		double		mn = INFINITY, mx = -INFINITY;
+
+		for (size_t i = 0; i < rows * cols; ++i) {
+			if (std::isfinite(map[i])) {
+				mn = std::min(mn, map[i]);
+				mx = std::max(mx, map[i]);
+			}
+		}
+		if (std::isnan(lo))
+			lo = mn;
+		if (std::isnan(hi))
+			hi = mx;
+	}
+
+	//	map, NaN pixels fully transparent
+	for (size_t c = 0; c < cols; ++c) {
+		for (size_t r = 0; r < rows; ++r) {
+			int			index = CPalette::Index(map[r + c * rows], lo, hi);
+			uint32_t	color = 0;
+
+			if (index >= 0) {
+				const uint8_t	*rgb = palette.Color(index);
+
+				color = ((uint32_t)rgb[0] << 24) | ((uint32_t)rgb[1] << 16) | ((uint32_t)rgb[2] << 8) | 0xff;
+			}
+			canvas.Fill(left + (long)c * zoom, top + (long)r * zoom, zoom, zoom, color);
+		}
+	}
+	canvas.Rect(left - 1, top - 1, mapW + 2, mapH + 2, RenderBlack);
+
+	//	axes, pixel i covers [i, i + 1) * unit like surf(X, Y, ...) with X = mmpxratio * (1:c)
+	double					step;
+	std::vector<double>		ticks = NiceTicks(unit, unit * (double)cols, 6, step);
+
+	for (size_t k = 0; k < ticks.size(); ++k) {
+		long			x = left + (long)lround((ticks[k] / unit - 1.0) * zoom + 0.5 * zoom);
+		std::string		label = TickLabel(ticks[k], step);
+
+		canvas.Fill(x, top + mapH + 1, 1, 4, RenderBlack);
+		canvas.Text(x - CCanvas::TextWidth(label, 1) / 2, top + mapH + 7, label, RenderBlack);
+	}
+	ticks = NiceTicks(unit, unit * (double)rows, 6, step);
+	for (size_t k = 0; k < ticks.size(); ++k) {
+		long			y = top + (long)lround((ticks[k] / unit - 1.0) * zoom + 0.5 * zoom);
+		std::string		label = TickLabel(ticks[k], step);
+
+		canvas.Fill(left - 5, y, 4, 1, RenderBlack);
+		canvas.Text(left - 8 - CCanvas::TextWidth(label, 1), y - 3, label, RenderBlack);
+	}
+
+	//	colour bar, high values on top
+	long	barX = left + mapW + barGap;
+
+	for (long y = 0; y < mapH; ++y) {
+		const uint8_t	*rgb = palette.Color((int)lround(255.0 * (double)(mapH - 1 - y) / (double)std::max(mapH - 1, 1L)));
+		uint32_t		color = ((uint32_t)rgb[0] << 24) | ((uint32_t)rgb[1] << 16) | ((uint32_t)rgb[2] << 8) | 0xff;
+
+		canvas.Fill(barX, top + y, barW, 1, color);
+	}
+	canvas.Rect(barX - 1, top - 1, barW + 2, mapH + 2, RenderBlack);
+	if (std::isfinite(lo) && std::isfinite(hi)) {
+		ticks = NiceTicks(lo, hi, 6, step);
+		for (size_t k = 0; k < ticks.size(); ++k) {
+			long		y = top + mapH - 1 - (long)lround((ticks[k] - lo) / (hi > lo ? hi - lo : 1.0) * (double)(mapH - 1));
+
+			canvas.Fill(barX + barW, y, 4, 1, RenderBlack);
+			canvas.Text(barX + barW + 7, y - 3, TickLabel(ticks[k], step), RenderBlack);
+		}
+	}
+
+	canvas.Text(left + mapW / 2 - CCanvas::TextWidth(style.title, 2) / 2, 8, style.title, RenderBlack, 2);
+	canvas.Text(left + mapW / 2 - CCanvas::TextWidth(style.xLabel, 1) / 2, top + mapH + 24, style.xLabel, RenderBlack);
+	canvas.Text(6, top + mapH / 2 + CCanvas::TextWidth(style.yLabel, 1) / 2, style.yLabel, RenderBlack, 1, true);
+	canvas.Text(barX + barW + 48, top + mapH / 2 + CCanvas::TextWidth(style.cLabel, 1) / 2, style.cLabel, RenderBlack, 1, true);
+
+	return image;
+}
+
+//	panels stacked vertically, like subplot(n, 1, k)
+inline SImage RenderPlot(const std::vector<SPlotPanel> &panels, size_t width, size_t height)
+{
+	static const uint32_t	colors[] = { 0x0072bdff, 0xd95319ff, 0xedb120ff, 0x7e2f8eff, 0x77ac30ff, 0x4dbeeeff, 0xa2142fff };
+	SImage					image(width, height, RenderWhite);
+	CCanvas					canvas(image);
+	long					panelH = panels.empty() ? 0 : (long)height / (long)panels.size();
+
+	for (size_t p = 0; p < panels.size(); ++p) {
+		const SPlotPanel	&panel = panels[p];
+		long				left = 64, right = 16, top = (long)p * panelH + (panel.title.empty() ? 12 : 32), bottom = 40;
+		long				w = (long)width - left - right, h = (long)(p + 1) * panelH - bottom - top;
+		double				x0 = INFINITY, x1 = -INFINITY, y0 = INFINITY, y1 = -INFINITY;
+
+		if (w < 16 || h < 16)
+			continue;
+
+		for (size_t s = 0; s < panel.series.size(); ++s) {
+			const SPlotSeries	&series = panel.series[s];
+
+			for (size_t i = 0; i < std::min(series.x.size(), series.y.size()); ++i) {
+				if (!std::isfinite(series.x[i]) || !std::isfinite(series.y[i]))
+					continue;
+				x0 = std::min(x0, series.x[i]);
+				x1 = std::max(x1, series.x[i]);
+				y0 = std::min(y0, series.y[i]);
+				y1 = std::max(y1, series.y[i]);
+			}
+		}
+		if (!(x1 >= x0)) {
+			x0 = 0.0;
+			x1 = 1.0;
+			y0 = 0.0;
+			y1 = 1.0;
+		}
+
+		double					xStep, yStep;
+		std::vector<double>		xTicks = NiceTicks(x0, x1, 8, xStep), yTicks = NiceTicks(y0, y1, 6, yStep);
+
+		//	axis limits snapped to the ticks like matlab's auto limits
+		x0 = std::min(x0, floor(x0 / xStep) * xStep);
+		x1 = std::max(x1, ceil(x1 / xStep) * xStep);
+		y0 = std::min(y0, floor(y0 / yStep) * yStep);
+		y1 = std::max(y1, ceil(y1 / yStep) * yStep);
+		if (!(x1 > x0))
+			x1 = x0 + 1.0;
+		if (!(y1 > y0))
+			y1 = y0 + 1.0;
+		xTicks = NiceTicks(x0, x1, 8, xStep);
+		yTicks = NiceTicks(y0, y1, 6, yStep);
+
+		auto sx = [&](double x) { return left + (long)lround((x - x0) / (x1 - x0) * (double)(w - 1)); };
+		auto sy = [&](double y) { return top + h - 1 - (long)lround((y - y0) / (y1 - y0) * (double)(h - 1)); };
+
+		for (size_t k = 0; k < xTicks.size(); ++k) {
+			std::string		label = TickLabel(xTicks[k], xStep);
+			long			x = sx(xTicks[k]);
+
+			canvas.Fill(x, top, 1, h, RenderGrid);
+			canvas.Fill(x, top + h, 1, 4, RenderBlack);
+			canvas.Text(x - CCanvas::TextWidth(label, 1) / 2, top + h + 7, label, RenderBlack);
+		}
+		for (size_t k = 0; k < yTicks.size(); ++k) {
+			std::string		label = TickLabel(yTicks[k], yStep);
+			long			y = sy(yTicks[k]);
+
+			canvas.Fill(left, y, w, 1, RenderGrid);
+			canvas.Fill(left - 5, y, 4, 1, RenderBlack);
+			canvas.Text(left - 8 - CCanvas::TextWidth(label, 1), y - 3, label, RenderBlack);
+		}
+
+		for (size_t s = 0; s < panel.series.size(); ++s) {
+			const SPlotSeries	&series = panel.series[s];
+			uint32_t			color = colors[s % (sizeof(colors) / sizeof(colors[0]))];
+			bool				pen = false;
+			long				px = 0, py = 0;
+
+			for (size_t i = 0; i < std::min(series.x.size(), series.y.size()); ++i) {
+				if (!std::isfinite(series.x[i]) || !std::isfinite(series.y[i])) {
+					pen = false;
+					continue;
+				}
+
+				long	x = sx(series.x[i]), y = sy(series.y[i]);
+
+				if (pen)
+					canvas.Line(px, py, x, y, color);
+				else
+					canvas.Pixel(x, y, color);
+				px = x;
+				py = y;
+				pen = true;
+			}
+		}
+
+		canvas.Rect(left - 1, top - 1, w + 2, h + 2, RenderBlack);
+		canvas.Text(left + w / 2 - CCanvas::TextWidth(panel.title, 2) / 2, top - 24, panel.title, RenderBlack, 2);
+		canvas.Text(left + w / 2 - CCanvas::TextWidth(panel.xLabel, 1) / 2, top + h + 22, panel.xLabel, RenderBlack);
+		canvas.Text(6, top + h / 2 + CCanvas::TextWidth(panel.yLabel, 1) / 2, panel.yLabel, RenderBlack, 1, true);
+	}
+
+	return image;
+}
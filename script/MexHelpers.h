@@ -0,0 +1,195 @@
+#pragma once
+
+#include "mex.h"
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <typeinfo>
+
+//	argument checking, output and handle helpers shared by the mex files
+
+inline void mxCheckRealDouble(const mxArray *ar, const char *name)
+{
+	char	msg[128];
+
+	if (!mxIsDouble(ar) || mxIsComplex(ar)) {
+		snprintf(msg, sizeof(msg), "%s must be a real double array.", name);
+		mexErrMsgTxt(msg);
+	}
+}
+
+inline const double *mxGetDoubleInput(const mxArray *ar, const char *name)
+{
+	mxCheckRealDouble(ar, name);
+
+	return (const double *)mxGetData(ar);
+}
+
+inline double mxGetScalarInput(const mxArray *ar, const char *name)
+{
+	char	msg[128];
+
+	if (!mxIsNumeric(ar) || mxIsComplex(ar) || mxGetNumberOfElements(ar) != 1) {
+		snprintf(msg, sizeof(msg), "%s must be a real scalar.", name);
+		mexErrMsgTxt(msg);
+	}
+
+	return mxGetScalar(ar);
+}
+
+inline std::string mxGetStdString(const mxArray *ar, const char *name)
+{
+	char	msg[128];
+	char	*str;
+
+	if (!mxIsChar(ar)) {
+		snprintf(msg, sizeof(msg), "%s must be a string.", name);
+		mexErrMsgTxt(msg);
+	}
+
+	str = mxArrayToString(ar);
+	std::string		ret(str);
+	mxFree(str);
+
+	return ret;
+}
+
+//	optional fields of an options struct (element index of a struct array), opts may be NULL or []
+inline const mxArray *mxGetOptionField(const mxArray *opts, const char *name, size_t index = 0)
+{
+	if (opts == NULL || mxIsEmpty(opts))
+		return NULL;
+	if (!mxIsStruct(opts))
+		mexErrMsgTxt("Options must be a struct.");
+
+	return index < mxGetNumberOfElements(opts) ? mxGetField(opts, index, name) : NULL;
+}
+
+inline double mxGetOption(const mxArray *opts, const char *name, double def, size_t index = 0)
+{
+	const mxArray	*field = mxGetOptionField(opts, name, index);
+
+	return field == NULL || mxIsEmpty(field) ? def : mxGetScalarInput(field, name);
+}
+
+inline std::string mxGetOption(const mxArray *opts, const char *name, const char *def, size_t index = 0)
+{
+	const mxArray	*field = mxGetOptionField(opts, name, index);
+
+	return field == NULL || mxIsEmpty(field) ? std::string(def) : mxGetStdString(field, name);
+}
+
+inline mxArray *mxCreateDoubleMatrixFrom(const double *data, size_t rows, size_t cols)
+{
+	mxArray		*ret = mxCreateDoubleMatrix(rows, cols, mxREAL);
+
+	if (rows * cols > 0)
+		memcpy(mxGetData(ret), data, rows * cols * sizeof(double));
+
+	return ret;
+}
+
+inline mxArray *mxCreateDoubleColumn(const std::vector<double> &data)
+{
+	return mxCreateDoubleMatrixFrom(data.data(), data.size(), 1);
+}
+
+//	enum parsing, info arrays end with a NULL name and the value returned for unknown names
+struct SEnumInfo
+{
+	const char	*name;
+	int			value;
+};
+
+inline int ParseEnum(SEnumInfo info[], const char *name)
+{
+	int		i = 0;
+
+	while (info[i].name != NULL) {
+		if (_stricmp(info[i].name, name) == 0)
+			return info[i].value;
+		++i;
+	}
+
+	return info[i].value;
+}
+
+inline const char *EnumToString(SEnumInfo info[], int value)
+{
+	int		i = 0;
+
+	while (info[i].name != NULL) {
+		if (info[i].value == value)
+			return info[i].name;
+		++i;
+	}
+
+	return "error";
+}
+
+//	wraps a c++ object into a matlab array
+struct SMatWrapper
+{
+	intptr_t	ptr;
+	size_t		typeLen;
+	char		typeName[];
+};
+
+template <class kind>
+mxArray *WrapObject(kind *obj)
+{
+	const char	*typeName = typeid(kind).name();
+	size_t		typeLen = strlen(typeName) + 1;
+	mxArray		*ret;
+	SMatWrapper	*wrapper;
+
+	ret = mxCreateNumericMatrix(1, sizeof(SMatWrapper) + typeLen, mxUINT8_CLASS, mxREAL);
+	wrapper = (SMatWrapper *)mxGetData(ret);
+
+	wrapper->ptr = (intptr_t)obj;
+	wrapper->typeLen = typeLen;
+	strcpy(wrapper->typeName, typeName);
+
+	mexLock();
+
+	return ret;
+}
+
+template <class kind>
+kind *GetObject(const mxArray *ar)
+{
+	const char	*typeName = typeid(kind).name();
+	size_t		typeLen = strlen(typeName) + 1;
+	SMatWrapper	*wrapper;
+
+	if (mxGetNumberOfElements(ar) != sizeof(SMatWrapper) + typeLen || mxGetClassID(ar) != mxUINT8_CLASS || mxIsComplex(ar))
+		mexErrMsgTxt("Invalid handle.");
+
+	wrapper = (SMatWrapper *)mxGetData(ar);
+
+	if (wrapper->typeLen != typeLen || strcmp(wrapper->typeName, typeName) != 0)
+		mexErrMsgTxt("Invalid handle.");
+
+	return (kind *)wrapper->ptr;
+}
+
+template <class kind>
+void UnwrapObject(const mxArray *ar)
+{
+	const char	*typeName = typeid(kind).name();
+	size_t		typeLen = strlen(typeName) + 1;
+	SMatWrapper	*wrapper;
+
+	if (mxGetNumberOfElements(ar) != sizeof(SMatWrapper) + typeLen || mxGetClassID(ar) != mxUINT8_CLASS || mxIsComplex(ar))
+		mexErrMsgTxt("Invalid handle.");
+
+	wrapper = (SMatWrapper *)mxGetData(ar);
+
+	if (wrapper->typeLen != typeLen || strcmp(wrapper->typeName, typeName) != 0)
+		mexErrMsgTxt("Invalid handle.");
+
+	memset(mxGetData(ar), 0, sizeof(SMatWrapper) + typeLen);
+	mexUnlock();
+}
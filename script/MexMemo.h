@@ -0,0 +1,258 @@
+#pragma once
+
+#include "mex.h"
+#include "ThermoMemo.h"
+
+//	matlab values in the stage cache (ThermoMemo.h)
+//
+//	numeric, logical and char arrays and structs and cells of them are written with their class and size:
+//		kind (uint8: 0 array, 1 struct, 2 cell, 255 empty field or cell), class (uint32), dims (uint32) and the dims
+//		(uint64), then an array's data, a struct's field names (uint32 length and the name) followed by the fields of
+//		every element, or the elements of a cell.
+//	complex and sparse arrays, objects and function handles are not stored. values are written to and read from the
+//	cache file piece by piece, never copied whole, and MemoHashArray hashes the same description, so parameter structs
+//	and whole cubes can be part of a key.
+
+enum EMemoKind
+{
+	mkArray = 0,
+	mkStruct = 1,
+	mkCell = 2,
+	mkEmpty = 255
+};
+
+inline bool MemoPlainArray(const mxArray *ar)
+{
+	return (mxIsNumeric(ar) || mxIsLogical(ar) || mxIsChar(ar)) && !mxIsComplex(ar) && !mxIsSparse(ar);
+}
+
+inline size_t MemoArrayBytes(const mxArray *ar)
+{
+	return mxGetNumberOfElements(ar) * mxGetElementSize(ar);
+}
+
+//	kind, class and dims through fn(data, bytes)
+template <typename kind>
+bool MemoDescribe(const mxArray *ar, const kind &fn)
+{
+	uint8_t			type = ar == NULL ? mkEmpty : mxIsStruct(ar) ? mkStruct : mxIsCell(ar) ? mkCell : mkArray;
+	uint32_t		classId, ndims;
+
+	fn(&type, sizeof(type));
+	if (ar == NULL)
+		return true;
+	if (type == mkArray && !MemoPlainArray(ar))
+		return false;
+	classId = (uint32_t)mxGetClassID(ar);
+	ndims = (uint32_t)mxGetNumberOfDimensions(ar);
+	fn(&classId, sizeof(classId));
+	fn(&ndims, sizeof(ndims));
+	for (uint32_t d = 0; d < ndims; ++d) {
+		uint64_t	dim = (uint64_t)mxGetDimensions(ar)[d];
+
+		fn(&dim, sizeof(dim));
+	}
+	if (type == mkStruct) {
+		uint32_t	numFields = (uint32_t)mxGetNumberOfFields(ar);
+
+		fn(&numFields, sizeof(numFields));
+		for (uint32_t f = 0; f < numFields; ++f) {
+			const char	*name = mxGetFieldNameByNumber(ar, (int)f);
+			uint32_t	length = (uint32_t)strlen(name);
+
+			fn(&length, sizeof(length));
+			fn(name, length);
+		}
+	}
+
+	return true;
+}
+
+//	the whole value through fn(data, bytes), false when some part cannot be stored
+template <typename kind>
+bool MemoWalk(const mxArray *ar, const kind &fn)
+{
+	if (!MemoDescribe(ar, fn))
+		return false;
+	if (ar == NULL)
+		return true;
+	if (mxIsStruct(ar)) {
+		for (size_t e = 0; e < mxGetNumberOfElements(ar); ++e)
+			for (int f = 0; f < mxGetNumberOfFields(ar); ++f)
+				if (!MemoWalk(mxGetFieldByNumber(ar, e, f), fn))
+					return false;
+	}
+	else if (mxIsCell(ar)) {
+		for (size_t e = 0; e < mxGetNumberOfElements(ar); ++e)
+			if (!MemoWalk(mxGetCell(ar, e), fn))
+				return false;
+	}
+	else if (MemoArrayBytes(ar) > 0)
+		fn(mxGetData(ar), MemoArrayBytes(ar));
+
+	return true;
+}
+
+//	the bytes MemoWalk hands out for ar, false when it cannot be stored
+inline bool MemoBytes(const mxArray *ar, size_t &total)
+{
+	total = 0;
+
+	return MemoWalk(ar, [&](const void *data, size_t bytes) {
+		(void)data;
+		total += bytes;
+	});
+}
+
+inline bool MemoHashArray(CMemoHasher &hasher, const mxArray *ar)
+{
+	return MemoWalk(ar, [&](const void *data, size_t bytes) {
+		hasher.Add(data, bytes);
+	});
+}
+
+//	reads what MemoWalk wrote from the cache file, NULL when the bytes are not a value
+class CMemoReader
+{
+private:
+	const FMemoRead		&mSource;
+	size_t				mLeft;				//	bytes not read yet, no array is made larger than that
+
+	bool Read(void *data, size_t bytes)
+	{
+		if (mLeft < bytes || !mSource(data, bytes))
+			return false;
+		mLeft -= bytes;
+
+		return true;
+	}
+
+	template <typename kind>
+	bool Read(kind &value)
+	{
+		return Read(&value, sizeof(value));
+	}
+
+public:
+	CMemoReader(const FMemoRead &source, size_t bytes) :
+		mSource(source),
+		mLeft(bytes)
+	{
+	}
+
+	bool done() const
+	{
+		return mLeft == 0;
+	}
+
+	//	the next value, empty fields and cells come back as NULL with ok true
+	mxArray *Value(bool &ok)
+	{
+		uint8_t					type;
+		uint32_t				classId, ndims;
+		std::vector<mwSize>		dims;
+		size_t					numel = 1;
+		mxArray					*ret = NULL;
+
+		ok = Read(type);
+		if (!ok || type == mkEmpty)
+			return NULL;
+		ok = Read(classId) && Read(ndims) && ndims >= 2 && ndims < 64;
+		for (uint32_t d = 0; ok && d < ndims; ++d) {
+			uint64_t	dim = 0;
+
+			ok = Read(dim);
+			dims.push_back((mwSize)dim);
+			numel = dim != 0 && numel > mLeft / dim ? mLeft + 1 : numel * (size_t)dim;
+		}
+		if (!ok)
+			return NULL;
+
+		if (type == mkStruct) {
+			uint32_t					numFields;
+			std::vector<std::string>	names;
+			std::vector<const char *>	fields;
+
+			ok = Read(numFields);
+			for (uint32_t f = 0; ok && f < numFields; ++f) {
+				uint32_t	length;
+				char		name[64];
+
+				ok = Read(length) && length < 64 && Read(name, length);
+				if (ok)
+					names.push_back(std::string(name, length));
+			}
+			//	elements take a byte at least each (but for a struct without fields), a damaged size must not make a huge
+			//	array
+			ok = ok && (numFields == 0 || numel <= mLeft);
+			if (!ok)
+				return NULL;
+			for (size_t f = 0; f < names.size(); ++f)
+				fields.push_back(names[f].c_str());
+			ret = mxCreateStructArray(ndims, dims.data(), (int)fields.size(), fields.data());
+			for (size_t e = 0; ok && e < mxGetNumberOfElements(ret); ++e)
+				for (size_t f = 0; ok && f < fields.size(); ++f)
+					mxSetFieldByNumber(ret, e, (int)f, Value(ok));
+		}
+		else if (type == mkCell) {
+			ok = numel <= mLeft;
+			if (!ok)
+				return NULL;
+			ret = mxCreateCellArray(ndims, dims.data());
+			for (size_t e = 0; ok && e < mxGetNumberOfElements(ret); ++e)
+				mxSetCell(ret, e, Value(ok));
+		}
+		else if (type == mkArray) {
+			ok = numel <= mLeft;
+			if (!ok)
+				return NULL;
+			if (classId == mxCHAR_CLASS)
+				ret = mxCreateCharArray(ndims, dims.data());
+			else if (classId == mxLOGICAL_CLASS)
+				ret = mxCreateLogicalArray(ndims, dims.data());
+			else if (classId >= mxDOUBLE_CLASS && classId <= mxUINT64_CLASS)
+				ret = mxCreateNumericArray(ndims, dims.data(), (mxClassID)classId, mxREAL);
+			ok = ret != NULL && (MemoArrayBytes(ret) == 0 || Read(mxGetData(ret), MemoArrayBytes(ret)));
+		}
+		else
+			ok = false;
+
+		if (!ok && ret != NULL) {
+			mxDestroyArray(ret);
+			ret = NULL;
+		}
+
+		return ret;
+	}
+};
+
+//	the value stored under key, NULL on a miss
+inline mxArray *MemoGet(CMemoCache *cache, const SMemoKey &key)
+{
+	mxArray			*ret = NULL;
+	bool			ok = false;
+
+	if (cache == NULL)
+		return NULL;
+	if (cache->Get(key, [&](size_t bytes, const FMemoRead &source) {
+		CMemoReader		reader(source, bytes);
+
+		ret = reader.Value(ok);
+		return ok && ret != NULL && reader.done();
+	}))
+		return ret;
+	if (ret != NULL)
+		mxDestroyArray(ret);
+
+	return NULL;
+}
+
+//	false when the value cannot be stored, the caller goes on without the cache
+inline bool MemoPut(CMemoCache *cache, const SMemoKey &key, const mxArray *value)
+{
+	size_t			bytes;
+
+	return cache != NULL && value != NULL && MemoBytes(value, bytes) && cache->Put(key, bytes, [&](const FMemoWrite &sink) {
+		return MemoWalk(value, sink);
+	});
+}
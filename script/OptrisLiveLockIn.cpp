@@ -0,0 +1,181 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "IRDevice.h"
+#include "IRImager.h"
+#include "IRLogger.h"
+#include "OptrisLockInClient.h"
+#include "MapRenderer.h"
+#include "ImageWriter.h"
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+//	cl /O2 /EHsc /std:c++17 /I..\Optris_irDirectSDK\sdk OptrisLiveLockIn.cpp ..\Optris_irDirectSDK\sdk\x64\libirimager.lib
+//	g++ -O3 -std=c++17 -pthread -I../Optris_irDirectSDK/sdk OptrisLiveLockIn.cpp -lirimager -o OptrisLiveLockIn
+
+//	OptrisLiveLockIn config.xml freq [options]
+//
+//	lock-in while the optris imager acquires (OptrisLockInClient.h): the amplitude and phase maps are rewritten every
+//	1 / rate seconds as <out>_amp.png and <out>_phase.png and a status line goes to stdout. with --replay the frames
+//	come from a raw file recorded by the sdk instead of the camera, which runs the same path offline. options:
+//		--tau s			exponential lock-in with this time constant (default, 10 periods)
+//		--window n		sliding window of n frames instead
+//		--pif ch		phase relative to the reference on pif analog input ch
+//		--rate Hz		publication rate (2)
+//		--duration s	stop after s seconds (until the device disconnects or ctrl-c)
+//		--out prefix	(lockin)
+//		--replay file	raw file instead of the camera
+
+static std::atomic<bool>	gStop(false);
+
+static void OnSignal(int)
+{
+	gStop = true;
+}
+
+//	sensor order to the column major maps of the renderer
+static void ToColumnMajor(std::vector<double> &dest, const std::vector<double> &src, size_t width, size_t height)
+{
+	dest.resize(width * height);
+	for (size_t y = 0; y < height; ++y)
+		for (size_t x = 0; x < width; ++x)
+			dest[x * height + y] = src[y * width + x];
+}
+
+int main(int argc, char **argv)
+{
+	SLiveLockInParams		params;
+	std::string				out = "lockin", replay;
+	double					duration = 0.0;
+
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s config.xml freq [--tau s | --window n] [--pif ch] [--rate Hz] [--duration s] [--out prefix] [--replay file]\n", argv[0]);
+		return -1;
+	}
+
+	params.lockIn.freq = atof(argv[2]);
+	params.lockIn.mode = SRecursiveLockInParams::lmExponential;
+	params.lockIn.timeConstant = params.lockIn.freq > 0.0 ? 10.0 / params.lockIn.freq : 0.0;
+	params.lockIn.window = 0;
+	params.lockIn.measuredReference = false;
+	params.pifChannel = -1;
+	params.publishRate = 2.0;
+
+	for (int i = 3; i < argc; ++i) {
+		std::string		arg = argv[i];
+		bool			value = i + 1 < argc;
+
+		if (arg == "--tau" && value) {
+			params.lockIn.mode = SRecursiveLockInParams::lmExponential;
+			params.lockIn.timeConstant = atof(argv[++i]);
+		}
+		else if (arg == "--window" && value) {
+			params.lockIn.mode = SRecursiveLockInParams::lmSliding;
+			params.lockIn.window = (size_t)atol(argv[++i]);
+		}
+		else if (arg == "--pif" && value)
+			params.pifChannel = atoi(argv[++i]);
+		else if (arg == "--rate" && value)
+			params.publishRate = atof(argv[++i]);
+		else if (arg == "--duration" && value)
+			duration = atof(argv[++i]);
+		else if (arg == "--out" && value)
+			out = argv[++i];
+		else if (arg == "--replay" && value)
+			replay = argv[++i];
+		else {
+			fprintf(stderr, "unknown option %s\n", arg.c_str());
+			return -1;
+		}
+	}
+	if (!(params.lockIn.freq > 0.0) || !(params.publishRate > 0.0) ||
+		(params.lockIn.mode == SRecursiveLockInParams::lmExponential ? !(params.lockIn.timeConstant > 0.0) : params.lockIn.window < 2)) {
+		fprintf(stderr, "freq, rate and tau must be positive, the window at least 2 frames\n");
+		return -1;
+	}
+
+	evo::IRLogger::setVerbosity(evo::IRLOG_ERROR, evo::IRLOG_OFF);
+
+	evo::IRDeviceParams		deviceParams;
+
+	if (!evo::IRDeviceParamsReader::readXMLC(argv[1], deviceParams)) {
+		fprintf(stderr, "cannot read %s\n", argv[1]);
+		return -1;
+	}
+
+	evo::IRDevice		*device = replay.empty() ? evo::IRDevice::IRCreateDevice(deviceParams) : evo::IRDevice::IRCreateDevice(deviceParams, replay);
+	evo::IRImager		imager;
+
+	if (device == NULL) {
+		fprintf(stderr, "%s\n", replay.empty() ? "no imager found" : ("cannot open " + replay).c_str());
+		return -1;
+	}
+	if (!imager.init(&deviceParams, device->getFrequency(), device->getWidth(), device->getHeight(), device->controlledViaHID())) {
+		fprintf(stderr, "cannot initialize the imager\n");
+		delete device;
+		return -1;
+	}
+
+	COptrisLockInClient		client(&imager, params);
+
+	device->setClient(&client);
+	signal(SIGINT, OnSignal);
+
+	//	the maps are rendered off the acquisition thread, a slow disk only drops publications
+	std::thread			writer([&]() {
+		SLiveLockInMaps		maps;
+		std::vector<double>	map;
+		uint64_t			serial = 0;
+		SMapStyle			style;
+
+		style.lo = NAN;
+		style.hi = NAN;
+		style.mmpx = 0.0;
+		style.zoom = 0;
+		while (client.Wait(maps, serial)) {
+			ToColumnMajor(map, maps.amp, maps.width, maps.height);
+			style.palette = palIronBlack;
+			style.title = "amplitude " + std::to_string(params.lockIn.freq) + " Hz";
+			style.cLabel = "K";
+			WriteImage(out + "_amp.png", RenderMap(&map[0], maps.height, maps.width, style));
+			ToColumnMajor(map, maps.phase, maps.width, maps.height);
+			style.palette = palJet;
+			style.title = "phase " + std::to_string(params.lockIn.freq) + " Hz";
+			style.cLabel = "rad";
+			WriteImage(out + "_phase.png", RenderMap(&map[0], maps.height, maps.width, style));
+			printf("frame %lld  t %.3f s%s\n", (long long)maps.frame, maps.time, maps.ready ? "" : "  (settling)");
+			fflush(stdout);
+		}
+	});
+
+	std::vector<unsigned char>				buffer(device->getRawBufferSize());
+	std::chrono::steady_clock::time_point	start = std::chrono::steady_clock::now();
+
+	device->startStreaming();
+	while (!gStop) {
+		evo::IRDeviceError		status = device->getFrame(&buffer[0], NULL, 1000);
+
+		if (status != evo::IRIMAGER_SUCCESS && status != evo::IRIMAGER_NODATA && status != evo::IRIMAGER_NOSYNC && status != evo::IRIMAGER_EAGAIN)
+			break;
+		if (!client.error().empty())
+			break;
+		if (duration > 0.0 && std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() >= duration)
+			break;
+	}
+	device->stopStreaming();
+	client.Finish();
+	writer.join();
+	delete device;
+
+	if (!client.error().empty()) {
+		fprintf(stderr, "%s\n", client.error().c_str());
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,225 @@
+#pragma once
+
+#include "IRImager.h"
+#include "RecursiveLockIn.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <cmath>
+#include <cstdint>
+
+//	live lock-in on an optris imager (irDirectSDK)
+//
+//	the client sits between the device and the imager: raw frames go to IRImager::process and every thermal frame is
+//	pushed into a CRecursiveLockIn on the sdk thread, in sensor order (row major width x height). the frame time comes
+//	from the hardware counter times the average frame period, so it does not jitter with the usb transfer, or from the
+//	arrival time stamp when the imager does not report the period. frames taken while the shutter flag is not open
+//	are left out. the measured reference is the voltage on one pif analog input (the laser drive). every 1 / publishRate
+//	seconds of frames the maps are computed into a back buffer and swapped with the published one, Wait hands the
+//	latest maps to a consumer thread, so a slow consumer only skips publications and never stalls the acquisition.
+//	amplitudes are in degrees (counts / 10^decimal), phases in rad relative to t = 0 or to the reference.
+
+struct SLiveLockInParams
+{
+	SRecursiveLockInParams	lockIn;
+	int						pifChannel;			//	analog input carrying the reference, -1 for the ideal reference
+	double					publishRate;		//	[Hz]
+};
+
+struct SLiveLockInMaps
+{
+	size_t					width;
+	size_t					height;
+	int64_t					frame;				//	frames pushed so far
+	double					time;				//	[s] of the last frame
+	bool					ready;				//	window full / filter settled
+	std::vector<double>		amp;				//	row major width x height
+	std::vector<double>		phase;
+};
+
+class COptrisLockInClient : public evo::IRImagerClient
+{
+private:
+	evo::IRImager						*mImager;
+	SLiveLockInParams					mParams;
+	size_t								mWidth;
+	size_t								mHeight;
+	double								mScale;
+	double								mFramePeriod;		//	[s], 0 to use the time stamps
+	std::unique_ptr<CRecursiveLockIn>	mLockIn;
+	int64_t								mFirstCounter;
+	long long							mFirstTimestamp;
+	double								mLastTime;
+	double								mLastPublished;
+	bool								mFlagOpen;
+	SLiveLockInMaps						mBack;
+	SLiveLockInMaps						mFront;
+	uint64_t							mSerial;
+	bool								mExit;
+	std::string							mError;
+	std::mutex							mMutex;
+	std::condition_variable				mPublished;
+
+	void Publish(double t)
+	{
+		mBack.frame = mLockIn->numFrames();
+		mBack.time = t;
+		mBack.ready = mLockIn->ready();
+		mLockIn->Result(mScale, &mBack.amp[0], &mBack.phase[0]);
+		{
+			std::lock_guard<std::mutex>		lock(mMutex);
+
+			std::swap(mBack, mFront);
+			++mSerial;
+		}
+		mPublished.notify_all();
+		mLastPublished = t;
+	}
+
+	void Fail(const std::string &message)
+	{
+		{
+			std::lock_guard<std::mutex>		lock(mMutex);
+
+			if (mError.empty())
+				mError = message;
+		}
+		mPublished.notify_all();
+	}
+
+public:
+	//	the imager must be initialized, the client registers itself with it
+	COptrisLockInClient(evo::IRImager *imager, const SLiveLockInParams &params) :
+		mImager(imager),
+		mParams(params),
+		mWidth(imager->getWidth()),
+		mHeight(imager->getHeight()),
+		mScale(pow(10.0, -(double)imager->getTemprangeDecimal())),
+		mFramePeriod((double)imager->getAvgTimePerFrame() * 1e-7),
+		mFirstCounter(-1),
+		mFirstTimestamp(0),
+		mLastTime(NAN),
+		mLastPublished(-INFINITY),
+		mFlagOpen(true),
+		mSerial(0),
+		mExit(false)
+	{
+		mParams.lockIn.measuredReference = params.pifChannel >= 0;
+		mLockIn.reset(new CRecursiveLockIn(mWidth * mHeight, mParams.lockIn));
+		for (SLiveLockInMaps *maps : { &mBack, &mFront }) {
+			maps->width = mWidth;
+			maps->height = mHeight;
+			maps->frame = 0;
+			maps->time = NAN;
+			maps->ready = false;
+			maps->amp.assign(mWidth * mHeight, NAN);
+			maps->phase.assign(mWidth * mHeight, NAN);
+		}
+		mImager->setClient(this);
+	}
+
+	void onRawFrame(unsigned char *data, int size)
+	{
+		(void)size;
+		mImager->process(data, NULL);
+	}
+
+	void onThermalFrame(unsigned short *data, unsigned int w, unsigned int h, evo::IRFrameMetadata meta, void *arg)
+	{
+		double		t, reference = 0.0;
+
+		(void)arg;
+		if ((size_t)w != mWidth || (size_t)h != mHeight) {
+			Fail("The imager changed its frame size.");
+			return;
+		}
+		if (!mFlagOpen || meta.flagState != evo::irFlagOpen)
+			return;
+
+		if (mFirstCounter < 0) {
+			mFirstCounter = (int64_t)meta.counterHW;
+			mFirstTimestamp = meta.timestamp;
+		}
+		if (mFramePeriod > 0.0)
+			t = (double)((int64_t)meta.counterHW - mFirstCounter) * mFramePeriod;
+		else
+			t = (double)(meta.timestamp - mFirstTimestamp) * 1e-7;
+
+		if (mParams.pifChannel >= 0) {
+			if ((size_t)mParams.pifChannel >= meta.pifAIs.size()) {
+				Fail("The pif has no analog input " + std::to_string(mParams.pifChannel) + ".");
+				return;
+			}
+			reference = (double)meta.pifAIs[(size_t)mParams.pifChannel];
+		}
+
+		mLockIn->Push(data, t, reference);
+		mLastTime = t;
+		if (mParams.publishRate > 0.0 && t - mLastPublished >= 1.0 / mParams.publishRate)
+			Publish(t);
+	}
+
+	void onFlagStateChange(evo::EnumFlagState flagState, void *arg)
+	{
+		(void)arg;
+		mFlagOpen = flagState == evo::irFlagOpen;
+	}
+
+	//	the sdk calls this after every raw frame, not on shutdown, which is left to Finish and Stop
+	void onProcessExit(void *arg)
+	{
+		(void)arg;
+	}
+
+	//	publishes what came after the last publication and stops, call once no more frames are processed
+	void Finish()
+	{
+		if (mLastTime > mLastPublished && error().empty())
+			Publish(mLastTime);
+		Stop();
+	}
+
+	//	wakes Wait for good
+	void Stop()
+	{
+		{
+			std::lock_guard<std::mutex>		lock(mMutex);
+
+			mExit = true;
+		}
+		mPublished.notify_all();
+	}
+
+	//	blocks until maps newer than serial are published and copies them, false once stopped or failed (see error())
+	bool Wait(SLiveLockInMaps &maps, uint64_t &serial)
+	{
+		std::unique_lock<std::mutex>	lock(mMutex);
+
+		mPublished.wait(lock, [&]() { return mExit || !mError.empty() || mSerial != serial; });
+		if (mSerial == serial)
+			return false;
+		maps = mFront;
+		serial = mSerial;
+
+		return true;
+	}
+
+	size_t width() const
+	{
+		return mWidth;
+	}
+
+	size_t height() const
+	{
+		return mHeight;
+	}
+
+	std::string error()
+	{
+		std::lock_guard<std::mutex>		lock(mMutex);
+
+		return mError;
+	}
+};
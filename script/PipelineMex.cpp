@@ -0,0 +1,564 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "mex.h"
+#include "MexHelpers.h"
+#include "ImagerFileSource.h"
+#include "PipelineOperators.h"
+#include "MexMemo.h"
+
+//	mex PipelineMex.cpp -I%FILESDKDIR%include -L%FILESDKDIR%bin/x64/Release -ltc.lib -ltc.file.lib -ltc.reduce.lib
+
+//	res = PipelineMex(source, nodes, opts)
+//
+//	runs a graph of operators over the recording in a single pass, blockSize frames at a time, without loading it.
+//	source is an ATS file name or a rows x cols x n cube (double, single, uint16 or int16, with opts.time or opts.fs).
+//	nodes is a struct array, nodes(k).op names the operator and nodes(k).input its input: 0 for the source, j for the
+//	output of nodes(j) (j < k). the other fields are the parameters of the operator:
+//		'window'	first, last			frames (1 based, of the input)
+//		'resample'	fs					uniform time base [Hz]
+//		'wiener'	size				adaptive wiener filter, as filtroSpaziale
+//		'iir'		b, a				causal temporal filter, as filtroTemporale but one pass
+//		'register'	template, interp, alpha, maxShift		as RegistrationMex
+//		'heatsource'	diffusivity, mmpx, halfWidth (3), order (2), spatialHalfWidth (1), rhoC (1), fs
+//										heat source frames as HeatSourceMex -> integral
+//		'lockin'	freqs				-> A, P, X, Y (rows x cols x numFreqs), freqs
+//		'stats'							-> mean, std, min, max, argMax (1 based frame of the input)
+//		'tsr'		pulse, numFrames, baselineFrames (pulse - 1), degree (5), fs, minDelta (1e-3)
+//										-> coeffs, mu, scale, rms as TsrMex
+//		'contrast'	region, backgroundRadius (20), baselineFrames (0), normFrame (0), minDelta (0.01), sign (1)
+//										-> absolute, running, normalised, tAbsolute, tRunning, tNormalised, sound as ContrastMex
+//		'hotzone'	isotherms, connectivity (8), minArea (1)
+//										-> components [frame track area xc yc eqDiameter perimeter maxT isotherm] in px
+//	register also returns shifts (n x 3 [dx dy peak]), heatsource the map of sum(q dt), the other transforms return an
+//	empty struct.
+//	opts (optional): blockSize (32 frames), memory (budget of the blocks in flight, 1024 MB), fs (frame rate when the
+//	frames carry no time), time (cube source), frames ([first last] of the file, 1 based), unit ('temperatureFactory')
+//	and temperatureType ('celsius') for the file source, memo (true) to use the stage cache.
+//	res is a numel(nodes) x 1 cell of structs.
+//
+//	with THERMO_MEMO set (ThermoMemo.h) the result of every node is kept under the key of its chain: the source (the
+//	file as found on disk with how it is read, or the hash of the cube and its times), then the parameters of each node
+//	down to it. a node found in the cache is not run, nor are the nodes only it needs, and when all of them are found
+//	the recording is not even opened. blockSize and memory do not change the results and are not part of the keys.
+
+SEnumInfo	UnitEnumInfo[] = {
+	{ "counts",					tc::unitCounts },
+	{ "radianceUser",			tc::unitRadianceUser },
+	{ "temperatureUser",		tc::unitTemperatureUser },
+	{ "objectSignal",			tc::unitObjectSignal },
+	{ "radianceFactory",		tc::unitRadianceFactory },
+	{ "temperatureFactory",		tc::unitTemperatureFactory },
+	{ NULL,						tc::unitError },
+};
+
+SEnumInfo	TemperatureTypeEnumInfo[] = {
+	{ "celsius",				tc::ttCelsius },
+	{ "fahrenheit",				tc::ttFahrenheit },
+	{ "kelvin",					tc::ttKelvin },
+	{ "rankine",				tc::ttRankine },
+	{ NULL,						tc::ttError },
+};
+
+SEnumInfo	TemplateEnumInfo[] = {
+	{ "reference",				SRegistrationParams::tpReference },
+	{ "running",				SRegistrationParams::tpRunning },
+	{ NULL,						-1 },
+};
+
+SEnumInfo	InterpEnumInfo[] = {
+	{ "none",					SRegistrationParams::ipNone },
+	{ "bilinear",				SRegistrationParams::ipBilinear },
+	{ "bicubic",				SRegistrationParams::ipBicubic },
+	{ NULL,						-1 },
+};
+
+static std::vector<double> GetVector(const mxArray *nodes, const char *name, size_t index)
+{
+	const mxArray	*ar = mxGetOptionField(nodes, name, index);
+
+	if (ar == NULL || mxIsEmpty(ar))
+		mexErrMsgTxt((std::string("Missing node parameter ") + name + ".").c_str());
+
+	const double	*data = mxGetDoubleInput(ar, name);
+
+	return std::vector<double>(data, data + mxGetNumberOfElements(ar));
+}
+
+static double GetRequired(const mxArray *nodes, const char *name, size_t index)
+{
+	double		value = mxGetOption(nodes, name, mxGetNaN(), index);
+
+	if (std::isnan(value))
+		mexErrMsgTxt((std::string("Missing node parameter ") + name + ".").c_str());
+
+	return value;
+}
+
+//	the operator of nodes(index), rows x cols frames; input frames are unknown here so frame parameters are taken as given
+static COperator *CreateOperator(const mxArray *nodes, size_t index, size_t rows, size_t cols, double fs)
+{
+	std::string		op = mxGetOption(nodes, "op", "", index);
+	size_t			pixels = rows * cols;
+
+	if (op == "window") {
+		double		last = mxGetOption(nodes, "last", INFINITY, index);
+
+		return new CWindowOp((int64_t)GetRequired(nodes, "first", index) - 1, std::isinf(last) ? INT64_MAX - 1 : (int64_t)last - 1);
+	}
+	if (op == "resample") {
+		double		rate = GetRequired(nodes, "fs", index);
+
+		if (!(rate > 0.0))
+			mexErrMsgTxt("fs must be positive.");
+		return new CResampleOp(rate);
+	}
+	if (op == "wiener")
+		return new CWienerOp((size_t)mxGetOption(nodes, "size", 3.0, index));
+	if (op == "iir") {
+		std::vector<double>		b = GetVector(nodes, "b", index), a = GetVector(nodes, "a", index);
+
+		if (a[0] == 0.0)
+			mexErrMsgTxt("a(1) must not be 0.");
+		return new CIirOp(b, a);
+	}
+	if (op == "register") {
+		SRegistrationParams		params;
+		int						value;
+
+		value = ParseEnum(TemplateEnumInfo, mxGetOption(nodes, "template", "reference", index).c_str());
+		if (value < 0)
+			mexErrMsgTxt("Unknown template.");
+		params.templ = (SRegistrationParams::ETemplate)value;
+		value = ParseEnum(InterpEnumInfo, mxGetOption(nodes, "interp", "bilinear", index).c_str());
+		if (value < 0)
+			mexErrMsgTxt("Unknown interp.");
+		params.interp = (SRegistrationParams::EInterp)value;
+		params.alpha = mxGetOption(nodes, "alpha", 0.05, index);
+		params.maxShift = mxGetOption(nodes, "maxShift", 0.0, index);
+		return new CRegisterOp(rows, cols, params);
+	}
+	if (op == "heatsource") {
+		SHeatSourceParams		params;
+
+		params.fs = mxGetOption(nodes, "fs", fs, index);
+		params.diffusivity = GetRequired(nodes, "diffusivity", index);
+		params.mmpx = GetRequired(nodes, "mmpx", index);
+		params.halfWidth = (size_t)mxGetOption(nodes, "halfWidth", 3.0, index);
+		params.order = (size_t)mxGetOption(nodes, "order", 2.0, index);
+		params.spatialHalfWidth = (size_t)mxGetOption(nodes, "spatialHalfWidth", 1.0, index);
+		params.rhoC = mxGetOption(nodes, "rhoC", 1.0, index);
+		return new CHeatSourceOp(params);
+	}
+	if (op == "lockin") {
+		std::vector<double>		freqs = GetVector(nodes, "freqs", index);
+
+		for (size_t k = 0; k < freqs.size(); ++k)
+			if (!(freqs[k] > 0.0))
+				mexErrMsgTxt("Frequencies must be positive.");
+		return new CLockInOp(pixels, freqs);
+	}
+	if (op == "stats")
+		return new CStatsOp(pixels);
+	if (op == "tsr") {
+		double		pulse = GetRequired(nodes, "pulse", index);
+		double		rate = mxGetOption(nodes, "fs", fs, index);
+
+		if (!(rate > 0.0))
+			mexErrMsgTxt("tsr needs fs.");
+		return new CTsrOp(pixels, (int64_t)pulse - 1, (size_t)GetRequired(nodes, "numFrames", index),
+			(size_t)mxGetOption(nodes, "baselineFrames", pulse - 1.0, index), (size_t)mxGetOption(nodes, "degree", 5.0, index),
+			rate, mxGetOption(nodes, "minDelta", 1e-3, index));
+	}
+	if (op == "contrast") {
+		SContrastParams		params;
+		const mxArray		*region = mxGetOptionField(nodes, "region", index);
+
+		params.reference = SContrastParams::crBackground;
+		params.r0 = params.r1 = params.c0 = params.c1 = 0;
+		if (region != NULL && !mxIsEmpty(region)) {
+			const double	*r = mxGetDoubleInput(region, "region");
+
+			if (mxGetNumberOfElements(region) != 4 || r[0] < 1.0 || r[2] < 1.0)
+				mexErrMsgTxt("region must be [r0 r1 c0 c1], 1 based.");
+			params.reference = SContrastParams::crRegion;
+			params.r0 = (size_t)r[0] - 1;
+			params.r1 = (size_t)r[1] - 1;
+			params.c0 = (size_t)r[2] - 1;
+			params.c1 = (size_t)r[3] - 1;
+		}
+		params.backgroundRadius = (size_t)mxGetOption(nodes, "backgroundRadius", 20.0, index);
+		params.baselineFrames = (size_t)mxGetOption(nodes, "baselineFrames", 0.0, index);
+		params.normFrame = (int64_t)mxGetOption(nodes, "normFrame", 0.0, index) - 1;
+		params.minDelta = mxGetOption(nodes, "minDelta", 0.01, index);
+		params.sign = (int)mxGetOption(nodes, "sign", 1.0, index);
+
+		CContrastOp		*contrast = new CContrastOp(rows, cols, params);
+
+		if (!contrast->error().empty()) {
+			std::string		message = contrast->error();
+
+			delete contrast;
+			mexErrMsgTxt(message.c_str());
+		}
+		return contrast;
+	}
+	if (op == "hotzone") {
+		SHotZoneParams		params;
+
+		params.eightConnected = mxGetOption(nodes, "connectivity", 8.0, index) != 4.0;
+		params.minArea = (size_t)std::max(mxGetOption(nodes, "minArea", 1.0, index), 1.0);
+		return new CHotZoneOp(rows, cols, GetVector(nodes, "isotherms", index), params);
+	}
+
+	mexErrMsgTxt((std::string("Unknown operator ") + op + ".").c_str());
+
+	return NULL;
+}
+
+static mxArray *CreatePlanes(size_t rows, size_t cols, size_t planes)
+{
+	mwSize		dims[3] = { rows, cols, planes };
+
+	return mxCreateNumericArray(3, dims, mxDOUBLE_CLASS, mxREAL);
+}
+
+//	sink results, an empty struct for the plain transforms
+static mxArray *Result(COperator *op, size_t rows, size_t cols)
+{
+	size_t		n = rows * cols;
+
+	if (CLockInOp *lockIn = dynamic_cast<CLockInOp *>(op)) {
+		const CLockInAccumulator	&acc = lockIn->accumulator();
+		const char					*fields[] = { "A", "P", "X", "Y", "freqs" };
+		mxArray						*ret = mxCreateStructMatrix(1, 1, sizeof(fields) / sizeof(fields[0]), fields);
+		mxArray						*amp = CreatePlanes(rows, cols, acc.numFreqs()), *phase = CreatePlanes(rows, cols, acc.numFreqs());
+		mxArray						*x = CreatePlanes(rows, cols, acc.numFreqs()), *y = CreatePlanes(rows, cols, acc.numFreqs());
+		mxArray						*freqs = mxCreateDoubleMatrix(acc.numFreqs(), 1, mxREAL);
+
+		for (size_t k = 0; k < acc.numFreqs(); ++k) {
+			acc.Result(k, mxGetPr(x) + k * n, mxGetPr(y) + k * n, mxGetPr(amp) + k * n, mxGetPr(phase) + k * n);
+			mxGetPr(freqs)[k] = acc.freq(k);
+		}
+		mxSetFieldByNumber(ret, 0, 0, amp);
+		mxSetFieldByNumber(ret, 0, 1, phase);
+		mxSetFieldByNumber(ret, 0, 2, x);
+		mxSetFieldByNumber(ret, 0, 3, y);
+		mxSetFieldByNumber(ret, 0, 4, freqs);
+
+		return ret;
+	}
+
+	if (CStatsOp *stats = dynamic_cast<CStatsOp *>(op)) {
+		const char		*fields[] = { "mean", "std", "min", "max", "argMax", "numFrames" };
+		mxArray			*ret = mxCreateStructMatrix(1, 1, sizeof(fields) / sizeof(fields[0]), fields);
+		mxArray			*planes[5];
+
+		for (size_t k = 0; k < 5; ++k) {
+			planes[k] = mxCreateDoubleMatrix(rows, cols, mxREAL);
+			mxSetFieldByNumber(ret, 0, k, planes[k]);
+		}
+		stats->Result(mxGetPr(planes[0]), mxGetPr(planes[1]), mxGetPr(planes[2]), mxGetPr(planes[3]), mxGetPr(planes[4]));
+		for (size_t p = 0; p < n; ++p)
+			mxGetPr(planes[4])[p] += 1.0;
+		mxSetFieldByNumber(ret, 0, 5, mxCreateDoubleScalar((double)stats->count()));
+
+		return ret;
+	}
+
+	if (CTsrOp *tsr = dynamic_cast<CTsrOp *>(op)) {
+		const CTsrAccumulator	&acc = tsr->accumulator();
+		const char				*fields[] = { "coeffs", "mu", "scale", "rms" };
+		mxArray					*ret = mxCreateStructMatrix(1, 1, sizeof(fields) / sizeof(fields[0]), fields);
+		mxArray					*coeffs = CreatePlanes(rows, cols, acc.numCoeffs());
+		mxArray					*rms = mxCreateDoubleMatrix(rows, cols, mxREAL);
+
+		for (size_t j = 0; j < acc.numCoeffs(); ++j)
+			std::copy(acc.coeffs(j), acc.coeffs(j) + n, mxGetPr(coeffs) + j * n);
+		acc.Residual(mxGetPr(rms));
+		mxSetFieldByNumber(ret, 0, 0, coeffs);
+		mxSetFieldByNumber(ret, 0, 1, mxCreateDoubleScalar(acc.mu()));
+		mxSetFieldByNumber(ret, 0, 2, mxCreateDoubleScalar(acc.scale()));
+		mxSetFieldByNumber(ret, 0, 3, rms);
+
+		return ret;
+	}
+
+	if (CHotZoneOp *zone = dynamic_cast<CHotZoneOp *>(op)) {
+		const std::vector<SHotComponent>	&all = zone->tracker().components();
+		const char							*fields[] = { "components" };
+		mxArray								*ret = mxCreateStructMatrix(1, 1, 1, fields);
+		mxArray								*table = mxCreateDoubleMatrix(all.size(), 9, mxREAL);
+		double								*t = mxGetPr(table);
+
+		for (size_t c = 0; c < all.size(); ++c) {
+			const SHotComponent		&hc = all[c];
+			double					values[] = { (double)hc.frame + 1.0, (double)hc.track + 1.0, hc.area, hc.xc + 1.0, hc.yc + 1.0,
+										2.0 * sqrt(hc.area / M_PI), hc.perimeter, hc.maxValue, (double)hc.isotherm + 1.0 };
+
+			for (size_t col = 0; col < 9; ++col)
+				t[c + col * all.size()] = values[col];
+		}
+		mxSetFieldByNumber(ret, 0, 0, table);
+
+		return ret;
+	}
+
+	if (CRegisterOp *reg = dynamic_cast<CRegisterOp *>(op)) {
+		const std::vector<SFrameShift>	&shifts = reg->shifts();
+		const char						*fields[] = { "shifts" };
+		mxArray							*ret = mxCreateStructMatrix(1, 1, 1, fields);
+		mxArray							*out = mxCreateDoubleMatrix(shifts.size(), 3, mxREAL);
+
+		for (size_t f = 0; f < shifts.size(); ++f) {
+			mxGetPr(out)[f] = shifts[f].dx;
+			mxGetPr(out)[f + shifts.size()] = shifts[f].dy;
+			mxGetPr(out)[f + 2 * shifts.size()] = shifts[f].peak;
+		}
+		mxSetFieldByNumber(ret, 0, 0, out);
+
+		return ret;
+	}
+
+	if (CContrastOp *contrastOp = dynamic_cast<CContrastOp *>(op)) {
+		const CThermalContrast	&contrast = contrastOp->contrast();
+		const char				*fields[] = { "absolute", "running", "normalised", "tAbsolute", "tRunning", "tNormalised", "sound" };
+		mxArray					*ret = mxCreateStructMatrix(1, 1, sizeof(fields) / sizeof(fields[0]), fields);
+
+		for (size_t k = 0; k < CThermalContrast::ctCount; ++k) {
+			const std::vector<float>	&best = contrast.maxContrast((CThermalContrast::EContrast)k);
+			mxArray						*map = mxCreateDoubleMatrix(rows, cols, mxREAL);
+
+			std::copy(best.begin(), best.end(), mxGetPr(map));
+			mxSetFieldByNumber(ret, 0, (int)k, map);
+			mxSetFieldByNumber(ret, 0, (int)(k + CThermalContrast::ctCount),
+				mxCreateDoubleMatrixFrom(contrast.timeOfMax((CThermalContrast::EContrast)k).data(), rows, cols));
+		}
+		mxSetFieldByNumber(ret, 0, 6, mxCreateDoubleColumn(contrast.sound()));
+
+		return ret;
+	}
+
+	if (CHeatSourceOp *heat = dynamic_cast<CHeatSourceOp *>(op)) {
+		std::vector<double>		integral = heat->integral();
+		const char				*fields[] = { "integral" };
+		mxArray					*ret = mxCreateStructMatrix(1, 1, 1, fields);
+
+		integral.resize(n, NAN);
+		mxSetFieldByNumber(ret, 0, 0, mxCreateDoubleMatrixFrom(integral.data(), rows, cols));
+
+		return ret;
+	}
+
+	return mxCreateStructMatrix(1, 1, 0, NULL);
+}
+
+static CFrameSource *CreateArraySource(const mxArray *cube, const mxArray *opts, std::vector<double> &time)
+{
+	const mwSize	*dims = mxGetDimensions(cube);
+	size_t			rows = dims[0], cols = mxGetNumberOfDimensions(cube) > 1 ? dims[1] : 1;
+	size_t			numFrames = rows * cols > 0 ? mxGetNumberOfElements(cube) / (rows * cols) : 0;
+	const mxArray	*t = mxGetOptionField(opts, "time");
+	double			fs = mxGetOption(opts, "fs", 0.0);
+
+	if (mxIsComplex(cube))
+		mexErrMsgTxt("Must not be complex.");
+	if (t != NULL) {
+		if (mxGetNumberOfElements(t) != numFrames)
+			mexErrMsgTxt("Need one time per frame.");
+		time.assign(mxGetDoubleInput(t, "time"), mxGetDoubleInput(t, "time") + numFrames);
+	}
+	else {
+		if (!(fs > 0.0))
+			mexErrMsgTxt("A cube source needs opts.time or opts.fs.");
+		time.resize(numFrames);
+		for (size_t f = 0; f < numFrames; ++f)
+			time[f] = (double)f / fs;
+	}
+
+	switch (mxGetClassID(cube)) {
+		case mxDOUBLE_CLASS:
+			return new CArraySource<double>((const double *)mxGetData(cube), time.data(), rows, cols, numFrames);
+		case mxSINGLE_CLASS:
+			return new CArraySource<float>((const float *)mxGetData(cube), time.data(), rows, cols, numFrames);
+		case mxUINT16_CLASS:
+			return new CArraySource<uint16_t>((const uint16_t *)mxGetData(cube), time.data(), rows, cols, numFrames);
+		case mxINT16_CLASS:
+			return new CArraySource<int16_t>((const int16_t *)mxGetData(cube), time.data(), rows, cols, numFrames);
+		default:
+			mexErrMsgTxt("Unsupported type.");
+			break;
+	}
+
+	return NULL;
+}
+
+static CFrameSource *CreateFileSource(const mxArray *name, const mxArray *opts)
+{
+	std::string			filename = mxGetStdString(name, "source");
+	int					unit = ParseEnum(UnitEnumInfo, mxGetOption(opts, "unit", "temperatureFactory").c_str());
+	int					tempType = ParseEnum(TemperatureTypeEnumInfo, mxGetOption(opts, "temperatureType", "celsius").c_str());
+	double				first = 1.0, last = INFINITY;
+	const mxArray		*frames = mxGetOptionField(opts, "frames");
+	CImagerFileSource	*source;
+
+	if (unit == tc::unitError)
+		mexErrMsgTxt("Unknown unit.");
+	if (tempType == tc::ttError)
+		mexErrMsgTxt("Unknown temperatureType.");
+	if (frames != NULL) {
+		if (mxGetNumberOfElements(frames) != 2)
+			mexErrMsgTxt("frames must be [first last].");
+		first = mxGetDoubleInput(frames, "frames")[0];
+		last = mxGetDoubleInput(frames, "frames")[1];
+	}
+
+	source = new CImagerFileSource(filename.c_str(), (tc::EUnit)unit, (tc::ETempType)tempType, (tc::UInt32)std::max(first - 1.0, 0.0),
+		std::isinf(last) ? 0xFFFFFFFF : (tc::UInt32)std::max(last - 1.0, 0.0), mxGetOption(opts, "fs", 0.0));
+	if (!source->isOpen()) {
+		std::string		message = source->error();
+
+		delete source;
+		mexErrMsgTxt(message.c_str());
+	}
+
+	return source;
+}
+
+//	the key of the source, as CreateFileSource / CreateArraySource read it
+static SMemoKey SourceKey(const mxArray *source, const mxArray *opts)
+{
+	CMemoHasher		hasher;
+	SMemoKey		file;
+	const char		*fields[] = { "time", "fs", "frames", "unit", "temperatureType" };
+
+	hasher.Add("pipeline source 1");
+	if (mxIsChar(source)) {
+		if (!MemoFileKey(mxGetStdString(source, "source"), file))
+			mexErrMsgTxt(("Cannot read " + mxGetStdString(source, "source") + ".").c_str());
+		hasher.Add(file);
+	}
+	else if (!MemoHashArray(hasher, source))
+		mexErrMsgTxt("Unsupported type.");
+	for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); ++f) {
+		const mxArray	*value = mxGetOptionField(opts, fields[f]);
+
+		hasher.Add(fields[f]);
+		if (value != NULL && !MemoHashArray(hasher, value))
+			mexErrMsgTxt((std::string("Unsupported ") + fields[f] + ".").c_str());
+	}
+
+	return hasher.Finish();
+}
+
+//	the key of nodes(index) from the key of its input and its parameters, empty fields (defaults, or parameters of
+//	the other operators) are left out so adding a node does not change the keys of the others
+static SMemoKey NodeKey(const SMemoKey &input, const mxArray *nodes, size_t index)
+{
+	CMemoHasher		hasher;
+
+	hasher.Add("pipeline node 1").Add(input);
+	for (int f = 0; f < mxGetNumberOfFields(nodes); ++f) {
+		const char		*name = mxGetFieldNameByNumber(nodes, f);
+		const mxArray	*value = mxGetFieldByNumber(nodes, index, f);
+
+		if (strcmp(name, "input") == 0 || value == NULL || mxIsEmpty(value))
+			continue;
+		hasher.Add(name);
+		if (!MemoHashArray(hasher, value))
+			mexErrMsgTxt((std::string("Unsupported node parameter ") + name + ".").c_str());
+	}
+
+	return hasher.Finish();
+}
+
+//	the mex entry point
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	if (nrhs < 2 || nrhs > 3 || nlhs > 1)
+		mexErrMsgTxt("Must have 2-3 inputs and 0-1 outputs.");
+
+	const mxArray			*nodes = prhs[1];
+	const mxArray			*opts = nrhs > 2 ? prhs[2] : NULL;
+	size_t					numNodes = mxGetNumberOfElements(nodes);
+	size_t					blockSize = (size_t)mxGetOption(opts, "blockSize", 32.0);
+	size_t					budget = (size_t)(mxGetOption(opts, "memory", 1024.0) * 1024.0 * 1024.0);
+	std::vector<double>		time;
+	std::unique_ptr<CFrameSource>	source;			//	freed too when an operator below fails to build
+	CPipeline				pipeline;
+	CMemoCache				*cache = mxGetOption(opts, "memo", 1.0) != 0.0 ? ThermoMemoCache() : NULL;
+	std::vector<SMemoKey>	keys(numNodes);
+	std::vector<mxArray *>	cached(numNodes, NULL);
+	std::vector<size_t>		position(numNodes, 0);			//	1 based in the pipeline, 0 when not run
+	size_t					numRun = 0;
+
+	if (!mxIsStruct(nodes) || numNodes == 0)
+		mexErrMsgTxt("nodes must be a non empty struct array.");
+	for (size_t k = 0; k < numNodes; ++k) {
+		double		input = GetRequired(nodes, "input", k);
+
+		if (input < 0.0 || input >= (double)(k + 1) || input != floor(input))
+			mexErrMsgTxt("Node inputs must be 0 (the source) or an earlier node.");
+	}
+
+	//	the nodes to run: those not in the cache and their inputs
+	std::vector<bool>		run(numNodes, true);
+
+	if (cache != NULL) {
+		SMemoKey	sourceKey = SourceKey(prhs[0], opts);
+
+		for (size_t k = 0; k < numNodes; ++k) {
+			size_t		input = (size_t)GetRequired(nodes, "input", k);
+
+			keys[k] = NodeKey(input == 0 ? sourceKey : keys[input - 1], nodes, k);
+			cached[k] = MemoGet(cache, keys[k]);
+			run[k] = cached[k] == NULL;
+		}
+		for (size_t k = numNodes; k-- > 0;) {
+			size_t		input = (size_t)GetRequired(nodes, "input", k);
+
+			if (run[k] && input > 0)
+				run[input - 1] = true;
+		}
+	}
+
+	plhs[0] = mxCreateCellMatrix(numNodes, 1);
+	for (size_t k = 0; k < numNodes; ++k)
+		numRun += run[k];
+	if (numRun == 0) {
+		for (size_t k = 0; k < numNodes; ++k)
+			mxSetCell(plhs[0], k, cached[k]);
+		return;
+	}
+
+	source.reset(mxIsChar(prhs[0]) ? CreateFileSource(prhs[0], opts) : CreateArraySource(prhs[0], opts, time));
+
+	for (size_t k = 0, added = 0; k < numNodes; ++k) {
+		size_t		input = (size_t)GetRequired(nodes, "input", k);
+
+		if (!run[k])
+			continue;
+		pipeline.Add(CreateOperator(nodes, k, source->rows(), source->cols(), mxGetOption(opts, "fs", 0.0)),
+			input == 0 ? 0 : position[input - 1], mxGetOption(nodes, "op", "", k) + std::to_string(k + 1));
+		position[k] = ++added;
+	}
+
+	if (!pipeline.Run(*source, blockSize, budget)) {
+		std::string		message = pipeline.error();
+
+		for (size_t k = 0; k < numNodes; ++k)
+			if (cached[k] != NULL)
+				mxDestroyArray(cached[k]);
+		source.reset();
+		mexErrMsgTxt(message.c_str());
+	}
+
+	//	a node run again gives the same result as the cached one, which is kept
+	for (size_t k = 0; k < numNodes; ++k) {
+		if (cached[k] != NULL) {
+			mxSetCell(plhs[0], k, cached[k]);
+			continue;
+		}
+		mxSetCell(plhs[0], k, Result(pipeline.op(position[k] - 1), source->rows(), source->cols()));
+		MemoPut(cache, keys[k], mxGetCell(plhs[0], k));
+	}
+}
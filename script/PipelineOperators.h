@@ -0,0 +1,666 @@
+#pragma once
+
+#include "ThermoPipeline.h"
+#include "LockInAccumulator.h"
+#include "ThermalSignalReconstruction.h"
+#include "FrameRegistration.h"
+#include "HotZoneTracker.h"
+#include "HeatSource.h"
+#include "ThermalContrast.h"
+#include <vector>
+#include <cmath>
+#include <limits>
+
+//	operators of the streaming graph (ThermoPipeline.h)
+//
+//	transforms mirror the TermoAnalizer steps that used to rewrite the whole cube: frame window (obj.temp(:,:,a:b)),
+//	resampling on a uniform time base (correctfs), the adaptive wiener filter (filtroSpaziale) and a temporal IIR
+//	filter (filtroTemporale, causal here: filtfilt needs the whole series). sinks wrap the streaming kernels. times of
+//	the blocks are seconds from the first frame of the source.
+
+//	frames first..last (0 based, inclusive) of the input
+class CWindowOp : public COperator
+{
+private:
+	int64_t		mFirst;
+	int64_t		mLast;
+
+public:
+	CWindowOp(int64_t first, int64_t last) :
+		mFirst(first),
+		mLast(last)
+	{
+	}
+
+	bool Process(const SFrameBlockPtr &in, CBlockAllocator &alloc, SFrameBlockPtr &out)
+	{
+		int64_t		begin = std::max(mFirst, in->first), end = std::min(mLast + 1, in->first + (int64_t)in->numFrames);
+
+		if (begin >= end)
+			return true;
+		if (begin == in->first && end == in->first + (int64_t)in->numFrames) {
+			out = in;
+			return true;
+		}
+
+		size_t							n = (size_t)(end - begin), offset = (size_t)(begin - in->first);
+		std::shared_ptr<SFrameBlock>	block = alloc.Allocate(in->rows, in->cols, n, begin);
+
+		std::copy(in->frame(offset), in->frame(offset) + n * in->numPixels(), block->data.begin());
+		std::copy(in->time.begin() + offset, in->time.begin() + offset + n, block->time.begin());
+		out = block;
+
+		return true;
+	}
+};
+
+//	linear interpolation on t0 + k / fs, t0 the time of the first input frame; output frames are renumbered
+class CResampleOp : public COperator
+{
+private:
+	double					mFs;
+	std::vector<float>		mPrevFrame;
+	double					mPrevTime;
+	double					mStart;
+	int64_t					mNext;			//	next output frame
+
+public:
+	CResampleOp(double fs) :
+		mFs(fs),
+		mPrevTime(0.0),
+		mStart(0.0),
+		mNext(0)
+	{
+	}
+
+	bool Process(const SFrameBlockPtr &in, CBlockAllocator &alloc, SFrameBlockPtr &out)
+	{
+		size_t					pixels = in->numPixels();
+		std::vector<size_t>		segment;		//	per output frame, the input frame at its right (0 pairs with the held frame)
+		std::vector<double>		times;
+
+		if (mPrevFrame.empty()) {
+			mStart = in->time[0];
+			mPrevTime = in->time[0];
+			mPrevFrame.assign(in->frame(0), in->frame(0) + pixels);
+		}
+
+		//	output times covered by [previous frame, last frame of the block]
+		for (size_t f = 0; f < in->numFrames; ++f) {
+			double		t = mStart + (double)mNext / mFs;
+
+			while (t <= in->time[f]) {
+				segment.push_back(f);
+				times.push_back(t);
+				++mNext;
+				t = mStart + (double)mNext / mFs;
+			}
+		}
+
+		if (!times.empty()) {
+			std::shared_ptr<SFrameBlock>	block = alloc.Allocate(in->rows, in->cols, times.size(), mNext - (int64_t)times.size());
+
+			ParallelFor(times.size(), 1, [&](size_t begin, size_t end) {
+				for (size_t k = begin; k < end; ++k) {
+					size_t			f = segment[k];
+					const float		*right = in->frame(f);
+					const float		*left = f == 0 ? mPrevFrame.data() : in->frame(f - 1);
+					double			t0 = f == 0 ? mPrevTime : in->time[f - 1], t1 = in->time[f];
+					double			w = t1 > t0 ? (times[k] - t0) / (t1 - t0) : 1.0;
+					float			*dst = &block->data[k * pixels];
+
+					for (size_t p = 0; p < pixels; ++p)
+						dst[p] = (float)((1.0 - w) * left[p] + w * right[p]);
+				}
+			});
+			std::copy(times.begin(), times.end(), block->time.begin());
+			out = block;
+		}
+
+		mPrevTime = in->time[in->numFrames - 1];
+		mPrevFrame.assign(in->frame(in->numFrames - 1), in->frame(in->numFrames - 1) + pixels);
+
+		return true;
+	}
+};
+
+//	adaptive wiener filter on size x size neighbourhoods, as matlab's wiener2: local mean m and variance v, noise the
+//	mean local variance of the frame, out = m + max(v - noise, 0) / max(v, noise) (x - m). borders use the part of the
+//	neighbourhood inside the frame
+class CWienerOp : public COperator
+{
+private:
+	size_t		mSize;
+
+public:
+	CWienerOp(size_t size) :
+		mSize(std::max<size_t>(size, 1))
+	{
+	}
+
+	bool Process(const SFrameBlockPtr &in, CBlockAllocator &alloc, SFrameBlockPtr &out)
+	{
+		size_t							rows = in->rows, cols = in->cols, pixels = in->numPixels();
+		std::shared_ptr<SFrameBlock>	block = alloc.Allocate(rows, cols, in->numFrames, in->first);
+		ptrdiff_t						lo = (ptrdiff_t)(mSize - 1) / 2, hi = (ptrdiff_t)mSize / 2;
+
+		ParallelFor(in->numFrames, 1, [&](size_t begin, size_t end) {
+			//	summed area tables of x and x^2, (rows + 1) x (cols + 1)
+			std::vector<double>		s1((rows + 1) * (cols + 1), 0.0), s2((rows + 1) * (cols + 1), 0.0);
+			std::vector<double>		mean(pixels), var(pixels);
+
+			for (size_t f = begin; f < end; ++f) {
+				const float		*x = in->frame(f);
+				float			*dst = &block->data[f * pixels];
+				double			noise = 0.0;
+
+				for (size_t c = 0; c < cols; ++c) {
+					for (size_t r = 0; r < rows; ++r) {
+						double		v = x[r + c * rows];
+						size_t		i = (r + 1) + (c + 1) * (rows + 1);
+
+						s1[i] = v + s1[i - 1] + s1[i - rows - 1] - s1[i - rows - 2];
+						s2[i] = v * v + s2[i - 1] + s2[i - rows - 1] - s2[i - rows - 2];
+					}
+				}
+				for (size_t c = 0; c < cols; ++c) {
+					size_t		c0 = (size_t)std::max<ptrdiff_t>(0, (ptrdiff_t)c - lo), c1 = std::min(cols, c + hi + 1);
+
+					for (size_t r = 0; r < rows; ++r) {
+						size_t		r0 = (size_t)std::max<ptrdiff_t>(0, (ptrdiff_t)r - lo), r1 = std::min(rows, r + hi + 1);
+						double		count = (double)((r1 - r0) * (c1 - c0));
+						double		a = s1[r1 + c1 * (rows + 1)] - s1[r0 + c1 * (rows + 1)] - s1[r1 + c0 * (rows + 1)] + s1[r0 + c0 * (rows + 1)];
+						double		b = s2[r1 + c1 * (rows + 1)] - s2[r0 + c1 * (rows + 1)] - s2[r1 + c0 * (rows + 1)] + s2[r0 + c0 * (rows + 1)];
+						size_t		i = r + c * rows;
+
+						mean[i] = a / count;
+						var[i] = std::max(b / count - mean[i] * mean[i], 0.0);
+						noise += var[i];
+					}
+				}
+				noise /= (double)pixels;
+				for (size_t i = 0; i < pixels; ++i) {
+					double		v = std::max(var[i], noise);
+
+					dst[i] = (float)(v > 0.0 ? mean[i] + std::max(var[i] - noise, 0.0) / v * (x[i] - mean[i]) : mean[i]);
+				}
+			}
+		});
+
+		std::copy(in->time.begin(), in->time.end(), block->time.begin());
+		out = block;
+
+		return true;
+	}
+};
+
+//	causal IIR filter b / a on every pixel (direct form II transposed), the state starts in steady state on the first frame
+class CIirOp : public COperator
+{
+private:
+	std::vector<double>		mB;
+	std::vector<double>		mA;
+	std::vector<double>		mState;			//	order planes
+	bool					mStarted;
+
+public:
+	CIirOp(const std::vector<double> &b, const std::vector<double> &a) :
+		mB(b),
+		mA(a),
+		mStarted(false)
+	{
+		size_t		order = std::max(b.size(), a.size());
+
+		mB.resize(order, 0.0);
+		mA.resize(order, 0.0);
+		for (size_t k = 0; k < order; ++k) {
+			mB[k] /= a[0];
+			mA[k] /= a[0];
+		}
+	}
+
+	bool Process(const SFrameBlockPtr &in, CBlockAllocator &alloc, SFrameBlockPtr &out)
+	{
+		size_t							pixels = in->numPixels(), order = mB.size();
+		std::shared_ptr<SFrameBlock>	block = alloc.Allocate(in->rows, in->cols, in->numFrames, in->first);
+
+		if (!mStarted) {
+			//	steady state for the first frame, so the output does not start with a step from 0
+			std::vector<double>		zi(order, 0.0);
+			double					gainB = 0.0, gainA = 0.0;
+
+			for (size_t k = 0; k < order; ++k) {
+				gainB += mB[k];
+				gainA += mA[k];
+			}
+
+			double		y = gainA != 0.0 ? gainB / gainA : 1.0;
+
+			for (size_t k = order - 1; k >= 1; --k)
+				zi[k - 1] = (k < order - 1 ? zi[k] : 0.0) + mB[k] - mA[k] * y;
+			mState.resize(order * pixels);
+			for (size_t k = 0; k + 1 < order; ++k)
+				for (size_t p = 0; p < pixels; ++p)
+					mState[k * pixels + p] = zi[k] * in->frame(0)[p];
+			mStarted = true;
+		}
+
+		ParallelFor(pixels, 4096, [&](size_t begin, size_t end) {
+			for (size_t f = 0; f < in->numFrames; ++f) {
+				const float		*x = in->frame(f);
+				float			*y = &block->data[f * pixels];
+
+				for (size_t p = begin; p < end; ++p) {
+					double		xv = x[p], yv = mB[0] * xv + (order > 1 ? mState[p] : 0.0);
+
+					for (size_t k = 1; k < order; ++k)
+						mState[(k - 1) * pixels + p] = (k + 1 < order ? mState[k * pixels + p] : 0.0) + mB[k] * xv - mA[k] * yv;
+					y[p] = (float)yv;
+				}
+			}
+		});
+
+		std::copy(in->time.begin(), in->time.end(), block->time.begin());
+		out = block;
+
+		return true;
+	}
+};
+
+//	heat source frames q = rhoC (dT/dt - alpha lap(T)) (HeatSource.h), one per input frame. the output lags halfWidth
+//	frames behind the input, the last ones come out of Finish. the derivatives follow the frame times of the blocks, fs
+//	is only the nominal rate and 0 takes it from the first two input frames
+class CHeatSourceOp : public COperator
+{
+private:
+	SHeatSourceParams				mParams;
+	std::unique_ptr<CHeatSource>	mEngine;
+	int64_t							mFirst;
+	std::vector<float>				mPending;
+	std::vector<double>				mPendingTimes;
+	int64_t							mPendingFirst;
+
+	bool Start(const SFrameBlock &in)
+	{
+		if (!(mParams.fs > 0.0)) {
+			if (in.numFrames < 2 || !(in.time[1] > in.time[0])) {
+				mError = "heatsource needs fs or increasing frame times.";
+				return false;
+			}
+			mParams.fs = 1.0 / (in.time[1] - in.time[0]);
+		}
+		mEngine.reset(new CHeatSource(in.rows, in.cols, mParams));
+		mFirst = in.first;
+		if (!mEngine->valid()) {
+			mError = mEngine->error();
+			return false;
+		}
+
+		return true;
+	}
+
+	void Collect(int64_t index, double t, const float *q, size_t pixels)
+	{
+		if (mPendingTimes.empty())
+			mPendingFirst = index;
+		mPending.insert(mPending.end(), q, q + pixels);
+		mPendingTimes.push_back(t);
+	}
+
+	void Flush(size_t rows, size_t cols, CBlockAllocator &alloc, SFrameBlockPtr &out)
+	{
+		size_t		n = mPendingTimes.size();
+
+		out.reset();
+		if (n == 0)
+			return;
+
+		std::shared_ptr<SFrameBlock>	block = alloc.Allocate(rows, cols, n, mFirst + mPendingFirst);
+
+		std::copy(mPending.begin(), mPending.end(), block->data.begin());
+		std::copy(mPendingTimes.begin(), mPendingTimes.end(), block->time.begin());
+		mPending.clear();
+		mPendingTimes.clear();
+		out = block;
+	}
+
+public:
+	CHeatSourceOp(const SHeatSourceParams &params) :
+		mParams(params),
+		mFirst(0),
+		mPendingFirst(0)
+	{
+	}
+
+	//	sum of q dt over the frames so far, empty before the first block
+	std::vector<double> integral() const
+	{
+		return mEngine != NULL ? mEngine->integral() : std::vector<double>();
+	}
+
+	bool Process(const SFrameBlockPtr &in, CBlockAllocator &alloc, SFrameBlockPtr &out)
+	{
+		if (mEngine == NULL && !Start(*in))
+			return false;
+
+		size_t		pixels = in->numPixels();
+		auto		emit = [&](int64_t index, double t, const float *q) { Collect(index, t, q, pixels); };
+
+		if (!mEngine->Push(in->data.data(), in->time.data(), in->numFrames, emit)) {
+			mError = mEngine->error();
+			return false;
+		}
+		Flush(in->rows, in->cols, alloc, out);
+
+		return true;
+	}
+
+	bool Finish(CBlockAllocator &alloc, SFrameBlockPtr &out)
+	{
+		out.reset();
+		if (mEngine == NULL)
+			return true;
+
+		size_t		pixels = mEngine->rows() * mEngine->cols();
+		auto		emit = [&](int64_t index, double t, const float *q) { Collect(index, t, q, pixels); };
+
+		if (!mEngine->Finish(emit)) {
+			mError = mEngine->error();
+			return false;
+		}
+		Flush(mEngine->rows(), mEngine->cols(), alloc, out);
+
+		return true;
+	}
+};
+
+class CRegisterOp : public COperator
+{
+private:
+	CFrameRegistration			mReg;
+	std::vector<SFrameShift>	mShifts;
+	bool						mWarp;
+
+public:
+	CRegisterOp(size_t rows, size_t cols, const SRegistrationParams &params) :
+		mReg(rows, cols, params),
+		mWarp(params.interp != SRegistrationParams::ipNone)
+	{
+	}
+
+	const std::vector<SFrameShift> &shifts() const
+	{
+		return mShifts;
+	}
+
+	bool Process(const SFrameBlockPtr &in, CBlockAllocator &alloc, SFrameBlockPtr &out)
+	{
+		size_t		first = mShifts.size();
+
+		mShifts.resize(first + in->numFrames);
+		if (!mWarp) {
+			mReg.Push(in->data.data(), in->numFrames, (float *)NULL, &mShifts[first]);
+			out = in;
+			return true;
+		}
+
+		std::shared_ptr<SFrameBlock>	block = alloc.Allocate(in->rows, in->cols, in->numFrames, in->first);
+
+		mReg.Push(in->data.data(), in->numFrames, block->data.data(), &mShifts[first]);
+		std::copy(in->time.begin(), in->time.end(), block->time.begin());
+		out = block;
+
+		return true;
+	}
+};
+
+class CLockInOp : public COperator
+{
+private:
+	CLockInAccumulator		mAcc;
+
+public:
+	CLockInOp(size_t numPixels, const std::vector<double> &freqs) :
+		mAcc(numPixels, freqs)
+	{
+	}
+
+	const CLockInAccumulator &accumulator() const
+	{
+		return mAcc;
+	}
+
+	bool Process(const SFrameBlockPtr &in, CBlockAllocator &alloc, SFrameBlockPtr &out)
+	{
+		(void)alloc;
+		(void)out;
+		mAcc.Push(in->data.data(), in->time.data(), in->numFrames);
+
+		return true;
+	}
+};
+
+class CContrastOp : public COperator
+{
+private:
+	CThermalContrast		mContrast;
+
+public:
+	CContrastOp(size_t rows, size_t cols, const SContrastParams &params) :
+		mContrast(rows, cols, params)
+	{
+		mError = mContrast.error();
+	}
+
+	const CThermalContrast &contrast() const
+	{
+		return mContrast;
+	}
+
+	bool Process(const SFrameBlockPtr &in, CBlockAllocator &alloc, SFrameBlockPtr &out)
+	{
+		(void)alloc;
+		(void)out;
+		if (!mContrast.Push(in->data.data(), in->time.data(), in->numFrames)) {
+			mError = mContrast.error();
+			return false;
+		}
+
+		return true;
+	}
+};
+
+//	per pixel mean, standard deviation, min, max and the frame of the max (0 based, in input order)
+class CStatsOp : public COperator
+{
+private:
+	size_t					mNumPixels;
+	int64_t					mCount;
+	std::vector<double>		mSum;
+	std::vector<double>		mSum2;
+	std::vector<double>		mMin;
+	std::vector<double>		mMax;
+	std::vector<double>		mArgMax;
+
+public:
+	CStatsOp(size_t numPixels) :
+		mNumPixels(numPixels),
+		mCount(0),
+		mSum(numPixels, 0.0),
+		mSum2(numPixels, 0.0),
+		mMin(numPixels, std::numeric_limits<double>::infinity()),
+		mMax(numPixels, -std::numeric_limits<double>::infinity()),
+		mArgMax(numPixels, 0.0)
+	{
+	}
+
+	bool Process(const SFrameBlockPtr &in, CBlockAllocator &alloc, SFrameBlockPtr &out)
+	{
+		(void)alloc;
+		(void)out;
+		ParallelFor(mNumPixels, 4096, [&](size_t begin, size_t end) {
+			for (size_t f = 0; f < in->numFrames; ++f) {
+				const float		*x = in->frame(f);
+				double			index = (double)(mCount + (int64_t)f);
+
+				for (size_t p = begin; p < end; ++p) {
+					double		v = x[p];
+
+					mSum[p] += v;
+					mSum2[p] += v * v;
+					mMin[p] = std::min(mMin[p], v);
+					if (v > mMax[p]) {
+						mMax[p] = v;
+						mArgMax[p] = index;
+					}
+				}
+			}
+		});
+		mCount += (int64_t)in->numFrames;
+
+		return true;
+	}
+
+	int64_t count() const
+	{
+		return mCount;
+	}
+
+	void Result(double *mean, double *stdDev, double *minimum, double *maximum, double *argMax) const
+	{
+		double		n = (double)std::max<int64_t>(mCount, 1);
+
+		for (size_t p = 0; p < mNumPixels; ++p) {
+			mean[p] = mSum[p] / n;
+			stdDev[p] = mCount > 1 ? sqrt(std::max(mSum2[p] - mSum[p] * mSum[p] / n, 0.0) / (n - 1.0)) : 0.0;
+			minimum[p] = mMin[p];
+			maximum[p] = mMax[p];
+			argMax[p] = mArgMax[p];
+		}
+	}
+};
+
+//	TSR on the numFrames frames after the pulse frame (0 based, in input order), dT from the mean of the
+//	baselineFrames frames before the pulse, times (k + 1) / fs from the pulse
+class CTsrOp : public COperator
+{
+private:
+	size_t					mNumPixels;
+	int64_t					mPulse;
+	int64_t					mBaselineFirst;
+	int64_t					mCount;
+	std::vector<double>		mBaseline;
+	int64_t					mBaselineCount;
+	size_t					mNumTimes;
+	size_t					mPushed;
+	CTsrAccumulator			mAcc;
+
+	static std::vector<double> Times(size_t numFrames, double fs)
+	{
+		std::vector<double>		t(numFrames);
+
+		for (size_t k = 0; k < numFrames; ++k)
+			t[k] = (double)(k + 1) / fs;
+
+		return t;
+	}
+
+public:
+	CTsrOp(size_t numPixels, int64_t pulse, size_t numFrames, size_t baselineFrames, size_t degree, double fs, double minDelta) :
+		mNumPixels(numPixels),
+		mPulse(pulse),
+		mBaselineFirst(std::max<int64_t>(0, pulse - (int64_t)baselineFrames)),
+		mCount(0),
+		mBaseline(numPixels, 0.0),
+		mBaselineCount(0),
+		mNumTimes(numFrames),
+		mPushed(0),
+		mAcc(numPixels, Times(numFrames, fs), degree, minDelta)
+	{
+	}
+
+	const CTsrAccumulator &accumulator() const
+	{
+		return mAcc;
+	}
+
+	bool Process(const SFrameBlockPtr &in, CBlockAllocator &alloc, SFrameBlockPtr &out)
+	{
+		(void)alloc;
+		(void)out;
+		if (!mAcc.valid()) {
+			mError = "Invalid TSR time base or degree.";
+			return false;
+		}
+
+		size_t		first = in->numFrames, last = 0;
+
+		for (size_t f = 0; f < in->numFrames; ++f) {
+			int64_t		index = mCount + (int64_t)f;
+
+			if (index >= mBaselineFirst && index < mPulse) {
+				const float		*x = in->frame(f);
+
+				for (size_t p = 0; p < mNumPixels; ++p)
+					mBaseline[p] += x[p];
+				++mBaselineCount;
+			}
+			else if (index > mPulse) {
+				first = std::min(first, f);
+				last = f + 1;
+			}
+		}
+
+		//	the post pulse frames of the block go in one push, the time base bounds how many are used
+		if (first < last && !mAcc.complete()) {
+			if (mCount + (int64_t)first == mPulse + 1) {
+				for (size_t p = 0; p < mNumPixels; ++p)
+					mBaseline[p] /= (double)std::max<int64_t>(mBaselineCount, 1);
+				mAcc.SetBaseline(mBaseline.data());
+			}
+			mAcc.Push(in->frame(first), std::min(last - first, mNumTimes - mPushed));
+			mPushed += std::min(last - first, mNumTimes - mPushed);
+		}
+		mCount += (int64_t)in->numFrames;
+
+		return true;
+	}
+
+	bool Finish(CBlockAllocator &alloc, SFrameBlockPtr &out)
+	{
+		(void)alloc;
+		out.reset();
+		if (!mAcc.complete()) {
+			mError = "The recording ended before the TSR time base.";
+			return false;
+		}
+
+		return true;
+	}
+};
+
+class CHotZoneOp : public COperator
+{
+private:
+	CHotZoneTracker		mTracker;
+
+public:
+	CHotZoneOp(size_t rows, size_t cols, const std::vector<double> &isotherms, const SHotZoneParams &params) :
+		mTracker(rows, cols, isotherms, params)
+	{
+	}
+
+	const CHotZoneTracker &tracker() const
+	{
+		return mTracker;
+	}
+
+	bool Process(const SFrameBlockPtr &in, CBlockAllocator &alloc, SFrameBlockPtr &out)
+	{
+		(void)alloc;
+		(void)out;
+		mTracker.Push(in->data.data(), in->numFrames);
+
+		return true;
+	}
+};
@@ -0,0 +1,99 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "mex.h"
+#include "MexHelpers.h"
+#include "PulsedPhase.h"
+#include "ThermoProfiler.h"
+
+//	mex PptMex.cpp
+
+//	res = PptMex(cube, fs, freqs, opts)
+//	cube is the rows x cols x n post pulse decay (double or single), fs the frame rate [Hz], freqs the frequencies of
+//	the phasegrams. opts is an optional struct with window ('rect', 'hann', 'hamming', 'tukey', default 'tukey'),
+//	tukeyAlpha (tapered tail fraction, default 0.25), padFactor (zero padding, default 2) and baseline (rows x cols
+//	map or scalar removed before the transform, default 0).
+//	res has A and P (rows x cols x numel(freqs)), freqs (frequencies of the bins actually used) and nfft
+
+SEnumInfo	WindowEnumInfo[] = {
+	{ "rect",					SPptParams::wnRect },
+	{ "hann",					SPptParams::wnHann },
+	{ "hamming",				SPptParams::wnHamming },
+	{ "tukey",					SPptParams::wnTukey },
+	{ NULL,						-1 },
+};
+
+//	the mex entry point
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	if (nrhs < 3 || nrhs > 4 || nlhs > 1)
+		mexErrMsgTxt("Must have 3-4 inputs and 0-1 outputs.");
+
+	CThermoStage		stage("ppt", "PptMex", (double)mxGetElementSize(prhs[0]) * mxGetNumberOfElements(prhs[0]));
+
+	const mxArray			*cube = prhs[0];
+	const mxArray			*opts = nrhs > 3 ? prhs[3] : NULL;
+	const mwSize			*dims = mxGetDimensions(cube);
+	size_t					rows = dims[0], cols = dims[1];
+	size_t					numPixels = rows * cols;
+	size_t					numFrames = numPixels > 0 ? mxGetNumberOfElements(cube) / numPixels : 0;
+	const double			*f = mxGetDoubleInput(prhs[2], "freqs");
+	std::vector<double>		freqs(f, f + mxGetNumberOfElements(prhs[2]));
+	const mxArray			*baseline = mxGetOptionField(opts, "baseline");
+	std::string				window = mxGetOption(opts, "window", "tukey");
+	std::vector<double>		plane;
+	SPptParams				params;
+	int						value;
+
+	if (mxIsComplex(cube) || (!mxIsDouble(cube) && !mxIsSingle(cube)) || mxGetNumberOfDimensions(cube) > 3)
+		mexErrMsgTxt("cube must be a real double or single rows x cols x n array.");
+	if (numFrames < 2)
+		mexErrMsgTxt("Need at least 2 frames.");
+
+	params.fs = mxGetScalarInput(prhs[1], "fs");
+	if (!(params.fs > 0.0))
+		mexErrMsgTxt("fs must be positive.");
+	for (size_t i = 0; i < freqs.size(); ++i)
+		if (!(freqs[i] >= 0.0) || freqs[i] > params.fs / 2.0)
+			mexErrMsgTxt("Frequencies must be between 0 and fs / 2.");
+
+	value = ParseEnum(WindowEnumInfo, window.c_str());
+	if (value < 0)
+		mexErrMsgTxt("Unknown window.");
+	params.window = (SPptParams::EWindow)value;
+	params.tukeyAlpha = mxGetOption(opts, "tukeyAlpha", 0.25);
+	params.padFactor = (size_t)mxGetOption(opts, "padFactor", 2.0);
+
+	if (baseline != NULL && !mxIsEmpty(baseline)) {
+		const double	*data = mxGetDoubleInput(baseline, "baseline");
+
+		if (mxGetNumberOfElements(baseline) == numPixels)
+			plane.assign(data, data + numPixels);
+		else if (mxGetNumberOfElements(baseline) == 1)
+			plane.assign(numPixels, data[0]);
+		else
+			mexErrMsgTxt("baseline must be a scalar or a rows x cols map.");
+	}
+
+	CPulsedPhase	ppt(numPixels, numFrames, freqs, params);
+	const char		*fields[] = { "A", "P", "freqs", "nfft" };
+	mxArray			*res = mxCreateStructMatrix(1, 1, sizeof(fields) / sizeof(fields[0]), fields);
+	mwSize			outDims[3] = { rows, cols, freqs.size() };
+	mxArray			*amp = mxCreateNumericArray(3, outDims, mxDOUBLE_CLASS, mxREAL);
+	mxArray			*phase = mxCreateNumericArray(3, outDims, mxDOUBLE_CLASS, mxREAL);
+	mxArray			*binFreqs = mxCreateDoubleMatrix(freqs.size(), 1, mxREAL);
+
+	if (mxIsDouble(cube))
+		ppt.Run((const double *)mxGetData(cube), plane.empty() ? NULL : plane.data(), mxGetPr(amp), mxGetPr(phase));
+	else
+		ppt.Run((const float *)mxGetData(cube), plane.empty() ? NULL : plane.data(), mxGetPr(amp), mxGetPr(phase));
+
+	for (size_t i = 0; i < freqs.size(); ++i)
+		mxGetPr(binFreqs)[i] = ppt.binFreq(i);
+
+	mxSetFieldByNumber(res, 0, 0, amp);
+	mxSetFieldByNumber(res, 0, 1, phase);
+	mxSetFieldByNumber(res, 0, 2, binFreqs);
+	mxSetFieldByNumber(res, 0, 3, mxCreateDoubleScalar((double)ppt.nfft()));
+
+	plhs[0] = res;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "Fft.h"
+#include "ThermoParallel.h"
+#include <vector>
+#include <complex>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+//	pulsed phase thermography (PPT)
+//
+//	TermoAnalizer.LockIn transforms the whole recording, baseline and pulse included, without a window and keeps every
+//	bin of every pixel. here only the post pulse decay is transformed (the caller trims the cube), the pre pulse
+//	baseline is removed, a window is applied and the series is zero padded to a power of two. pixels are processed
+//	in tiles: the tile is gathered frame by frame (contiguous reads in the matlab cube), its time series go two at a
+//	time through one complex FFT and only the bins closest to the requested frequencies are kept.
+
+struct SPptParams
+{
+	enum EWindow
+	{
+		wnRect = 0,
+		wnHann,
+		wnHamming,
+		wnTukey
+	};
+
+	double		fs;					//	frame rate [Hz]
+	EWindow		window;
+	double		tukeyAlpha;			//	tapered fraction of the tukey window
+	size_t		padFactor;			//	fft length is the next power of two of padFactor * numFrames
+};
+
+class CPulsedPhase
+{
+private:
+	size_t					mNumPixels;
+	size_t					mNumFrames;
+	SPptParams				mParams;
+	CFftPlan				mPlan;
+	std::vector<double>		mWindow;
+	double					mWindowSum;
+	std::vector<size_t>		mBins;
+
+public:
+	CPulsedPhase(size_t numPixels, size_t numFrames, const std::vector<double> &freqs, const SPptParams &params) :
+		mNumPixels(numPixels),
+		mNumFrames(numFrames),
+		mParams(params),
+		mPlan(std::max<size_t>(params.padFactor, 1) * numFrames),
+		mWindow(numFrames),
+		mWindowSum(0.0),
+		mBins(freqs.size())
+	{
+		size_t		n = mPlan.size();
+
+		for (size_t k = 0; k < numFrames; ++k) {
+			double		x = numFrames > 1 ? (double)k / (double)(numFrames - 1) : 0.0;
+			double		w = 1.0;
+
+			switch (params.window) {
+				case SPptParams::wnHann:
+					w = 0.5 - 0.5 * cos(2.0 * M_PI * x);
+					break;
+				case SPptParams::wnHamming:
+					w = 0.54 - 0.46 * cos(2.0 * M_PI * x);
+					break;
+				case SPptParams::wnTukey:
+					//	the decay starts at the pulse, only its tail is tapered
+					if (params.tukeyAlpha > 0.0 && x > 1.0 - params.tukeyAlpha)
+						w = 0.5 + 0.5 * cos(M_PI * (x - 1.0 + params.tukeyAlpha) / params.tukeyAlpha);
+					break;
+				default:
+					break;
+			}
+			mWindow[k] = w;
+			mWindowSum += w;
+		}
+
+		for (size_t i = 0; i < freqs.size(); ++i)
+			mBins[i] = std::min(n / 2, (size_t)lround(freqs[i] * (double)n / params.fs));
+	}
+
+	size_t nfft() const
+	{
+		return mPlan.size();
+	}
+
+	//	frequency of the bin used for the i-th requested frequency
+	double binFreq(size_t i) const
+	{
+		return (double)mBins[i] * mParams.fs / (double)mPlan.size();
+	}
+
+	//	cube has numFrames frames of numPixels samples, baseline (optional) one value per pixel. amp and phase get one
+	//	plane per requested frequency; amplitudes are single sided and corrected for the window gain
+	template <typename kind>
+	void Run(const kind *cube, const double *baseline, double *amp, double *phase) const
+	{
+		const size_t	tile = 32;
+		size_t			n = mPlan.size(), numTiles = (mNumPixels + tile - 1) / tile;
+
+		ParallelFor(numTiles, 1, [&](size_t begin, size_t end) {
+			std::vector<double>					series(tile * n, 0.0);
+			std::vector<std::complex<double> >	specA(n / 2 + 1), specB(n / 2 + 1), work;
+
+			for (size_t t = begin; t < end; ++t) {
+				size_t		p0 = t * tile, count = std::min(tile, mNumPixels - p0);
+
+				//	gather the tile, zero padding stays from the initialization
+				for (size_t k = 0; k < mNumFrames; ++k) {
+					const kind		*frame = cube + k * mNumPixels + p0;
+
+					for (size_t p = 0; p < count; ++p)
+						series[p * n + k] = ((double)frame[p] - (baseline != NULL ? baseline[p0 + p] : 0.0)) * mWindow[k];
+				}
+
+				for (size_t p = 0; p < count; p += 2) {
+					bool	pair = p + 1 < count;
+
+					mPlan.ForwardRealPair(&series[p * n], pair ? &series[(p + 1) * n] : NULL, specA.data(), pair ? specB.data() : NULL, work);
+					for (size_t i = 0; i < mBins.size(); ++i) {
+						double		scale = (mBins[i] == 0 || 2 * mBins[i] == n ? 1.0 : 2.0) / mWindowSum;
+
+						for (size_t q = 0; q < (pair ? 2u : 1u); ++q) {
+							std::complex<double>	z = q == 0 ? specA[mBins[i]] : specB[mBins[i]];
+							size_t					out = i * mNumPixels + p0 + p + q;
+
+							if (amp != NULL)
+								amp[out] = std::abs(z) * scale;
+							if (phase != NULL)
+								phase[out] = std::arg(z);
+						}
+					}
+				}
+			}
+		});
+	}
+};
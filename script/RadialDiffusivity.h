@@ -0,0 +1,321 @@
+#pragma once
+
+#include "ThermoParallel.h"
+#include <vector>
+#include <cmath>
+#include <cstddef>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+//	radial phase/amplitude slope method on lock-in maps
+//
+//	evaluateDiffusivity fits the unwrapped phase along one row and one column. here the complex field A*exp(iP) is
+//	sampled along numRays rays leaving the spot centre (bilinear interpolation of the phasor, so the phase wrap does
+//	not smear the samples), the phase is unwrapped along each ray and phase and log-amplitude are fitted against the
+//	radius with weights A^2 (phase and log-amplitude noise both go like 1/A). for a thermal wave both slopes are
+//	sqrt(pi f / D), so D = pi f / m^2. the squared phase slopes of all rays are then fitted with the quadratic form
+//	m(theta)^2 / (pi f) = n' inv(D) n, which gives the in-plane diffusivity tensor (anisotropy ellipse).
+//	maps are matlab column major rows x cols, x runs along the columns, y along the rows, angles go from +x to +y.
+
+struct SRadialParams
+{
+	double		freq;				//	modulation frequency [Hz]
+	double		xc;					//	spot centre, 0 based pixels
+	double		yc;
+	double		mmpx;				//	mm per pixel
+	double		rStart;				//	fit range [mm]
+	double		rEnd;
+	double		step;				//	sampling step along the rays [px]
+	size_t		numRays;
+	double		tol;				//	samples touching pixels with A < tol are dropped
+};
+
+struct SRayFit
+{
+	double		angle;				//	[rad]
+	double		slopePhase;			//	[rad/mm]
+	double		interceptPhase;
+	double		r2Phase;
+	double		slopeAmp;			//	d ln(A) / dr [1/mm]
+	double		interceptAmp;
+	double		r2Amp;
+	double		dPhase;				//	pi f / slopePhase^2 [mm^2/s]
+	double		dAmp;				//	pi f / slopeAmp^2
+	double		dComb;				//	pi f / (slopePhase * slopeAmp)
+	size_t		numValid;
+};
+
+struct SAnisotropy
+{
+	bool		valid;
+	double		dxx;				//	diffusivity tensor [mm^2/s]
+	double		dyy;
+	double		dxy;
+	double		dMax;				//	principal values
+	double		dMin;
+	double		theta;				//	direction of dMax from +x [rad]
+	double		dx;					//	pi f / m^2 along x and y, what evaluateDiffusivity estimates
+	double		dy;
+	double		r2;					//	fit of m(theta)^2 over the rays
+};
+
+//	weighted least squares y = slope * x + intercept, samples with NaN or w <= 0 are skipped
+inline size_t FitLineWeighted(const double *x, const double *y, const double *w, size_t n, double &slope, double &intercept, double &r2)
+{
+	double		sw = 0.0, sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0, syy = 0.0;
+	size_t		used = 0;
+
+	slope = intercept = r2 = NAN;
+
+	for (size_t i = 0; i < n; ++i) {
+		double		wi = w == NULL ? 1.0 : w[i];
+
+		if (!(wi > 0.0) || std::isnan(x[i]) || std::isnan(y[i]))
+			continue;
+		sw += wi;
+		sx += wi * x[i];
+		sy += wi * y[i];
+		++used;
+	}
+
+	if (used < 2)
+		return used;
+
+	double		mx = sx / sw, my = sy / sw;
+
+	//	centred sums, the phase offsets can be large compared to the slopes
+	for (size_t i = 0; i < n; ++i) {
+		double		wi = w == NULL ? 1.0 : w[i];
+
+		if (!(wi > 0.0) || std::isnan(x[i]) || std::isnan(y[i]))
+			continue;
+		sxx += wi * (x[i] - mx) * (x[i] - mx);
+		sxy += wi * (x[i] - mx) * (y[i] - my);
+		syy += wi * (y[i] - my) * (y[i] - my);
+	}
+
+	if (sxx <= 0.0)
+		return used;
+
+	slope = sxy / sxx;
+	intercept = my - slope * mx;
+	r2 = syy > 0.0 ? (sxy * sxy) / (sxx * syy) : 1.0;
+
+	return used;
+}
+
+//	anisotropy ellipse: m^2 / (pi f) = a cos^2 + 2 b cos sin + c sin^2 over the rays, weighted by their phase R^2
+inline void FitDiffusivityEllipse(const std::vector<SRayFit> &rays, double freq, SAnisotropy &an)
+{
+	double		n[3][3] = { { 0 } }, v[3] = { 0 };
+	double		sw = 0.0, sq = 0.0, sqq = 0.0;
+	size_t		used = 0;
+
+	an.valid = false;
+	an.dxx = an.dyy = an.dxy = an.dMax = an.dMin = an.theta = an.dx = an.dy = an.r2 = NAN;
+
+	for (size_t k = 0; k < rays.size(); ++k) {
+		const SRayFit	&fit = rays[k];
+		double			w = fit.r2Phase;
+
+		if (fit.numValid < 3 || std::isnan(fit.slopePhase) || !(w > 0.0))
+			continue;
+
+		double		q = fit.slopePhase * fit.slopePhase / (M_PI * freq);
+		double		c = cos(fit.angle), s = sin(fit.angle);
+		double		basis[3] = { c * c, 2.0 * c * s, s * s };
+
+		for (int i = 0; i < 3; ++i) {
+			for (int j = 0; j < 3; ++j)
+				n[i][j] += w * basis[i] * basis[j];
+			v[i] += w * basis[i] * q;
+		}
+		sw += w;
+		sq += w * q;
+		sqq += w * q * q;
+		++used;
+	}
+
+	if (used < 3)
+		return;
+
+	//	3x3 normal equations, cramer is fine at this size
+	double		det = n[0][0] * (n[1][1] * n[2][2] - n[1][2] * n[2][1])
+					- n[0][1] * (n[1][0] * n[2][2] - n[1][2] * n[2][0])
+					+ n[0][2] * (n[1][0] * n[2][1] - n[1][1] * n[2][0]);
+
+	if (fabs(det) < 1e-300)
+		return;
+
+	double		coef[3];
+
+	for (int col = 0; col < 3; ++col) {
+		double		m[3][3];
+
+		for (int i = 0; i < 3; ++i)
+			for (int j = 0; j < 3; ++j)
+				m[i][j] = j == col ? v[i] : n[i][j];
+		coef[col] = (m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+					- m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+					+ m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0])) / det;
+	}
+
+	double		a = coef[0], b = coef[1], c = coef[2];
+	double		inv = a * c - b * b;
+
+	//	residual of the quadratic form for the R^2
+	double		ssRes = 0.0;
+
+	for (size_t k = 0; k < rays.size(); ++k) {
+		const SRayFit	&fit = rays[k];
+		double			w = fit.r2Phase;
+
+		if (fit.numValid < 3 || std::isnan(fit.slopePhase) || !(w > 0.0))
+			continue;
+
+		double		q = fit.slopePhase * fit.slopePhase / (M_PI * freq);
+		double		cs = cos(fit.angle), sn = sin(fit.angle);
+		double		e = q - (a * cs * cs + 2.0 * b * cs * sn + c * sn * sn);
+
+		ssRes += w * e * e;
+	}
+
+	double		ssTot = sqq - sq * sq / sw;
+
+	an.r2 = ssTot > 0.0 ? 1.0 - ssRes / ssTot : 1.0;
+	an.dx = a > 0.0 ? 1.0 / a : NAN;
+	an.dy = c > 0.0 ? 1.0 / c : NAN;
+
+	if (!(a > 0.0) || !(inv > 0.0))
+		return;
+
+	an.dxx = c / inv;
+	an.dyy = a / inv;
+	an.dxy = -b / inv;
+
+	double		mean = 0.5 * (an.dxx + an.dyy);
+	double		half = sqrt(0.25 * (an.dxx - an.dyy) * (an.dxx - an.dyy) + an.dxy * an.dxy);
+
+	an.dMax = mean + half;
+	an.dMin = mean - half;
+	an.theta = 0.5 * atan2(2.0 * an.dxy, an.dxx - an.dyy);
+	an.valid = true;
+}
+
+class CRadialDiffusivity
+{
+private:
+	SRadialParams			mParams;
+	std::vector<double>		mRadius;		//	[mm]
+	std::vector<double>		mPhase;			//	unwrapped, numSamples x numRays
+	std::vector<double>		mLogAmp;
+	std::vector<SRayFit>	mRays;
+	SAnisotropy				mAnisotropy;
+
+	void SampleRay(size_t ray, const double *re, const double *im, const unsigned char *ok, size_t rows, size_t cols)
+	{
+		size_t		ns = mRadius.size();
+		double		angle = 2.0 * M_PI * (double)ray / (double)mParams.numRays;
+		double		ca = cos(angle), sa = sin(angle);
+		double		*phase = &mPhase[ray * ns];
+		double		*logAmp = &mLogAmp[ray * ns];
+		std::vector<double>		weight(ns);
+		double		prev = NAN;
+
+		for (size_t j = 0; j < ns; ++j) {
+			double		rpx = mRadius[j] / mParams.mmpx;
+			double		x = mParams.xc + rpx * ca, y = mParams.yc + rpx * sa;
+
+			phase[j] = logAmp[j] = NAN;
+			weight[j] = 0.0;
+
+			if (x < 0.0 || y < 0.0 || x > (double)(cols - 1) || y > (double)(rows - 1))
+				continue;
+
+			size_t		x0 = (size_t)x, y0 = (size_t)y;
+			size_t		x1 = x0 + 1 < cols ? x0 + 1 : x0, y1 = y0 + 1 < rows ? y0 + 1 : y0;
+			double		fx = x - (double)x0, fy = y - (double)y0;
+			size_t		i00 = y0 + x0 * rows, i10 = y0 + x1 * rows, i01 = y1 + x0 * rows, i11 = y1 + x1 * rows;
+
+			if (!ok[i00] || !ok[i10] || !ok[i01] || !ok[i11])
+				continue;
+
+			double		zr = (1 - fy) * ((1 - fx) * re[i00] + fx * re[i10]) + fy * ((1 - fx) * re[i01] + fx * re[i11]);
+			double		zi = (1 - fy) * ((1 - fx) * im[i00] + fx * im[i10]) + fy * ((1 - fx) * im[i01] + fx * im[i11]);
+			double		mag2 = zr * zr + zi * zi;
+
+			if (!(mag2 > 0.0))
+				continue;
+
+			double		ph = atan2(zi, zr);
+
+			//	unwrap against the previous valid sample, like unwrap() skipping the holes
+			if (!std::isnan(prev))
+				ph -= 2.0 * M_PI * floor((ph - prev) / (2.0 * M_PI) + 0.5);
+			prev = ph;
+
+			phase[j] = ph;
+			logAmp[j] = 0.5 * log(mag2);
+			weight[j] = mag2;
+		}
+
+		SRayFit		&fit = mRays[ray];
+		double		pf = M_PI * mParams.freq;
+
+		fit.angle = angle;
+		fit.numValid = FitLineWeighted(mRadius.data(), phase, weight.data(), ns, fit.slopePhase, fit.interceptPhase, fit.r2Phase);
+		FitLineWeighted(mRadius.data(), logAmp, weight.data(), ns, fit.slopeAmp, fit.interceptAmp, fit.r2Amp);
+		fit.dPhase = pf / (fit.slopePhase * fit.slopePhase);
+		fit.dAmp = pf / (fit.slopeAmp * fit.slopeAmp);
+		fit.dComb = pf / fabs(fit.slopePhase * fit.slopeAmp);
+	}
+
+public:
+	//	phase and amp are rows x cols column major, phase is the wrapped lock-in phase
+	bool Run(const double *phase, const double *amp, size_t rows, size_t cols, const SRadialParams &params)
+	{
+		mParams = params;
+
+		if (rows < 2 || cols < 2 || params.numRays == 0 || !(params.mmpx > 0.0) || !(params.step > 0.0) || !(params.rEnd > params.rStart))
+			return false;
+
+		size_t		numSamples = (size_t)floor((params.rEnd - params.rStart) / (params.step * params.mmpx)) + 1;
+		size_t		n = rows * cols;
+
+		mRadius.resize(numSamples);
+		for (size_t j = 0; j < numSamples; ++j)
+			mRadius[j] = params.rStart + (double)j * params.step * params.mmpx;
+
+		std::vector<double>			re(n), im(n);
+		std::vector<unsigned char>	ok(n);
+
+		ParallelFor(n, 16384, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				ok[i] = amp[i] >= params.tol && std::isfinite(amp[i]) && std::isfinite(phase[i]);
+				re[i] = ok[i] ? amp[i] * cos(phase[i]) : 0.0;
+				im[i] = ok[i] ? amp[i] * sin(phase[i]) : 0.0;
+			}
+		});
+
+		mPhase.assign(numSamples * params.numRays, NAN);
+		mLogAmp.assign(numSamples * params.numRays, NAN);
+		mRays.resize(params.numRays);
+
+		ParallelFor(params.numRays, 4, [&](size_t begin, size_t end) {
+			for (size_t ray = begin; ray < end; ++ray)
+				SampleRay(ray, re.data(), im.data(), ok.data(), rows, cols);
+		});
+
+		FitDiffusivityEllipse(mRays, mParams.freq, mAnisotropy);
+
+		return true;
+	}
+
+	const std::vector<double> &radius() const { return mRadius; }
+	const std::vector<double> &phase() const { return mPhase; }
+	const std::vector<double> &logAmp() const { return mLogAmp; }
+	const std::vector<SRayFit> &rays() const { return mRays; }
+	const SAnisotropy &anisotropy() const { return mAnisotropy; }
+};
@@ -0,0 +1,104 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "mex.h"
+#include "MexHelpers.h"
+#include "RadialDiffusivity.h"
+#include "ThermoProfiler.h"
+
+//	mex RadialDiffusivityMex.cpp
+
+//	res = RadialDiffusivityMex(P, A, freq, xc, yc, mmpxratio, opts)
+//	P, A are the lock-in phase and amplitude maps, xc, yc the 1 based spot centre (column, row), opts is an optional
+//	struct with rStart, rEnd [mm], step [px], numRays and tol (see RadialDiffusivity.h)
+
+static mxArray *RayColumn(const std::vector<SRayFit> &rays, double SRayFit::*field)
+{
+	mxArray		*ret = mxCreateDoubleMatrix(rays.size(), 1, mxREAL);
+	double		*data = mxGetPr(ret);
+
+	for (size_t k = 0; k < rays.size(); ++k)
+		data[k] = rays[k].*field;
+
+	return ret;
+}
+
+static mxArray *EllipseStruct(const SAnisotropy &an)
+{
+	const char	*fields[] = { "valid", "D", "Dmax", "Dmin", "theta", "Dx", "Dy", "R2" };
+	mxArray		*ret = mxCreateStructMatrix(1, 1, sizeof(fields) / sizeof(fields[0]), fields);
+	double		tensor[4] = { an.dxx, an.dxy, an.dxy, an.dyy };
+
+	mxSetFieldByNumber(ret, 0, 0, mxCreateLogicalScalar(an.valid));
+	mxSetFieldByNumber(ret, 0, 1, mxCreateDoubleMatrixFrom(tensor, 2, 2));
+	mxSetFieldByNumber(ret, 0, 2, mxCreateDoubleScalar(an.dMax));
+	mxSetFieldByNumber(ret, 0, 3, mxCreateDoubleScalar(an.dMin));
+	mxSetFieldByNumber(ret, 0, 4, mxCreateDoubleScalar(an.theta));
+	mxSetFieldByNumber(ret, 0, 5, mxCreateDoubleScalar(an.dx));
+	mxSetFieldByNumber(ret, 0, 6, mxCreateDoubleScalar(an.dy));
+	mxSetFieldByNumber(ret, 0, 7, mxCreateDoubleScalar(an.r2));
+
+	return ret;
+}
+
+//	the mex entry point
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	if (nrhs < 6 || nrhs > 7 || nlhs > 1)
+		mexErrMsgTxt("Must have 6-7 inputs and 0-1 outputs.");
+
+	CThermoStage		stage("radialDiffusivity", "RadialDiffusivityMex", (double)mxGetElementSize(prhs[0]) * mxGetNumberOfElements(prhs[0]));
+
+	const double	*phase = mxGetDoubleInput(prhs[0], "P");
+	const double	*amp = mxGetDoubleInput(prhs[1], "A");
+	size_t			rows = mxGetM(prhs[0]), cols = mxGetN(prhs[0]);
+	const mxArray	*opts = nrhs > 6 ? prhs[6] : NULL;
+	SRadialParams	params;
+
+	if (mxGetNumberOfDimensions(prhs[0]) != 2 || mxGetM(prhs[1]) != rows || mxGetN(prhs[1]) != cols)
+		mexErrMsgTxt("P and A must be 2-D maps of the same size.");
+
+	params.freq = mxGetScalarInput(prhs[2], "freq");
+	params.xc = mxGetScalarInput(prhs[3], "xc") - 1.0;
+	params.yc = mxGetScalarInput(prhs[4], "yc") - 1.0;
+	params.mmpx = mxGetScalarInput(prhs[5], "mmpxratio");
+	params.step = mxGetOption(opts, "step", 0.5);
+	params.numRays = (size_t)mxGetOption(opts, "numRays", 180.0);
+	params.tol = mxGetOption(opts, "tol", 0.0);
+	params.rStart = mxGetOption(opts, "rStart", 0.0);
+	//	default range: up to the closest image border
+	params.rEnd = mxGetOption(opts, "rEnd", params.mmpx * std::min(std::min(params.xc, (double)cols - 1.0 - params.xc),
+		std::min(params.yc, (double)rows - 1.0 - params.yc)));
+
+	if (!(params.freq > 0.0) || !(params.mmpx > 0.0))
+		mexErrMsgTxt("freq and mmpxratio must be positive.");
+
+	CRadialDiffusivity	engine;
+
+	if (!engine.Run(phase, amp, rows, cols, params))
+		mexErrMsgTxt("Invalid fit range or sampling parameters.");
+
+	const std::vector<SRayFit>	&rays = engine.rays();
+	const char					*fields[] = { "angle", "Dphase", "Damp", "Dcomb", "slopePhase", "slopeAmp", "R2phase", "R2amp",
+									"numValid", "radius", "phase", "logAmp", "ellipse" };
+	mxArray						*res = mxCreateStructMatrix(1, 1, sizeof(fields) / sizeof(fields[0]), fields);
+	std::vector<double>			numValid(rays.size());
+
+	for (size_t k = 0; k < rays.size(); ++k)
+		numValid[k] = (double)rays[k].numValid;
+
+	mxSetFieldByNumber(res, 0, 0, RayColumn(rays, &SRayFit::angle));
+	mxSetFieldByNumber(res, 0, 1, RayColumn(rays, &SRayFit::dPhase));
+	mxSetFieldByNumber(res, 0, 2, RayColumn(rays, &SRayFit::dAmp));
+	mxSetFieldByNumber(res, 0, 3, RayColumn(rays, &SRayFit::dComb));
+	mxSetFieldByNumber(res, 0, 4, RayColumn(rays, &SRayFit::slopePhase));
+	mxSetFieldByNumber(res, 0, 5, RayColumn(rays, &SRayFit::slopeAmp));
+	mxSetFieldByNumber(res, 0, 6, RayColumn(rays, &SRayFit::r2Phase));
+	mxSetFieldByNumber(res, 0, 7, RayColumn(rays, &SRayFit::r2Amp));
+	mxSetFieldByNumber(res, 0, 8, mxCreateDoubleColumn(numValid));
+	mxSetFieldByNumber(res, 0, 9, mxCreateDoubleColumn(engine.radius()));
+	mxSetFieldByNumber(res, 0, 10, mxCreateDoubleMatrixFrom(engine.phase().data(), engine.radius().size(), rays.size()));
+	mxSetFieldByNumber(res, 0, 11, mxCreateDoubleMatrixFrom(engine.logAmp().data(), engine.radius().size(), rays.size()));
+	mxSetFieldByNumber(res, 0, 12, EllipseStruct(engine.anisotropy()));
+
+	plhs[0] = res;
+}
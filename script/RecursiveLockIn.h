@@ -0,0 +1,325 @@
+#pragma once
+
+#include "ThermoKernels.h"
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RECURSIVE_LOCKIN_SSE2
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+//	live lock-in, one frame at a time
+//
+//	the demodulation of CLockInAccumulator, X = mean((T - Tm) 2cos(wt)), Y = mean((T - Tm) 2sin(wt)), taken over the
+//	recent past instead of the whole recording so the maps follow the sample while it is being acquired:
+//		lmExponential	first order low pass with time constant tau, per frame with a = 1 - exp(-dt / tau)
+//							m += a (T - m),  X += a ((T - m) 2cos(wt) - X),  Y += a ((T - m) 2sin(wt) - Y)
+//						X, Y are divided by the accumulated weight so they are unbiased while the filter fills up.
+//						the 2w ripple left on X, Y is about 1 / (2 w tau) of the amplitude, tau should span a few periods
+//		lmSliding		exact sums over the last window frames, the frame falling out of the ring buffer is subtracted,
+//						so the result equals CLockInAccumulator over those frames. the ring holds window frames
+//	the reference is either the ideal sine at freq, phases are then relative to t = 0, or a measured reference (the
+//	laser drive on a pif analog input) demodulated the same way: the pixel phasors are rotated by the reference phasor,
+//	so the phase is relative to the actual excitation and a generator started at an arbitrary time cancels out. freq
+//	still has to be known, the reference only fixes the phase. everything is allocated in the constructor and Push
+//	runs on the calling thread (handing a frame to other threads costs more than the update): the exponential update
+//	of float and 16 bit frames with the simd variant of ThermoKernels.h for the cpu, the sliding one with sse2.
+
+struct SRecursiveLockInParams
+{
+	enum EMode
+	{
+		lmExponential = 0,
+		lmSliding
+	};
+
+	double		freq;					//	[Hz]
+	EMode		mode;
+	double		timeConstant;			//	lmExponential [s]
+	size_t		window;					//	lmSliding [frames]
+	bool		measuredReference;		//	Push gets the reference signal
+};
+
+class CRecursiveLockIn
+{
+private:
+	size_t					mNumPixels;
+	SRecursiveLockInParams	mParams;
+	int64_t					mNumFrames;
+	double					mLastTime;
+	double					mWeight;			//	lmExponential, 1 - prod(1 - a)
+	std::vector<float>		mMean;				//	lmExponential planes
+	std::vector<float>		mX;
+	std::vector<float>		mY;
+	std::vector<double>		mSumV;				//	lmSliding planes
+	std::vector<double>		mSumVC;
+	std::vector<double>		mSumVS;
+	std::vector<float>		mRing;				//	lmSliding, window frames
+	std::vector<double>		mRingC;				//	references of the frames in the ring
+	std::vector<double>		mRingS;
+	std::vector<double>		mRingR;
+	size_t					mHead;
+	size_t					mFilled;
+	double					mSumC;
+	double					mSumS;
+	double					mRefSum[3];			//	reference: mean, X, Y (lmExponential) or sums of r, r c, r s (lmSliding)
+
+#ifdef RECURSIVE_LOCKIN_SSE2
+	static __m128 Load4(const float *p)
+	{
+		return _mm_loadu_ps(p);
+	}
+
+	static __m128 Load4(const unsigned short *p)
+	{
+		__m128i		v = _mm_loadl_epi64((const __m128i *)p);
+
+		return _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128()));
+	}
+
+	template <typename kind>
+	static __m128 Load4(const kind *p)
+	{
+		return _mm_setr_ps((float)p[0], (float)p[1], (float)p[2], (float)p[3]);
+	}
+#endif
+
+	template <typename kind>
+	void PushExponential(const kind *frame, float a, float c, float s)
+	{
+		KernelLockInIir(frame, mNumPixels, a, c, s, &mMean[0], &mX[0], &mY[0]);
+	}
+
+	void PushExponential(const float *frame, float a, float c, float s)
+	{
+		ThermoKernels().lockInIirF32(frame, mNumPixels, a, c, s, &mMean[0], &mX[0], &mY[0]);
+	}
+
+	void PushExponential(const unsigned short *frame, float a, float c, float s)
+	{
+		ThermoKernels().lockInIirU16((const uint16_t *)frame, mNumPixels, a, c, s, &mMean[0], &mX[0], &mY[0]);
+	}
+
+	template <typename kind>
+	void PushSliding(const kind *frame, double c, double s, double cOld, double sOld)
+	{
+		float		*ring = &mRing[mHead * mNumPixels];
+		double		*sumV = &mSumV[0], *sumVC = &mSumVC[0], *sumVS = &mSumVS[0];
+		size_t		p = 0;
+
+#ifdef RECURSIVE_LOCKIN_SSE2
+		__m128d		vc = _mm_set1_pd(c), vs = _mm_set1_pd(s), oc = _mm_set1_pd(cOld), os = _mm_set1_pd(sOld);
+
+		for (; p + 4 <= mNumPixels; p += 4) {
+			__m128		v = Load4(frame + p), o = _mm_loadu_ps(ring + p);
+			__m128d		v2[2] = { _mm_cvtps_pd(v), _mm_cvtps_pd(_mm_movehl_ps(v, v)) };
+			__m128d		o2[2] = { _mm_cvtps_pd(o), _mm_cvtps_pd(_mm_movehl_ps(o, o)) };
+
+			_mm_storeu_ps(ring + p, v);
+			for (size_t h = 0; h < 2; ++h) {
+				size_t		q = p + 2 * h;
+
+				_mm_storeu_pd(sumV + q, _mm_add_pd(_mm_loadu_pd(sumV + q), _mm_sub_pd(v2[h], o2[h])));
+				_mm_storeu_pd(sumVC + q, _mm_add_pd(_mm_loadu_pd(sumVC + q), _mm_sub_pd(_mm_mul_pd(v2[h], vc), _mm_mul_pd(o2[h], oc))));
+				_mm_storeu_pd(sumVS + q, _mm_add_pd(_mm_loadu_pd(sumVS + q), _mm_sub_pd(_mm_mul_pd(v2[h], vs), _mm_mul_pd(o2[h], os))));
+			}
+		}
+#endif
+		for (; p < mNumPixels; ++p) {
+			double		v = (double)(float)frame[p], o = (double)ring[p];
+
+			ring[p] = (float)v;
+			sumV[p] += v - o;
+			sumVC[p] += v * c - o * cOld;
+			sumVS[p] += v * s - o * sOld;
+		}
+	}
+
+	//	reference phasor, (1, 0) for the ideal reference
+	void ReferencePhasor(double &rx, double &ry) const
+	{
+		rx = 1.0;
+		ry = 0.0;
+		if (!mParams.measuredReference)
+			return;
+		if (mParams.mode == SRecursiveLockInParams::lmExponential) {
+			rx = mRefSum[1];
+			ry = mRefSum[2];
+		}
+		else {
+			double		n = (double)mFilled, mean = mRefSum[0] / n;
+
+			rx = mRefSum[1] - mean * mSumC;
+			ry = mRefSum[2] - mean * mSumS;
+		}
+
+		double		r = sqrt(rx * rx + ry * ry);
+
+		if (r > 0.0) {
+			rx /= r;
+			ry /= r;
+		}
+		else {
+			rx = NAN;
+			ry = NAN;
+		}
+	}
+
+public:
+	CRecursiveLockIn(size_t numPixels, const SRecursiveLockInParams &params) :
+		mNumPixels(numPixels),
+		mParams(params)
+	{
+		if (mParams.mode == SRecursiveLockInParams::lmExponential) {
+			mMean.resize(numPixels);
+			mX.resize(numPixels);
+			mY.resize(numPixels);
+		}
+		else {
+			mParams.window = std::max<size_t>(mParams.window, 1);
+			mSumV.resize(numPixels);
+			mSumVC.resize(numPixels);
+			mSumVS.resize(numPixels);
+			mRing.resize(mParams.window * numPixels);
+			mRingC.resize(mParams.window);
+			mRingS.resize(mParams.window);
+			mRingR.resize(mParams.window);
+		}
+		Reset();
+	}
+
+	void Reset()
+	{
+		mNumFrames = 0;
+		mLastTime = NAN;
+		mWeight = 0.0;
+		mHead = 0;
+		mFilled = 0;
+		mSumC = 0.0;
+		mSumS = 0.0;
+		std::fill(mRefSum, mRefSum + 3, 0.0);
+		std::fill(mX.begin(), mX.end(), 0.0f);
+		std::fill(mY.begin(), mY.end(), 0.0f);
+		std::fill(mSumV.begin(), mSumV.end(), 0.0);
+		std::fill(mSumVC.begin(), mSumVC.end(), 0.0);
+		std::fill(mSumVS.begin(), mSumVS.end(), 0.0);
+		std::fill(mRing.begin(), mRing.end(), 0.0f);
+		std::fill(mRingC.begin(), mRingC.end(), 0.0);
+		std::fill(mRingS.begin(), mRingS.end(), 0.0);
+		std::fill(mRingR.begin(), mRingR.end(), 0.0);
+	}
+
+	//	one frame of numPixels samples taken at time t [s], reference is the measured reference at that time
+	template <typename kind>
+	void Push(const kind *frame, double t, double reference = 0.0)
+	{
+		double		w = 2.0 * M_PI * mParams.freq * t;
+		double		c = 2.0 * cos(w), s = 2.0 * sin(w);
+
+		if (mParams.mode == SRecursiveLockInParams::lmExponential) {
+			//	the first frame only seeds the mean, repeated time stamps are taken as one frame period
+			if (mNumFrames == 0) {
+				for (size_t p = 0; p < mNumPixels; ++p)
+					mMean[p] = (float)frame[p];
+				mRefSum[0] = reference;
+			}
+			else {
+				double		dt = t - mLastTime;
+				double		a = dt > 0.0 && mParams.timeConstant > 0.0 ? 1.0 - exp(-dt / mParams.timeConstant) : 1.0 / (double)(mNumFrames + 1);
+				double		d = reference - mRefSum[0];
+
+				PushExponential(frame, (float)a, (float)c, (float)s);
+				mWeight += a * (1.0 - mWeight);
+				mRefSum[0] += a * d;
+				mRefSum[1] += a * (d * c - mRefSum[1]);
+				mRefSum[2] += a * (d * s - mRefSum[2]);
+			}
+		}
+		else {
+			double		cOld = mRingC[mHead], sOld = mRingS[mHead], rOld = mRingR[mHead];
+
+			PushSliding(frame, c, s, cOld, sOld);
+			mSumC += c - cOld;
+			mSumS += s - sOld;
+			mRefSum[0] += reference - rOld;
+			mRefSum[1] += reference * c - rOld * cOld;
+			mRefSum[2] += reference * s - rOld * sOld;
+			mRingC[mHead] = c;
+			mRingS[mHead] = s;
+			mRingR[mHead] = reference;
+			mHead = (mHead + 1) % mParams.window;
+			mFilled = std::min(mFilled + 1, mParams.window);
+		}
+
+		mLastTime = t;
+		++mNumFrames;
+	}
+
+	size_t numPixels() const
+	{
+		return mNumPixels;
+	}
+
+	int64_t numFrames() const
+	{
+		return mNumFrames;
+	}
+
+	//	the window is full, or the exponential filter has seen three time constants
+	bool ready() const
+	{
+		if (mParams.mode == SRecursiveLockInParams::lmExponential)
+			return mWeight >= 1.0 - exp(-3.0);
+
+		return mFilled == mParams.window;
+	}
+
+	//	phase [rad] and amplitude, x and y scaled by scale (counts to degrees), NaN before the second frame or without a
+	//	reference signal. any output may be NULL
+	void Result(double scale, double *amp, double *phase, double *x = NULL, double *y = NULL) const
+	{
+		double		rx, ry;
+		bool		valid = mParams.mode == SRecursiveLockInParams::lmExponential ? mWeight > 0.0 : mFilled > 1;
+
+		if (valid)
+			ReferencePhasor(rx, ry);
+		for (size_t p = 0; p < mNumPixels; ++p) {
+			double		xp = NAN, yp = NAN;
+
+			if (valid) {
+				if (mParams.mode == SRecursiveLockInParams::lmExponential) {
+					xp = (double)mX[p] / mWeight;
+					yp = (double)mY[p] / mWeight;
+				}
+				else {
+					double		n = (double)mFilled, mean = mSumV[p] / n;
+
+					xp = (mSumVC[p] - mean * mSumC) / n;
+					yp = (mSumVS[p] - mean * mSumS) / n;
+				}
+
+				//	times the conjugate of the reference phasor
+				double		xr = xp * rx + yp * ry, yr = yp * rx - xp * ry;
+
+				xp = scale * xr;
+				yp = scale * yr;
+			}
+			if (x != NULL)
+				x[p] = xp;
+			if (y != NULL)
+				y[p] = yp;
+			if (amp != NULL)
+				amp[p] = sqrt(xp * xp + yp * yp);
+			if (phase != NULL)
+				phase[p] = atan2(yp, xp);
+		}
+	}
+};
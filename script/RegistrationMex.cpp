@@ -0,0 +1,183 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "mex.h"
+#include "MexHelpers.h"
+#include "FrameRegistration.h"
+#include "ThermoProfiler.h"
+
+//	mex RegistrationMex.cpp
+
+//	h = RegistrationMex('new', rows, cols, opts)		opts (optional):
+//		template		'reference' (default) or 'running'
+//		alpha			running template update (0.05)
+//		interp			'bilinear' (default), 'bicubic' or 'none' (shifts only)
+//		maxShift		peak search radius [px], 0 (default) for no limit
+//		reference		rows x cols reference frame, default the first frame pushed
+//	[registered, shifts] = RegistrationMex('push', h, frames)	frames rows x cols x n (double, single, uint16 or int16)
+//		registered		rows x cols x n, double for double frames and single otherwise, NaN where the shifted frame has no data
+//		shifts			n x 3 [dx dy peak], dx along the columns [px]
+//	RegistrationMex('delete', h)
+
+SEnumInfo	TemplateEnumInfo[] = {
+	{ "reference",				SRegistrationParams::tpReference },
+	{ "running",				SRegistrationParams::tpRunning },
+	{ NULL,						-1 },
+};
+
+SEnumInfo	InterpEnumInfo[] = {
+	{ "none",					SRegistrationParams::ipNone },
+	{ "bilinear",				SRegistrationParams::ipBilinear },
+	{ "bicubic",				SRegistrationParams::ipBicubic },
+	{ NULL,						-1 },
+};
+
+class CMatRegistration
+{
+private:
+	size_t					mRows;
+	size_t					mCols;
+	bool					mWarp;
+	CFrameRegistration		mReg;
+
+	template <typename kind>
+	void Push(const kind *frames, size_t numFrames, mxArray *registered, std::vector<SFrameShift> &shifts)
+	{
+		if (registered == NULL)
+			mReg.Push(frames, numFrames, (float *)NULL, shifts.data());
+		else if (mxIsDouble(registered))
+			mReg.Push(frames, numFrames, (double *)mxGetData(registered), shifts.data());
+		else
+			mReg.Push(frames, numFrames, (float *)mxGetData(registered), shifts.data());
+	}
+
+public:
+	CMatRegistration(size_t rows, size_t cols, const SRegistrationParams &params) :
+		mRows(rows),
+		mCols(cols),
+		mWarp(params.interp != SRegistrationParams::ipNone),
+		mReg(rows, cols, params)
+	{
+	}
+
+	bool SetReference(const mxArray *frame)
+	{
+		if (!mxIsDouble(frame) || mxIsComplex(frame) || mxGetM(frame) != mRows || mxGetNumberOfElements(frame) != mRows * mCols)
+			return false;
+		mReg.SetReference(mxGetPr(frame));
+
+		return true;
+	}
+
+	void Push(int nlhs, mxArray *plhs[], const mxArray *frames)
+	{
+		const mwSize	*dims = mxGetDimensions(frames);
+		size_t			numFrames = mxGetNumberOfElements(frames) / (mRows * mCols);
+		mxArray			*registered = NULL;
+
+		if (dims[0] != mRows || dims[1] != mCols || numFrames * mRows * mCols != mxGetNumberOfElements(frames))
+			mexErrMsgTxt("Frames do not match the frame size.");
+		if (mxIsComplex(frames))
+			mexErrMsgTxt("Must not be complex.");
+
+		if (nlhs > 0 && mWarp) {
+			mwSize		outDims[3] = { mRows, mCols, numFrames };
+
+			registered = mxCreateNumericArray(3, outDims, mxIsDouble(frames) ? mxDOUBLE_CLASS : mxSINGLE_CLASS, mxREAL);
+		}
+
+		std::vector<SFrameShift>	shifts(numFrames);
+
+		switch (mxGetClassID(frames)) {
+			case mxDOUBLE_CLASS:
+				Push((const double *)mxGetData(frames), numFrames, registered, shifts);
+				break;
+			case mxSINGLE_CLASS:
+				Push((const float *)mxGetData(frames), numFrames, registered, shifts);
+				break;
+			case mxUINT16_CLASS:
+				Push((const uint16_t *)mxGetData(frames), numFrames, registered, shifts);
+				break;
+			case mxINT16_CLASS:
+				Push((const int16_t *)mxGetData(frames), numFrames, registered, shifts);
+				break;
+			default:
+				if (registered != NULL)
+					mxDestroyArray(registered);
+				mexErrMsgTxt("Unsupported type.");
+				break;
+		}
+
+		if (nlhs > 0)
+			plhs[0] = registered != NULL ? registered : mxCreateDoubleMatrix(0, 0, mxREAL);
+		if (nlhs > 1) {
+			plhs[1] = mxCreateDoubleMatrix(numFrames, 3, mxREAL);
+
+			double		*out = mxGetPr(plhs[1]);
+
+			for (size_t f = 0; f < numFrames; ++f) {
+				out[f] = shifts[f].dx;
+				out[f + numFrames] = shifts[f].dy;
+				out[f + 2 * numFrames] = shifts[f].peak;
+			}
+		}
+	}
+};
+
+//	the mex entry point
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	char				command[64];
+	CMatRegistration	*reg;
+
+	if (nrhs < 1 || mxGetString(prhs[0], command, sizeof(command)) != 0)
+		mexErrMsgTxt("First argument must be a command string.");
+
+	if (strcmp(command, "new") == 0) {
+		if (nlhs != 1 || nrhs < 3 || nrhs > 4)
+			mexErrMsgTxt("Must have 3-4 inputs and 1 output.");
+
+		const mxArray			*opts = nrhs > 3 ? prhs[3] : NULL;
+		SRegistrationParams		params;
+		int						value;
+
+		value = ParseEnum(TemplateEnumInfo, mxGetOption(opts, "template", "reference").c_str());
+		if (value < 0)
+			mexErrMsgTxt("Unknown template.");
+		params.templ = (SRegistrationParams::ETemplate)value;
+		value = ParseEnum(InterpEnumInfo, mxGetOption(opts, "interp", "bilinear").c_str());
+		if (value < 0)
+			mexErrMsgTxt("Unknown interp.");
+		params.interp = (SRegistrationParams::EInterp)value;
+		params.alpha = mxGetOption(opts, "alpha", 0.05);
+		params.maxShift = mxGetOption(opts, "maxShift", 0.0);
+		if (!(params.alpha > 0.0 && params.alpha <= 1.0))
+			mexErrMsgTxt("alpha must be in (0, 1].");
+
+		reg = new CMatRegistration((size_t)mxGetScalarInput(prhs[1], "rows"), (size_t)mxGetScalarInput(prhs[2], "cols"), params);
+		if (mxGetOptionField(opts, "reference") != NULL && !reg->SetReference(mxGetOptionField(opts, "reference"))) {
+			delete reg;
+			mexErrMsgTxt("reference must be a real double rows x cols frame.");
+		}
+		plhs[0] = WrapObject(reg);
+		return;
+	}
+
+	if (nrhs < 2)
+		mexErrMsgTxt("Second argument must be a handle.");
+
+	reg = GetObject<CMatRegistration>(prhs[1]);		//	won't get past here if GetObject fails
+
+	if (strcmp(command, "delete") == 0) {
+		UnwrapObject<CMatRegistration>(prhs[1]);
+		delete reg;
+	} else if (strcmp(command, "push") == 0) {
+		if (nlhs > 2 || nrhs != 3)
+			mexErrMsgTxt("Must have 3 inputs and 0-2 outputs.");
+
+		CThermoStage	stage("registration", "RegistrationMex", (double)mxGetElementSize(prhs[2]) * mxGetNumberOfElements(prhs[2]));
+
+		reg->Push(nlhs, plhs, prhs[2]);
+	} else {
+		mexErrMsgTxt("Unknown command.");
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+//	dense solvers for the tiny systems of the per pixel / per frame fits (normal equations of a few parameters).
+//	matrices are row major n x n, everything is done in place.
+
+//	cholesky factorization of a symmetric positive definite matrix, the lower triangle of a receives L
+inline bool CholeskyFactor(double *a, size_t n)
+{
+	for (size_t j = 0; j < n; ++j) {
+		double		d = a[j * n + j];
+
+		for (size_t k = 0; k < j; ++k)
+			d -= a[j * n + k] * a[j * n + k];
+		if (!(d > 0.0))
+			return false;
+		d = sqrt(d);
+		a[j * n + j] = d;
+
+		for (size_t i = j + 1; i < n; ++i) {
+			double		s = a[i * n + j];
+
+			for (size_t k = 0; k < j; ++k)
+				s -= a[i * n + k] * a[j * n + k];
+			a[i * n + j] = s / d;
+		}
+	}
+
+	return true;
+}
+
+//	solves L L' x = b with the factor from CholeskyFactor, b is overwritten with x
+inline void CholeskySolve(const double *l, double *b, size_t n)
+{
+	for (size_t i = 0; i < n; ++i) {
+		double		s = b[i];
+
+		for (size_t k = 0; k < i; ++k)
+			s -= l[i * n + k] * b[k];
+		b[i] = s / l[i * n + i];
+	}
+
+	for (size_t i = n; i-- > 0; ) {
+		double		s = b[i];
+
+		for (size_t k = i + 1; k < n; ++k)
+			s -= l[k * n + i] * b[k];
+		b[i] = s / l[i * n + i];
+	}
+}
+
+//	inverse of a symmetric positive definite matrix through its cholesky factor, used for parameter covariances
+inline bool CholeskyInverse(const double *a, double *inv, size_t n, double *work)
+{
+	for (size_t i = 0; i < n * n; ++i)
+		work[i] = a[i];
+	if (!CholeskyFactor(work, n))
+		return false;
+
+	for (size_t col = 0; col < n; ++col) {
+		double		*e = inv + col * n;
+
+		for (size_t i = 0; i < n; ++i)
+			e[i] = i == col ? 1.0 : 0.0;
+		CholeskySolve(work, e, n);
+	}
+
+	return true;
+}
@@ -0,0 +1,260 @@
+#pragma once
+
+#include "ThermoParallel.h"
+#include "SmallLinearAlgebra.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+//	sub-pixel laser spot tracking
+//
+//	LockinAmplifierResults finds the centre by counting non NaN pixels per row and column and GetSpotSizeByFirstMax
+//	looks at a single frame. here every frame gets a moment estimate (background subtracted, pixels above tol times
+//	the peak, centroid and second moments) and, unless only moments are asked for, a Levenberg-Marquardt fit of an
+//	axis aligned 2-D gaussian  B + A exp(-(x-x0)^2/(2 sx^2) - (y-y0)^2/(2 sy^2))  in a window of about 3 sigma
+//	around the moment centre. frames are independent and processed in parallel.
+//	frames are matlab column major rows x cols, x along the columns, coordinates are 0 based pixels.
+
+struct SSpotParams
+{
+	bool		gaussian;			//	refine the moments with the gaussian fit
+	double		tol;				//	moment pixels must be above tol * peak (after background removal)
+	double		window;				//	half size of the fit window [px], 0 picks 3 sigma of the moments
+	size_t		maxIterations;
+	const double	*background;	//	optional rows x cols plane removed from every frame
+};
+
+struct SSpotFit
+{
+	double		xc;
+	double		yc;
+	double		sx;					//	gaussian sigma or second moment [px]
+	double		sy;
+	double		peak;				//	amplitude above the background
+	double		background;
+	double		r2;					//	of the gaussian fit, NaN for moments
+	int			iterations;
+	bool		valid;
+};
+
+class CSpotTracker
+{
+private:
+	SSpotParams		mParams;
+	size_t			mRows;
+	size_t			mCols;
+
+	template <typename kind>
+	double Value(const kind *frame, size_t i) const
+	{
+		return (double)frame[i] - (mParams.background != NULL ? mParams.background[i] : 0.0);
+	}
+
+	template <typename kind>
+	void Moments(const kind *frame, SSpotFit &fit) const
+	{
+		size_t					n = mRows * mCols;
+		std::vector<double>		values(n);
+		size_t					best = 0;
+
+		for (size_t i = 0; i < n; ++i) {
+			values[i] = Value(frame, i);
+			if (values[i] > values[best] || !std::isfinite(values[best]))
+				best = i;
+		}
+
+		//	median as background, the spot covers a small part of the frame. NaN pixels (masked maps) are ignored
+		std::vector<double>		sorted(values);
+
+		sorted.erase(std::remove_if(sorted.begin(), sorted.end(), [](double v) { return !std::isfinite(v); }), sorted.end());
+		fit.valid = false;
+		if (sorted.empty())
+			return;
+		std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+
+		double		bg = sorted[sorted.size() / 2];
+		double		peak = values[best] - bg;
+		double		th = mParams.tol * peak;
+		double		sw = 0.0, sx = 0.0, sy = 0.0, sxx = 0.0, syy = 0.0;
+
+		fit.background = bg;
+		fit.peak = peak;
+		fit.r2 = NAN;
+		fit.iterations = 0;
+		if (!(peak > 0.0))
+			return;
+
+		for (size_t x = 0; x < mCols; ++x) {
+			for (size_t y = 0; y < mRows; ++y) {
+				double		w = values[y + x * mRows] - bg;
+
+				if (!(w >= th))
+					continue;
+				sw += w;
+				sx += w * (double)x;
+				sy += w * (double)y;
+				sxx += w * (double)x * (double)x;
+				syy += w * (double)y * (double)y;
+			}
+		}
+
+		fit.xc = sx / sw;
+		fit.yc = sy / sw;
+		//	moments of a gaussian cut at tol * peak underestimate sigma, correct for the truncation
+		double		cut = mParams.tol > 0.0 && mParams.tol < 1.0 ? 1.0 + log(mParams.tol) / (1.0 / mParams.tol - 1.0) : 1.0;
+		fit.sx = sqrt(std::max(sxx / sw - fit.xc * fit.xc, 0.0) / cut);
+		fit.sy = sqrt(std::max(syy / sw - fit.yc * fit.yc, 0.0) / cut);
+		fit.valid = sw > 0.0;
+	}
+
+	template <typename kind>
+	void Gaussian(const kind *frame, SSpotFit &fit) const
+	{
+		double		half = mParams.window > 0.0 ? mParams.window : 3.0 * std::max(std::max(fit.sx, fit.sy), 1.0);
+		long		x0 = std::max(0L, (long)floor(fit.xc - half)), x1 = std::min((long)mCols - 1, (long)ceil(fit.xc + half));
+		long		y0 = std::max(0L, (long)floor(fit.yc - half)), y1 = std::min((long)mRows - 1, (long)ceil(fit.yc + half));
+		double		p[6] = { fit.peak, fit.xc, fit.yc, std::max(fit.sx, 0.5), std::max(fit.sy, 0.5), fit.background };
+		double		lambda = 1e-3;
+		double		cost = Cost(frame, p, x0, x1, y0, y1);
+
+		if ((x1 - x0 + 1) * (y1 - y0 + 1) < 12)
+			return;
+
+		for (size_t it = 0; it < mParams.maxIterations; ++it) {
+			double		jtj[36] = { 0 }, jtr[6] = { 0 };
+
+			for (long x = x0; x <= x1; ++x) {
+				for (long y = y0; y <= y1; ++y) {
+					double		v = Value(frame, (size_t)(y + x * (long)mRows));
+					double		dx = (double)x - p[1], dy = (double)y - p[2];
+					double		e = exp(-0.5 * (dx * dx / (p[3] * p[3]) + dy * dy / (p[4] * p[4])));
+					double		r = v - (p[5] + p[0] * e);
+					double		j[6] = { e, p[0] * e * dx / (p[3] * p[3]), p[0] * e * dy / (p[4] * p[4]),
+									p[0] * e * dx * dx / (p[3] * p[3] * p[3]), p[0] * e * dy * dy / (p[4] * p[4] * p[4]), 1.0 };
+
+					if (!std::isfinite(v))
+						continue;
+					for (int a = 0; a < 6; ++a) {
+						for (int b = 0; b <= a; ++b)
+							jtj[a * 6 + b] += j[a] * j[b];
+						jtr[a] += j[a] * r;
+					}
+				}
+			}
+
+			bool		improved = false;
+
+			while (lambda < 1e10) {
+				double		m[36], step[6], trial[6];
+
+				for (int a = 0; a < 6; ++a) {
+					for (int b = 0; b <= a; ++b)
+						m[a * 6 + b] = m[b * 6 + a] = jtj[a * 6 + b];
+					m[a * 6 + a] *= 1.0 + lambda;
+					step[a] = jtr[a];
+				}
+
+				if (CholeskyFactor(m, 6)) {
+					CholeskySolve(m, step, 6);
+					for (int a = 0; a < 6; ++a)
+						trial[a] = p[a] + step[a];
+					trial[3] = fabs(trial[3]);
+					trial[4] = fabs(trial[4]);
+
+					double		trialCost = Cost(frame, trial, x0, x1, y0, y1);
+
+					if (trialCost < cost) {
+						bool	small = fabs(step[1]) < 1e-4 && fabs(step[2]) < 1e-4;
+
+						for (int a = 0; a < 6; ++a)
+							p[a] = trial[a];
+						cost = trialCost;
+						lambda = std::max(lambda * 0.1, 1e-12);
+						improved = !small;
+						fit.iterations = (int)it + 1;
+						break;
+					}
+				}
+				lambda *= 10.0;
+			}
+
+			if (!improved)
+				break;
+		}
+
+		//	keep the moments if the fit wandered off the window
+		if (p[1] < (double)x0 || p[1] > (double)x1 || p[2] < (double)y0 || p[2] > (double)y1 || !(p[0] > 0.0))
+			return;
+
+		double		sum = 0.0, sum2 = 0.0, count = 0.0;
+
+		for (long x = x0; x <= x1; ++x) {
+			for (long y = y0; y <= y1; ++y) {
+				double		v = Value(frame, (size_t)(y + x * (long)mRows));
+
+				if (!std::isfinite(v))
+					continue;
+				sum += v;
+				sum2 += v * v;
+				count += 1.0;
+			}
+		}
+
+		double		ssTot = sum2 - sum * sum / count;
+
+		fit.peak = p[0];
+		fit.xc = p[1];
+		fit.yc = p[2];
+		fit.sx = p[3];
+		fit.sy = p[4];
+		fit.background = p[5];
+		fit.r2 = ssTot > 0.0 ? 1.0 - cost / ssTot : 1.0;
+	}
+
+	template <typename kind>
+	double Cost(const kind *frame, const double *p, long x0, long x1, long y0, long y1) const
+	{
+		double		cost = 0.0;
+
+		for (long x = x0; x <= x1; ++x) {
+			for (long y = y0; y <= y1; ++y) {
+				double		dx = (double)x - p[1], dy = (double)y - p[2];
+				double		r = Value(frame, (size_t)(y + x * (long)mRows)) - (p[5] + p[0] * exp(-0.5 * (dx * dx / (p[3] * p[3]) + dy * dy / (p[4] * p[4]))));
+
+				if (std::isfinite(r))
+					cost += r * r;
+			}
+		}
+
+		return cost;
+	}
+
+public:
+	CSpotTracker(size_t rows, size_t cols, const SSpotParams &params) :
+		mParams(params),
+		mRows(rows),
+		mCols(cols)
+	{
+	}
+
+	template <typename kind>
+	void Fit(const kind *frame, SSpotFit &fit) const
+	{
+		Moments(frame, fit);
+		if (fit.valid && mParams.gaussian)
+			Gaussian(frame, fit);
+	}
+
+	//	numFrames frames one after the other, fits has numFrames entries
+	template <typename kind>
+	void Track(const kind *frames, size_t numFrames, SSpotFit *fits) const
+	{
+		size_t		n = mRows * mCols;
+
+		ParallelFor(numFrames, 1, [&](size_t begin, size_t end) {
+			for (size_t f = begin; f < end; ++f)
+				Fit(frames + f * n, fits[f]);
+		});
+	}
+};
@@ -0,0 +1,93 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "mex.h"
+#include "MexHelpers.h"
+#include "SpotTracker.h"
+
+//	mex SpotTrackerMex.cpp
+
+//	track = SpotTrackerMex(cube, opts)
+//	cube is a rows x cols x frames double or single array (a single map works too), opts an optional struct with
+//	method ('gauss' or 'moments'), tol (moment threshold relative to the peak), window (half size of the fit window
+//	in px, 0 for automatic), maxIterations and background (rows x cols plane removed from every frame).
+//	track has one column entry per frame: xc, yc (1 based, column and row), sx, sy, fwhmX, fwhmY [px], peak,
+//	background, R2, iterations and valid
+
+static mxArray *FitColumn(const std::vector<SSpotFit> &fits, double SSpotFit::*field, double offset = 0.0, double scale = 1.0)
+{
+	mxArray		*ret = mxCreateDoubleMatrix(fits.size(), 1, mxREAL);
+	double		*data = mxGetPr(ret);
+
+	for (size_t k = 0; k < fits.size(); ++k)
+		data[k] = fits[k].valid ? (fits[k].*field + offset) * scale : mxGetNaN();
+
+	return ret;
+}
+
+//	the mex entry point
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	if (nrhs < 1 || nrhs > 2 || nlhs > 1)
+		mexErrMsgTxt("Must have 1-2 inputs and 0-1 outputs.");
+
+	const mxArray	*cube = prhs[0];
+	const mxArray	*opts = nrhs > 1 ? prhs[1] : NULL;
+	const mwSize	*dims = mxGetDimensions(cube);
+	size_t			rows = dims[0], cols = dims[1];
+	size_t			numFrames = mxGetNumberOfDimensions(cube) > 2 ? dims[2] : 1;
+	std::string		method = mxGetOption(opts, "method", "gauss");
+	const mxArray	*background = mxGetOptionField(opts, "background");
+	SSpotParams		params;
+
+	if (mxIsComplex(cube) || (!mxIsDouble(cube) && !mxIsSingle(cube)) || mxGetNumberOfDimensions(cube) > 3)
+		mexErrMsgTxt("cube must be a real double or single rows x cols x frames array.");
+	if (method != "gauss" && method != "moments")
+		mexErrMsgTxt("method must be 'gauss' or 'moments'.");
+
+	params.gaussian = method == "gauss";
+	params.tol = mxGetOption(opts, "tol", 0.5);
+	params.window = mxGetOption(opts, "window", 0.0);
+	params.maxIterations = (size_t)mxGetOption(opts, "maxIterations", 50.0);
+	params.background = NULL;
+	if (background != NULL && !mxIsEmpty(background)) {
+		params.background = mxGetDoubleInput(background, "background");
+		if (mxGetM(background) != rows || mxGetN(background) != cols)
+			mexErrMsgTxt("background must be a rows x cols map.");
+	}
+
+	if (!(params.tol > 0.0 && params.tol < 1.0))
+		mexErrMsgTxt("tol must be between 0 and 1.");
+
+	CSpotTracker			tracker(rows, cols, params);
+	std::vector<SSpotFit>	fits(numFrames);
+
+	if (mxIsDouble(cube))
+		tracker.Track((const double *)mxGetData(cube), numFrames, fits.data());
+	else
+		tracker.Track((const float *)mxGetData(cube), numFrames, fits.data());
+
+	const char		*fields[] = { "xc", "yc", "sx", "sy", "fwhmX", "fwhmY", "peak", "background", "R2", "iterations", "valid" };
+	mxArray			*res = mxCreateStructMatrix(1, 1, sizeof(fields) / sizeof(fields[0]), fields);
+	mxArray			*iterations = mxCreateDoubleMatrix(numFrames, 1, mxREAL);
+	mxArray			*valid = mxCreateLogicalMatrix(numFrames, 1);
+	double			fwhm = 2.0 * sqrt(2.0 * log(2.0));
+
+	for (size_t k = 0; k < numFrames; ++k) {
+		mxGetPr(iterations)[k] = (double)fits[k].iterations;
+		mxGetLogicals(valid)[k] = fits[k].valid;
+	}
+
+	mxSetFieldByNumber(res, 0, 0, FitColumn(fits, &SSpotFit::xc, 1.0));
+	mxSetFieldByNumber(res, 0, 1, FitColumn(fits, &SSpotFit::yc, 1.0));
+	mxSetFieldByNumber(res, 0, 2, FitColumn(fits, &SSpotFit::sx));
+	mxSetFieldByNumber(res, 0, 3, FitColumn(fits, &SSpotFit::sy));
+	mxSetFieldByNumber(res, 0, 4, FitColumn(fits, &SSpotFit::sx, 0.0, fwhm));
+	mxSetFieldByNumber(res, 0, 5, FitColumn(fits, &SSpotFit::sy, 0.0, fwhm));
+	mxSetFieldByNumber(res, 0, 6, FitColumn(fits, &SSpotFit::peak));
+	mxSetFieldByNumber(res, 0, 7, FitColumn(fits, &SSpotFit::background));
+	mxSetFieldByNumber(res, 0, 8, FitColumn(fits, &SSpotFit::r2));
+	mxSetFieldByNumber(res, 0, 9, iterations);
+	mxSetFieldByNumber(res, 0, 10, valid);
+
+	plhs[0] = res;
+}
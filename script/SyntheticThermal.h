@@ -0,0 +1,341 @@
+#pragma once
+
+#include "ThermoParallel.h"
+#include <vector>
+#include <complex>
+#include <cmath>
+#include <random>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+//	synthetic thermal sequences from analytic heat conduction solutions, with known ground truth
+//
+//	all frames are matlab column major rows x cols floats, x along the columns, pixels are mmpx mm wide and the
+//	frame centre is at ((cols - 1) / 2, (rows - 1) / 2). the cases:
+//	- modulated gaussian spot on a half-space: the surface phasor of a source with 1/e^2 radius a is the hankel
+//	  integral  theta(r) = int_0^inf exp(-l^2 a^2 / 8) J0(l r) l / sqrt(l^2 + i w / D) dl, evaluated on a radial table
+//	  and interpolated. far from the spot phase and log-amplitude fall with sqrt(pi f / D) per mm. anisotropy is
+//	  obtained by stretching the coordinates, exact away from the spot
+//	- flash on an adiabatic plate of thickness L (thinner inside a defect rectangle): the series solution, or its
+//	  image form at early times, with the log-log slope d ln dT / d ln t known in closed form (TSR ground truth)
+//	- moving point source on a half-space (rosenthal), quasi steady in the frame of the source
+//	- instantaneous line source on a thin plate, T = Q / (4 pi D t) exp(-r^2 / (4 D t)): isotherms are circles of
+//	  known radius (hot zone ground truth)
+//	- a drifting smooth texture, sum of random plane waves shifted by a known sub-pixel drift (registration)
+//	noise and dead pixels (stuck at 0) are added on top, with a fixed seed.
+
+struct SSyntheticFormat
+{
+	size_t		rows;
+	size_t		cols;
+	size_t		numFrames;
+	double		fs;					//	frame rate [Hz]
+	double		mmpx;				//	[mm/px]
+	double		ambient;
+	double		noise;				//	gaussian noise std
+	double		deadFraction;		//	fraction of pixels stuck at 0
+	uint32_t	seed;
+};
+
+class CSyntheticSequence
+{
+private:
+	SSyntheticFormat		mFormat;
+	std::vector<float>		mFrames;
+	std::vector<double>		mTime;
+	std::vector<char>		mDead;
+
+	double X(size_t c) const
+	{
+		return ((double)c - 0.5 * (double)(mFormat.cols - 1)) * mFormat.mmpx;
+	}
+
+	double Y(size_t r) const
+	{
+		return ((double)r - 0.5 * (double)(mFormat.rows - 1)) * mFormat.mmpx;
+	}
+
+	//	fills frame f with fn(x, y) [mm]
+	template <class kfn>
+	void Fill(size_t f, kfn fn)
+	{
+		float		*frame = &mFrames[f * mFormat.rows * mFormat.cols];
+
+		for (size_t c = 0; c < mFormat.cols; ++c)
+			for (size_t r = 0; r < mFormat.rows; ++r)
+				frame[r + c * mFormat.rows] = (float)(mFormat.ambient + fn(X(c), Y(r)));
+	}
+
+	template <class kfn>
+	void FillAll(kfn fn)
+	{
+		ParallelFor(mFormat.numFrames, 1, [&](size_t begin, size_t end) {
+			for (size_t f = begin; f < end; ++f)
+				Fill(f, [&](double x, double y) { return fn(f, x, y); });
+		});
+	}
+
+public:
+	CSyntheticSequence(const SSyntheticFormat &format) :
+		mFormat(format),
+		mFrames(format.rows * format.cols * format.numFrames, 0.0f),
+		mTime(format.numFrames),
+		mDead(format.rows * format.cols, 0)
+	{
+		for (size_t f = 0; f < format.numFrames; ++f)
+			mTime[f] = (double)f / format.fs;
+	}
+
+	const SSyntheticFormat &format() const
+	{
+		return mFormat;
+	}
+
+	const float *frames() const
+	{
+		return mFrames.data();
+	}
+
+	const double *time() const
+	{
+		return mTime.data();
+	}
+
+	bool dead(size_t pixel) const
+	{
+		return mDead[pixel] != 0;
+	}
+
+	//	surface phasor of a unit gaussian source modulated at freq on radii 0, dr, 2 dr, ... [mm], peak normalized to 1
+	static std::vector<std::complex<double> > SpotPhasor(double spotRadius, double diffusivity, double freq, double dr, size_t numRadii)
+	{
+		std::vector<std::complex<double> >	table(numRadii);
+		std::complex<double>				k2(0.0, 2.0 * M_PI * freq / diffusivity);
+		double								lMax = sqrt(8.0 * 20.0) / spotRadius;
+		size_t								steps = 1024;
+		double								h = lMax / (double)steps;
+
+		ParallelFor(numRadii, 8, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				double					r = (double)i * dr;
+				std::complex<double>	sum(0.0, 0.0);
+
+				//	simpson, the integrand vanishes at 0 and is negligible at lMax
+				for (size_t j = 1; j < steps; ++j) {
+					double		l = (double)j * h;
+					double		w = j % 2 == 1 ? 4.0 : 2.0;
+
+					sum += w * exp(-l * l * spotRadius * spotRadius / 8.0) * std::cyl_bessel_j(0.0, l * r) * l / std::sqrt(l * l + k2);
+				}
+				table[i] = sum * h / 3.0;
+			}
+		});
+
+		std::complex<double>	peak = table.empty() ? 1.0 : table[0];
+
+		for (size_t i = 0; i < numRadii; ++i)
+			table[i] /= std::abs(peak);
+
+		return table;
+	}
+
+	//	T = ambient + amplitude (1 + Re(theta exp(i w t))) / 2 after onset frames of ambient. amp and phase (optional,
+	//	rows x cols) get the ground truth of the lock-in maps: |theta| amplitude / 2 and the phase lag -arg(theta).
+	//	dx, dy scale the diffusivity along x and y (1 for isotropic)
+	void ModulatedSpot(double spotRadius, double diffusivity, double freq, double amplitude, double dx, double dy, size_t onset,
+		double *amp, double *phase)
+	{
+		double		rMax = 0.5 * hypot((double)mFormat.rows, (double)mFormat.cols) * mFormat.mmpx / sqrt(std::min(dx, dy)) + 1.0;
+		double		dr = mFormat.mmpx / 4.0;
+		size_t		numRadii = (size_t)(rMax / dr) + 2;
+
+		std::vector<std::complex<double> >	table = SpotPhasor(spotRadius, diffusivity, freq, dr, numRadii);
+		std::vector<std::complex<double> >	field(mFormat.rows * mFormat.cols);
+
+		for (size_t c = 0; c < mFormat.cols; ++c) {
+			for (size_t r = 0; r < mFormat.rows; ++r) {
+				double		rr = hypot(X(c) / sqrt(dx), Y(r) / sqrt(dy)) / dr;
+				size_t		i0 = std::min((size_t)rr, numRadii - 2);
+				double		w = rr - (double)i0;
+				size_t		p = r + c * mFormat.rows;
+
+				field[p] = (1.0 - w) * table[i0] + w * table[i0 + 1];
+				if (amp != NULL)
+					amp[p] = 0.5 * amplitude * std::abs(field[p]);
+				if (phase != NULL)
+					phase[p] = -std::arg(field[p]);
+			}
+		}
+
+		ParallelFor(mFormat.numFrames, 1, [&](size_t begin, size_t end) {
+			for (size_t f = begin; f < end; ++f) {
+				float					*frame = &mFrames[f * field.size()];
+				std::complex<double>	e = std::polar(1.0, 2.0 * M_PI * freq * mTime[f]);
+
+				for (size_t p = 0; p < field.size(); ++p)
+					frame[p] = (float)(mFormat.ambient + (f < onset ? 0.0 : 0.5 * amplitude * (1.0 + (field[p] * e).real())));
+			}
+		});
+	}
+
+	//	dT of an adiabatic plate flashed at t = 0 (unit energy over rho c), thickness L [mm], and d ln dT / d ln t
+	static void FlashPlate(double t, double thickness, double diffusivity, double &dT, double &slope)
+	{
+		double		tau = M_PI * M_PI * diffusivity * t / (thickness * thickness);
+
+		if (tau > 1.0) {
+			double		s = 1.0, ds = 0.0;
+
+			for (int n = 1; n < 64; ++n) {
+				double		e = exp(-(double)(n * n) * tau);
+
+				s += 2.0 * e;
+				ds -= 2.0 * (double)(n * n) * tau * e;
+				if (e < 1e-17)
+					break;
+			}
+			dT = s / thickness;
+			slope = ds / s;
+		}
+		else {
+			//	images: dT = (1 / sqrt(pi D t)) (1 + 2 sum exp(-n^2 L^2 / (D t)))
+			double		beta = thickness * thickness / (diffusivity * t), s = 1.0, ds = 0.0;
+
+			for (int n = 1; n < 64; ++n) {
+				double		e = exp(-(double)(n * n) * beta);
+
+				s += 2.0 * e;
+				ds += 2.0 * (double)(n * n) * beta * e;
+				if (e < 1e-17)
+					break;
+			}
+			dT = s / sqrt(M_PI * diffusivity * t);
+			slope = -0.5 + ds / s;
+		}
+	}
+
+	//	flash at frame pulse, plate of thickness L, L1 inside the rectangle [x0 x1] x [y0 y1] mm. slope (optional) gets
+	//	the ground truth d ln dT / d ln t at time evalTime after the flash
+	void Flash(size_t pulse, double amplitude, double thickness, double diffusivity, double defectThickness,
+		double x0, double x1, double y0, double y1, double evalTime, double *slope)
+	{
+		auto plate = [&](double x, double y) {
+			return x >= x0 && x <= x1 && y >= y0 && y <= y1 ? defectThickness : thickness;
+		};
+
+		FillAll([&](size_t f, double x, double y) {
+			double		dT, s;
+
+			if (f <= pulse)
+				return 0.0;
+			FlashPlate((double)(f - pulse) / mFormat.fs, plate(x, y), diffusivity, dT, s);
+			return amplitude * dT;
+		});
+
+		if (slope != NULL) {
+			for (size_t c = 0; c < mFormat.cols; ++c) {
+				for (size_t r = 0; r < mFormat.rows; ++r) {
+					double		dT;
+
+					FlashPlate(evalTime, plate(X(c), Y(r)), diffusivity, dT, slope[r + c * mFormat.rows]);
+				}
+			}
+		}
+	}
+
+	//	point source moving along +x at speed [mm/s] from x0, depth h [mm] keeps the peak finite. xs (optional,
+	//	numFrames) gets the source position in pixels (0 based)
+	void MovingSource(double amplitude, double speed, double diffusivity, double x0, double y0, double h, double *xs)
+	{
+		FillAll([&](size_t f, double x, double y) {
+			double		xi = x - x0 - speed * mTime[f], yy = y - y0;
+			double		r = sqrt(xi * xi + yy * yy + h * h);
+
+			return amplitude * h / r * exp(-speed * (xi + r - h) / (2.0 * diffusivity));
+		});
+
+		if (xs != NULL)
+			for (size_t f = 0; f < mFormat.numFrames; ++f)
+				xs[f] = (x0 + speed * mTime[f]) / mFormat.mmpx + 0.5 * (double)(mFormat.cols - 1);
+	}
+
+	//	line source released at -t0, peak temperature rise amplitude at t = 0. radius (optional, numFrames) gets the
+	//	radius [px] of the isotherm ambient + level, 0 once the peak drops below it
+	void DiffusingSpot(double amplitude, double diffusivity, double t0, double level, double *radius)
+	{
+		FillAll([&](size_t f, double x, double y) {
+			double		t = t0 + mTime[f];
+
+			return amplitude * t0 / t * exp(-(x * x + y * y) / (4.0 * diffusivity * t));
+		});
+
+		if (radius != NULL) {
+			for (size_t f = 0; f < mFormat.numFrames; ++f) {
+				double		t = t0 + mTime[f], peak = amplitude * t0 / t;
+
+				radius[f] = peak > level ? sqrt(4.0 * diffusivity * t * log(peak / level)) / mFormat.mmpx : 0.0;
+			}
+		}
+	}
+
+	//	random plane waves (periods of 6 px and more) drifting by (dx, dy) px per frame, the content of frame f is the
+	//	first frame moved by f (dx, dy)
+	void DriftingTexture(double amplitude, double dx, double dy, size_t numWaves)
+	{
+		std::mt19937							rng(mFormat.seed + 1);
+		std::uniform_real_distribution<double>	uni(0.0, 1.0);
+		std::vector<double>						kx(numWaves), ky(numWaves), ph(numWaves), a(numWaves);
+
+		for (size_t k = 0; k < numWaves; ++k) {
+			double		kk = 2.0 * M_PI / (6.0 + 40.0 * uni(rng)), dir = 2.0 * M_PI * uni(rng);
+
+			kx[k] = kk * cos(dir);
+			ky[k] = kk * sin(dir);
+			ph[k] = 2.0 * M_PI * uni(rng);
+			a[k] = amplitude * uni(rng) / sqrt((double)numWaves);
+		}
+
+		FillAll([&](size_t f, double x, double y) {
+			double		px = x / mFormat.mmpx - dx * (double)f, py = y / mFormat.mmpx - dy * (double)f, v = 0.0;
+
+			for (size_t k = 0; k < numWaves; ++k)
+				v += a[k] * sin(kx[k] * px + ky[k] * py + ph[k]);
+
+			return v;
+		});
+	}
+
+	//	gaussian noise on every sample, then the dead pixels
+	void Degrade()
+	{
+		size_t		n = mFormat.rows * mFormat.cols;
+
+		if (mFormat.noise > 0.0) {
+			//	a generator per frame, so the noise does not depend on how the frames are split among threads
+			ParallelFor(mFormat.numFrames, 1, [&](size_t begin, size_t end) {
+				for (size_t f = begin; f < end; ++f) {
+					std::mt19937						rng(mFormat.seed + (uint32_t)f * 7919u);
+					std::normal_distribution<float>		gauss(0.0f, (float)mFormat.noise);
+
+					for (size_t i = f * n; i < (f + 1) * n; ++i)
+						mFrames[i] += gauss(rng);
+				}
+			});
+		}
+
+		std::mt19937							rng(mFormat.seed);
+		std::uniform_real_distribution<double>	uni(0.0, 1.0);
+
+		for (size_t p = 0; p < n; ++p)
+			mDead[p] = uni(rng) < mFormat.deadFraction;
+		for (size_t f = 0; f < mFormat.numFrames; ++f)
+			for (size_t p = 0; p < n; ++p)
+				if (mDead[p])
+					mFrames[f * n + p] = 0.0f;
+	}
+};
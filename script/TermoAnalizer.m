@@ -12,15 +12,36 @@ classdef TermoAnalizer < handle
         P
         f_c2
         saveDir
+        fileName
+        profile
+        cube
+        memo
+        memoKey
+        lockKey
     end
 
     methods
-        function obj = TermoAnalizer(fileName,saveDir)
+        function obj = TermoAnalizer(fileName,saveDir,frames)
             %TermoAnalizer Construct an instance of this class
             %   Vuole il nome del file ATS da leggere
             %   saveDir se specificato, indica il nome della cartella in
             %   cui salvare le figure
-
+            %   frames se specificato ([primo ultimo], in frame) carica
+            %   solo quella finestra, ad esempio quella trovata da
+            %   FlirMovieReader.findExcitation senza caricare tutto il file
+            %   Se la variabile d'ambiente THERMO_PROFILE indica un file,
+            %   caricamento, ricampionamento, filtri, lock-in e grafici vi
+            %   scrivono i loro tempi (vedi stageEnd e profileReport)
+            %   Se THERMO_MEMO indica una cartella, caricamento,
+            %   ricampionamento, filtri, lock-in e fit salvano i risultati
+            %   nella cache delle fasi (ThermoMemoMex) e, rilanciati sugli
+            %   stessi dati con gli stessi parametri, li rileggono invece di
+            %   ricalcolarli (vedi stageKey)
+
+            obj.profile = getenv('THERMO_PROFILE');
+            obj.memo = getenv('THERMO_MEMO');
+            obj.fileName = fileName;
+            st = obj.stageStart('load');
             if ~exist("saveDir", "var")
                 saveDir = '.';
             end
@@ -28,16 +49,34 @@ classdef TermoAnalizer < handle
                 mkdir(saveDir);
             end
             obj.saveDir = saveDir;
+            if ~exist("frames", "var")
+                frames = [1 Inf];
+            end
+
+            key = '';
+            if ~isempty(obj.memo)
+                key = obj.stageKey('load', ThermoMemoMex('file', fileName), frames);
+            end
+            obj.memoKey = key;
+            [hit, value] = obj.memoGet(key);
+            if hit
+                obj.metadata = value.metadata;
+                obj.radiance = double(value.radiance);
+                obj.time = value.time;
+                obj.temp = double(value.temp);
+                obj.stageEnd(st, 8*(numel(obj.temp)+numel(obj.radiance)));
+                return
+            end
 
             v = FlirMovieReader(fileName);
             v.unit = 'radianceFactory';
-            [frame, metadata] = step(v);
+            [frame, metadata] = step(v, frames(1)-1);
             obj.metadata = metadata;
 
             obj.radiance = double(frame);
             tempo = str2double(metadata.Time(5:6))*60*60+str2double(metadata.Time(8:9))*60+str2double(metadata.Time(11:end));
 
-            while ~isDone(v)
+            while ~isDone(v) && v.frameIndex+1 < frames(2)
                 [frame, metadata] = step(v);
                 tempo = [tempo, ...
                     str2double(metadata.Time(5:6))*60*60+str2double(metadata.Time(8:9))*60+str2double(metadata.Time(11:end))];
@@ -47,13 +86,16 @@ classdef TermoAnalizer < handle
             obj.time = tempo-tempo(1);
             %figure, plot(tempo(2:end)-tempo(1:end-1));
             v.unit = 'temperatureFactory';
-            [frame, metadata] = step(v);
+            [frame, metadata] = step(v, frames(1)-1);
             obj.temp = double(frame);
 
-            while ~isDone(v)
+            while ~isDone(v) && v.frameIndex+1 < frames(2)
                 frame = step(v);
                 obj.temp(:,:,end+1) = double(frame);
             end
+            obj.memoPut(key, struct('metadata', obj.metadata, 'radiance', memoCompact(obj.radiance), ...
+                'time', obj.time, 'temp', memoCompact(obj.temp)));
+            obj.stageEnd(st, 8*(numel(obj.temp)+numel(obj.radiance)));
         end
 
         function [tIni, tEnd] = cercaPeriodo(obj, nframe)
@@ -64,6 +106,7 @@ classdef TermoAnalizer < handle
             %  tIni è il primo frame in cui la temperatura inizia ad
             %  aumentare.
             %  tEnd è il frame dell'ultimo picco.
+            obj.needTemp();
 
             M = max(obj.temp,[],3);
             [r,c] = find(M == max(M,[],"all"), 1);
@@ -98,12 +141,27 @@ classdef TermoAnalizer < handle
             %questa funzione interpola i dati acquisiti e da in output un
             %campionamento a passo costante del segnale in 1.5 volte i
             %punti del segnale in ingresso
+            obj.needTemp();
+            st = obj.stageStart('resample');
+            obj.memoKey = obj.stageKey('resample', obj.memoKey);
+            [hit, value] = obj.memoGet(obj.memoKey);
+            if hit
+                obj.temp = value.temp;
+                obj.radiance = value.radiance;
+                obj.framerate = value.framerate;
+                obj.time = value.time;
+                obj.stageEnd(st, 8*(numel(obj.temp)+numel(obj.radiance)));
+                return
+            end
             n = length(obj.time);
             time_equal=linspace(0,obj.time(end),1.5*n);
             obj.temp=permute(interp1(obj.time,permute(obj.temp,[3 2 1]),time_equal),[3 2 1]);
             obj.radiance=permute(interp1(obj.time,permute(obj.radiance,[3 2 1]),time_equal),[3 2 1]);
             obj.framerate=1.5*n/obj.time(end);
             obj.time=time_equal;
+            obj.memoPut(obj.memoKey, struct('temp', obj.temp, 'radiance', obj.radiance, ...
+                'framerate', obj.framerate, 'time', obj.time));
+            obj.stageEnd(st, 8*(numel(obj.temp)+numel(obj.radiance)));
 
         end
 
@@ -114,6 +172,7 @@ classdef TermoAnalizer < handle
             %getTemp Restituisce la matrice delle temperature
             %  tIni è il primo frame (in numero di frame - default 1)
             %  tEnd è l'ultimo frame (in numero di frame - default l'ultimo)
+            obj.needTemp();
             if ~exist("tEnd", "var")
                 tEnd = length(obj.temp);
             end
@@ -132,9 +191,11 @@ classdef TermoAnalizer < handle
             %    Nota: il frame viene tolto sia della radiance che dalla
             %    temperatura. Se cancelli un frame a metà, pensa bene a ciò
             %    che fai
+            obj.needTemp();
 
             obj.radiance = obj.radiance(:,:,[1:frame-1 frame+1:end]);
             obj.temp = obj.temp(:,:,[1:frame-1 frame+1:end]);
+            obj.memoKey = obj.stageKey('cancellaFrame', obj.memoKey, frame);
         end
 
 
@@ -144,6 +205,7 @@ classdef TermoAnalizer < handle
             %    Se non assegni il risultato a nessuna variabile, fa il
             %    plot (non apre una nuova figure)
             %    Il tempo è restituito in frame
+            obj.needTemp();
 
             [temp, time] = max(obj.temp, [], 3);
             if nargout == 0
@@ -166,6 +228,7 @@ classdef TermoAnalizer < handle
             %   temp è la temperatura iniziale che si desidera (celsius)
             %   frames è il numero di frame iniziali usati per la calcolare
             %   la normalizzazione (default 1)
+            obj.needTemp();
 
             if ~exist("frames", "var")
                 frames = 1;
@@ -173,6 +236,7 @@ classdef TermoAnalizer < handle
 
             EpsSig = mean(obj.radiance(:,:,1:frames), 3)/(temp+273.16)^4;
             obj.temp = (obj.radiance./EpsSig).^(0.25)-273.16;
+            obj.memoKey = obj.stageKey('normalizzaTemp', obj.memoKey, temp, frames);
         end
 
         function mask = tagliaMappa(obj, mask)
@@ -186,6 +250,7 @@ classdef TermoAnalizer < handle
             %   in modo da tenere tutti i punti che hanno raggiunto una
             %   temperatura massima pari ad almeno mask volte la
             %   temperatura iniziale
+            obj.needTemp();
 
             if isscalar(mask)
                 th = mask;
@@ -196,6 +261,7 @@ classdef TermoAnalizer < handle
 
             mask(~isnan(mask)) = 1;
             obj.temp = obj.temp.*mask;
+            obj.memoKey = obj.stageKey('tagliaMappa', obj.memoKey, mask);
         end
 
         function mappa = evalCooling(obj)
@@ -203,6 +269,7 @@ classdef TermoAnalizer < handle
             %curve di raffreddamento
             %   La funzione lavora sulla matrice delle temperature corrente
             %   (al netto di filtri e cose varie)
+            obj.needTemp();
 
             [maxT, time] = obj.getMaxTemp(); % prendo l'istante di tempo in cui la temperatura raggiunge il massimo (pixel per pixel)
 
@@ -224,6 +291,7 @@ classdef TermoAnalizer < handle
 
 
         function mappa = evalHeating2(obj,t1,t2)
+            obj.needTemp();
             [maxT, time] = obj.getMaxTemp(); % prendo l'istante di tempo in cui la temperatura raggiunge il massimo (pixel per pixel)
 
             [r,c] = size(time);
@@ -252,6 +320,7 @@ classdef TermoAnalizer < handle
         end
 
         function mappa = evalHeatingArea(obj,t1,t2)
+            obj.needTemp();
             [maxT, time] = obj.getMaxTemp(); % prendo l'istante di tempo in cui la temperatura raggiunge il massimo (pixel per pixel)
 
             [r,c] = size(time);
@@ -281,8 +350,22 @@ classdef TermoAnalizer < handle
 
 
         function  LockInAmplifier(obj,f, a, b)
-
-            [r,c,s]=size(obj.temp(:,:,a:b));
+            obj.needTemp();
+
+            st = obj.stageStart('lockInAmplifier');
+            % dimensioni senza copiare obj.temp(:,:,a:b), anche quando i
+            % risultati arrivano dalla cache
+            r=size(obj.temp,1);c=size(obj.temp,2);s=b-a+1;
+            obj.lockKey = obj.stageKey('lockInAmplifier', obj.memoKey, f, a, b);
+            [hit, value] = obj.memoGet(obj.lockKey);
+            if hit
+                obj.A = value.A;
+                obj.P = value.P;
+                obj.f_c2 = value.f_c2;
+                obj.framerate = value.framerate;
+                obj.stageEnd(st, 8*r*c*s);
+                return
+            end
             nfft=s; %no 0 padding è meglio
             if isempty(obj.framerate)
                 obj.framerate = obj.metadata.FrameRate;
@@ -324,13 +407,104 @@ classdef TermoAnalizer < handle
 
             obj.A=A;
             obj.P=P;
+            obj.memoPut(obj.lockKey, struct('A', A, 'P', P, 'f_c2', obj.f_c2, 'framerate', obj.framerate));
+            obj.stageEnd(st, 8*r*c*s);
 
             %crea le mappe a f=freq
 
 
         end
 
+        function  LockInSweep(obj,freqs,a,b)
+            %LockInSweep come LockInAmplifier ma per tutte le frequenze
+            %freqs in una sola passata sui dati (LockInSweepMex)
+            %   a e b sono primo e ultimo frame (default tutto il video),
+            %   oppure matrici numel(freqs) x 1 per eccitazioni a gradini
+            %   (una finestra per ogni frequenza)
+            %   obj.A e obj.P diventano r x c x numel(freqs) e obj.f_c2 =
+            %   freqs, quindi evaluateDiffusivity sceglie la mappa alla
+            %   frequenza richiesta
+
+            if isempty(obj.cube)
+                [r,c,s]=size(obj.temp);
+            else
+                info = ThermoCubeMex('info', obj.cube);
+                r = info.rows;
+                c = info.cols;
+                s = info.numFrames;
+            end
+            if ~exist("a", "var")
+                a = 1;
+            end
+            if ~exist("b", "var")
+                b = s;
+            end
+            freqs = freqs(:);
+            windows = [a(:).*ones(size(freqs)), b(:).*ones(size(freqs))];
+
+            % la finestra e' passata al mex, niente copia di obj.temp(:,:,a:b)
+            st = obj.stageStart('lockInSweep');
+            obj.lockKey = obj.stageKey('lockInSweep', obj.memoKey, freqs, windows);
+            [hit, res] = obj.memoGet(obj.lockKey);
+            if hit
+                obj.A = res.A;
+                obj.P = res.P;
+                obj.f_c2 = freqs';
+                obj.stageEnd(st, 8*r*c*s);
+                return
+            end
+            h = LockInSweepMex('new', r, c, freqs, windows);
+            if isempty(obj.cube)
+                LockInSweepMex('push', h, obj.temp, obj.time(:));
+            else
+                % dopo spill a blocchi dal cubo, quelli fuori budget
+                % arrivano dal file temporaneo
+                n = info.blockFrames;
+                for k = 1:n:s
+                    m = min(n, s-k+1);
+                    LockInSweepMex('push', h, ThermoCubeMex('read', obj.cube, k, m), obj.time(k:k+m-1)');
+                end
+            end
+            res = LockInSweepMex('result', h);
+            LockInSweepMex('delete', h);
+            obj.memoPut(obj.lockKey, struct('A', res.A, 'P', res.P));
+            obj.stageEnd(st, 8*r*c*s);
+
+            obj.A = res.A;
+            obj.P = res.P;
+            obj.f_c2 = freqs';
+        end
+
+        function  [D,res]=evaluateDiffusivitySweep(obj,xc,yc,mmpxratio,laserspotdiameter,expectedDiffusivity,tol,numRays)
+            %evaluateDiffusivitySweep fit congiunto della diffusivita' su
+            %tutte le frequenze calcolate con LockInSweep
+            %   Per ogni raggio la pendenza della fase e' m = s*sqrt(f),
+            %   D = pi/s^2. res contiene la diffusivita' per raggio e per
+            %   frequenza, gli R2 e le ellissi di anisotropia
+            %   Il range dei raggi e' quello di evaluateDiffusivity alla
+            %   frequenza piu' bassa
+
+            if ~exist("numRays", "var")
+                numRays = 180;
+            end
+            freqs = obj.f_c2(:);
+            expectedThermalDiffusionLength=sqrt(expectedDiffusivity/min(freqs)/pi());
+            opts.rStart=laserspotdiameter;
+            opts.rEnd=laserspotdiameter+2*expectedThermalDiffusionLength;
+            opts.numRays=numRays;
+            opts.tol=tol;
+
+            key = obj.stageKey('sweepFit', obj.lockKey, xc, yc, mmpxratio, opts);
+            [hit, res] = obj.memoGet(key);
+            if ~hit
+                res=LockInSweepMex('fit',obj.A,obj.P,freqs,xc,yc,mmpxratio,opts);
+                obj.memoPut(key, res);
+            end
+            D=res.D;
+        end
+
         function  LockIn(obj)
+            obj.needTemp();
 
             [r,c,s]=size(obj.temp);
             nfft=s; %no 0 padding è meglio
@@ -349,6 +523,7 @@ classdef TermoAnalizer < handle
 
             obj.A=A;
             obj.P=P;
+            obj.lockKey = obj.stageKey('lockIn', obj.memoKey);
 
             %crea le mappe a f=freq
 
@@ -356,11 +531,154 @@ classdef TermoAnalizer < handle
         end
 
 
-        function  [Cut_x,yp,Cut_y,xp,xc,yc]=LockinAmplifierResults(obj,freq,mmpxratio,tol, save)
+        function pulse = trovaImpulso(obj)
+            %trovaImpulso frame dell'impulso (flash) nelle prove impulsive:
+            %il frame con il salto piu' grande della temperatura media
+            %della mappa
+            obj.needTemp();
+
+            m = squeeze(mean(obj.temp, [1 2]));
+            [~, k] = max(diff(m));
+            pulse = k+1;
+        end
+
+        function res = TSR(obj, degree, pulse, evalTimes)
+            %TSR thermographic signal reconstruction per le prove
+            %impulsive: fit polinomiale di log(dT) contro log(t) dopo
+            %l'impulso su ogni pixel (TsrMex)
+            %   degree e' il grado del polinomio (default 5)
+            %   pulse e' il frame dell'impulso (default trovaImpulso)
+            %   evalTimes sono i tempi dall'impulso [s] a cui ricostruire le
+            %   mappe delle derivate (default nessuno, solo i coefficienti)
+            %   dT e' riferito alla media dei frame prima dell'impulso.
+            %   res contiene i coefficienti (res.coeffs), il residuo
+            %   (res.rms), il tempo del massimo della derivata seconda
+            %   (res.peakD2) e, per evalTimes, la ricostruzione e le
+            %   derivate prima e seconda in log-log (res.logT, res.d1,
+            %   res.d2)
+            obj.needTemp();
+
+            if ~exist("degree", "var") || isempty(degree)
+                degree = 5;
+            end
+            if ~exist("pulse", "var") || isempty(pulse)
+                pulse = obj.trovaImpulso();
+            end
+
+            opts.degree = degree;
+            opts.baseline = mean(obj.temp(:,:,1:max(pulse-1,1)), 3);
+            if exist("evalTimes", "var")
+                opts.evalTimes = evalTimes;
+            end
+            t = obj.time(pulse+1:end)-obj.time(pulse);
+            res = TsrMex(obj.temp(:,:,pulse+1:end), t(:), opts);
+            res.pulse = pulse;
+        end
+
+        function res = PPT(obj, freqs, duration, opts)
+            %PPT pulsed phase thermography: fasegrammi alle frequenze freqs
+            %calcolati solo sul decadimento dopo l'impulso (PptMex),
+            %invece della fft su tutta la registrazione di LockIn
+            %   duration (opzionale) e' la durata del decadimento da usare
+            %   [s], default fino alla fine del video
+            %   opts (opzionale) come in PptMex: window (default 'tukey'),
+            %   tukeyAlpha, padFactor; opts.pulse forza il frame
+            %   dell'impulso (default trovaImpulso)
+            %   La baseline e' la media dei frame prima dell'impulso.
+            %   obj.A e obj.P diventano r x c x numel(freqs) e obj.f_c2 le
+            %   frequenze dei bin usati, come in LockInSweep
+            obj.needTemp();
+
+            if ~exist("opts", "var") || isempty(opts)
+                opts = struct();
+            end
+            if isfield(opts, 'pulse')
+                pulse = opts.pulse;
+                opts = rmfield(opts, 'pulse');
+            else
+                pulse = obj.trovaImpulso();
+            end
+            if isempty(obj.framerate)
+                obj.framerate = obj.metadata.FrameRate;
+            end
+
+            last = size(obj.temp,3);
+            if exist("duration", "var") && ~isempty(duration)
+                last = min(last, pulse+round(duration*obj.framerate));
+            end
+            opts.baseline = mean(obj.temp(:,:,1:max(pulse-1,1)), 3);
+
+            res = PptMex(obj.temp(:,:,pulse:last), obj.framerate, freqs, opts);
+            res.pulse = pulse;
+            obj.A = res.A;
+            obj.P = res.P;
+            obj.f_c2 = res.freqs';
+        end
+
+        function res = heatSource(obj, diffusivity, mmpxratio, opts)
+            %heatSource stima della sorgente di calore per pixel e frame,
+            %q = rhoC*(dT/dt - alpha*lap(T)) (HeatSourceMex): derivata
+            %temporale con filtro Savitzky-Golay e laplaciano sul frame
+            %filtrato, in una sola passata sul video
+            %   diffusivity e' alpha [mm^2/s], mmpxratio [mm/px]
+            %   opts (opzionale) come in HeatSourceMex: halfWidth (default
+            %   3), order (2), spatialHalfWidth (1), rhoC (1, q in K/s),
+            %   output ('cube' o 'map' per la sola mappa integrata)
+            %   res.q e' il cubo r x c x n (single), res.integral la somma
+            %   di q*dt su tutti i frame
+            %   La derivata temporale usa i tempi dei frame (obj.time),
+            %   quindi vale anche con frame persi, senza correctfs
+            obj.needTemp();
+
+            if ~exist("opts", "var") || isempty(opts)
+                opts = struct();
+            end
+
+            res = HeatSourceMex(obj.temp, obj.time(:), diffusivity, mmpxratio, opts);
+        end
+
+        function res = thermalContrast(obj, opts)
+            %thermalContrast mappe di contrasto termico assoluto, running
+            %e normalizzato rispetto a una zona sana (ContrastMex), con il
+            %massimo di ogni pixel e il tempo in cui viene raggiunto
+            %   opts (opzionale) come in ContrastMex: region = [r0 r1 c0 c1]
+            %   e' la zona sana (come P_sound in LockinResults), senza
+            %   region il riferimento e' la media mobile su
+            %   backgroundRadius pixel; baselineFrames (default i frame
+            %   prima di trovaImpulso), normFrame, minDelta, sign
+            %   res.absolute, res.running, res.normalised sono i contrasti
+            %   massimi, res.tAbsolute, ... i tempi [s], res.sound la
+            %   curva della zona sana
+            obj.needTemp();
+
+            if ~exist("opts", "var") || isempty(opts)
+                opts = struct();
+            end
+            if ~isfield(opts, 'baselineFrames')
+                opts.baselineFrames = max(obj.trovaImpulso()-1, 1);
+            end
+
+            res = ContrastMex(obj.temp, obj.time(:), opts);
+        end
+
+        function  [Cut_x,yp,Cut_y,xp,xc,yc,jobs]=LockinAmplifierResults(obj,freq,mmpxratio,tol, save)
+            %LockinAmplifierResults mappe di fase e ampiezza e tagli di fase
+            %lungo x e y passanti per il centro dello spot
+            %   save 0 (default) crea solo le figure, 1 le salva anche in
+            %   obj.saveDir (.fig), 2 non usa la grafica di matlab e scrive
+            %   phase_map.png, amp_map.png e phase_cut.png con MapRenderMex.
+            %   Con save 2, se si chiede anche jobs, le immagini non vengono
+            %   scritte ma restituite come job: si possono accumulare su
+            %   tutti i file di un batch e renderizzare in parallelo con una
+            %   sola chiamata MapRenderMex(jobs)
 
             if ~exist("save", "var")
                 save = 0;
             end
+            headless = save >= 2;
+            jobs = [];
+            st = obj.stageStart('plot');
+            done = onCleanup(@() obj.stageEnd(st));
 
             A=obj.A;
             PLru=obj.P;
@@ -426,7 +744,9 @@ classdef TermoAnalizer < handle
 
 
             % MAPPE
-            f = figure;
+            if ~headless
+                f = figure;
+            end
 
 
 
@@ -439,15 +759,20 @@ classdef TermoAnalizer < handle
             xc = floor(mean(find(app >= max(app)-3)));
             app = sum(M,2);
             yc = floor(mean(find(app >= max(app)-3)));
-            surf(X,Y,PLruSurf,'EdgeColor','none')
-            view([0,-90])
-            axis equal
-            xlabel('X')
-            ylabel('Y')
-            title(string(['Phase Map at ',num2str(freq),'Hz']))
-            if save > 0
-                savefig(f, fullfile(obj.saveDir, 'phase_map.fig'));
-                close(f)
+            if headless
+                jobs = renderJob(fullfile(obj.saveDir, 'phase_map.png'), PLruSurf, mmpxratio, ...
+                    ['Phase Map at ',num2str(freq),'Hz'], 'Phase [rad]');
+            else
+                surf(X,Y,PLruSurf,'EdgeColor','none')
+                view([0,-90])
+                axis equal
+                xlabel('X')
+                ylabel('Y')
+                title(string(['Phase Map at ',num2str(freq),'Hz']))
+                if save > 0
+                    savefig(f, fullfile(obj.saveDir, 'phase_map.fig'));
+                    close(f)
+                end
             end
 
 %             [Gmag,Gdir] = imgradient(PLruSurf)
@@ -471,38 +796,55 @@ classdef TermoAnalizer < handle
             X=mmpxratio*[1:c];
             Y=mmpxratio*[1:r];
 
-            f = figure;
-            surf(X,Y,A,'EdgeColor','none')
-            view([0,-90])
-            axis equal
-            xlabel('X')
-            ylabel('Y')
-            title(string(['Amplitude Map at ',num2str(freq),'Hz']))
-
-            if save > 0
-                savefig(f, fullfile(obj.saveDir, 'amp_map.fig'));
-                close(f)
+            if headless
+                jobs = [jobs, renderJob(fullfile(obj.saveDir, 'amp_map.png'), A, mmpxratio, ...
+                    ['Amplitude Map at ',num2str(freq),'Hz'], 'Amplitude')];
+            else
+                f = figure;
+                surf(X,Y,A,'EdgeColor','none')
+                view([0,-90])
+                axis equal
+                xlabel('X')
+                ylabel('Y')
+                title(string(['Amplitude Map at ',num2str(freq),'Hz']))
+
+                if save > 0
+                    savefig(f, fullfile(obj.saveDir, 'amp_map.fig'));
+                    close(f)
+                end
             end
 
 
             % Phase Cut
 
-            f = figure;
-            subplot(2,1,1)
             Cut_y=PLru(:,xc);
             lx=length(Cut_y);
             xp=mmpxratio*[1:lx];
+            Cut_x=PLru(yc,:);
+            ly=length(Cut_x);
+            yp=mmpxratio*[1:ly];
+
+            if headless
+                panels = struct('x', {xp, yp}, 'y', {Cut_y, Cut_x}, ...
+                    'title', {'Phase along y axis', 'Phase along x axis'}, ...
+                    'xlabel', {'y[mm]', 'x[mm]'}, 'ylabel', 'Phase [rad]');
+                job = renderJob(fullfile(obj.saveDir, 'phase_cut.png'), [], mmpxratio, '', '');
+                job.panels = panels;
+                jobs = [jobs, job];
+                if nargout < 7
+                    MapRenderMex(jobs);
+                end
+                return
+            end
 
+            f = figure;
+            subplot(2,1,1)
             plot(xp,Cut_y)
             title('Phase along y axis')
             xlabel('y[mm]')
             ylabel('Phase [rad]')
 
             subplot(2,1,2)
-            Cut_x=PLru(yc,:);
-            ly=length(Cut_x);
-            yp=mmpxratio*[1:ly];
-
             plot(yp,Cut_x)
             title('Phase along x axis')
             xlabel('x[mm]')
@@ -511,7 +853,6 @@ classdef TermoAnalizer < handle
                 savefig(f, fullfile(obj.saveDir, 'phase_cut.fig'));
                 close(f)
             end
-
         end
 
 
@@ -628,6 +969,7 @@ classdef TermoAnalizer < handle
             %   il laser era spento (in campioni, non secondi!)
             %   mappa è la mappa in output, calcolata sulle temperature
             %   correnti (al netto di filtri e cose varie)
+            obj.needTemp();
 
             [maxT, time] = obj.getMaxTemp(); % prendo l'istante di tempo in cui la temperatura raggiunge il massimo (pixel per pixel)
 
@@ -682,10 +1024,20 @@ classdef TermoAnalizer < handle
             %radiance. La temperatura va ricalcolata a posteriori con la
             %funzione di normalizzazione
             %   size è la dimensione del filtro
+            st = obj.stageStart('spatialFilter');
+            obj.memoKey = obj.stageKey('spatialFilter', obj.memoKey, s);
+            [hit, value] = obj.memoGet(obj.memoKey);
+            if hit
+                obj.radiance = value;
+                obj.stageEnd(st, 8*numel(obj.radiance));
+                return
+            end
             d = size(obj.radiance);
             for ii = 1:d(3)
                 obj.radiance(:,:,ii) = wiener2(obj.radiance(:,:,ii), [s s]);
             end
+            obj.memoPut(obj.memoKey, obj.radiance);
+            obj.stageEnd(st, 8*numel(obj.radiance));
         end
 
         function filtroTemporale(obj, b, a)
@@ -695,6 +1047,14 @@ classdef TermoAnalizer < handle
             %   b e a sono i parametri del filtro da calcolare con
             %   creaFiltro
 
+            st = obj.stageStart('temporalFilter');
+            obj.memoKey = obj.stageKey('temporalFilter', obj.memoKey, b, a);
+            [hit, value] = obj.memoGet(obj.memoKey);
+            if hit
+                obj.radiance = value;
+                obj.stageEnd(st, 8*numel(obj.radiance));
+                return
+            end
             d = size(obj.radiance);
 
             for ii = 1:d(1)
@@ -702,6 +1062,179 @@ classdef TermoAnalizer < handle
                     obj.radiance(ii,jj,:) = filtfilt(b,a,squeeze(obj.radiance(ii,jj,:)));
                 end
             end
+            obj.memoPut(obj.memoKey, obj.radiance);
+            obj.stageEnd(st, 8*numel(obj.radiance));
+        end
+
+        function spill(obj, memoryMB, scratchDir)
+            %spill sposta obj.temp in un cubo nativo (ThermoCubeMex) che
+            %tiene in memoria al massimo memoryMB di frame e il resto in un
+            %file temporaneo mappato in memoria, per i video che non stanno
+            %nella RAM. obj.temp resta vuoto, LockInSweep, trackSpot e
+            %getFrames leggono dal cubo, gli altri metodi danno errore
+            %   scratchDir (opzionale) e' la cartella del file temporaneo,
+            %   default quella temporanea del sistema
+            opts = struct('memory', memoryMB);
+            if exist("scratchDir", "var")
+                opts.scratchDir = scratchDir;
+            end
+            if ~isempty(obj.cube)
+                return % gia' nel cubo, obj.temp e' vuoto
+            end
+            [r,c,~] = size(obj.temp);
+            cube = ThermoCubeMex('new', r, c, opts);
+            ThermoCubeMex('write', cube, 1, obj.temp);
+            obj.cube = cube;
+            obj.temp = [];
+        end
+
+        function needTemp(obj)
+            %needTemp errore per i metodi che leggono obj.temp, vuoto dopo
+            %spill
+            if ~isempty(obj.cube)
+                error("I frame sono nel cubo di spill: questo metodo usa obj.temp, solo getFrames, LockInSweep e trackSpot leggono dal cubo");
+            end
+        end
+
+        function frames = getFrames(obj, a, b)
+            %getFrames frame di temperatura da a a b, da obj.temp o dal
+            %cubo dopo spill
+            if isempty(obj.cube)
+                frames = obj.temp(:,:,a:b);
+            else
+                frames = ThermoCubeMex('read', obj.cube, a, b-a+1);
+            end
+        end
+
+        function delete(obj)
+            %delete libera il cubo di spill e il suo file temporaneo
+            if ~isempty(obj.cube)
+                ThermoCubeMex('delete', obj.cube);
+                obj.cube = [];
+            end
+        end
+
+        function key = stageKey(obj, name, parent, varargin)
+            %stageKey chiave della fase name nella cache (ThermoMemoMex):
+            %la chiave della fase da cui parte (parent) e i parametri,
+            %cosi' cambiare un parametro o un passo prima cambia le chiavi
+            %di tutte le fasi dopo. Vuota senza THERMO_MEMO o se parent e'
+            %vuota (dati modificati fuori da TermoAnalizer)
+            key = '';
+            if ~isempty(obj.memo) && ~isempty(parent)
+                key = ThermoMemoMex('key', name, parent, varargin{:});
+            end
+        end
+
+        function [hit, value] = memoGet(obj, key)
+            %memoGet valore della fase salvato con key, hit false se non
+            %c'e' o la chiave e' vuota
+            hit = false;
+            value = [];
+            if ~isempty(key)
+                [hit, value] = ThermoMemoMex('get', key);
+            end
+        end
+
+        function memoPut(obj, key, value)
+            %memoPut salva il valore della fase, niente se la chiave e'
+            %vuota. La cache tiene i valori usati di recente nel limite di
+            %THERMO_MEMO_MB
+            if ~isempty(key)
+                ThermoMemoMex('put', key, value);
+            end
+        end
+
+        function st = stageStart(obj, name)
+            %stageStart apre la fase name del profilo, da chiudere con
+            %stageEnd. Senza THERMO_PROFILE non misura niente
+            st = struct('name', name, 'ts', 0, 'cpu', 0);
+            if ~isempty(obj.profile)
+                st.ts = profileNow();
+                st.cpu = cputime;
+            end
+        end
+
+        function stageEnd(obj, st, bytes)
+            %stageEnd chiude la fase st e ne aggiunge la riga al file
+            %THERMO_PROFILE, nello stesso formato dei mex (ThermoProfiler.h)
+            %   bytes (opzionale) sono i dati elaborati dalla fase
+            if isempty(obj.profile)
+                return
+            end
+            if ~exist("bytes", "var")
+                bytes = 0;
+            end
+            dur = profileNow() - st.ts;
+            [rssMB, peakMB] = processMemory();
+            fid = fopen(obj.profile, 'a');
+            if fid < 0
+                return
+            end
+            fprintf(fid, ['{"name":%s,"source":"TermoAnalizer","pid":%d,"tid":0,"ts":%d,"dur":%d,"cpu":%.6f,' ...
+                '"bytes":%.17g,"rssMB":%.1f,"peakMB":%.1f,"threads":%d}\n'], jsonencode(st.name), feature('getpid'), ...
+                st.ts, dur, cputime-st.cpu, bytes, rssMB, peakMB, maxNumCompThreads);
+            fclose(fid);
+        end
+
+        function report = profileReport(obj, jsonFile, traceFile)
+            %profileReport riassume per fase il file THERMO_PROFILE (le
+            %fasi di TermoAnalizer e quelle dei mex) e lo scrive in jsonFile
+            %   per ogni fase: calls, wall e cpu [s], bytes, MBps,
+            %   utilisation (cpu / (wall * threads), 1 = tutti i thread
+            %   occupati) e peakMB, in ordine di wall decrescente.
+            %   traceFile (opzionale) e' la timeline in formato chrome trace
+            %   (chrome://tracing o ui.perfetto.dev)
+            report = struct('metadata', struct('file', obj.fileName, 'events', obj.profile, ...
+                'date', char(datetime('now', 'Format', 'yyyy-MM-dd''T''HH:mm:ss')), 'matlab', version, ...
+                'host', hostName(), 'cores', feature('numcores'), 'threads', maxNumCompThreads), ...
+                'wall', 0, 'peakMB', 0, 'stages', []);
+            if isempty(obj.profile) || ~exist(obj.profile, 'file')
+                warning('TermoAnalizer:profile', 'No profile, set THERMO_PROFILE before creating the TermoAnalizer.');
+                return
+            end
+
+            lines = splitlines(strtrim(fileread(obj.profile)));
+            ev = cellfun(@jsondecode, lines(~cellfun(@isempty, lines)), 'UniformOutput', false);
+            ev = [ev{:}];
+            if isempty(ev)
+                return
+            end
+            t0 = min([ev.ts]);
+            report.wall = (max([ev.ts]+[ev.dur]) - t0)/1e6;
+            report.peakMB = max([ev.peakMB]);
+
+            [names, ~, idx] = unique({ev.name}, 'stable');
+            stages = struct('name', names, 'source', '', 'calls', 0, 'wall', 0, 'cpu', 0, 'bytes', 0, ...
+                'MBps', 0, 'utilisation', 0, 'peakMB', 0);
+            for k = 1:numel(names)
+                e = ev(idx == k);
+                stages(k).source = e(1).source;
+                stages(k).calls = numel(e);
+                stages(k).wall = sum([e.dur])/1e6;
+                stages(k).cpu = sum([e.cpu]);
+                stages(k).bytes = sum([e.bytes]);
+                stages(k).MBps = stages(k).bytes/2^20/max(stages(k).wall, eps);
+                stages(k).utilisation = stages(k).cpu/max(sum([e.dur].*[e.threads])/1e6, eps);
+                stages(k).peakMB = max([e.peakMB]);
+            end
+            [~, order] = sort([stages.wall], 'descend');
+            report.stages = stages(order);
+
+            fid = fopen(jsonFile, 'w');
+            fprintf(fid, '%s', jsonencode(report));
+            fclose(fid);
+
+            if exist("traceFile", "var") && ~isempty(traceFile)
+                % eventi completi ("X"), tempi in us dal primo evento
+                trace = struct('name', {ev.name}, 'cat', {ev.source}, 'ph', 'X', ...
+                    'ts', num2cell([ev.ts]-t0), 'dur', {ev.dur}, 'pid', {ev.pid}, 'tid', {ev.tid}, ...
+                    'args', num2cell(struct('bytes', {ev.bytes}, 'cpu', {ev.cpu}, 'rssMB', {ev.rssMB}, ...
+                    'peakMB', {ev.peakMB}, 'threads', {ev.threads})));
+                fid = fopen(traceFile, 'w');
+                fprintf(fid, '%s', jsonencode(struct('traceEvents', trace, 'displayTimeUnit', 'ms')));
+                fclose(fid);
+            end
         end
 
         function metadata = getMetadata(obj)
@@ -710,6 +1243,7 @@ classdef TermoAnalizer < handle
 
 
         function Tmax= TMaxVsTime(obj)
+            obj.needTemp();
             figure
 
             [temp, time] = max(obj.temp, [], 3);
@@ -723,6 +1257,7 @@ classdef TermoAnalizer < handle
 
 
         function  GetSpotSizeByFirstMax(obj,frameMax,tol,mmpxratio)
+            obj.needTemp();
             S=obj.temp(:,:,frameMax);
             S=S-min(S,[],'all');
             S=S/max(S,[],'all');
@@ -735,11 +1270,137 @@ classdef TermoAnalizer < handle
 
         end
 
+        function  [xc,yc,track]=trackSpot(obj,a,b,mmpxratio,method)
+            %trackSpot trova centro e dimensione dello spot laser con
+            %precisione sub-pixel su tutti i frame da a a b (default tutto
+            %il video), senza doverlo reiterare a mano
+            %   Su ogni frame viene fittata una gaussiana 2-D (method
+            %   'gauss', default) oppure usata la stima con i momenti
+            %   ('moments'), vedi SpotTrackerMex. Se a e' 0 lavora sulla
+            %   mappa di ampiezza obj.A (prima frequenza) invece che sulle
+            %   temperature.
+            %   xc e yc sono la mediana del centro (pixel, 1 based), da
+            %   passare a evaluateDiffusivity. track contiene le traiettorie
+            %   per frame (xc, yc, fwhmX, fwhmY, peak, R2, ...), le stesse in
+            %   mm se mmpxratio e' dato, e la deriva del fascio (drift, in
+            %   pixel o mm)
+
+            if ~exist("method", "var")
+                method = 'gauss';
+            end
+            if exist("a", "var") && isequal(a, 0)
+                cube = obj.A(:,:,1);
+            else
+                if ~exist("a", "var") || isempty(a)
+                    a = 1;
+                end
+                if ~exist("b", "var") || isempty(b)
+                    if isempty(obj.cube)
+                        b = size(obj.temp,3);
+                    else
+                        info = ThermoCubeMex('info', obj.cube);
+                        b = info.numFrames;
+                    end
+                end
+                cube = obj.getFrames(a, b);
+            end
+
+            opts.method = method;
+            track = SpotTrackerMex(cube, opts);
+
+            xc = median(track.xc, 'omitnan');
+            yc = median(track.yc, 'omitnan');
+            scale = 1;
+            if exist("mmpxratio", "var") && ~isempty(mmpxratio)
+                scale = mmpxratio;
+                track.xmm = track.xc*mmpxratio;
+                track.ymm = track.yc*mmpxratio;
+                track.fwhmXmm = track.fwhmX*mmpxratio;
+                track.fwhmYmm = track.fwhmY*mmpxratio;
+            end
+            track.drift = scale*hypot(track.xc-xc, track.yc-yc);
+            track.maxDrift = max(track.drift);
+        end
+
+        function shifts = registerFrames(obj, opts)
+            %registerFrames compensa la deriva del provino/camera
+            %registrando ogni frame con correlazione di fase (sub-pixel)
+            %   I frame di obj.temp vengono allineati al primo frame (o a
+            %   opts.reference) oppure a un template mobile
+            %   (opts.template = 'running', aggiornato con opts.alpha) e
+            %   ricampionati (opts.interp 'bilinear', 'bicubic', 'none'
+            %   per le sole stime), vedi RegistrationMex. I pixel senza
+            %   dati dopo lo spostamento sono NaN. shifts e' numFrame x 3
+            %   [dx dy picco] in pixel. obj.radiance non viene toccata
+            obj.needTemp();
+
+            if ~exist("opts", "var")
+                opts = struct();
+            end
+            blockSize = 64;
+            if isfield(opts, "blockSize")
+                blockSize = opts.blockSize;
+                opts = rmfield(opts, "blockSize");
+            end
+
+            [rows, cols, numFrames] = size(obj.temp);
+            shifts = zeros(numFrames, 3);
+            h = RegistrationMex('new', rows, cols, opts);
+            for first = 1:blockSize:numFrames
+                idx = first:min(first+blockSize-1, numFrames);
+                [registered, shifts(idx,:)] = RegistrationMex('push', h, obj.temp(:,:,idx));
+                if ~isempty(registered)
+                    obj.temp(:,:,idx) = registered;
+                end
+            end
+            RegistrationMex('delete', h);
+            obj.memoKey = obj.stageKey('registerFrames', obj.memoKey, opts);
+        end
+
+        function res = trackHotZone(obj, isotherms, mmpxratio, opts)
+            %trackHotZone segmenta la zona calda (nocciolo della saldatura
+            %RSW) a ogni isoterma e ne segue l'evoluzione frame per frame
+            %   Ogni frame viene sogliato alle isoterme (stesse unita' di
+            %   obj.temp), le componenti connesse vengono etichettate e
+            %   inseguite tra i frame da HotZoneMex, a blocchi di frame.
+            %   res(k) contiene, per l'isoterma k, le serie temporali di
+            %   area, centro, diametro equivalente e perimetro della
+            %   componente piu' grande (mm se mmpxratio e' dato), l'area
+            %   totale e la tabella di tutte le componenti. opts:
+            %   connectivity (4 o 8), minArea (pixel), blockSize (frame)
+            obj.needTemp();
+
+            if ~exist("opts", "var")
+                opts = struct();
+            end
+            if exist("mmpxratio", "var") && ~isempty(mmpxratio)
+                opts.mmpxratio = mmpxratio;
+            end
+            blockSize = 64;
+            if isfield(opts, "blockSize")
+                blockSize = opts.blockSize;
+            end
+
+            [rows, cols, numFrames] = size(obj.temp);
+            % a blocchi: il mex tiene le etichette di tutti i frame del blocco
+            h = HotZoneMex('new', rows, cols, isotherms, opts);
+            for first = 1:blockSize:numFrames
+                HotZoneMex('push', h, obj.temp(:,:,first:min(first+blockSize-1, numFrames)));
+            end
+            res = HotZoneMex('result', h);
+            HotZoneMex('delete', h);
+
+            for k = 1:numel(res)
+                res(k).time = obj.time(:);
+            end
+        end
+
 
 
 
 
         function Tmax= TMaxVsFrame(obj)
+            obj.needTemp();
             figure
 
             [temp, time] = max(obj.temp, [], 3);
@@ -752,6 +1413,7 @@ classdef TermoAnalizer < handle
         end
 
         function Tensore_denoised = SVDdenoising(obj)
+            obj.needTemp();
             frame=size(obj.temp,3);
             px=size(obj.temp,1);
             py=size(obj.temp,2);
@@ -763,12 +1425,15 @@ classdef TermoAnalizer < handle
 
             obj.temp=reshape(Matrice_denoised(:,:),px,py,frame);
             Tensore_denoised= obj.temp;
+            obj.memoKey = obj.stageKey('SVDdenoising', obj.memoKey);
         end
 
         function SelectTimeInterval(obj,frame_start,frame_end)
+            obj.needTemp();
             obj.temp=obj.temp(:,:,frame_start:frame_end);
             obj.time=obj.time(frame_start:frame_end);
             obj.radiance=obj.radiance(:,:,frame_start:frame_end);
+            obj.memoKey = obj.stageKey('SelectTimeInterval', obj.memoKey, frame_start, frame_end);
         end
 
         function  [Dx,Dy,Davg]=evaluateDiffusivity(obj,freq,xc,yc,mmpxratio,laserspotdiameter,expectedDiffusivity,tol)
@@ -850,7 +1515,110 @@ classdef TermoAnalizer < handle
 
         end
 
+        function  [Dx,Dy,Davg,res]=evaluateDiffusivityRadial(obj,freq,xc,yc,mmpxratio,laserspotdiameter,expectedDiffusivity,tol,numRays)
+            %evaluateDiffusivityRadial come evaluateDiffusivity, ma usa
+            %numRays raggi (default 180) che partono dal centro dello spot
+            %invece di un solo taglio lungo x e uno lungo y
+            %   Fase e log dell'ampiezza sono campionati lungo ogni raggio
+            %   (interpolazione bilineare) e fittati ai minimi quadrati
+            %   pesati. Dx e Dy vengono dall'ellisse di anisotropia fittata
+            %   su tutti i raggi, res contiene la diffusivita' per raggio
+            %   (res.Dphase, res.R2phase, ...) e l'ellisse (res.ellipse)
+            %   Vedi RadialDiffusivityMex
+
+            if ~exist("numRays", "var")
+                numRays = 180;
+            end
+            if size(obj.P,3)>1
+                [~,index]=min(abs(obj.f_c2-freq));
+                P=obj.P(:,:,index);A=obj.A(:,:,index);
+            else
+                P=obj.P;A=obj.A;
+            end
+
+            % stesso intervallo di raggi dei tagli di evaluateDiffusivity
+            expectedThermalDiffusionLength=sqrt(expectedDiffusivity/freq/pi());
+            opts.rStart=laserspotdiameter;
+            opts.rEnd=laserspotdiameter+2*expectedThermalDiffusionLength;
+            opts.numRays=numRays;
+            opts.tol=tol;
+
+            key = obj.stageKey('radialFit', obj.lockKey, freq, xc, yc, mmpxratio, opts);
+            [hit, res] = obj.memoGet(key);
+            if ~hit
+                res=RadialDiffusivityMex(P,A,freq,xc,yc,mmpxratio,opts);
+                obj.memoPut(key, res);
+            end
+
+            Dx=res.ellipse.Dx;
+            Dy=res.ellipse.Dy;
+            Davg=(Dx+Dy)/2;
+        end
+
+        function  [Dx,Dy,Davg,res]=evaluateDiffusivityFit(obj,freq,xc,yc,mmpxratio,laserspotdiameter,expectedDiffusivity,tol,opts)
+            %evaluateDiffusivityFit fit delle mappe complete di ampiezza e
+            %fase con l'onda termica di uno spot gaussiano modulato
+            %   Diffusivita' lungo x e y, raggio dello spot e centro sono
+            %   fittati con Levenberg-Marquardt su tutti i pixel entro
+            %   laserspotdiameter+2*lunghezza di diffusione attesa (lo spot
+            %   e' nel modello, quindi non va escluso). res contiene anche le
+            %   deviazioni standard dei parametri (res.sigmaDx, ...) e le
+            %   mappe del modello (res.Amodel, res.Pmodel)
+            %   opts (opzionale) come in ThermalWaveFitMex
+            %   Vedi ThermalWaveFitMex
+
+            if ~exist("opts", "var") || isempty(opts)
+                opts = struct();
+            end
+            if size(obj.P,3)>1
+                [~,index]=min(abs(obj.f_c2-freq));
+                P=obj.P(:,:,index);A=obj.A(:,:,index);
+            else
+                P=obj.P;A=obj.A;
+            end
+
+            expectedThermalDiffusionLength=sqrt(expectedDiffusivity/freq/pi());
+            if ~isfield(opts, 'rEnd')
+                opts.rEnd=laserspotdiameter+2*expectedThermalDiffusionLength;
+            end
+            if ~isfield(opts, 'diffusivity')
+                opts.diffusivity=expectedDiffusivity;
+            end
+            if ~isfield(opts, 'spotRadius')
+                opts.spotRadius=laserspotdiameter/2;
+            end
+            opts.tol=tol;
+
+            key = obj.stageKey('thermalWaveFit', obj.lockKey, freq, xc, yc, mmpxratio, opts);
+            [hit, res] = obj.memoGet(key);
+            if ~hit
+                res=ThermalWaveFitMex(P,A,freq,xc,yc,mmpxratio,opts);
+                obj.memoPut(key, res);
+            end
+
+            Dx=res.Dx;
+            Dy=res.Dy;
+            Davg=(Dx+Dy)/2;
+        end
+
+        function info = exportVideo(obj, fileName, opts)
+            %exportVideo scrive il cubo delle temperature come video in
+            %falsi colori (vedi ExportVideo), molto piu' veloce di surf
+            %   opts come in ExportVideo; se non c'e' fps usa il frame rate
+            %   medio di obj.time
+            obj.needTemp();
+
+            if ~exist("opts", "var") || isempty(opts)
+                opts = struct();
+            end
+            if ~isfield(opts, 'fps') && numel(obj.time) > 1
+                opts.fps = (numel(obj.time)-1)/(obj.time(end)-obj.time(1));
+            end
+            info = ExportVideo(obj.temp, fileName, opts);
+        end
+
         function  surf(obj)
+            obj.needTemp();
             frame=size(obj.temp,3);
 
             for i=1:frame
@@ -872,4 +1640,54 @@ classdef TermoAnalizer < handle
 
 
 
-end
\ No newline at end of file
+end
+
+function t = profileNow()
+%profileNow microsecondi dal 1970, lo stesso orologio di ThermoProfiler.h
+t = round(posixtime(datetime('now', 'TimeZone', 'UTC'))*1e6);
+end
+
+function [rssMB, peakMB] = processMemory()
+%processMemory memoria residente e picco del processo [MB] (su windows
+%memory non da il picco, che resta quello dei mex)
+rssMB = 0;
+peakMB = 0;
+if ispc
+    user = memory;
+    rssMB = user.MemUsedMATLAB/2^20;
+    peakMB = rssMB;
+elseif exist('/proc/self/status', 'file')
+    status = fileread('/proc/self/status');
+    t = regexp(status, 'VmRSS:\s*(\d+)', 'tokens', 'once');
+    if ~isempty(t)
+        rssMB = str2double(t{1})/1024;
+    end
+    t = regexp(status, 'VmHWM:\s*(\d+)', 'tokens', 'once');
+    if ~isempty(t)
+        peakMB = str2double(t{1})/1024;
+    end
+end
+end
+
+function name = hostName()
+%hostName nome del computer, per i metadati del profilo
+name = getenv('COMPUTERNAME');
+if isempty(name)
+    [~, name] = system('hostname');
+    name = strtrim(name);
+end
+end
+
+function job = renderJob(file, map, mmpxratio, name, clabel)
+%renderJob job di MapRenderMex per una mappa (panels vuoto)
+job = struct('file', file, 'map', map, 'panels', [], ...
+    'mmpxratio', mmpxratio, 'title', name, 'clabel', clabel);
+end
+
+function v = memoCompact(v)
+%memoCompact i frame in single se non perdono niente (i dati del file lo
+%sono), per dimezzare le voci della cache
+if isequal(double(single(v)), v)
+    v = single(v);
+end
+end
@@ -0,0 +1,299 @@
+#pragma once
+
+#include "ThermoParallel.h"
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+//	streaming thermal contrast
+//
+//	dT = T - T0 is the rise over the mean of the first baselineFrames frames (T itself when there are none) and dTs the
+//	rise of the sound area: the mean of a reference rectangle (the P_sound of LockinResults, for one curve shared by all
+//	pixels) or, with crBackground, the frame smoothed by a box of 2 backgroundRadius + 1 pixels (a background of its own
+//	for every pixel, for samples with no sound area known in advance). per frame
+//		absolute	Ca = dT - dTs
+//		running		Cr = (dT - dTs) / dTs, where |dTs| > minDelta
+//		normalised	Cn = dT / dT(tm) - dTs / dTs(tm), tm the frame normFrame (none if negative, after the baseline frames,
+//					where dT is 0), where |dT(tm)| and |dTs(tm)| > minDelta
+//	and for every kind the map of the extreme contrast and the time it was reached: the largest sign C (sign 1 for hot
+//	defects, -1 for cold ones) or the largest |C| with sign 0, keeping its signed value. frames are pushed in blocks as
+//	they are read, nothing but a few planes is kept. frames are column major rows x cols (matlab), frame numbers count
+//	from 0 in push order.
+
+struct SContrastParams
+{
+	enum EReference
+	{
+		crRegion = 0,
+		crBackground
+	};
+
+	EReference	reference;
+	size_t		r0;						//	crRegion, inclusive rectangle (0 based rows / columns)
+	size_t		r1;
+	size_t		c0;
+	size_t		c1;
+	size_t		backgroundRadius;		//	crBackground [px]
+	size_t		baselineFrames;
+	int64_t		normFrame;				//	frame of the normalisation, < 0 for none
+	double		minDelta;				//	[K]
+	int			sign;
+};
+
+class CThermalContrast
+{
+public:
+	enum EContrast
+	{
+		ctAbsolute = 0,
+		ctRunning,
+		ctNormalised,
+		ctCount
+	};
+
+private:
+	size_t					mRows;
+	size_t					mCols;
+	SContrastParams			mParams;
+	int64_t					mNumFrames;
+	std::vector<double>		mBaseline;			//	sum, then mean of the baseline frames
+	std::vector<float>		mBackground;		//	crBackground, dTs of the current frame
+	std::vector<double>		mPrefix;			//	box filter running sums
+	std::vector<float>		mNorm;				//	dT(tm)
+	double					mSoundNorm;			//	crRegion dTs(tm)
+	std::vector<float>		mBackgroundNorm;	//	crBackground dTs(tm)
+	std::vector<float>		mMax[ctCount];		//	signed extreme contrast
+	std::vector<float>		mScore[ctCount];	//	sign C or |C| at the extreme
+	std::vector<float>		mContrast[ctCount];	//	contrast of the current frame
+	std::vector<double>		mTime[ctCount];		//	[s], NaN until a contrast was defined
+	std::vector<double>		mSound;				//	per frame dTs of the region (frame mean of the background)
+	std::string				mError;
+
+	//	box mean of 2 radius + 1 pixels of plane into mBackground, the part of the box inside the frame
+	void Smooth(const float *plane)
+	{
+		size_t		rows = mRows, cols = mCols;
+		long		w = (long)mParams.backgroundRadius;
+
+		//	along the contiguous rows, each column on its own
+		ParallelFor(cols, 8, [&](size_t begin, size_t end) {
+			std::vector<double>		prefix(rows + 1);
+
+			for (size_t c = begin; c < end; ++c) {
+				const float		*src = plane + c * rows;
+				float			*dest = &mBackground[c * rows];
+
+				prefix[0] = 0.0;
+				for (size_t r = 0; r < rows; ++r)
+					prefix[r + 1] = prefix[r] + src[r];
+				for (size_t r = 0; r < rows; ++r) {
+					size_t		lo = (size_t)std::max((long)r - w, 0L), hi = (size_t)std::min((long)r + w + 1, (long)rows);
+
+					dest[r] = (float)((prefix[hi] - prefix[lo]) / (double)(hi - lo));
+				}
+			}
+		});
+
+		//	across the columns on running planes, rows stay contiguous
+		for (size_t r = 0; r < rows; ++r)
+			mPrefix[r] = 0.0;
+		for (size_t c = 0; c < cols; ++c) {
+			const float		*src = &mBackground[c * rows];
+			double			*prev = &mPrefix[c * rows], *next = &mPrefix[(c + 1) * rows];
+
+			for (size_t r = 0; r < rows; ++r)
+				next[r] = prev[r] + src[r];
+		}
+		ParallelFor(cols, 8, [&](size_t begin, size_t end) {
+			for (size_t c = begin; c < end; ++c) {
+				size_t			lo = (size_t)std::max((long)c - w, 0L), hi = (size_t)std::min((long)c + w + 1, (long)cols);
+				const double	*a = &mPrefix[lo * rows], *b = &mPrefix[hi * rows];
+				float			*dest = &mBackground[c * rows];
+				double			scale = 1.0 / (double)(hi - lo);
+
+				for (size_t r = 0; r < rows; ++r)
+					dest[r] = (float)((b[r] - a[r]) * scale);
+			}
+		});
+	}
+
+	//	keeps the extreme of the contrast plane c over [begin, end), NaN never wins
+	void Track(EContrast kind, size_t begin, size_t end, double t)
+	{
+		const float		*c = &mContrast[kind][0];
+		float			*best = &mMax[kind][0], *score = &mScore[kind][0];
+		double			*time = &mTime[kind][0];
+		float			sign = (float)mParams.sign;
+		bool			magnitude = mParams.sign == 0;
+
+		for (size_t p = begin; p < end; ++p) {
+			float		s = magnitude ? fabsf(c[p]) : sign * c[p];
+			bool		better = s > score[p];
+
+			score[p] = better ? s : score[p];
+			best[p] = better ? c[p] : best[p];
+			time[p] = better ? t : time[p];
+		}
+	}
+
+public:
+	CThermalContrast(size_t rows, size_t cols, const SContrastParams &params) :
+		mRows(rows),
+		mCols(cols),
+		mParams(params),
+		mNumFrames(0),
+		mBaseline(rows * cols, 0.0),
+		mSoundNorm(NAN)
+	{
+		size_t		n = rows * cols;
+
+		if (params.reference == SContrastParams::crRegion && (params.r0 > params.r1 || params.r1 >= rows || params.c0 > params.c1 || params.c1 >= cols))
+			mError = "The reference region must lie inside the frame.";
+		if (params.normFrame >= 0 && params.normFrame < (int64_t)params.baselineFrames)
+			mError = "normFrame must come after the baseline frames.";
+		if (params.reference == SContrastParams::crBackground) {
+			mBackground.resize(n);
+			mPrefix.resize((cols + 1) * rows);
+			if (params.normFrame >= 0)
+				mBackgroundNorm.assign(n, NAN);
+		}
+		if (params.normFrame >= 0)
+			mNorm.assign(n, NAN);
+		for (size_t k = 0; k < ctCount; ++k) {
+			mMax[k].assign(n, NAN);
+			mScore[k].assign(n, -INFINITY);
+			mContrast[k].assign(n, NAN);
+			mTime[k].assign(n, NAN);
+		}
+	}
+
+	bool valid() const
+	{
+		return mError.empty();
+	}
+
+	//	numFrames frames with their times [s]
+	template <typename kind>
+	bool Push(const kind *frames, const double *times, size_t numFrames)
+	{
+		size_t					n = mRows * mCols;
+		std::vector<float>		rise(n);
+
+		if (!mError.empty())
+			return false;
+
+		for (size_t f = 0; f < numFrames; ++f) {
+			const kind		*frame = frames + f * n;
+			int64_t			index = mNumFrames++;
+			double			t = times[f];
+
+			if (index < (int64_t)mParams.baselineFrames) {
+				for (size_t p = 0; p < n; ++p)
+					mBaseline[p] += (double)frame[p];
+				if (index + 1 == (int64_t)mParams.baselineFrames)
+					for (size_t p = 0; p < n; ++p)
+						mBaseline[p] /= (double)mParams.baselineFrames;
+				mSound.push_back(0.0);
+				continue;
+			}
+
+			for (size_t p = 0; p < n; ++p)
+				rise[p] = (float)((double)frame[p] - mBaseline[p]);
+
+			//	the sound reference of this frame
+			double		sound = 0.0;
+
+			if (mParams.reference == SContrastParams::crRegion) {
+				for (size_t c = mParams.c0; c <= mParams.c1; ++c)
+					for (size_t r = mParams.r0; r <= mParams.r1; ++r)
+						sound += rise[r + c * mRows];
+				sound /= (double)((mParams.r1 - mParams.r0 + 1) * (mParams.c1 - mParams.c0 + 1));
+			}
+			else {
+				Smooth(rise.data());
+				for (size_t p = 0; p < n; ++p)
+					sound += mBackground[p];
+				sound /= (double)n;
+			}
+			mSound.push_back(sound);
+
+			bool		isNorm = mParams.normFrame >= 0 && index == mParams.normFrame;
+			bool		normed = mParams.normFrame >= 0 && index >= mParams.normFrame;
+
+			if (isNorm) {
+				std::copy(rise.begin(), rise.end(), mNorm.begin());
+				if (mParams.reference == SContrastParams::crRegion)
+					mSoundNorm = sound;
+				else
+					std::copy(mBackground.begin(), mBackground.end(), mBackgroundNorm.begin());
+			}
+
+			ParallelFor(n, 4096, [&](size_t begin, size_t end) {
+				const float		*background = mParams.reference == SContrastParams::crRegion ? NULL : &mBackground[0];
+				const float		*backgroundNorm = background != NULL && normed ? &mBackgroundNorm[0] : NULL;
+				float			*ca = &mContrast[ctAbsolute][0], *cr = &mContrast[ctRunning][0], *cn = &mContrast[ctNormalised][0];
+				float			minDelta = (float)mParams.minDelta, region = (float)sound, regionNorm = (float)mSoundNorm;
+
+				for (size_t p = begin; p < end; ++p) {
+					float		s = background != NULL ? background[p] : region;
+
+					ca[p] = rise[p] - s;
+					cr[p] = fabsf(s) > minDelta ? ca[p] / s : NAN;
+				}
+				if (normed) {
+					for (size_t p = begin; p < end; ++p) {
+						float		s = background != NULL ? background[p] : region;
+						float		dn = mNorm[p], sn = backgroundNorm != NULL ? backgroundNorm[p] : regionNorm;
+
+						cn[p] = fabsf(dn) > minDelta && fabsf(sn) > minDelta ? rise[p] / dn - s / sn : NAN;
+					}
+				}
+				Track(ctAbsolute, begin, end, t);
+				Track(ctRunning, begin, end, t);
+				if (normed)
+					Track(ctNormalised, begin, end, t);
+			});
+		}
+
+		return true;
+	}
+
+	size_t rows() const
+	{
+		return mRows;
+	}
+
+	size_t cols() const
+	{
+		return mCols;
+	}
+
+	int64_t numFrames() const
+	{
+		return mNumFrames;
+	}
+
+	//	signed extreme contrast and its time [s], NaN where it was never defined
+	const std::vector<float> &maxContrast(EContrast kind) const
+	{
+		return mMax[kind];
+	}
+
+	const std::vector<double> &timeOfMax(EContrast kind) const
+	{
+		return mTime[kind];
+	}
+
+	const std::vector<double> &sound() const
+	{
+		return mSound;
+	}
+
+	const std::string &error() const
+	{
+		return mError;
+	}
+};
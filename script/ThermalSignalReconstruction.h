@@ -0,0 +1,216 @@
+#pragma once
+
+#include "ThermoParallel.h"
+#include "SmallLinearAlgebra.h"
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+//	thermographic signal reconstruction (TSR) for pulsed tests
+//
+//	after the pulse every pixel is fitted with a polynomial in log time: ln dT = sum_j c_j x^j with x = (ln t - mu) / s,
+//	mu and s centre and scale ln t to keep the normal equations well conditioned. all pixels share the time base, so
+//	the pseudo-inverse P = (V'V)^-1 V' of the vandermonde matrix is computed once and the fit of a block of frames is
+//	c_j += P(j, k) ln dT_k: a small matrix product running along the pixels (contiguous in the matlab cube, so it
+//	vectorizes), split over the cores. frames can be pushed as they are read, the cube is never needed as a whole.
+//	sum (ln dT)^2 is kept too, which gives the residual of each pixel from the normal equations: y'y - c'V'Vc.
+//	dT = T - baseline is clamped to minDelta before the logarithm (late samples can fall into the noise).
+
+class CTsrAccumulator
+{
+private:
+	size_t					mNumPixels;
+	size_t					mNumTimes;
+	size_t					mNumCoeffs;
+	double					mMu;
+	double					mScale;
+	double					mMinDelta;
+	std::vector<double>		mPinv;			//	numCoeffs x numTimes, row major
+	std::vector<double>		mGram;			//	V'V, numCoeffs x numCoeffs
+	std::vector<double>		mBaseline;		//	per pixel, empty for 0
+	std::vector<double>		mCoeffs;		//	numCoeffs planes
+	std::vector<double>		mSumY2;
+	size_t					mNumFrames;
+	bool					mValid;
+
+public:
+	//	times in seconds from the pulse (all > 0), one per frame that will be pushed
+	CTsrAccumulator(size_t numPixels, const std::vector<double> &times, size_t degree, double minDelta) :
+		mNumPixels(numPixels),
+		mNumTimes(times.size()),
+		mNumCoeffs(degree + 1),
+		mMu(0.0),
+		mScale(1.0),
+		mMinDelta(minDelta),
+		mPinv((degree + 1) * times.size(), 0.0),
+		mGram((degree + 1) * (degree + 1), 0.0),
+		mCoeffs((degree + 1) * numPixels, 0.0),
+		mSumY2(numPixels, 0.0),
+		mNumFrames(0),
+		mValid(false)
+	{
+		size_t					n = mNumTimes, m = mNumCoeffs;
+		std::vector<double>		x(n), inv(m * m), work(m * m);
+		double					var = 0.0;
+
+		if (n <= degree)
+			return;
+		for (size_t k = 0; k < n; ++k) {
+			if (!(times[k] > 0.0))
+				return;
+			x[k] = log(times[k]);
+			mMu += x[k];
+		}
+		mMu /= (double)n;
+		for (size_t k = 0; k < n; ++k)
+			var += (x[k] - mMu) * (x[k] - mMu);
+		mScale = var > 0.0 ? sqrt(var / (double)n) : 1.0;
+
+		std::vector<double>		v(n * m);
+
+		for (size_t k = 0; k < n; ++k) {
+			double		xk = (x[k] - mMu) / mScale, power = 1.0;
+
+			for (size_t j = 0; j < m; ++j, power *= xk)
+				v[k * m + j] = power;
+		}
+		for (size_t a = 0; a < m; ++a)
+			for (size_t b = 0; b < m; ++b)
+				for (size_t k = 0; k < n; ++k)
+					mGram[a * m + b] += v[k * m + a] * v[k * m + b];
+
+		if (!CholeskyInverse(mGram.data(), inv.data(), m, work.data()))
+			return;
+
+		for (size_t j = 0; j < m; ++j)
+			for (size_t k = 0; k < n; ++k)
+				for (size_t b = 0; b < m; ++b)
+					mPinv[j * n + k] += inv[j * m + b] * v[k * m + b];
+
+		mValid = true;
+	}
+
+	bool valid() const
+	{
+		return mValid;
+	}
+
+	size_t numCoeffs() const
+	{
+		return mNumCoeffs;
+	}
+
+	double mu() const
+	{
+		return mMu;
+	}
+
+	double scale() const
+	{
+		return mScale;
+	}
+
+	void SetBaseline(const double *baseline)
+	{
+		mBaseline.assign(baseline, baseline + mNumPixels);
+	}
+
+	//	the next numFrames frames (numPixels samples each) of the post pulse sequence, false past the time base
+	template <typename kind>
+	bool Push(const kind *frames, size_t numFrames)
+	{
+		if (!mValid || mNumFrames + numFrames > mNumTimes)
+			return false;
+
+		ParallelFor(mNumPixels, 4096, [&](size_t begin, size_t end) {
+			std::vector<double>		y(end - begin);
+
+			for (size_t f = 0; f < numFrames; ++f) {
+				const kind		*frame = frames + f * mNumPixels;
+				size_t			k = mNumFrames + f;
+
+				for (size_t p = begin; p < end; ++p) {
+					double		d = (double)frame[p] - (mBaseline.empty() ? 0.0 : mBaseline[p]);
+
+					y[p - begin] = log(d > mMinDelta ? d : mMinDelta);
+				}
+				for (size_t p = begin; p < end; ++p)
+					mSumY2[p] += y[p - begin] * y[p - begin];
+				for (size_t j = 0; j < mNumCoeffs; ++j) {
+					double		w = mPinv[j * mNumTimes + k];
+					double		*c = &mCoeffs[j * mNumPixels];
+
+					for (size_t p = begin; p < end; ++p)
+						c[p] += w * y[p - begin];
+				}
+			}
+		});
+
+		mNumFrames += numFrames;
+
+		return true;
+	}
+
+	//	the coefficient planes are only complete once every frame of the time base was pushed
+	bool complete() const
+	{
+		return mValid && mNumFrames == mNumTimes;
+	}
+
+	const double *coeffs(size_t j) const
+	{
+		return &mCoeffs[j * mNumPixels];
+	}
+
+	//	rms residual of the fit in ln dT
+	void Residual(double *rms) const
+	{
+		size_t		m = mNumCoeffs;
+
+		ParallelFor(mNumPixels, 4096, [&](size_t begin, size_t end) {
+			for (size_t p = begin; p < end; ++p) {
+				double		fit = 0.0;
+
+				for (size_t a = 0; a < m; ++a)
+					for (size_t b = 0; b < m; ++b)
+						fit += mCoeffs[a * mNumPixels + p] * mGram[a * m + b] * mCoeffs[b * mNumPixels + p];
+				rms[p] = sqrt(std::max(mSumY2[p] - fit, 0.0) / (double)mNumTimes);
+			}
+		});
+	}
+
+	//	reconstructed ln dT and its first and second derivatives in ln t at time t [s], any output may be NULL
+	void Evaluate(double t, double *logT, double *d1, double *d2) const
+	{
+		double					x = (log(t) - mMu) / mScale;
+		std::vector<double>		b0(mNumCoeffs, 0.0), b1(mNumCoeffs, 0.0), b2(mNumCoeffs, 0.0);
+
+		//	basis values of the three outputs, d/d(ln t) = (1 / s) d/dx
+		for (size_t j = 0; j < mNumCoeffs; ++j) {
+			b0[j] = pow(x, (double)j);
+			b1[j] = j >= 1 ? (double)j * pow(x, (double)j - 1.0) / mScale : 0.0;
+			b2[j] = j >= 2 ? (double)(j * (j - 1)) * pow(x, (double)j - 2.0) / (mScale * mScale) : 0.0;
+		}
+
+		ParallelFor(mNumPixels, 4096, [&](size_t begin, size_t end) {
+			for (size_t p = begin; p < end; ++p) {
+				double		v0 = 0.0, v1 = 0.0, v2 = 0.0;
+
+				for (size_t j = 0; j < mNumCoeffs; ++j) {
+					double		c = mCoeffs[j * mNumPixels + p];
+
+					v0 += b0[j] * c;
+					v1 += b1[j] * c;
+					v2 += b2[j] * c;
+				}
+				if (logT != NULL)
+					logT[p] = v0;
+				if (d1 != NULL)
+					d1[p] = v1;
+				if (d2 != NULL)
+					d2[p] = v2;
+			}
+		});
+	}
+};
@@ -0,0 +1,549 @@
+#pragma once
+
+#include "ThermoParallel.h"
+#include "SmallLinearAlgebra.h"
+#include <vector>
+#include <complex>
+#include <string>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+//	full field fit of the lock-in maps to the thermal wave of a gaussian modulated source
+//
+//	the surface phasor of a gaussian source (1/e^2 radius a) modulated at w on a half-space of diffusivity D is
+//	  theta(r) = int_0^inf exp(-l^2 a^2 / 8) J0(l r) l / sqrt(l^2 + i w / D) dl
+//	an orthotropic plate (principal diffusivities Dx, Dy, the first along theta) is the same wave in the stretched
+//	radius rho^2 = u^2 sqrt(Dy / Dx) + v^2 sqrt(Dx / Dy) with D = sqrt(Dx Dy), u, v the distances from the spot centre
+//	along the principal axes. the model of a pixel is S theta(rho), S a free complex scale (absorbs the emissivity and
+//	the phase of the reference), fitted to A exp(+-iP) on the pixels of an annulus around the spot by levenberg-marquardt
+//	on the real and imaginary parts, which weights every pixel by its signal like the lock-in noise does.
+//	at each evaluation theta and its derivatives in rho, ln a and ln D are integrated on a radial table (trapezoids on a
+//	l grid fine enough for the largest radius, bessel functions by the abramowitz-stegun polynomials), the pixels then
+//	interpolate the table and get the analytic jacobian by the chain rule. both passes run in parallel, the normal
+//	equations are summed per chunk of pixels and reduced in a fixed order so the result does not depend on the threads.
+//	parameter uncertainties come from the covariance s^2 inv(J'J), s^2 the residual variance.
+//	maps are matlab column major rows x cols, x along the columns, centres in 0 based pixels.
+
+struct SThermalWaveParams
+{
+	double		freq;				//	modulation frequency [Hz]
+	double		mmpx;				//	mm per pixel
+	double		xc;					//	initial spot centre, 0 based pixels
+	double		yc;
+	double		diffusivity;		//	initial guess [mm^2/s]
+	double		spotRadius;			//	initial 1/e^2 radius [mm]
+	double		rStart;				//	pixels rStart to rEnd away from the initial centre are fitted [mm]
+	double		rEnd;
+	double		tol;				//	pixels with A < tol are left out
+	bool		anisotropic;		//	Dx and Dy, otherwise a single D
+	bool		rotate;				//	free principal axes (anisotropic only), otherwise along x and y
+	bool		fitSpot;			//	otherwise the spot radius stays at its initial value
+	bool		fitCentre;
+	int			phaseSign;			//	+1 when A exp(iP) is the phasor of exp(i w t), -1 for the conjugate, 0 from the data
+	size_t		maxIterations;
+};
+
+struct SThermalWaveFit
+{
+	double		dx;					//	principal diffusivities [mm^2/s], equal unless anisotropic
+	double		dy;
+	double		theta;				//	direction of dx from +x [rad]
+	double		spotRadius;			//	[mm]
+	double		xc;					//	0 based pixels
+	double		yc;
+	double		amplitude;			//	|S|
+	double		phase;				//	arg S [rad]
+	double		sigmaDx;			//	one standard deviation of the parameters, 0 for the fixed ones
+	double		sigmaDy;
+	double		sigmaTheta;
+	double		sigmaSpot;
+	double		sigmaXc;
+	double		sigmaYc;
+	double		rms;				//	of the complex residual
+	double		r2;
+	size_t		numPixels;
+	size_t		iterations;
+	int			phaseSign;
+	bool		converged;
+};
+
+//	abramowitz-stegun 9.4.1 - 9.4.6, absolute error below 1e-7
+inline void BesselJ01(double x, double &j0, double &j1)
+{
+	if (x < 3.0) {
+		double		t = x * x / 9.0;
+
+		j0 = 1.0 + t * (-2.2499997 + t * (1.2656208 + t * (-0.3163866 + t * (0.0444479 + t * (-0.0039444 + t * 0.0002100)))));
+		j1 = x * (0.5 + t * (-0.56249985 + t * (0.21093573 + t * (-0.03954289 + t * (0.00443319 + t * (-0.00031761 + t * 0.00001109))))));
+		return;
+	}
+
+	double		u = 3.0 / x, s = 1.0 / sqrt(x);
+	double		f0 = 0.79788456 + u * (-0.00000077 + u * (-0.00552740 + u * (-0.00009512 + u * (0.00137237 + u * (-0.00072805 + u * 0.00014476)))));
+	double		t0 = x - 0.78539816 + u * (-0.04166397 + u * (-0.00003954 + u * (0.00262573 + u * (-0.00054125 + u * (-0.00029333 + u * 0.00013558)))));
+	double		f1 = 0.79788456 + u * (0.00000156 + u * (0.01659667 + u * (0.00017105 + u * (-0.00249511 + u * (0.00113653 + u * -0.00020033)))));
+	double		t1 = x - 2.35619449 + u * (0.12499612 + u * (0.00005650 + u * (-0.00637879 + u * (0.00074348 + u * (0.00079824 + u * -0.00029166)))));
+
+	j0 = f0 * cos(t0) * s;
+	j1 = f1 * cos(t1) * s;
+}
+
+class CThermalWaveFit
+{
+private:
+	typedef std::complex<double>	complex;
+
+	enum EParam
+	{
+		pmLogDx = 0,
+		pmLogDy,
+		pmTheta,
+		pmLogSpot,
+		pmXc,
+		pmYc,
+		pmScaleRe,
+		pmScaleIm,
+		pmCount
+	};
+
+	struct SPixel
+	{
+		size_t		index;
+		double		x;				//	[px]
+		double		y;
+		complex		z;
+	};
+
+	//	normal equations of a chunk of pixels
+	struct SNormal
+	{
+		double		jtj[pmCount * pmCount];
+		double		jtr[pmCount];
+		double		cost;
+	};
+
+	SThermalWaveParams		mParams;
+	std::vector<SPixel>		mPixels;
+	std::vector<int>		mFree;				//	free parameters, pmLogDx stands for both diffusivities when isotropic
+	double					mRhoMax;
+	double					mSpotMin;
+	double					mMaxLogRatio;
+	double					mDr;
+	double					mDl;
+	std::vector<complex>	mTheta;				//	radial tables of theta, d/drho, d/dln a, d/dln D
+	std::vector<complex>	mThetaRho;
+	std::vector<complex>	mThetaSpot;
+	std::vector<complex>	mThetaD;
+	SThermalWaveFit			mFit;
+	std::string				mError;
+
+	void Tabulate(double spotRadius, double diffusivity)
+	{
+		size_t		numRadii = mTheta.size();
+		double		lCut = sqrt(8.0 * 20.0) / spotRadius;
+		size_t		numL = std::max<size_t>((size_t)ceil(lCut / mDl), 2);
+		complex		k2(0.0, 2.0 * M_PI * mParams.freq / diffusivity);
+
+		std::vector<complex>	g(numL), gSpot(numL), gD(numL), gRho(numL);
+		std::vector<double>		l(numL);
+
+		//	trapezoids, the integrand vanishes at 0 and is below exp(-20) at lCut
+		for (size_t j = 1; j < numL; ++j) {
+			double		lj = (double)j * mDl, e = exp(-lj * lj * spotRadius * spotRadius / 8.0);
+			complex		q = lj * lj + k2;
+
+			l[j] = lj;
+			g[j] = e * lj / std::sqrt(q) * mDl;
+			gSpot[j] = g[j] * (-lj * lj * spotRadius * spotRadius / 4.0);
+			gD[j] = g[j] * (0.5 * k2 / q);
+			gRho[j] = -g[j] * lj;
+		}
+
+		ParallelFor(numRadii, 16, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				double		r = (double)i * mDr;
+				complex		t(0.0), tRho(0.0), tSpot(0.0), tD(0.0);
+
+				for (size_t j = 1; j < numL; ++j) {
+					double		j0, j1;
+
+					BesselJ01(l[j] * r, j0, j1);
+					t += g[j] * j0;
+					tSpot += gSpot[j] * j0;
+					tD += gD[j] * j0;
+					tRho += gRho[j] * j1;
+				}
+				mTheta[i] = t;
+				mThetaRho[i] = tRho;
+				mThetaSpot[i] = tSpot;
+				mThetaD[i] = tD;
+			}
+		});
+	}
+
+	//	theta and its derivatives at rho: cubic hermite for the value, linear for the derivatives
+	void Interpolate(double rho, complex &t, complex &tRho, complex &tSpot, complex &tD) const
+	{
+		double		s = rho / mDr;
+		size_t		i = std::min((size_t)s, mTheta.size() - 2);
+		double		w = s - (double)i, w2 = w * w, w3 = w2 * w;
+
+		t = (2.0 * w3 - 3.0 * w2 + 1.0) * mTheta[i] + (w3 - 2.0 * w2 + w) * mDr * mThetaRho[i] +
+			(-2.0 * w3 + 3.0 * w2) * mTheta[i + 1] + (w3 - w2) * mDr * mThetaRho[i + 1];
+		tRho = (1.0 - w) * mThetaRho[i] + w * mThetaRho[i + 1];
+		tSpot = (1.0 - w) * mThetaSpot[i] + w * mThetaSpot[i + 1];
+		tD = (1.0 - w) * mThetaD[i] + w * mThetaD[i + 1];
+	}
+
+	//	model of a pixel and its jacobian (pmCount columns, NULL for the value only)
+	complex PixelModel(const SPixel &pixel, const double *p, complex *jac) const
+	{
+		double		c = cos(p[pmTheta]), s = sin(p[pmTheta]);
+		double		u = (pixel.x - p[pmXc]) * mParams.mmpx, v = (pixel.y - p[pmYc]) * mParams.mmpx;
+		double		up = u * c + v * s, vp = -u * s + v * c;
+		double		e1 = exp(0.5 * (p[pmLogDy] - p[pmLogDx])), e2 = 1.0 / e1;
+		double		rho = std::max(sqrt(up * up * e1 + vp * vp * e2), 1e-12);
+		complex		scale(p[pmScaleRe], p[pmScaleIm]), t, tRho, tSpot, tD;
+
+		Interpolate(rho, t, tRho, tSpot, tD);
+		if (jac == NULL)
+			return scale * t;
+
+		double		dRhoDx = (-up * up * e1 + vp * vp * e2) / (4.0 * rho);
+		complex		st = scale * tRho;
+
+		jac[pmLogDx] = st * dRhoDx + scale * 0.5 * tD;
+		jac[pmLogDy] = -st * dRhoDx + scale * 0.5 * tD;
+		jac[pmTheta] = st * (up * vp * (e1 - e2) / rho);
+		jac[pmLogSpot] = scale * tSpot;
+		jac[pmXc] = st * ((-up * e1 * c + vp * e2 * s) * mParams.mmpx / rho);
+		jac[pmYc] = st * ((-up * e1 * s - vp * e2 * c) * mParams.mmpx / rho);
+		jac[pmScaleRe] = t;
+		jac[pmScaleIm] = complex(0.0, 1.0) * t;
+
+		return scale * t;
+	}
+
+	//	tables at p, then cost and (optionally) the normal equations of the free parameters
+	double Evaluate(const double *p, double *jtj, double *jtr)
+	{
+		size_t		numFree = mFree.size(), numChunks = std::min<size_t>(64, mPixels.size());
+		bool		tied = !mParams.anisotropic;
+
+		Tabulate(exp(p[pmLogSpot]), exp(0.5 * (p[pmLogDx] + p[pmLogDy])));
+
+		std::vector<SNormal>	partial(numChunks);
+
+		ParallelFor(numChunks, 1, [&](size_t begin, size_t end) {
+			for (size_t k = begin; k < end; ++k) {
+				SNormal		&n = partial[k];
+				size_t		p0 = k * mPixels.size() / numChunks, p1 = (k + 1) * mPixels.size() / numChunks;
+
+				std::fill(n.jtj, n.jtj + pmCount * pmCount, 0.0);
+				std::fill(n.jtr, n.jtr + pmCount, 0.0);
+				n.cost = 0.0;
+				for (size_t i = p0; i < p1; ++i) {
+					complex		jac[pmCount], jf[pmCount];
+					complex		r = mPixels[i].z - PixelModel(mPixels[i], p, jtj != NULL ? jac : NULL);
+
+					n.cost += std::norm(r);
+					if (jtj == NULL)
+						continue;
+
+					for (size_t a = 0; a < numFree; ++a)
+						jf[a] = tied && mFree[a] == pmLogDx ? jac[pmLogDx] + jac[pmLogDy] : jac[mFree[a]];
+					for (size_t a = 0; a < numFree; ++a) {
+						for (size_t b = 0; b <= a; ++b)
+							n.jtj[a * numFree + b] += (std::conj(jf[a]) * jf[b]).real();
+						n.jtr[a] += (std::conj(jf[a]) * r).real();
+					}
+				}
+			}
+		});
+
+		double		cost = 0.0;
+
+		if (jtj != NULL) {
+			std::fill(jtj, jtj + numFree * numFree, 0.0);
+			std::fill(jtr, jtr + numFree, 0.0);
+		}
+		for (size_t k = 0; k < numChunks; ++k) {
+			cost += partial[k].cost;
+			if (jtj == NULL)
+				continue;
+			for (size_t a = 0; a < numFree; ++a) {
+				for (size_t b = 0; b <= a; ++b)
+					jtj[a * numFree + b] += partial[k].jtj[a * numFree + b];
+				jtr[a] += partial[k].jtr[a];
+			}
+		}
+		if (jtj != NULL)
+			for (size_t a = 0; a < numFree; ++a)
+				for (size_t b = 0; b < a; ++b)
+					jtj[b * numFree + a] = jtj[a * numFree + b];
+
+		return cost;
+	}
+
+	//	sign of the phase convention: the wave lags outwards, so arg(theta) decreases along the radius
+	int PhaseSign(const double *phase, const double *amp, size_t rows, size_t cols) const
+	{
+		size_t					numRings = (size_t)ceil(mParams.rEnd / mParams.mmpx) + 1;
+		std::vector<complex>	rings(numRings, 0.0);
+		double					total = 0.0;
+
+		for (size_t c = 0; c < cols; ++c) {
+			for (size_t r = 0; r < rows; ++r) {
+				size_t		i = r + c * rows;
+				size_t		k = (size_t)(hypot((double)c - mParams.xc, (double)r - mParams.yc) + 0.5);
+
+				if (k < numRings && std::isfinite(phase[i]) && std::isfinite(amp[i]) && amp[i] >= mParams.tol)
+					rings[k] += std::polar(amp[i], phase[i]);
+			}
+		}
+		for (size_t k = (size_t)(mParams.rStart / mParams.mmpx); k + 1 < numRings; ++k)
+			if (std::abs(rings[k]) > 0.0 && std::abs(rings[k + 1]) > 0.0)
+				total += std::arg(rings[k + 1] * std::conj(rings[k]));
+
+		return total > 0.0 ? -1 : 1;
+	}
+
+	//	keeps a trial inside the region the tables cover
+	void Clamp(double *p, const double *start) const
+	{
+		double		shift = 0.5 * mParams.rEnd / mParams.mmpx;
+		double		mid = 0.5 * (p[pmLogDx] + p[pmLogDy]), half = 0.5 * (p[pmLogDx] - p[pmLogDy]);
+
+		half = std::min(std::max(half, -0.5 * mMaxLogRatio), 0.5 * mMaxLogRatio);
+		p[pmLogDx] = mid + half;
+		p[pmLogDy] = mid - half;
+		p[pmLogSpot] = std::min(std::max(p[pmLogSpot], log(mSpotMin)), log(mParams.rEnd));
+		p[pmXc] = std::min(std::max(p[pmXc], start[pmXc] - shift), start[pmXc] + shift);
+		p[pmYc] = std::min(std::max(p[pmYc], start[pmYc] - shift), start[pmYc] + shift);
+	}
+
+public:
+	CThermalWaveFit()
+	{
+	}
+
+	//	fits the maps, false on invalid parameters or too few pixels (see error())
+	bool Run(const double *phase, const double *amp, size_t rows, size_t cols, const SThermalWaveParams &params)
+	{
+		mParams = params;
+		mPixels.clear();
+		mError.clear();
+		mFit = SThermalWaveFit();
+
+		if (!(params.freq > 0.0) || !(params.mmpx > 0.0) || !(params.diffusivity > 0.0) || !(params.spotRadius > 0.0)) {
+			mError = "freq, mmpx, diffusivity and spotRadius must be positive.";
+			return false;
+		}
+		if (!(params.rEnd > params.rStart) || params.rStart < 0.0) {
+			mError = "The fit range must satisfy 0 <= rStart < rEnd.";
+			return false;
+		}
+
+		mFit.phaseSign = params.phaseSign != 0 ? (params.phaseSign > 0 ? 1 : -1) : PhaseSign(phase, amp, rows, cols);
+		for (size_t c = 0; c < cols; ++c) {
+			for (size_t r = 0; r < rows; ++r) {
+				size_t		i = r + c * rows;
+				double		d = hypot((double)c - params.xc, (double)r - params.yc) * params.mmpx;
+
+				if (d < params.rStart || d > params.rEnd || !std::isfinite(phase[i]) || !std::isfinite(amp[i]) || amp[i] < params.tol)
+					continue;
+
+				SPixel		pixel = { i, (double)c, (double)r, std::polar(amp[i], mFit.phaseSign * phase[i]) };
+
+				mPixels.push_back(pixel);
+			}
+		}
+
+		mFree.clear();
+		mFree.push_back(pmLogDx);
+		if (params.anisotropic) {
+			mFree.push_back(pmLogDy);
+			if (params.rotate)
+				mFree.push_back(pmTheta);
+		}
+		if (params.fitSpot)
+			mFree.push_back(pmLogSpot);
+		if (params.fitCentre) {
+			mFree.push_back(pmXc);
+			mFree.push_back(pmYc);
+		}
+		mFree.push_back(pmScaleRe);
+		mFree.push_back(pmScaleIm);
+
+		if (2 * mPixels.size() <= mFree.size() + 1) {
+			mError = "Too few valid pixels in the fit range.";
+			return false;
+		}
+
+		//	tables up to the farthest pixel with the centre moved by rEnd / 2 and the largest stretch, the l grid
+		//	resolves the oscillations of J0 at that radius and reaches the smallest spot allowed
+		mMaxLogRatio = log(10.0);
+		mSpotMin = std::min(params.spotRadius, std::max(0.25 * params.spotRadius, params.mmpx));
+		mRhoMax = 1.5 * params.rEnd * exp(0.25 * mMaxLogRatio);
+		mDr = 0.5 * params.mmpx;
+		mDl = 2.0 * M_PI / (12.0 * mRhoMax);
+		mTheta.resize((size_t)ceil(mRhoMax / mDr) + 2);
+		mThetaRho.resize(mTheta.size());
+		mThetaSpot.resize(mTheta.size());
+		mThetaD.resize(mTheta.size());
+
+		double		start[pmCount] = { log(params.diffusivity), log(params.diffusivity), 0.0, log(params.spotRadius), params.xc, params.yc, 1.0, 0.0 };
+		double		p[pmCount];
+		size_t		numFree = mFree.size();
+
+		std::copy(start, start + pmCount, p);
+		Clamp(p, start);
+
+		//	scale from the linear least squares at the initial guess
+		{
+			complex		num(0.0), den(0.0);
+
+			Tabulate(exp(p[pmLogSpot]), params.diffusivity);
+			for (size_t i = 0; i < mPixels.size(); ++i) {
+				complex		t = PixelModel(mPixels[i], p, NULL);
+
+				num += std::conj(t) * mPixels[i].z;
+				den += std::norm(t);
+			}
+			if (std::abs(den) > 0.0) {
+				p[pmScaleRe] = (num / den).real();
+				p[pmScaleIm] = (num / den).imag();
+			}
+		}
+
+		std::vector<double>		jtj(numFree * numFree), jtr(numFree), m(numFree * numFree), step(numFree);
+		double					lambda = 1e-3, cost = Evaluate(p, jtj.data(), jtr.data());
+		bool					converged = false;
+
+		for (size_t it = 0; it < params.maxIterations && !converged; ++it) {
+			bool		improved = false;
+
+			double		maxDiag = 0.0;
+
+			for (size_t a = 0; a < numFree; ++a)
+				maxDiag = std::max(maxDiag, jtj[a * numFree + a]);
+
+			while (lambda < 1e10) {
+				double		trial[pmCount];
+
+				//	marquardt scaling, floored: the axes direction has no gradient while Dx = Dy
+				for (size_t a = 0; a < numFree; ++a) {
+					for (size_t b = 0; b < numFree; ++b)
+						m[a * numFree + b] = jtj[a * numFree + b];
+					m[a * numFree + a] += lambda * std::max(jtj[a * numFree + a], 1e-9 * maxDiag);
+					step[a] = jtr[a];
+				}
+
+				if (CholeskyFactor(m.data(), numFree)) {
+					CholeskySolve(m.data(), step.data(), numFree);
+					std::copy(p, p + pmCount, trial);
+					for (size_t a = 0; a < numFree; ++a) {
+						trial[mFree[a]] += step[a];
+						if (!params.anisotropic && mFree[a] == pmLogDx)
+							trial[pmLogDy] += step[a];
+					}
+					Clamp(trial, start);
+
+					double		trialCost = Evaluate(trial, NULL, NULL);
+
+					if (trialCost < cost) {
+						converged = cost - trialCost <= 1e-10 * cost;
+						std::copy(trial, trial + pmCount, p);
+						cost = trialCost;
+						lambda = std::max(lambda * 0.1, 1e-12);
+						improved = true;
+						mFit.iterations = it + 1;
+						break;
+					}
+				}
+				lambda *= 10.0;
+			}
+
+			if (!improved) {
+				converged = true;
+				break;
+			}
+			if (!converged)
+				cost = Evaluate(p, jtj.data(), jtr.data());
+		}
+
+		//	normal equations (and the tables Model() uses) at the solution, the last evaluation may be a rejected trial
+		cost = Evaluate(p, jtj.data(), jtr.data());
+
+		//	covariance of the free parameters
+		std::vector<double>		cov(numFree * numFree, 0.0), work(numFree * numFree);
+		double					sigma2 = cost / (double)(2 * mPixels.size() - numFree);
+		double					var[pmCount] = { 0.0 };
+		complex					mean(0.0);
+		double					total = 0.0;
+
+		//	NaN when the parameters are not all determined (free axes of an isotropic plate)
+		bool					inverse = CholeskyInverse(jtj.data(), cov.data(), numFree, work.data());
+
+		for (size_t a = 0; a < numFree; ++a)
+			var[mFree[a]] = inverse ? sigma2 * cov[a * numFree + a] : NAN;
+		if (!params.anisotropic)
+			var[pmLogDy] = var[pmLogDx];
+
+		for (size_t i = 0; i < mPixels.size(); ++i)
+			mean += mPixels[i].z;
+		mean /= (double)mPixels.size();
+		for (size_t i = 0; i < mPixels.size(); ++i)
+			total += std::norm(mPixels[i].z - mean);
+
+		mFit.dx = exp(p[pmLogDx]);
+		mFit.dy = exp(p[pmLogDy]);
+		mFit.theta = p[pmTheta];
+		mFit.spotRadius = exp(p[pmLogSpot]);
+		mFit.xc = p[pmXc];
+		mFit.yc = p[pmYc];
+		mFit.amplitude = std::abs(complex(p[pmScaleRe], p[pmScaleIm]));
+		mFit.phase = std::arg(complex(p[pmScaleRe], p[pmScaleIm]));
+		mFit.sigmaDx = mFit.dx * sqrt(var[pmLogDx]);
+		mFit.sigmaDy = mFit.dy * sqrt(var[pmLogDy]);
+		mFit.sigmaTheta = sqrt(var[pmTheta]);
+		mFit.sigmaSpot = mFit.spotRadius * sqrt(var[pmLogSpot]);
+		mFit.sigmaXc = sqrt(var[pmXc]);
+		mFit.sigmaYc = sqrt(var[pmYc]);
+		mFit.rms = sqrt(cost / (double)mPixels.size());
+		mFit.r2 = total > 0.0 ? 1.0 - cost / total : 1.0;
+		mFit.numPixels = mPixels.size();
+		mFit.converged = converged;
+
+		return true;
+	}
+
+	const SThermalWaveFit &fit() const
+	{
+		return mFit;
+	}
+
+	//	fitted amplitude and phase (in the convention of the input) on the fitted pixels, the others are left alone
+	void Model(double *amp, double *phase) const
+	{
+		double		p[pmCount] = { log(mFit.dx), log(mFit.dy), mFit.theta, log(mFit.spotRadius), mFit.xc, mFit.yc,
+						mFit.amplitude * cos(mFit.phase), mFit.amplitude * sin(mFit.phase) };
+
+		for (size_t i = 0; i < mPixels.size(); ++i) {
+			complex		z = PixelModel(mPixels[i], p, NULL);
+
+			amp[mPixels[i].index] = std::abs(z);
+			phase[mPixels[i].index] = mFit.phaseSign * std::arg(z);
+		}
+	}
+
+	const std::string &error() const
+	{
+		return mError;
+	}
+};
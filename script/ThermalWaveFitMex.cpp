@@ -0,0 +1,101 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "mex.h"
+#include "MexHelpers.h"
+#include "ThermalWaveFit.h"
+#include "ThermoProfiler.h"
+
+//	mex ThermalWaveFitMex.cpp
+
+//	res = ThermalWaveFitMex(P, A, freq, xc, yc, mmpxratio, opts)
+//	fits the lock-in phase and amplitude maps to the thermal wave of a gaussian modulated spot (see ThermalWaveFit.h).
+//	xc, yc are the 1 based initial spot centre (column, row). opts is an optional struct with
+//		diffusivity		initial guess [mm^2/s] (1)
+//		spotRadius		initial 1/e^2 radius [mm] (4 pixels)
+//		rStart, rEnd	pixels in this distance range from the initial centre are fitted [mm] (0, closest image border)
+//		tol				pixels with A < tol are left out (0)
+//		anisotropic		separate Dx and Dy (true), rotate frees the principal axes (false)
+//		fitSpot, fitCentre	(true)
+//		phaseSign		+1 if A exp(iP) is the phasor of exp(iwt), -1 for the conjugate, 0 detects it (0)
+//		maxIterations	(50)
+//	res has Dx, Dy, D = sqrt(Dx Dy), theta, spotRadius, xc, yc (1 based), amplitude, phase (of the source term), the
+//	standard deviations sigmaDx, sigmaDy, sigmaTheta, sigmaSpot, sigmaXc, sigmaYc, rms, R2, numPixels, iterations,
+//	converged, phaseSign and the fitted maps Amodel, Pmodel (NaN outside the fitted pixels)
+
+//	the mex entry point
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	if (nrhs < 6 || nrhs > 7 || nlhs > 1)
+		mexErrMsgTxt("Must have 6-7 inputs and 0-1 outputs.");
+
+	CThermoStage		stage("thermalWaveFit", "ThermalWaveFitMex", (double)mxGetElementSize(prhs[0]) * mxGetNumberOfElements(prhs[0]));
+
+	const double		*phase = mxGetDoubleInput(prhs[0], "P");
+	const double		*amp = mxGetDoubleInput(prhs[1], "A");
+	size_t				rows = mxGetM(prhs[0]), cols = mxGetN(prhs[0]);
+	const mxArray		*opts = nrhs > 6 ? prhs[6] : NULL;
+	SThermalWaveParams	params;
+
+	if (mxGetNumberOfDimensions(prhs[0]) != 2 || mxGetM(prhs[1]) != rows || mxGetN(prhs[1]) != cols)
+		mexErrMsgTxt("P and A must be 2-D maps of the same size.");
+
+	params.freq = mxGetScalarInput(prhs[2], "freq");
+	params.xc = mxGetScalarInput(prhs[3], "xc") - 1.0;
+	params.yc = mxGetScalarInput(prhs[4], "yc") - 1.0;
+	params.mmpx = mxGetScalarInput(prhs[5], "mmpxratio");
+	params.diffusivity = mxGetOption(opts, "diffusivity", 1.0);
+	params.spotRadius = mxGetOption(opts, "spotRadius", 4.0 * params.mmpx);
+	params.rStart = mxGetOption(opts, "rStart", 0.0);
+	params.rEnd = mxGetOption(opts, "rEnd", params.mmpx * std::min(std::min(params.xc, (double)cols - 1.0 - params.xc),
+		std::min(params.yc, (double)rows - 1.0 - params.yc)));
+	params.tol = mxGetOption(opts, "tol", 0.0);
+	params.anisotropic = mxGetOption(opts, "anisotropic", 1.0) != 0.0;
+	params.rotate = mxGetOption(opts, "rotate", 0.0) != 0.0;
+	params.fitSpot = mxGetOption(opts, "fitSpot", 1.0) != 0.0;
+	params.fitCentre = mxGetOption(opts, "fitCentre", 1.0) != 0.0;
+	params.phaseSign = (int)mxGetOption(opts, "phaseSign", 0.0);
+	params.maxIterations = (size_t)mxGetOption(opts, "maxIterations", 50.0);
+
+	CThermalWaveFit		engine;
+
+	if (!engine.Run(phase, amp, rows, cols, params))
+		mexErrMsgTxt(engine.error().c_str());
+
+	const SThermalWaveFit	&fit = engine.fit();
+	const char				*fields[] = { "Dx", "Dy", "D", "theta", "spotRadius", "xc", "yc", "amplitude", "phase", "sigmaDx", "sigmaDy",
+								"sigmaTheta", "sigmaSpot", "sigmaXc", "sigmaYc", "rms", "R2", "numPixels", "iterations", "converged",
+								"phaseSign", "Amodel", "Pmodel" };
+	mxArray					*res = mxCreateStructMatrix(1, 1, sizeof(fields) / sizeof(fields[0]), fields);
+	mxArray					*ampModel = mxCreateDoubleMatrix(rows, cols, mxREAL);
+	mxArray					*phaseModel = mxCreateDoubleMatrix(rows, cols, mxREAL);
+
+	std::fill(mxGetPr(ampModel), mxGetPr(ampModel) + rows * cols, NAN);
+	std::fill(mxGetPr(phaseModel), mxGetPr(phaseModel) + rows * cols, NAN);
+	engine.Model(mxGetPr(ampModel), mxGetPr(phaseModel));
+
+	mxSetFieldByNumber(res, 0, 0, mxCreateDoubleScalar(fit.dx));
+	mxSetFieldByNumber(res, 0, 1, mxCreateDoubleScalar(fit.dy));
+	mxSetFieldByNumber(res, 0, 2, mxCreateDoubleScalar(sqrt(fit.dx * fit.dy)));
+	mxSetFieldByNumber(res, 0, 3, mxCreateDoubleScalar(fit.theta));
+	mxSetFieldByNumber(res, 0, 4, mxCreateDoubleScalar(fit.spotRadius));
+	mxSetFieldByNumber(res, 0, 5, mxCreateDoubleScalar(fit.xc + 1.0));
+	mxSetFieldByNumber(res, 0, 6, mxCreateDoubleScalar(fit.yc + 1.0));
+	mxSetFieldByNumber(res, 0, 7, mxCreateDoubleScalar(fit.amplitude));
+	mxSetFieldByNumber(res, 0, 8, mxCreateDoubleScalar(fit.phase));
+	mxSetFieldByNumber(res, 0, 9, mxCreateDoubleScalar(fit.sigmaDx));
+	mxSetFieldByNumber(res, 0, 10, mxCreateDoubleScalar(fit.sigmaDy));
+	mxSetFieldByNumber(res, 0, 11, mxCreateDoubleScalar(fit.sigmaTheta));
+	mxSetFieldByNumber(res, 0, 12, mxCreateDoubleScalar(fit.sigmaSpot));
+	mxSetFieldByNumber(res, 0, 13, mxCreateDoubleScalar(fit.sigmaXc));
+	mxSetFieldByNumber(res, 0, 14, mxCreateDoubleScalar(fit.sigmaYc));
+	mxSetFieldByNumber(res, 0, 15, mxCreateDoubleScalar(fit.rms));
+	mxSetFieldByNumber(res, 0, 16, mxCreateDoubleScalar(fit.r2));
+	mxSetFieldByNumber(res, 0, 17, mxCreateDoubleScalar((double)fit.numPixels));
+	mxSetFieldByNumber(res, 0, 18, mxCreateDoubleScalar((double)fit.iterations));
+	mxSetFieldByNumber(res, 0, 19, mxCreateLogicalScalar(fit.converged));
+	mxSetFieldByNumber(res, 0, 20, mxCreateDoubleScalar((double)fit.phaseSign));
+	mxSetFieldByNumber(res, 0, 21, ampModel);
+	mxSetFieldByNumber(res, 0, 22, phaseModel);
+
+	plhs[0] = res;
+}
@@ -0,0 +1,156 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "ThermoBatch.h"
+#include "ImagerFileSource.h"
+#include "CatalogScanner.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+//	cl /O2 /EHsc /std:c++17 /I%FILESDKDIR%include ThermoBatch.cpp /link /LIBPATH:%FILESDKDIR%bin\x64\Release tc.lib tc.file.lib tc.reduce.lib sqlite3.lib psapi.lib
+//	(sqlite3.h of the sqlite amalgamation in the include path, sqlite3.lib made from sqlite3.dll with lib /def:sqlite3.def)
+
+//	ThermoBatch job.txt [options]
+//
+//	the RSW campaign of the job description (ThermoBatch.h) on its ATS recordings, several at once, with the scalar
+//	results of all of them in one csv or .tcol file. a status line per recording goes to stdout, the exit code is the
+//	number of recordings that failed (255 for 255 or more, the code only holds a byte). options:
+//		--restart			ignore the progress file and start from scratch
+//		--jobs n			recordings at once (the job description)
+//		--threads n			of the pool (THERMO_NUM_THREADS)
+//	with THERMO_PROFILE set every recording adds its excitation, lockin and fit stages to the profile.
+//	with a catalog in the job description every recording done is indexed there with its run ("rsw", the recipe as
+//	parameters and the values of the row as results), and a recording with an ok run of the same recipe is not done again.
+
+static CFrameSource *OpenRecording(const std::string &file, const SBatchRecipe &recipe, int64_t first, int64_t last,
+	std::string &error)
+{
+	tc::EUnit			unit = ImagerUnit(recipe.unit);
+	tc::ETempType		tempType = ImagerTempType(recipe.temperatureType);
+	CImagerFileSource	*source;
+
+	if (unit == tc::unitError) {
+		error = "Unknown unit " + recipe.unit + ".";
+		return NULL;
+	}
+	if (tempType == tc::ttError) {
+		error = "Unknown temperatureType " + recipe.temperatureType + ".";
+		return NULL;
+	}
+
+	source = new CImagerFileSource(file.c_str(), unit, tempType, (tc::UInt32)first, last < 0 ? 0xFFFFFFFF : (tc::UInt32)last, 0.0);
+	if (!source->isOpen()) {
+		error = source->error();
+		delete source;
+		return NULL;
+	}
+
+	return source;
+}
+
+//	the row of the latest ok run of the recipe on the recording
+static bool LookupRun(CThermoCatalog &catalog, const std::string &file, const SBatchRecipe &recipe, SBatchRow &row)
+{
+	std::map<std::string, double>	results;
+	int64_t							runId;
+
+	if (!catalog.FindRun(file, "rsw", BatchRecipeParams(recipe), "ok", runId, results))
+		return false;
+	row.file = file;
+	row.status = "ok";
+	for (size_t v = 0; v < bvCount; ++v)
+		row.values[v] = results.count(BatchColumns()[v + 2]) != 0 ? results[BatchColumns()[v + 2]] : NAN;
+
+	return true;
+}
+
+//	the recording, indexed when it is not yet, and its run
+static bool AddRun(CThermoCatalog &catalog, const SBatchJob &job, const SBatchRow &row, std::string &error)
+{
+	std::map<std::string, double>	results;
+	SCatalogRecording				recording;
+	int64_t							bytes, mtime, id;
+	bool							index = !(CatalogFileStamp(row.file, bytes, mtime) && catalog.IsIndexed(row.file, bytes, mtime, id));
+
+	for (size_t v = 0; v < bvCount; ++v)
+		results[BatchColumns()[v + 2]] = row.values[v];
+	//	a recording that cannot be read still gets its run, on a row with just its path
+	if (index && !ReadRecordingHeader(row.file, recording, error))
+		index = false;
+	if (!catalog.Begin() || (index && !catalog.IndexRecording(recording, id)) ||
+		!catalog.AddRun(row.file, "rsw", BatchRecipeParams(job.RecipeFor(row.file)), row.status, row.values[bvTotalSeconds],
+			results, id) || !catalog.Commit()) {
+		error = catalog.error();
+		catalog.Rollback();
+		return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	SBatchJob		job;
+	std::string		error;
+	bool			restart = false;
+	size_t			jobs = 0, numFailed = 0;
+
+	if (argc < 2 || !job.Load(argv[1], error)) {
+		if (argc < 2)
+			fprintf(stderr, "usage: %s job.txt [--restart] [--jobs n] [--threads n]\n", argv[0]);
+		else
+			fprintf(stderr, "%s\n", error.c_str());
+		return -1;
+	}
+	for (int i = 2; i < argc; ++i) {
+		std::string		arg = argv[i];
+		bool			value = i + 1 < argc;
+
+		if (arg == "--restart")
+			restart = true;
+		else if (arg == "--jobs" && value)
+			jobs = (size_t)atol(argv[++i]);
+		else if (arg == "--threads" && value)
+			ThermoSetNumThreads((unsigned)atoi(argv[++i]));
+		else {
+			fprintf(stderr, "usage: %s job.txt [--restart] [--jobs n] [--threads n]\n", argv[0]);
+			return -1;
+		}
+	}
+	if (jobs > 0)
+		job.jobs = jobs;
+
+	CBatchRunner	runner(job, OpenRecording);
+	CThermoCatalog	catalog;
+
+	if (!job.catalog.empty()) {
+		if (!catalog.Open(job.catalog)) {
+			fprintf(stderr, "%s\n", catalog.error().c_str());
+			return -1;
+		}
+		if (!restart)
+			runner.lookup = [&](const std::string &file, const SBatchRecipe &recipe, SBatchRow &row) {
+				return LookupRun(catalog, file, recipe, row);
+			};
+	}
+	runner.onRow = [&](const SBatchRow &row, size_t done, size_t total) {
+		std::string		error;
+
+		if (catalog.isOpen() && !AddRun(catalog, job, row, error))
+			fprintf(stderr, "%s: %s\n", FileNamePart(row.file).c_str(), error.c_str());
+		if (row.status == "ok")
+			printf("[%zu/%zu] %s: Dx %.3f Dy %.3f Davg %.3f mm^2/s, r2 %.3f, frames %.0f-%.0f, %.1f s\n", done, total,
+				FileNamePart(row.file).c_str(), row.values[bvDx], row.values[bvDy], row.values[bvDavg], row.values[bvR2],
+				row.values[bvOnset], row.values[bvLast], row.values[bvTotalSeconds]);
+		else
+			printf("[%zu/%zu] %s: %s\n", done, total, FileNamePart(row.file).c_str(), row.status.c_str());
+		fflush(stdout);
+	};
+	if (!runner.Run(restart, numFailed)) {
+		fprintf(stderr, "%s\n", runner.error().c_str());
+		return -1;
+	}
+	printf("results in %s, %zu failed\n", job.output.c_str(), numFailed);
+
+	return (int)std::min<size_t>(numFailed, 255);
+}
@@ -0,0 +1,772 @@
+#pragma once
+
+#include "ThermoPipeline.h"
+#include "ExcitationDetector.h"
+#include "LockInAccumulator.h"
+#include "RadialDiffusivity.h"
+#include "ThermoProfiler.h"
+#include <functional>
+#include <map>
+#include <deque>
+#include <condition_variable>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <glob.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+//	batch of RSW lock-in tests (ThermoBatch.cpp)
+//
+//	the native version of the RSW_automated loop, one recording after the other:
+//	- excitation window from a first pass over the file (CExcitationDetector, as FlirMovieReader.findExcitation(window))
+//	- lock-in at freq over that window only, from the frame times (CLockInAccumulator, as LockInSweep)
+//	- spot centre from the pixels with A >= tol, as LockinAmplifierResults
+//	- diffusivity from the rays out of the centre (CRadialDiffusivity, as evaluateDiffusivityRadial with the rays from
+//	  spot to spot + 2 thermal diffusion lengths of the expected diffusivity)
+//	recordings run concurrently on 'jobs' threads, each one once its memory estimate fits in the budget, the kernels share
+//	the pool. every finished recording is appended to the progress file right away: a batch started again skips the
+//	recordings already done there, unless restarted. at the end all the rows go to the output in the order of the
+//	recordings, csv or columnar binary (.tcol, read by readBatchResults.m):
+//		"TCOL", version (uint32 1), rows (uint64), columns (uint32), then every column: name length (uint32), name,
+//		type (uint8, 0 double, 1 string) and its data, rows doubles or rows strings as length (uint32) and bytes.
+//	all little endian. frames, xc and yc are 1 based like in matlab.
+//
+//	the job description has key = value lines (# starts a comment):
+//		input = D:\prove\Razza_0210\*.ats		(more input lines add more files)
+//		output = D:\prove\Razza_0210\saves\results.tcol
+//		progress = ...						(output.progress)
+//		jobs = 4							(recordings at once, half the pool)
+//		memory = 4096						(MB for the recordings at once)
+//		catalog = D:\prove\campagna.db		(ThermoCatalog.h, optional)
+//	and the recipe: window (100), freq (2 Hz), mmpxratio (0.125), tol (0.1), fitTol (along the rays, tol), spot (the
+//	laser spot diameter, 1 mm), diffusivity (expected, 10 mm^2/s), rays (180), unit (temperatureFactory),
+//	temperatureType (celsius). a [pattern] line starts the recipe of the recordings whose name matches the pattern
+//	(* and ?), over the one before it.
+//	with a catalog the recordings that already have an ok run with the same recipe there are not processed again (lookup),
+//	and every recording done is indexed with its run (ThermoBatch.cpp).
+
+struct SBatchRecipe
+{
+	double		window;				//	frames of the excitation baseline
+	double		freq;				//	[Hz]
+	double		mmpx;				//	mm per pixel
+	double		tol;				//	amplitude threshold of the valid pixels, for the centre
+	double		fitTol;				//	same along the rays, tol when negative
+	double		spot;				//	laser spot diameter [mm], start of the rays
+	double		diffusivity;		//	expected [mm^2/s], sets the end of the rays
+	size_t		rays;
+	std::string	unit;
+	std::string	temperatureType;
+};
+
+//	the scalar results of one recording, the columns of BatchColumns() after file and status
+enum EBatchValue
+{
+	bvOnset,
+	bvLast,
+	bvFrames,
+	bvXc,
+	bvYc,
+	bvDx,
+	bvDy,
+	bvDavg,
+	bvR2,
+	bvDMax,
+	bvDMin,
+	bvTheta,
+	bvExcitationSeconds,
+	bvLockInSeconds,
+	bvFitSeconds,
+	bvTotalSeconds,
+	bvCount
+};
+
+inline const std::vector<std::string> &BatchColumns()
+{
+	static const std::vector<std::string>	columns = { "file", "status", "onset", "last", "frames", "xc", "yc", "Dx", "Dy", "Davg",
+		"r2", "dMax", "dMin", "theta", "excitationSeconds", "lockinSeconds", "fitSeconds", "totalSeconds" };
+
+	return columns;
+}
+
+struct SBatchRow
+{
+	std::string		file;
+	std::string		status;			//	"ok" or the error
+	double			values[bvCount];
+
+	SBatchRow()
+	{
+		std::fill(values, values + bvCount, NAN);
+	}
+};
+
+//	* and ? over the whole name
+inline bool WildcardMatch(const char *pattern, const char *name)
+{
+	if (*pattern == 0)
+		return *name == 0;
+	if (*pattern == '*')
+		return WildcardMatch(pattern + 1, name) || (*name != 0 && WildcardMatch(pattern, name + 1));
+	if (*name != 0 && (*pattern == '?' || *pattern == *name))
+		return WildcardMatch(pattern + 1, name + 1);
+
+	return false;
+}
+
+inline std::string FileNamePart(const std::string &path)
+{
+	size_t		slash = path.find_last_of("/\\");
+
+	return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+//	files matching the pattern (wildcards in the name), sorted
+inline std::vector<std::string> ListFiles(const std::string &pattern)
+{
+	std::vector<std::string>	files;
+
+#ifdef _WIN32
+	size_t						slash = pattern.find_last_of("/\\");
+	std::string					dir = slash == std::string::npos ? "" : pattern.substr(0, slash + 1);
+	WIN32_FIND_DATAA			data;
+	HANDLE						find = FindFirstFileA(pattern.c_str(), &data);
+
+	if (find != INVALID_HANDLE_VALUE) {
+		do {
+			if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+				files.push_back(dir + data.cFileName);
+		} while (FindNextFileA(find, &data));
+		FindClose(find);
+	}
+#else
+	glob_t						found;
+
+	if (glob(pattern.c_str(), 0, NULL, &found) == 0) {
+		for (size_t i = 0; i < found.gl_pathc; ++i)
+			files.push_back(found.gl_pathv[i]);
+		globfree(&found);
+	}
+#endif
+	std::sort(files.begin(), files.end());
+
+	return files;
+}
+
+struct SBatchJob
+{
+	std::vector<std::string>	inputs;
+	std::string					output;
+	std::string					progress;
+	std::string					catalog;
+	size_t						jobs;
+	double						memoryMB;
+	SBatchRecipe				recipe;
+	//	patterns in order with their settings
+	std::vector<std::pair<std::string, std::map<std::string, std::string>>>	overrides;
+
+	SBatchJob() :
+		jobs(std::max(1u, ThermoNumThreads() / 2)),
+		memoryMB(4096.0)
+	{
+		recipe.window = 100.0;
+		recipe.freq = 2.0;
+		recipe.mmpx = 30.0 / 240.0;
+		recipe.tol = 0.1;
+		recipe.fitTol = -1.0;
+		recipe.spot = 1.0;
+		recipe.diffusivity = 10.0;
+		recipe.rays = 180;
+		recipe.unit = "temperatureFactory";
+		recipe.temperatureType = "celsius";
+	}
+
+	static bool SetRecipe(SBatchRecipe &recipe, const std::string &key, const std::string &value)
+	{
+		double		number = atof(value.c_str());
+
+		if (key == "window")
+			recipe.window = number;
+		else if (key == "freq")
+			recipe.freq = number;
+		else if (key == "mmpxratio")
+			recipe.mmpx = number;
+		else if (key == "tol")
+			recipe.tol = number;
+		else if (key == "fitTol")
+			recipe.fitTol = number;
+		else if (key == "spot")
+			recipe.spot = number;
+		else if (key == "diffusivity")
+			recipe.diffusivity = number;
+		else if (key == "rays")
+			recipe.rays = (size_t)number;
+		else if (key == "unit")
+			recipe.unit = value;
+		else if (key == "temperatureType")
+			recipe.temperatureType = value;
+		else
+			return false;
+
+		return true;
+	}
+
+	bool Load(const std::string &fileName, std::string &error)
+	{
+		std::ifstream	file(fileName.c_str());
+		std::string		line;
+		size_t			lineNumber = 0;
+
+		if (!file) {
+			error = "Cannot open " + fileName + ".";
+			return false;
+		}
+		while (std::getline(file, line)) {
+			size_t			hash = line.find('#'), eq;
+			std::string		key, value;
+
+			++lineNumber;
+			if (hash != std::string::npos)
+				line.erase(hash);
+			line.erase(0, line.find_first_not_of(" \t\r"));
+			line.erase(line.find_last_not_of(" \t\r") + 1);
+			if (line.empty())
+				continue;
+			if (line[0] == '[' && line[line.size() - 1] == ']') {
+				overrides.emplace_back(line.substr(1, line.size() - 2), std::map<std::string, std::string>());
+				continue;
+			}
+			eq = line.find('=');
+			if (eq == std::string::npos) {
+				error = fileName + ":" + std::to_string(lineNumber) + ": expected key = value.";
+				return false;
+			}
+			key = line.substr(0, eq);
+			key.erase(key.find_last_not_of(" \t") + 1);
+			value = line.substr(eq + 1);
+			value.erase(0, value.find_first_not_of(" \t"));
+
+			SBatchRecipe	check = recipe;
+
+			if (!SetRecipe(check, key, value) && (!overrides.empty() ||
+				(key != "input" && key != "output" && key != "progress" && key != "catalog" && key != "jobs" && key != "memory"))) {
+				error = fileName + ":" + std::to_string(lineNumber) + ": unknown key " + key + ".";
+				return false;
+			}
+			if (!overrides.empty())
+				overrides.back().second[key] = value;
+			else if (key == "input")
+				inputs.push_back(value);
+			else if (key == "output")
+				output = value;
+			else if (key == "progress")
+				progress = value;
+			else if (key == "catalog")
+				catalog = value;
+			else if (key == "jobs")
+				jobs = std::max<size_t>(1, (size_t)atol(value.c_str()));
+			else if (key == "memory")
+				memoryMB = atof(value.c_str());
+			else
+				SetRecipe(recipe, key, value);
+		}
+		if (inputs.empty() || output.empty()) {
+			error = fileName + ": needs input and output.";
+			return false;
+		}
+		if (progress.empty())
+			progress = output + ".progress";
+
+		return true;
+	}
+
+	SBatchRecipe RecipeFor(const std::string &file) const
+	{
+		SBatchRecipe	ret = recipe;
+		std::string		name = FileNamePart(file);
+
+		for (size_t i = 0; i < overrides.size(); ++i) {
+			if (!WildcardMatch(overrides[i].first.c_str(), name.c_str()))
+				continue;
+			for (std::map<std::string, std::string>::const_iterator it = overrides[i].second.begin(); it != overrides[i].second.end(); ++it)
+				SetRecipe(ret, it->first, it->second);
+		}
+
+		return ret;
+	}
+};
+
+//	the recipe as the parameters of a catalog run, with the keys of the job description
+inline std::map<std::string, std::string> BatchRecipeParams(const SBatchRecipe &recipe)
+{
+	std::map<std::string, std::string>	params;
+	char								text[32];
+	const std::pair<const char *, double>	numbers[] = { { "window", recipe.window }, { "freq", recipe.freq },
+		{ "mmpxratio", recipe.mmpx }, { "tol", recipe.tol }, { "fitTol", recipe.fitTol < 0.0 ? recipe.tol : recipe.fitTol },
+		{ "spot", recipe.spot }, { "diffusivity", recipe.diffusivity }, { "rays", (double)recipe.rays } };
+
+	for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); ++i) {
+		snprintf(text, sizeof(text), "%.15g", numbers[i].second);
+		params[numbers[i].first] = text;
+	}
+	params["unit"] = recipe.unit;
+	params["temperatureType"] = recipe.temperatureType;
+
+	return params;
+}
+
+//	frames first..last (0 based, inclusive, last < 0 to the end) of a recording, NULL with error set on failure
+typedef std::function<CFrameSource *(const std::string &file, const SBatchRecipe &recipe, int64_t first, int64_t last,
+	std::string &error)>	FBatchSourceFactory;
+
+//	csv with the fields quoted when needed
+inline std::string CsvField(const std::string &text)
+{
+	std::string		out = "\"";
+
+	if (text.find_first_of(",\"\r\n") == std::string::npos)
+		return text;
+	for (size_t i = 0; i < text.size(); ++i) {
+		if (text[i] == '"')
+			out += '"';
+		out += text[i] == '\r' || text[i] == '\n' ? ' ' : text[i];
+	}
+
+	return out + "\"";
+}
+
+inline std::string CsvRow(const SBatchRow &row)
+{
+	std::string		line = CsvField(row.file) + "," + CsvField(row.status);
+	char			text[32];
+
+	for (size_t v = 0; v < bvCount; ++v) {
+		snprintf(text, sizeof(text), ",%.17g", row.values[v]);
+		line += text;
+	}
+
+	return line;
+}
+
+inline bool ParseCsvRow(const std::string &line, SBatchRow &row)
+{
+	std::vector<std::string>	fields(1);
+	bool						quoted = false;
+
+	for (size_t i = 0; i < line.size(); ++i) {
+		char		c = line[i];
+
+		if (quoted) {
+			if (c == '"' && i + 1 < line.size() && line[i + 1] == '"')
+				fields.back() += line[++i];
+			else if (c == '"')
+				quoted = false;
+			else
+				fields.back() += c;
+		}
+		else if (c == '"')
+			quoted = true;
+		else if (c == ',')
+			fields.emplace_back();
+		else if (c != '\r')
+			fields.back() += c;
+	}
+	if (fields.size() != BatchColumns().size())
+		return false;
+	row.file = fields[0];
+	row.status = fields[1];
+	for (size_t v = 0; v < bvCount; ++v)
+		row.values[v] = strtod(fields[v + 2].c_str(), NULL);
+
+	return true;
+}
+
+inline bool WriteBatchCsv(const std::string &fileName, const std::vector<SBatchRow> &rows)
+{
+	FILE		*out = fopen(fileName.c_str(), "wb");
+	bool		ok;
+
+	if (out == NULL)
+		return false;
+	for (size_t c = 0; c < BatchColumns().size(); ++c)
+		fprintf(out, c == 0 ? "%s" : ",%s", BatchColumns()[c].c_str());
+	fprintf(out, "\n");
+	for (size_t r = 0; r < rows.size(); ++r)
+		fprintf(out, "%s\n", CsvRow(rows[r]).c_str());
+	ok = ferror(out) == 0;
+
+	return fclose(out) == 0 && ok;
+}
+
+inline bool WriteBatchColumns(const std::string &fileName, const std::vector<SBatchRow> &rows)
+{
+	FILE			*out = fopen(fileName.c_str(), "wb");
+	uint32_t		version = 1, numColumns = (uint32_t)BatchColumns().size();
+	uint64_t		numRows = rows.size();
+	std::vector<double>	column(rows.size());
+	bool			ok;
+
+	if (out == NULL)
+		return false;
+	fwrite("TCOL", 1, 4, out);
+	fwrite(&version, sizeof(version), 1, out);
+	fwrite(&numRows, sizeof(numRows), 1, out);
+	fwrite(&numColumns, sizeof(numColumns), 1, out);
+	for (uint32_t c = 0; c < numColumns; ++c) {
+		const std::string	&name = BatchColumns()[c];
+		uint32_t			length = (uint32_t)name.size();
+		uint8_t				type = c < 2 ? 1 : 0;
+
+		fwrite(&length, sizeof(length), 1, out);
+		fwrite(name.data(), 1, length, out);
+		fwrite(&type, sizeof(type), 1, out);
+		if (type == 0) {
+			for (size_t r = 0; r < rows.size(); ++r)
+				column[r] = rows[r].values[c - 2];
+			fwrite(column.data(), sizeof(double), column.size(), out);
+			continue;
+		}
+		for (size_t r = 0; r < rows.size(); ++r) {
+			const std::string	&text = c == 0 ? rows[r].file : rows[r].status;
+
+			length = (uint32_t)text.size();
+			fwrite(&length, sizeof(length), 1, out);
+			fwrite(text.data(), 1, length, out);
+		}
+	}
+	ok = ferror(out) == 0;
+
+	return fclose(out) == 0 && ok;
+}
+
+//	bytes a recording needs at once: the excitation baseline and planes, the lock-in sums, a block of frames and the
+//	maps of the fit
+inline size_t BatchMemoryEstimate(size_t rows, size_t cols, const SBatchRecipe &recipe)
+{
+	size_t		n = rows * cols;
+
+	return n * (sizeof(float) * ((size_t)std::max(recipe.window, 1.0) + 2 * 64) + 64 + 3 * sizeof(double) + 8 * sizeof(double));
+}
+
+class CBatchRunner
+{
+private:
+	const SBatchJob					&mJob;
+	FBatchSourceFactory				mFactory;
+	std::mutex						mMutex;
+	std::condition_variable			mFreed;
+	size_t							mBudget;
+	size_t							mUsed;
+	std::string						mError;
+
+	//	waits until bytes fit in the budget, alone it always fits
+	void Reserve(size_t bytes)
+	{
+		std::unique_lock<std::mutex>	lock(mMutex);
+
+		mFreed.wait(lock, [&]() { return mUsed == 0 || mUsed + bytes <= mBudget; });
+		mUsed += bytes;
+	}
+
+	void Release(size_t bytes)
+	{
+		{
+			std::lock_guard<std::mutex>		lock(mMutex);
+
+			mUsed -= bytes;
+		}
+		mFreed.notify_all();
+	}
+
+	//	every frame of the source through fn(block), false on a read error
+	static bool ForEachBlock(CFrameSource &source, const std::function<void(const SFrameBlock &)> &fn)
+	{
+		CBlockAllocator				alloc;
+
+		for (;;) {
+			SFrameBlockPtr		block = source.Read(alloc, 64);
+
+			if (block == NULL)
+				return source.error().empty();
+			fn(*block);
+		}
+	}
+
+	static double Seconds(const std::chrono::steady_clock::time_point &start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	bool Process(const std::string &file, SBatchRow &row)
+	{
+		std::chrono::steady_clock::time_point	start = std::chrono::steady_clock::now(), stage = start;
+		SBatchRecipe							recipe = mJob.RecipeFor(file);
+		std::string								error;
+		std::unique_ptr<CFrameSource>			source(mFactory(file, recipe, 0, -1, error));
+
+		row.file = file;
+		if (source == NULL) {
+			row.status = error.empty() ? "Cannot open the file." : error;
+			return false;
+		}
+		if (!(recipe.freq > 0.0) || !(recipe.mmpx > 0.0) || !(recipe.diffusivity > 0.0) || recipe.rays == 0) {
+			row.status = "freq, mmpxratio, diffusivity and rays must be positive.";
+			return false;
+		}
+
+		size_t					rows = source->rows(), cols = source->cols(), n = rows * cols;
+		size_t					bytes = BatchMemoryEstimate(rows, cols, recipe);
+		SExcitationWindow		window;
+		bool					ok;
+
+		Reserve(bytes);
+
+		//	the excitation window, the detector wants row major frames
+		{
+			CThermoStage			profile("excitation", "ThermoBatch");
+			CExcitationDetector		detector(cols, rows, (size_t)std::max(recipe.window, 1.0));
+			std::vector<float>		frame(n);
+
+			ok = ForEachBlock(*source, [&](const SFrameBlock &block) {
+				for (size_t f = 0; f < block.numFrames; ++f) {
+					const float		*src = block.frame(f);
+
+					for (size_t c = 0; c < cols; ++c)
+						for (size_t r = 0; r < rows; ++r)
+							frame[r * cols + c] = src[c * rows + r];
+					detector.Push(frame.data());
+				}
+				profile.AddBytes((double)block.data.size() * sizeof(float));
+			}) && detector.Finish(window);
+		}
+		source.reset();
+		row.values[bvExcitationSeconds] = Seconds(stage);
+		if (!ok || window.onset < 0 || window.lastPeak < window.onset) {
+			Release(bytes);
+			row.status = ok ? "No excitation found." : "Read failed.";
+			return false;
+		}
+		row.values[bvOnset] = (double)(window.onset + 1);
+		row.values[bvLast] = (double)(window.lastPeak + 1);
+		row.values[bvFrames] = (double)(window.lastPeak - window.onset + 1);
+
+		//	lock-in over the window
+		stage = std::chrono::steady_clock::now();
+		source.reset(mFactory(file, recipe, window.onset, window.lastPeak, error));
+
+		CLockInAccumulator		lockin(n, std::vector<double>(1, recipe.freq));
+		std::vector<double>		x(n), y(n), amp(n), phase(n);
+
+		if (source != NULL) {
+			CThermoStage			profile("lockin", "ThermoBatch");
+
+			ok = ForEachBlock(*source, [&](const SFrameBlock &block) {
+				lockin.Push(block.data.data(), block.time.data(), block.numFrames);
+				profile.AddBytes((double)block.data.size() * sizeof(float));
+			});
+			lockin.Result(0, x.data(), y.data(), amp.data(), phase.data());
+		}
+		source.reset();
+		row.values[bvLockInSeconds] = Seconds(stage);
+		if (!ok || error.size() > 0 || lockin.count(0) < 2) {
+			Release(bytes);
+			row.status = !error.empty() ? error : ok ? "Too few frames in the excitation window." : "Read failed.";
+			return false;
+		}
+
+		//	centre as LockinAmplifierResults: the columns and rows with most valid pixels, within 3 of the best
+		stage = std::chrono::steady_clock::now();
+
+		std::vector<size_t>		perCol(cols, 0), perRow(rows, 0);
+		double					xc = 0.0, yc = 0.0;
+		size_t					bestCol = 0, bestRow = 0, numCols = 0, numRows = 0;
+		CRadialDiffusivity		radial;
+		SRadialParams			params;
+
+		{
+			CThermoStage			profile("fit", "ThermoBatch", (double)n * 2.0 * sizeof(double));
+
+			for (size_t c = 0; c < cols; ++c)
+				for (size_t r = 0; r < rows; ++r)
+					if (amp[c * rows + r] >= recipe.tol) {
+						++perCol[c];
+						++perRow[r];
+					}
+			bestCol = *std::max_element(perCol.begin(), perCol.end());
+			bestRow = *std::max_element(perRow.begin(), perRow.end());
+			for (size_t c = 0; c < cols; ++c)
+				if (perCol[c] + 3 >= bestCol) {
+					xc += (double)c;
+					++numCols;
+				}
+			for (size_t r = 0; r < rows; ++r)
+				if (perRow[r] + 3 >= bestRow) {
+					yc += (double)r;
+					++numRows;
+				}
+			xc = floor(xc / (double)numCols + 1.0) - 1.0;
+			yc = floor(yc / (double)numRows + 1.0) - 1.0;
+
+			params.freq = recipe.freq;
+			params.xc = xc;
+			params.yc = yc;
+			params.mmpx = recipe.mmpx;
+			params.rStart = recipe.spot;
+			params.rEnd = recipe.spot + 2.0 * sqrt(recipe.diffusivity / recipe.freq / M_PI);
+			params.step = 0.5;
+			params.numRays = recipe.rays;
+			params.tol = recipe.fitTol < 0.0 ? recipe.tol : recipe.fitTol;
+			ok = bestCol > 0 && radial.Run(phase.data(), amp.data(), rows, cols, params) && radial.anisotropy().valid;
+		}
+		Release(bytes);
+		row.values[bvXc] = xc + 1.0;
+		row.values[bvYc] = yc + 1.0;
+		row.values[bvFitSeconds] = Seconds(stage);
+		row.values[bvTotalSeconds] = Seconds(start);
+		if (!ok) {
+			row.status = bestCol == 0 ? "No pixel above tol." : "The radial fit failed.";
+			return false;
+		}
+
+		const SAnisotropy	&a = radial.anisotropy();
+
+		row.values[bvDx] = a.dx;
+		row.values[bvDy] = a.dy;
+		row.values[bvDavg] = 0.5 * (a.dx + a.dy);
+		row.values[bvR2] = a.r2;
+		row.values[bvDMax] = a.dMax;
+		row.values[bvDMin] = a.dMin;
+		row.values[bvTheta] = a.theta;
+		row.status = "ok";
+
+		return true;
+	}
+
+public:
+	//	called for every recording done, from the worker threads but one at a time
+	std::function<void(const SBatchRow &row, size_t done, size_t total)>	onRow;
+	//	the row of a recording done before with this recipe (the catalog), it is not processed again when true
+	std::function<bool(const std::string &file, const SBatchRecipe &recipe, SBatchRow &row)>	lookup;
+
+	CBatchRunner(const SBatchJob &job, const FBatchSourceFactory &factory) :
+		mJob(job),
+		mFactory(factory),
+		mBudget((size_t)(std::max(job.memoryMB, 0.0) * 1024.0 * 1024.0)),
+		mUsed(0)
+	{
+	}
+
+	//	the rows of the progress file, the last one of every recording
+	static std::map<std::string, SBatchRow> ReadProgress(const std::string &fileName)
+	{
+		std::map<std::string, SBatchRow>	rows;
+		std::ifstream						file(fileName.c_str());
+		std::string							line;
+		SBatchRow							row;
+
+		while (std::getline(file, line))
+			if (ParseCsvRow(line, row) && row.file != "file")
+				rows[row.file] = row;
+
+		return rows;
+	}
+
+	//	false when the output cannot be written, failed recordings are rows with their error as status
+	bool Run(bool restart, size_t &numFailed)
+	{
+		std::vector<std::string>			files;
+		std::map<std::string, SBatchRow>	done;
+		std::deque<size_t>					queue;
+		std::vector<SBatchRow>				rows;
+		std::vector<std::thread>			workers;
+		FILE								*progress;
+		size_t								numDone = 0;
+
+		for (size_t i = 0; i < mJob.inputs.size(); ++i) {
+			std::vector<std::string>	found = ListFiles(mJob.inputs[i]);
+
+			for (size_t k = 0; k < found.size(); ++k)
+				if (std::find(files.begin(), files.end(), found[k]) == files.end())
+					files.push_back(found[k]);
+		}
+		if (!restart)
+			done = ReadProgress(mJob.progress);
+		progress = fopen(mJob.progress.c_str(), restart ? "wb" : "ab");
+		if (progress == NULL) {
+			mError = "Cannot write " + mJob.progress + ".";
+			return false;
+		}
+
+		rows.resize(files.size());
+		for (size_t i = 0; i < files.size(); ++i) {
+			if (done.count(files[i]) != 0 && done[files[i]].status == "ok") {
+				rows[i] = done[files[i]];
+				++numDone;
+			}
+			else if (lookup && lookup(files[i], mJob.RecipeFor(files[i]), rows[i])) {
+				rows[i].file = files[i];
+				fprintf(progress, "%s\n", CsvRow(rows[i]).c_str());
+				++numDone;
+			}
+			else
+				queue.push_back(i);
+		}
+
+		for (size_t w = 0; w < std::min(mJob.jobs, queue.size()); ++w) {
+			workers.emplace_back([&]() {
+				for (;;) {
+					size_t		i;
+
+					{
+						std::lock_guard<std::mutex>		lock(mMutex);
+
+						if (queue.empty())
+							return;
+						i = queue.front();
+						queue.pop_front();
+					}
+
+					SBatchRow	row;
+
+					Process(files[i], row);
+
+					std::lock_guard<std::mutex>		lock(mMutex);
+
+					rows[i] = row;
+					fprintf(progress, "%s\n", CsvRow(row).c_str());
+					fflush(progress);
+					if (onRow)
+						onRow(row, ++numDone, files.size());
+				}
+			});
+		}
+		for (size_t w = 0; w < workers.size(); ++w)
+			workers[w].join();
+		fclose(progress);
+
+		numFailed = 0;
+		for (size_t i = 0; i < rows.size(); ++i)
+			numFailed += rows[i].status != "ok";
+
+		std::string		output = mJob.output;
+		bool			columns = output.size() >= 5 && output.compare(output.size() - 5, 5, ".tcol") == 0;
+
+		if (!(columns ? WriteBatchColumns(output, rows) : WriteBatchCsv(output, rows))) {
+			mError = "Cannot write " + output + ".";
+			return false;
+		}
+
+		return true;
+	}
+
+	const std::string &error() const
+	{
+		return mError;
+	}
+};
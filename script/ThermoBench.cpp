@@ -0,0 +1,918 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "SyntheticThermal.h"
+#include "LockInAccumulator.h"
+#include "RadialDiffusivity.h"
+#include "ThermalWaveFit.h"
+#include "ThermalSignalReconstruction.h"
+#include "PulsedPhase.h"
+#include "SpotTracker.h"
+#include "HotZoneTracker.h"
+#include "FrameRegistration.h"
+#include "ExcitationDetector.h"
+#include "PipelineOperators.h"
+#include "HeatSource.h"
+#include "ThermalContrast.h"
+#include "ThermoCube.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+//	cl /O2 /EHsc /std:c++17 ThermoBench.cpp psapi.lib
+//	g++ -O3 -std=c++17 -pthread ThermoBench.cpp -o ThermoBench
+
+//	ThermoBench [options] [case ...]
+//
+//	builds synthetic sequences from analytic solutions (SyntheticThermal.h), runs the native kernels on them and
+//	prints for every case the throughput in Mpixel-samples/s (rows * cols * frames over the kernel time, generation
+//	excluded), the peak memory of the process so far and the error against the ground truth with its limit. the exit
+//	code is the number of cases over their limit, so the run can gate a build. cases (all by default):
+//		lockin		modulated gaussian spot on a half-space, rms amplitude error [% of peak] of the lock-in maps
+//		diffusivity	RadialDiffusivity on the lock-in maps, worst of Dx, Dy [%] (anisotropic plate)
+//		wavefit		full field ThermalWaveFit of the same maps, worst of Dx, Dy [%]
+//		pipeline	lock-in and statistics in one pass of the streaming graph, rms amplitude error [% of peak]
+//		cube		the sequence written to a ThermoCube with a quarter of its size in memory (the rest spills to the
+//					scratch file) and the lock-in streamed back from it block by block, rms amplitude error [% of peak]
+//		excitation	onset of the modulation found by the streaming excitation detector [frames]
+//		tsr			flash on a plate with a thinner region, rms error of d ln T / d ln t at 1 s
+//		ppt			pulsed phase on the same flash, rms phase error [rad] at about D / (2 L^2)
+//		contrast	absolute contrast of the thin region of the flash against a sound corner, error of its mean
+//					maximum [%] (the limit allows for the maximum of the noise, about 3 noise over the plateau)
+//		spot		moving point source (rosenthal) tracked by SpotTracker, error of the speed [%]
+//		hotzone		diffusing line source, rms error of the isotherm equivalent diameter [px]
+//		registration	drifting texture, rms error of the phase correlation shifts [px]
+//		wiener		adaptive wiener filter of the pipeline, residual noise over input noise
+//		heatsource	diffusing spot without sources (noise and dead pixels off, the laplacian amplifies them), rms of
+//					the recovered source over the rms of dT/dt
+//	options: --rows (240) --cols (320) --frames (250) --fs (50 Hz) --noise (0.05 K) --dead (fraction, 0.001)
+//	--seed (1) --threads (THERMO_NUM_THREADS) --affinity (cpus of the workers as 0-3,8, THERMO_AFFINITY) --csv (one
+//	comma separated line per case) --scaling (every case on 1, 2, 4 ... threads up to --threads, with the speedup over
+//	one thread)
+
+struct SBenchOptions
+{
+	SSyntheticFormat	format;
+	bool				csv;
+};
+
+struct SBenchResult
+{
+	double		seconds;
+	double		samples;			//	pixel samples processed
+	double		error;
+	double		limit;				//	the case fails when error > limit (or is NaN)
+	const char	*unit;
+};
+
+static double PeakMemoryMB()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS		counters;
+
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return NAN;
+
+	return (double)counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+	struct rusage	usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return NAN;
+#ifdef __APPLE__
+	return (double)usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+	return (double)usage.ru_maxrss / 1024.0;
+#endif
+#endif
+}
+
+class CStopwatch
+{
+private:
+	std::chrono::steady_clock::time_point	mStart;
+
+public:
+	CStopwatch() :
+		mStart(std::chrono::steady_clock::now())
+	{
+	}
+
+	double seconds() const
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart).count();
+	}
+};
+
+//	frequency with a whole number of periods in the recording, about 1 Hz
+static double LockInFrequency(const SSyntheticFormat &format)
+{
+	double		duration = (double)format.numFrames / format.fs;
+
+	return std::max(1.0, floor(duration + 0.5)) / duration;
+}
+
+//	the lock-in cases share one spot: 0.3 mm radius, D = 4 mm^2/s, 1.5 times faster along x, 12 mm across the short
+//	side. a wider spot bends the phase over the fit range (1 mm gives about 12 % on D at 1.5 - 4.5 mm)
+struct SSpotCase
+{
+	double		mmpx;
+	double		freq;
+	double		diffusivity;
+	double		dx;
+	double		dy;
+	double		amplitude;
+	double		spotRadius;
+};
+
+static SSpotCase SpotCase(const SSyntheticFormat &format)
+{
+	SSpotCase	c;
+
+	c.mmpx = 12.0 / (double)std::min(format.rows, format.cols);
+	c.freq = LockInFrequency(format);
+	c.diffusivity = 4.0;
+	c.dx = 1.5;
+	c.dy = 1.0;
+	c.amplitude = 10.0;
+	c.spotRadius = 0.3;
+
+	return c;
+}
+
+//	rms of (a - b) over the live pixels, scaled
+static double RmsError(const CSyntheticSequence &seq, const double *a, const double *b, double scale)
+{
+	double		sum = 0.0;
+	size_t		count = 0;
+
+	for (size_t p = 0; p < seq.format().rows * seq.format().cols; ++p) {
+		if (seq.dead(p))
+			continue;
+		sum += (a[p] - b[p]) * (a[p] - b[p]);
+		++count;
+	}
+
+	return count == 0 ? NAN : sqrt(sum / (double)count) * scale;
+}
+
+enum ELockInStage
+{
+	lsLockIn,
+	lsRadial,
+	lsWaveFit
+};
+
+static SBenchResult BenchLockIn(const SBenchOptions &options, ELockInStage stage)
+{
+	SSyntheticFormat	format = options.format;
+	SSpotCase			spot = SpotCase(format);
+	size_t				n = format.rows * format.cols;
+	SBenchResult		res = { 0.0, (double)(n * format.numFrames), NAN, 1.0, "% of peak" };
+
+	format.mmpx = spot.mmpx;
+
+	CSyntheticSequence		seq(format);
+	std::vector<double>		ampTrue(n), phaseTrue(n);
+
+	seq.ModulatedSpot(spot.spotRadius, spot.diffusivity, spot.freq, spot.amplitude, spot.dx, spot.dy, 0, ampTrue.data(), phaseTrue.data());
+	seq.Degrade();
+
+	CStopwatch				watch;
+	CLockInAccumulator		lockin(n, std::vector<double>(1, spot.freq));
+	std::vector<double>		x(n), y(n), amp(n), phase(n);
+
+	lockin.Push(seq.frames(), seq.time(), format.numFrames);
+	lockin.Result(0, x.data(), y.data(), amp.data(), phase.data());
+
+	if (stage == lsLockIn) {
+		res.seconds = watch.seconds();
+		res.error = RmsError(seq, amp.data(), ampTrue.data(), 100.0 / (0.5 * spot.amplitude));
+		return res;
+	}
+
+	CStopwatch				fitWatch;
+	double					xc = 0.5 * (double)(format.cols - 1), yc = 0.5 * (double)(format.rows - 1), dx, dy;
+
+	res.unit = "% worst of Dx Dy";
+	res.samples = (double)n;
+	if (stage == lsRadial) {
+		CRadialDiffusivity		radial;
+		//	144 rays from 1 mm out keep the noise from one seed to the next at about 1 %, over the 1.5 % bias of the
+		//	spot not being a point source
+		SRadialParams			params = { spot.freq, xc, yc, spot.mmpx, 1.0, 5.0, 0.5, 144, 1e-3 * spot.amplitude };
+
+		res.limit = 4.0;
+		if (!radial.Run(phase.data(), amp.data(), format.rows, format.cols, params) || !radial.anisotropy().valid)
+			return res;
+		dx = radial.anisotropy().dx;
+		dy = radial.anisotropy().dy;
+	}
+	else {
+		//	started off by a few pixels and 25 % on D, the spot is part of the model
+		CThermalWaveFit			wave;
+		SThermalWaveParams		params = { spot.freq, spot.mmpx, xc + 2.5, yc - 2.5, 0.75 * spot.diffusivity, 1.5 * spot.spotRadius,
+			0.0, 4.5, 0.0, true, false, true, true, 0, 50 };
+
+		res.limit = 1.0;
+		if (!wave.Run(phase.data(), amp.data(), format.rows, format.cols, params) || !wave.fit().converged)
+			return res;
+		dx = wave.fit().dx;
+		dy = wave.fit().dy;
+	}
+	res.seconds = fitWatch.seconds();
+	res.error = 100.0 * std::max(fabs(dx / (spot.diffusivity * spot.dx) - 1.0), fabs(dy / (spot.diffusivity * spot.dy) - 1.0));
+
+	return res;
+}
+
+static SBenchResult BenchPipeline(const SBenchOptions &options)
+{
+	SSyntheticFormat	format = options.format;
+	SSpotCase			spot = SpotCase(format);
+	size_t				n = format.rows * format.cols;
+	SBenchResult		res = { 0.0, (double)(n * format.numFrames), NAN, 1.0, "% of peak" };
+
+	format.mmpx = spot.mmpx;
+
+	CSyntheticSequence		seq(format);
+	std::vector<double>		ampTrue(n);
+
+	seq.ModulatedSpot(spot.spotRadius, spot.diffusivity, spot.freq, spot.amplitude, spot.dx, spot.dy, 0, ampTrue.data(), NULL);
+	seq.Degrade();
+
+	CStopwatch				watch;
+	CArraySource<float>		source(seq.frames(), seq.time(), format.rows, format.cols, format.numFrames);
+	CPipeline				pipeline;
+	CLockInOp				*lockin = new CLockInOp(n, std::vector<double>(1, spot.freq));
+
+	pipeline.Add(lockin, 0, "lockin");
+	pipeline.Add(new CStatsOp(n), 0, "stats");
+	if (!pipeline.Run(source, 32, 64 << 20)) {
+		fprintf(stderr, "pipeline: %s\n", pipeline.error().c_str());
+		return res;
+	}
+
+	std::vector<double>		x(n), y(n), amp(n), phase(n);
+
+	lockin->accumulator().Result(0, x.data(), y.data(), amp.data(), phase.data());
+	res.seconds = watch.seconds();
+	res.error = RmsError(seq, amp.data(), ampTrue.data(), 100.0 / (0.5 * spot.amplitude));
+
+	return res;
+}
+
+static SBenchResult BenchCube(const SBenchOptions &options)
+{
+	SSyntheticFormat	format = options.format;
+	SSpotCase			spot = SpotCase(format);
+	size_t				n = format.rows * format.cols;
+	SBenchResult		res = { 0.0, (double)(n * format.numFrames), NAN, 1.0, "% of peak" };
+
+	format.mmpx = spot.mmpx;
+
+	CSyntheticSequence		seq(format);
+	std::vector<double>		ampTrue(n);
+
+	seq.ModulatedSpot(spot.spotRadius, spot.diffusivity, spot.freq, spot.amplitude, spot.dx, spot.dy, 0, ampTrue.data(), NULL);
+	seq.Degrade();
+
+	CStopwatch				watch;
+	CThermoCube				cube;
+	SThermoCubeParams		params;
+
+	params.rows = format.rows;
+	params.cols = format.cols;
+	params.elementSize = sizeof(float);
+	params.blockFrames = 16;
+	params.budget = std::max<size_t>(1, n * format.numFrames * sizeof(float) / 4);
+	if (!cube.Open(params) || !cube.Write(0, format.numFrames, seq.frames())) {
+		fprintf(stderr, "cube: %s\n", cube.error().c_str());
+		return res;
+	}
+
+	CLockInAccumulator		lockin(n, std::vector<double>(1, spot.freq));
+	std::vector<double>		x(n), y(n), amp(n), phase(n);
+
+	for (size_t b = 0; b < cube.numBlocks(); ++b) {
+		size_t			first = b * cube.blockFrames(), count = std::min(cube.blockFrames(), format.numFrames - first);
+		const float		*frames = (const float *)cube.Acquire(b);
+
+		if (frames == NULL) {
+			fprintf(stderr, "cube: %s\n", cube.error().c_str());
+			return res;
+		}
+		lockin.Push(frames, seq.time() + first, count);
+		cube.Release(b);
+	}
+	lockin.Result(0, x.data(), y.data(), amp.data(), phase.data());
+	res.seconds = watch.seconds();
+	res.error = RmsError(seq, amp.data(), ampTrue.data(), 100.0 / (0.5 * spot.amplitude));
+
+	return res;
+}
+
+static SBenchResult BenchExcitation(const SBenchOptions &options)
+{
+	SSyntheticFormat	format = options.format;
+	SSpotCase			spot = SpotCase(format);
+	size_t				n = format.rows * format.cols, onset = format.numFrames / 5;
+	SBenchResult		res = { 0.0, (double)(n * format.numFrames), NAN, format.fs / spot.freq, "frames" };
+
+	format.mmpx = spot.mmpx;
+
+	CSyntheticSequence		seq(format);
+
+	seq.ModulatedSpot(spot.spotRadius, spot.diffusivity, spot.freq, spot.amplitude, spot.dx, spot.dy, onset, NULL, NULL);
+	seq.Degrade();
+
+	//	the detector wants row major frames, a column major frame is the row major frame of the transposed image
+	CStopwatch				watch;
+	CExcitationDetector		detector(format.rows, format.cols, std::max<size_t>(onset / 2, 1));
+	SExcitationWindow		window;
+
+	for (size_t f = 0; f < format.numFrames; ++f)
+		detector.Push(seq.frames() + f * n);
+	if (!detector.Finish(window) || window.onset < 0)
+		return res;
+	res.seconds = watch.seconds();
+	res.error = fabs((double)window.onset - (double)onset);
+
+	return res;
+}
+
+//	3 mm steel-like plate (D = 4 mm^2/s), 1.5 mm thick in the central ninth, flash on frame 4
+struct SFlashCase
+{
+	size_t		pulse;
+	double		thickness;
+	double		defectThickness;
+	double		diffusivity;
+	double		amplitude;
+	double		halfWidth;			//	of the defect [mm]
+};
+
+static SFlashCase FlashCase(const SSyntheticFormat &format)
+{
+	SFlashCase	c = { 4, 3.0, 1.5, 4.0, 6.0, 0.0 };
+
+	c.halfWidth = (double)std::min(format.rows, format.cols) * format.mmpx / 6.0;
+
+	return c;
+}
+
+static SBenchResult BenchTsr(const SBenchOptions &options)
+{
+	SSyntheticFormat	format = options.format;
+	SFlashCase			flash = FlashCase(format);
+	size_t				n = format.rows * format.cols;
+	double				evalTime = 1.0;
+	SBenchResult		res = { 0.0, (double)(n * format.numFrames), NAN, 0.05, "d ln T / d ln t" };
+
+	if (format.numFrames <= flash.pulse + 8)
+		return res;
+
+	CSyntheticSequence		seq(format);
+	std::vector<double>		slopeTrue(n);
+
+	seq.Flash(flash.pulse, flash.amplitude, flash.thickness, flash.diffusivity, flash.defectThickness, -flash.halfWidth, flash.halfWidth,
+		-flash.halfWidth, flash.halfWidth, evalTime, slopeTrue.data());
+	seq.Degrade();
+
+	CStopwatch				watch;
+	size_t					numDecay = format.numFrames - flash.pulse - 1;
+	std::vector<double>		times(numDecay), baseline(n, 0.0), logT(n), d1(n);
+
+	for (size_t k = 0; k < numDecay; ++k)
+		times[k] = (double)(k + 1) / format.fs;
+	for (size_t f = 0; f <= flash.pulse; ++f)
+		for (size_t p = 0; p < n; ++p)
+			baseline[p] += (double)seq.frames()[f * n + p] / (double)(flash.pulse + 1);
+
+	CTsrAccumulator		tsr(n, times, 5, 1e-3);
+
+	tsr.SetBaseline(baseline.data());
+	if (!tsr.valid() || !tsr.Push(seq.frames() + (flash.pulse + 1) * n, numDecay))
+		return res;
+	tsr.Evaluate(evalTime, logT.data(), d1.data(), NULL);
+	res.seconds = watch.seconds();
+	res.error = RmsError(seq, d1.data(), slopeTrue.data(), 1.0);
+
+	return res;
+}
+
+static SBenchResult BenchPpt(const SBenchOptions &options)
+{
+	SSyntheticFormat	format = options.format;
+	SFlashCase			flash = FlashCase(format);
+	size_t				n = format.rows * format.cols;
+	SBenchResult		res = { 0.0, (double)(n * format.numFrames), NAN, 0.02, "rad" };
+
+	if (format.numFrames <= flash.pulse + 8)
+		return res;
+
+	CSyntheticSequence		seq(format);
+
+	seq.Flash(flash.pulse, flash.amplitude, flash.thickness, flash.diffusivity, flash.defectThickness, -flash.halfWidth, flash.halfWidth,
+		-flash.halfWidth, flash.halfWidth, 1.0, NULL);
+	seq.Degrade();
+
+	CStopwatch				watch;
+	size_t					numDecay = format.numFrames - flash.pulse - 1;
+	SPptParams				params = { format.fs, SPptParams::wnRect, 0.0, 1 };
+	std::vector<double>		freqs(1, 0.5 * flash.diffusivity / (flash.thickness * flash.thickness)), baseline(n, 0.0);
+	std::vector<double>		amp(n), phase(n);
+
+	for (size_t f = 0; f <= flash.pulse; ++f)
+		for (size_t p = 0; p < n; ++p)
+			baseline[p] += (double)seq.frames()[f * n + p] / (double)(flash.pulse + 1);
+
+	CPulsedPhase			ppt(n, numDecay, freqs, params);
+
+	ppt.Run(seq.frames() + (flash.pulse + 1) * n, baseline.data(), amp.data(), phase.data());
+	res.seconds = watch.seconds();
+
+	//	ground truth: the bin of the zero padded decay summed directly on the noise free series of both thicknesses
+	double		phaseTrue[2];
+
+	for (int k = 0; k < 2; ++k) {
+		std::complex<double>	z(0.0, 0.0);
+		double					w = 2.0 * M_PI * ppt.binFreq(0) / format.fs;
+
+		for (size_t i = 0; i < numDecay; ++i) {
+			double		dT, slope;
+
+			CSyntheticSequence::FlashPlate((double)(i + 1) / format.fs, k == 0 ? flash.thickness : flash.defectThickness, flash.diffusivity, dT, slope);
+			z += flash.amplitude * dT * std::polar(1.0, -w * (double)i);
+		}
+		phaseTrue[k] = std::arg(z);
+	}
+
+	std::vector<double>		truth(n);
+
+	for (size_t c = 0; c < format.cols; ++c) {
+		for (size_t r = 0; r < format.rows; ++r) {
+			double		x = ((double)c - 0.5 * (double)(format.cols - 1)) * format.mmpx, y = ((double)r - 0.5 * (double)(format.rows - 1)) * format.mmpx;
+			bool		thin = fabs(x) <= flash.halfWidth && fabs(y) <= flash.halfWidth;
+
+			truth[r + c * format.rows] = phaseTrue[thin ? 1 : 0];
+		}
+	}
+	res.error = RmsError(seq, phase.data(), truth.data(), 1.0);
+
+	return res;
+}
+
+static SBenchResult BenchContrast(const SBenchOptions &options)
+{
+	SSyntheticFormat	format = options.format;
+	SFlashCase			flash = FlashCase(format);
+	size_t				n = format.rows * format.cols;
+	SBenchResult		res = { 0.0, (double)(n * format.numFrames), NAN, 5.0, "%" };
+
+	if (format.numFrames <= flash.pulse + 8)
+		return res;
+
+	CSyntheticSequence		seq(format);
+
+	seq.Flash(flash.pulse, flash.amplitude, flash.thickness, flash.diffusivity, flash.defectThickness, -flash.halfWidth, flash.halfWidth,
+		-flash.halfWidth, flash.halfWidth, 1.0, NULL);
+	seq.Degrade();
+
+	CStopwatch				watch;
+	size_t					corner = std::min(format.rows, format.cols) / 8;
+	SContrastParams			params = { SContrastParams::crRegion, 1, corner, 1, corner, 0, flash.pulse + 1, -1, 0.01, 1 };
+	CThermalContrast		contrast(format.rows, format.cols, params);
+
+	if (!contrast.Push(seq.frames(), seq.time(), format.numFrames))
+		return res;
+	res.seconds = watch.seconds();
+
+	//	the plates are 1-D, the contrast is the difference of the two decays
+	double		truth = -INFINITY, sum = 0.0, count = 0.0;
+
+	for (size_t f = flash.pulse + 1; f < format.numFrames; ++f) {
+		double		thin, thick, slope;
+
+		CSyntheticSequence::FlashPlate((double)(f - flash.pulse) / format.fs, flash.defectThickness, flash.diffusivity, thin, slope);
+		CSyntheticSequence::FlashPlate((double)(f - flash.pulse) / format.fs, flash.thickness, flash.diffusivity, thick, slope);
+		truth = std::max(truth, flash.amplitude * (thin - thick));
+	}
+	for (size_t c = format.cols / 2 - corner / 2; c < format.cols / 2 + corner / 2; ++c) {
+		for (size_t r = format.rows / 2 - corner / 2; r < format.rows / 2 + corner / 2; ++r) {
+			if (seq.dead(r + c * format.rows))
+				continue;
+			sum += contrast.maxContrast(CThermalContrast::ctAbsolute)[r + c * format.rows];
+			count += 1.0;
+		}
+	}
+	if (count > 0.0)
+		res.error = 100.0 * fabs(sum / count - truth) / truth;
+	res.limit = 2.0 + 300.0 * format.noise / truth;
+
+	return res;
+}
+
+static SBenchResult BenchSpot(const SBenchOptions &options)
+{
+	SSyntheticFormat	format = options.format;
+	size_t				n = format.rows * format.cols;
+	SBenchResult		res = { 0.0, (double)(n * format.numFrames), NAN, 2.0, "% on speed" };
+	double				width = (double)format.cols * format.mmpx, duration = (double)format.numFrames / format.fs;
+	double				speed = 0.5 * width / duration;
+
+	CSyntheticSequence		seq(format);
+	std::vector<double>		xs(format.numFrames);
+
+	seq.MovingSource(20.0, speed, 4.0, -0.25 * width, 0.0, 4.0 * format.mmpx, xs.data());
+	seq.Degrade();
+
+	CStopwatch				watch;
+	SSpotParams				params = { true, 0.5, 0.0, 20, NULL };
+	CSpotTracker			tracker(format.rows, format.cols, params);
+	std::vector<SSpotFit>	fits(format.numFrames);
+
+	tracker.Track(seq.frames(), format.numFrames, fits.data());
+	res.seconds = watch.seconds();
+
+	//	the rosenthal peak trails the source by a fixed distance, the speed is the slope of the tracked centre
+	double		st = 0.0, sx = 0.0, stt = 0.0, stx = 0.0, count = 0.0;
+
+	for (size_t f = 0; f < format.numFrames; ++f) {
+		if (!fits[f].valid)
+			continue;
+
+		double		t = seq.time()[f];
+
+		st += t;
+		sx += fits[f].xc;
+		stt += t * t;
+		stx += t * fits[f].xc;
+		count += 1.0;
+	}
+	if (count > 2.0)
+		res.error = 100.0 * fabs((count * stx - st * sx) / (count * stt - st * st) * format.mmpx / speed - 1.0);
+
+	return res;
+}
+
+static SBenchResult BenchHotZone(const SBenchOptions &options)
+{
+	SSyntheticFormat	format = options.format;
+	size_t				n = format.rows * format.cols;
+	double				level = 20.0;
+	SBenchResult		res = { 0.0, (double)(n * format.numFrames), NAN, 0.5, "px" };
+
+	//	the isotherm grows to a quarter of the short side
+	double				t0 = 0.25 / format.fs * (double)format.numFrames, diffusivity;
+	double				rMax = 0.25 * (double)std::min(format.rows, format.cols) * format.mmpx;
+
+	diffusivity = rMax * rMax / (4.0 * 2.0 * t0 * log(100.0 / (2.0 * level)));
+
+	CSyntheticSequence		seq(format);
+	std::vector<double>		radius(format.numFrames);
+
+	seq.DiffusingSpot(100.0, diffusivity, t0, level, radius.data());
+	seq.Degrade();
+
+	CStopwatch				watch;
+	SHotZoneParams			params = { true, 5 };
+	CHotZoneTracker			tracker(format.rows, format.cols, std::vector<double>(1, format.ambient + level), params);
+
+	tracker.Push(seq.frames(), format.numFrames);
+	res.seconds = watch.seconds();
+
+	std::vector<double>		area(format.numFrames, 0.0);
+	double					sum = 0.0, count = 0.0;
+
+	for (size_t i = 0; i < tracker.components().size(); ++i) {
+		const SHotComponent		&c = tracker.components()[i];
+
+		area[c.frame] = std::max(area[c.frame], c.area);
+	}
+	for (size_t f = 0; f < format.numFrames; ++f) {
+		if (radius[f] < 3.0)
+			continue;
+
+		double		e = 2.0 * sqrt(area[f] / M_PI) - 2.0 * radius[f];
+
+		sum += e * e;
+		count += 1.0;
+	}
+	if (count > 0.0)
+		res.error = sqrt(sum / count);
+
+	return res;
+}
+
+static SBenchResult BenchRegistration(const SBenchOptions &options)
+{
+	SSyntheticFormat	format = options.format;
+	size_t				n = format.rows * format.cols;
+	double				dx = 0.05, dy = -0.03;
+	SBenchResult		res = { 0.0, (double)(n * format.numFrames), NAN, 0.2, "px" };
+
+	//	stuck pixels are a fixed pattern that pins the correlation at zero shift, cameras replace them before frames
+	//	get this far
+	format.deadFraction = 0.0;
+
+	CSyntheticSequence		seq(format);
+
+	seq.DriftingTexture(2.0, dx, dy, 24);
+	seq.Degrade();
+
+	CStopwatch					watch;
+	SRegistrationParams			params = { SRegistrationParams::tpReference, 0.1, SRegistrationParams::ipNone, 0.0 };
+	CFrameRegistration			registration(format.rows, format.cols, params);
+	std::vector<SFrameShift>	shifts(format.numFrames);
+
+	registration.Push(seq.frames(), format.numFrames, (float *)NULL, shifts.data());
+	res.seconds = watch.seconds();
+
+	double		sum = 0.0;
+
+	for (size_t f = 0; f < format.numFrames; ++f) {
+		double		ex = shifts[f].dx - dx * (double)f, ey = shifts[f].dy - dy * (double)f;
+
+		sum += ex * ex + ey * ey;
+	}
+	res.error = sqrt(sum / (double)format.numFrames);
+
+	return res;
+}
+
+static SBenchResult BenchWiener(const SBenchOptions &options)
+{
+	SSyntheticFormat	format = options.format, clean = options.format;
+	size_t				n = format.rows * format.cols;
+	SBenchResult		res = { 0.0, (double)(n * format.numFrames), NAN, 0.7, "of input noise" };
+
+	if (format.noise <= 0.0) {
+		res.error = 0.0;
+		return res;
+	}
+
+	CSyntheticSequence		seq(format);
+
+	//	smooth field: the diffusing spot over the whole frame
+	double					t0 = 0.25 * (double)format.numFrames / format.fs, rMax = 0.5 * (double)std::min(format.rows, format.cols) * format.mmpx;
+
+	seq.DiffusingSpot(10.0, rMax * rMax / (8.0 * t0), t0, 1.0, NULL);
+	clean.noise = 0.0;
+	clean.deadFraction = 0.0;
+
+	CSyntheticSequence		reference(clean);
+
+	reference.DiffusingSpot(10.0, rMax * rMax / (8.0 * t0), t0, 1.0, NULL);
+	seq.Degrade();
+
+	CStopwatch				watch;
+	CBlockAllocator			alloc;
+	CWienerOp				wiener(5);
+	double					in = 0.0, out = 0.0;
+	size_t					blockSize = 32;
+
+	for (size_t f0 = 0; f0 < format.numFrames; f0 += blockSize) {
+		size_t							count = std::min(blockSize, format.numFrames - f0);
+		std::shared_ptr<SFrameBlock>	block = alloc.Allocate(format.rows, format.cols, count, (int64_t)f0);
+		SFrameBlockPtr					filtered;
+
+		std::copy(seq.frames() + f0 * n, seq.frames() + (f0 + count) * n, block->data.begin());
+		std::copy(seq.time() + f0, seq.time() + f0 + count, block->time.begin());
+		if (!wiener.Process(block, alloc, filtered))
+			return res;
+
+		//	away from the dead pixels, which the filter spreads over its neighbourhood
+		for (size_t f = 0; f < count; ++f) {
+			for (size_t c = 2; c + 2 < format.cols; ++c) {
+				for (size_t r = 2; r + 2 < format.rows; ++r) {
+					size_t		p = r + c * format.rows;
+					bool		near = false;
+
+					for (size_t j = c - 2; j <= c + 2 && !near; ++j)
+						for (size_t i = r - 2; i <= r + 2 && !near; ++i)
+							near = seq.dead(i + j * format.rows);
+					if (near)
+						continue;
+
+					double		truth = reference.frames()[(f0 + f) * n + p];
+					double		a = block->data[f * n + p] - truth, b = filtered->data[f * n + p] - truth;
+
+					in += a * a;
+					out += b * b;
+				}
+			}
+		}
+	}
+	res.seconds = watch.seconds();
+	res.error = in > 0.0 ? sqrt(out / in) : NAN;
+
+	return res;
+}
+
+static SBenchResult BenchHeatSource(const SBenchOptions &options)
+{
+	SSyntheticFormat	format = options.format;
+	size_t				n = format.rows * format.cols;
+	SBenchResult		res = { 0.0, (double)(n * format.numFrames), NAN, 0.05, "of dT/dt" };
+
+	format.noise = 0.0;
+	format.deadFraction = 0.0;
+
+	CSyntheticSequence		seq(format);
+	double					t0 = 0.25 * (double)format.numFrames / format.fs, rMax = 0.5 * (double)std::min(format.rows, format.cols) * format.mmpx;
+	double					diffusivity = rMax * rMax / (8.0 * t0);
+
+	seq.DiffusingSpot(10.0, diffusivity, t0, 1.0, NULL);
+
+	CStopwatch				watch;
+	SHeatSourceParams		params = { format.fs, 3, 3, 2, diffusivity, format.mmpx, 1.0 };
+	CHeatSource				engine(format.rows, format.cols, params);
+	double					source = 0.0, slope = 0.0;
+	double					xc = 0.5 * (double)(format.cols - 1), yc = 0.5 * (double)(format.rows - 1);
+
+	//	the exact dT/dt of the spot, away from the borders where the replicated edge is not the infinite plate
+	auto emit = [&](int64_t index, double time, const float *q) {
+		double		t = t0 + time;
+
+		for (size_t c = 8; c + 8 < format.cols; ++c) {
+			for (size_t r = 8; r + 8 < format.rows; ++r) {
+				double		x = ((double)c - xc) * format.mmpx, y = ((double)r - yc) * format.mmpx, rr = x * x + y * y;
+				double		d = seq.frames()[(size_t)index * n + r + c * format.rows] - format.ambient;
+				double		rate = d * (rr / (4.0 * diffusivity * t * t) - 1.0 / t);
+
+				source += (double)q[r + c * format.rows] * q[r + c * format.rows];
+				slope += rate * rate;
+			}
+		}
+	};
+
+	if (!engine.Push(seq.frames(), seq.time(), format.numFrames, emit) || !engine.Finish(emit))
+		return res;
+	res.seconds = watch.seconds();
+	res.error = slope > 0.0 ? sqrt(source / slope) : NAN;
+
+	return res;
+}
+
+struct SBenchCase
+{
+	const char								*name;
+	std::function<SBenchResult(const SBenchOptions &)>	run;
+};
+
+int main(int argc, char **argv)
+{
+	SBenchOptions			options;
+	std::vector<std::string>	selected;
+
+	options.format.rows = 240;
+	options.format.cols = 320;
+	options.format.numFrames = 250;
+	options.format.fs = 50.0;
+	options.format.mmpx = 0.05;
+	options.format.ambient = 25.0;
+	options.format.noise = 0.05;
+	options.format.deadFraction = 0.001;
+	options.format.seed = 1;
+	options.csv = false;
+
+	bool		scaling = false;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string		arg = argv[i];
+		bool			value = i + 1 < argc;
+
+		if (arg == "--csv")
+			options.csv = true;
+		else if (arg == "--scaling")
+			scaling = true;
+		else if (arg == "--rows" && value)
+			options.format.rows = (size_t)atol(argv[++i]);
+		else if (arg == "--cols" && value)
+			options.format.cols = (size_t)atol(argv[++i]);
+		else if (arg == "--frames" && value)
+			options.format.numFrames = (size_t)atol(argv[++i]);
+		else if (arg == "--fs" && value)
+			options.format.fs = atof(argv[++i]);
+		else if (arg == "--noise" && value)
+			options.format.noise = atof(argv[++i]);
+		else if (arg == "--dead" && value)
+			options.format.deadFraction = atof(argv[++i]);
+		else if (arg == "--seed" && value)
+			options.format.seed = (uint32_t)atol(argv[++i]);
+		else if (arg == "--threads" && value) {
+			std::string		threads = std::string("THERMO_NUM_THREADS=") + argv[++i];
+
+#ifdef _WIN32
+			_putenv(threads.c_str());
+#else
+			setenv("THERMO_NUM_THREADS", argv[i], 1);
+#endif
+		}
+		else if (arg == "--affinity" && value) {
+			std::string		affinity = std::string("THERMO_AFFINITY=") + argv[++i];
+
+#ifdef _WIN32
+			_putenv(affinity.c_str());
+#else
+			setenv("THERMO_AFFINITY", argv[i], 1);
+#endif
+		}
+		else if (arg.compare(0, 2, "--") == 0) {
+			fprintf(stderr, "unknown option %s\n", arg.c_str());
+			return -1;
+		}
+		else
+			selected.push_back(arg);
+	}
+	if (options.format.rows < 16 || options.format.cols < 16 || options.format.numFrames < 16 || !(options.format.fs > 0.0)) {
+		fprintf(stderr, "frames must be at least 16 x 16, at least 16 of them, with fs > 0\n");
+		return -1;
+	}
+
+	SBenchCase		cases[] = {
+		{ "lockin",			[](const SBenchOptions &o) { return BenchLockIn(o, lsLockIn); } },
+		{ "diffusivity",	[](const SBenchOptions &o) { return BenchLockIn(o, lsRadial); } },
+		{ "wavefit",		[](const SBenchOptions &o) { return BenchLockIn(o, lsWaveFit); } },
+		{ "pipeline",		BenchPipeline },
+		{ "cube",			BenchCube },
+		{ "excitation",		BenchExcitation },
+		{ "tsr",			BenchTsr },
+		{ "ppt",			BenchPpt },
+		{ "contrast",		BenchContrast },
+		{ "spot",			BenchSpot },
+		{ "hotzone",		BenchHotZone },
+		{ "registration",	BenchRegistration },
+		{ "wiener",			BenchWiener },
+		{ "heatsource",		BenchHeatSource },
+	};
+	int						failures = 0;
+	unsigned				maxThreads = ThermoNumThreads();
+	std::vector<unsigned>	threadCounts(1, maxThreads);
+
+	if (scaling) {
+		threadCounts.clear();
+		for (unsigned n = 1; n < maxThreads; n *= 2)
+			threadCounts.push_back(n);
+		threadCounts.push_back(maxThreads);
+	}
+
+	if (options.csv)
+		printf("case,threads,seconds,mpxSamplesPerSecond,speedup,peakMB,error,limit,unit,pass\n");
+	else {
+		printf("%zu x %zu, %zu frames at %g Hz, noise %g, dead %g, %u threads\n\n", options.format.rows, options.format.cols,
+			options.format.numFrames, options.format.fs, options.format.noise, options.format.deadFraction, maxThreads);
+		printf("%-14s %7s %10s %14s %8s %10s %12s %10s  %s\n", "case", "threads", "time [s]", "Mpx-samples/s", "speedup", "peak [MB]",
+			"error", "limit", "");
+	}
+
+	for (size_t k = 0; k < sizeof(cases) / sizeof(cases[0]); ++k) {
+		if (!selected.empty() && std::find(selected.begin(), selected.end(), cases[k].name) == selected.end())
+			continue;
+
+		double		single = NAN;
+
+		for (size_t t = 0; t < threadCounts.size(); ++t) {
+			ThermoSetNumThreads(threadCounts[t]);
+
+			SBenchResult	res = cases[k].run(options);
+			double			throughput = res.seconds > 0.0 ? res.samples / res.seconds * 1e-6 : NAN;
+			bool			pass = res.error <= res.limit;
+
+			if (threadCounts[t] == 1)
+				single = res.seconds;
+
+			double			speedup = single / res.seconds;
+			char			speedupText[32] = "-";
+
+			//	without a run on one thread there is nothing to compare with
+			if (!std::isnan(speedup))
+				snprintf(speedupText, sizeof(speedupText), options.csv ? "%.3f" : "%.2f", speedup);
+			else if (options.csv)
+				speedupText[0] = 0;
+
+			failures += pass ? 0 : 1;
+			if (options.csv)
+				printf("%s,%u,%.6f,%.3f,%s,%.1f,%.6g,%.6g,%s,%d\n", cases[k].name, threadCounts[t], res.seconds, throughput, speedupText,
+					PeakMemoryMB(), res.error, res.limit, res.unit, pass ? 1 : 0);
+			else
+				printf("%-14s %7u %10.4f %14.1f %8s %10.1f %12.4g %10.4g  %s %s\n", cases[k].name, threadCounts[t], res.seconds, throughput,
+					speedupText, PeakMemoryMB(), res.error, res.limit, res.unit, pass ? "ok" : "FAIL");
+			fflush(stdout);
+		}
+	}
+	ThermoSetNumThreads(0);
+
+	return failures;
+}
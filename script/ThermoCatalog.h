@@ -0,0 +1,510 @@
+#pragma once
+
+#include "sqlite3.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <ctime>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+//	campaign catalog in sqlite (sqlite3.dll)
+//
+//	one database per campaign with the recordings, indexed once from their header (CatalogScanner.h), and the analysis
+//	runs on them with their parameters and scalar results:
+//		recordings	id, path (unique), name, bytes, mtime, rows, cols, frames, frameRate, dataType, indexed
+//		metadata	recording, key, value, number		frame info of the first frame, object parameters, presets
+//		runs		id, recording, kind, params, status, started, seconds
+//		params		run, key, value, number				the parameters of the run one by one
+//		results		run, name, value
+//	number is the value as a double when it is one (NULL otherwise), so parameters and metadata can be compared in sql.
+//	params of a run is also kept as one canonical string (keys sorted, key=value;...), which finds the run of a recording
+//	with given parameters in one indexed lookup. e.g. all 2 Hz tests with Davg < 12 mm^2/s:
+//		SELECT rec.name, res.value AS Davg FROM runs
+//			JOIN recordings rec ON rec.id = runs.recording
+//			JOIN params p ON p.run = runs.id AND p.key = 'freq' AND p.number = 2
+//			JOIN results res ON res.run = runs.id AND res.name = 'Davg'
+//			WHERE res.value < 12
+//	statements are prepared once per catalog and reused, writes go through explicit transactions (Begin / Commit) so a
+//	scan of a whole folder or a run with its results costs one commit. like the kernels it reports failures through the
+//	return value and error(). one catalog is used by one thread at a time, sqlite locks the file between processes.
+
+typedef std::map<std::string, std::string>	SCatalogParams;
+
+struct SCatalogRecording
+{
+	std::string		path;
+	int64_t			bytes;
+	int64_t			mtime;				//	[s] since 1970
+	int64_t			rows;
+	int64_t			cols;
+	int64_t			frames;
+	double			frameRate;			//	NaN when unknown
+	std::string		dataType;
+	SCatalogParams	metadata;
+};
+
+//	a cell of a query result
+struct SCatalogValue
+{
+	int				type;				//	SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB or SQLITE_NULL
+	double			number;
+	std::string		text;
+};
+
+//	size and modification time of a file, false when it cannot be read
+inline bool CatalogFileStamp(const std::string &path, int64_t &bytes, int64_t &mtime)
+{
+#ifdef _WIN32
+	struct _stat64		st;
+
+	if (_stat64(path.c_str(), &st) != 0)
+		return false;
+#else
+	struct stat			st;
+
+	if (stat(path.c_str(), &st) != 0)
+		return false;
+#endif
+	bytes = (int64_t)st.st_size;
+	mtime = (int64_t)st.st_mtime;
+
+	return true;
+}
+
+//	key=value;... with the keys in order, the same parameters always give the same string
+inline std::string CatalogParamsKey(const SCatalogParams &params)
+{
+	std::string		key;
+
+	for (SCatalogParams::const_iterator it = params.begin(); it != params.end(); ++it)
+		key += (key.empty() ? "" : ";") + it->first + "=" + it->second;
+
+	return key;
+}
+
+class CSqliteStatement
+{
+private:
+	sqlite3_stmt	*mStatement;
+
+public:
+	CSqliteStatement() :
+		mStatement(NULL)
+	{
+	}
+
+	CSqliteStatement(const CSqliteStatement &) = delete;
+	CSqliteStatement &operator=(const CSqliteStatement &) = delete;
+
+	~CSqliteStatement()
+	{
+		sqlite3_finalize(mStatement);
+	}
+
+	bool Prepare(sqlite3 *db, const std::string &sql)
+	{
+		sqlite3_finalize(mStatement);
+		mStatement = NULL;
+
+		return sqlite3_prepare_v2(db, sql.c_str(), (int)sql.size() + 1, &mStatement, NULL) == SQLITE_OK;
+	}
+
+	//	ready for new bindings
+	CSqliteStatement &Reset()
+	{
+		sqlite3_reset(mStatement);
+		sqlite3_clear_bindings(mStatement);
+
+		return *this;
+	}
+
+	//	parameters are 1 based, NaN binds NULL
+	CSqliteStatement &Bind(int i, double value)
+	{
+		if (value != value)
+			sqlite3_bind_null(mStatement, i);
+		else
+			sqlite3_bind_double(mStatement, i, value);
+
+		return *this;
+	}
+
+	CSqliteStatement &Bind(int i, int64_t value)
+	{
+		sqlite3_bind_int64(mStatement, i, (sqlite3_int64)value);
+
+		return *this;
+	}
+
+	CSqliteStatement &Bind(int i, const std::string &value)
+	{
+		sqlite3_bind_text(mStatement, i, value.c_str(), (int)value.size(), SQLITE_TRANSIENT);
+
+		return *this;
+	}
+
+	//	the value as a number when all of it parses as one, NULL otherwise
+	CSqliteStatement &BindNumber(int i, const std::string &value)
+	{
+		char		*end = NULL;
+		double		number = value.empty() ? 0.0 : strtod(value.c_str(), &end);
+
+		if (end == NULL || *end != 0 || number != number)
+			sqlite3_bind_null(mStatement, i);
+		else
+			sqlite3_bind_double(mStatement, i, number);
+
+		return *this;
+	}
+
+	//	SQLITE_ROW, SQLITE_DONE or an error code
+	int Step()
+	{
+		return sqlite3_step(mStatement);
+	}
+
+	int columns() const
+	{
+		return sqlite3_column_count(mStatement);
+	}
+
+	std::string name(int c) const
+	{
+		return sqlite3_column_name(mStatement, c);
+	}
+
+	int64_t Integer(int c) const
+	{
+		return (int64_t)sqlite3_column_int64(mStatement, c);
+	}
+
+	double Double(int c) const
+	{
+		return sqlite3_column_type(mStatement, c) == SQLITE_NULL ? NAN : sqlite3_column_double(mStatement, c);
+	}
+
+	std::string Text(int c) const
+	{
+		const unsigned char		*text = sqlite3_column_text(mStatement, c);
+
+		return text == NULL ? std::string() : std::string((const char *)text, (size_t)sqlite3_column_bytes(mStatement, c));
+	}
+
+	SCatalogValue Value(int c) const
+	{
+		SCatalogValue	value;
+
+		value.type = sqlite3_column_type(mStatement, c);
+		value.number = value.type == SQLITE_INTEGER || value.type == SQLITE_FLOAT ? sqlite3_column_double(mStatement, c) : NAN;
+		if (value.type == SQLITE_TEXT || value.type == SQLITE_BLOB)
+			value.text = Text(c);
+
+		return value;
+	}
+};
+
+class CThermoCatalog
+{
+private:
+	sqlite3										*mDb;
+	std::string									mError;
+	std::map<std::string, std::unique_ptr<CSqliteStatement>>	mStatements;
+
+	bool Fail(const std::string &what)
+	{
+		mError = what + (mDb != NULL ? std::string(": ") + sqlite3_errmsg(mDb) : std::string()) + ".";
+
+		return false;
+	}
+
+	bool Exec(const char *sql)
+	{
+		char	*message = NULL;
+
+		if (sqlite3_exec(mDb, sql, NULL, NULL, &message) == SQLITE_OK)
+			return true;
+		mError = message != NULL ? message : "sqlite error";
+		sqlite3_free(message);
+
+		return false;
+	}
+
+	//	the prepared statement of sql, prepared on first use
+	CSqliteStatement *Statement(const std::string &sql)
+	{
+		std::unique_ptr<CSqliteStatement>	&statement = mStatements[sql];
+
+		if (statement == NULL) {
+			statement.reset(new CSqliteStatement);
+			if (!statement->Prepare(mDb, sql)) {
+				Fail("Cannot prepare " + sql);
+				statement.reset();
+				return NULL;
+			}
+		}
+
+		return &statement->Reset();
+	}
+
+	bool Done(CSqliteStatement *statement, const char *what)
+	{
+		return statement->Step() == SQLITE_DONE || Fail(what);
+	}
+
+public:
+	CThermoCatalog() :
+		mDb(NULL)
+	{
+	}
+
+	CThermoCatalog(const CThermoCatalog &) = delete;
+	CThermoCatalog &operator=(const CThermoCatalog &) = delete;
+
+	~CThermoCatalog()
+	{
+		Close();
+	}
+
+	//	opens the database, created with its tables the first time
+	bool Open(const std::string &fileName)
+	{
+		Close();
+		if (sqlite3_open_v2(fileName.c_str(), &mDb, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) != SQLITE_OK) {
+			Fail("Cannot open " + fileName);
+			Close();
+			return false;
+		}
+		sqlite3_busy_timeout(mDb, 10000);
+		if (!Exec("PRAGMA journal_mode = WAL; PRAGMA synchronous = NORMAL; PRAGMA foreign_keys = ON;") ||
+			!Exec("CREATE TABLE IF NOT EXISTS recordings (id INTEGER PRIMARY KEY, path TEXT NOT NULL UNIQUE, name TEXT, "
+				"bytes INTEGER, mtime INTEGER, rows INTEGER, cols INTEGER, frames INTEGER, frameRate REAL, dataType TEXT, "
+				"indexed INTEGER);"
+			"CREATE TABLE IF NOT EXISTS metadata (recording INTEGER NOT NULL REFERENCES recordings(id) ON DELETE CASCADE, "
+				"key TEXT NOT NULL, value TEXT, number REAL, PRIMARY KEY (recording, key));"
+			"CREATE TABLE IF NOT EXISTS runs (id INTEGER PRIMARY KEY, recording INTEGER NOT NULL REFERENCES recordings(id) "
+				"ON DELETE CASCADE, kind TEXT NOT NULL, params TEXT NOT NULL, status TEXT, started INTEGER, seconds REAL);"
+			"CREATE TABLE IF NOT EXISTS params (run INTEGER NOT NULL REFERENCES runs(id) ON DELETE CASCADE, key TEXT NOT NULL, "
+				"value TEXT, number REAL, PRIMARY KEY (run, key));"
+			"CREATE TABLE IF NOT EXISTS results (run INTEGER NOT NULL REFERENCES runs(id) ON DELETE CASCADE, "
+				"name TEXT NOT NULL, value REAL, PRIMARY KEY (run, name));"
+			"CREATE INDEX IF NOT EXISTS runsByRecording ON runs (recording, kind, params);"
+			"CREATE INDEX IF NOT EXISTS paramsByValue ON params (key, number);"
+			"CREATE INDEX IF NOT EXISTS resultsByValue ON results (name, value);"
+			"CREATE INDEX IF NOT EXISTS metadataByValue ON metadata (key, number);")) {
+			std::string		message = mError;
+
+			Close();
+			mError = "Cannot create the catalog " + fileName + ": " + message;
+			return false;
+		}
+
+		return true;
+	}
+
+	void Close()
+	{
+		mStatements.clear();
+		if (mDb != NULL)
+			sqlite3_close(mDb);
+		mDb = NULL;
+	}
+
+	bool isOpen() const
+	{
+		return mDb != NULL;
+	}
+
+	bool Begin()
+	{
+		return Exec("BEGIN IMMEDIATE");
+	}
+
+	bool Commit()
+	{
+		return Exec("COMMIT");
+	}
+
+	void Rollback()
+	{
+		sqlite3_exec(mDb, "ROLLBACK", NULL, NULL, NULL);
+	}
+
+	//	true when the recording is indexed with this size and time, its id in id
+	bool IsIndexed(const std::string &path, int64_t bytes, int64_t mtime, int64_t &id)
+	{
+		CSqliteStatement	*select = Statement("SELECT id FROM recordings WHERE path = ? AND bytes = ? AND mtime = ? AND indexed IS NOT NULL");
+
+		if (select == NULL)
+			return false;
+		select->Bind(1, path).Bind(2, bytes).Bind(3, mtime);
+		if (select->Step() != SQLITE_ROW)
+			return false;
+		id = select->Integer(0);
+		select->Reset();
+
+		return true;
+	}
+
+	//	the id of the recording, a row with just path, size and time when it is not there yet
+	bool RecordingId(const std::string &path, int64_t &id)
+	{
+		CSqliteStatement	*select = Statement("SELECT id FROM recordings WHERE path = ?"), *insert;
+		int64_t				bytes = 0, mtime = 0;
+
+		if (select == NULL)
+			return false;
+		select->Bind(1, path);
+		if (select->Step() == SQLITE_ROW) {
+			id = select->Integer(0);
+			select->Reset();
+			return true;
+		}
+		insert = Statement("INSERT INTO recordings (path, name, bytes, mtime) VALUES (?, ?, ?, ?)");
+		if (insert == NULL)
+			return false;
+		CatalogFileStamp(path, bytes, mtime);
+		insert->Bind(1, path).Bind(2, path.substr(path.find_last_of("/\\") == std::string::npos ? 0 : path.find_last_of("/\\") + 1))
+			.Bind(3, bytes).Bind(4, mtime);
+		if (!Done(insert, "Cannot add the recording"))
+			return false;
+		id = (int64_t)sqlite3_last_insert_rowid(mDb);
+
+		return true;
+	}
+
+	//	adds or refreshes the recording and replaces its metadata, inside the caller's transaction
+	bool IndexRecording(const SCatalogRecording &recording, int64_t &id)
+	{
+		CSqliteStatement	*update, *clear, *insert;
+
+		if (!RecordingId(recording.path, id))
+			return false;
+		update = Statement("UPDATE recordings SET bytes = ?, mtime = ?, rows = ?, cols = ?, frames = ?, frameRate = ?, dataType = ?, "
+			"indexed = ? WHERE id = ?");
+		clear = Statement("DELETE FROM metadata WHERE recording = ?");
+		insert = Statement("INSERT INTO metadata (recording, key, value, number) VALUES (?, ?, ?, ?)");
+		if (update == NULL || clear == NULL || insert == NULL)
+			return false;
+		update->Bind(1, recording.bytes).Bind(2, recording.mtime).Bind(3, recording.rows).Bind(4, recording.cols)
+			.Bind(5, recording.frames).Bind(6, recording.frameRate).Bind(7, recording.dataType).Bind(8, (int64_t)time(NULL)).Bind(9, id);
+		if (!Done(update, "Cannot index the recording"))
+			return false;
+		clear->Bind(1, id);
+		if (!Done(clear, "Cannot index the recording"))
+			return false;
+		for (SCatalogParams::const_iterator it = recording.metadata.begin(); it != recording.metadata.end(); ++it) {
+			insert->Reset().Bind(1, id).Bind(2, it->first).Bind(3, it->second).BindNumber(4, it->second);
+			if (!Done(insert, "Cannot add the metadata"))
+				return false;
+		}
+
+		return true;
+	}
+
+	//	a run of kind on the recording with its parameters and scalar results, inside the caller's transaction
+	bool AddRun(const std::string &path, const std::string &kind, const SCatalogParams &params, const std::string &status,
+		double seconds, const std::map<std::string, double> &results, int64_t &runId)
+	{
+		int64_t				recording;
+		CSqliteStatement	*run, *param, *result;
+
+		if (!RecordingId(path, recording))
+			return false;
+		run = Statement("INSERT INTO runs (recording, kind, params, status, started, seconds) VALUES (?, ?, ?, ?, ?, ?)");
+		param = Statement("INSERT INTO params (run, key, value, number) VALUES (?, ?, ?, ?)");
+		result = Statement("INSERT INTO results (run, name, value) VALUES (?, ?, ?)");
+		if (run == NULL || param == NULL || result == NULL)
+			return false;
+		run->Bind(1, recording).Bind(2, kind).Bind(3, CatalogParamsKey(params)).Bind(4, status).Bind(5, (int64_t)time(NULL)).Bind(6, seconds);
+		if (!Done(run, "Cannot add the run"))
+			return false;
+		runId = (int64_t)sqlite3_last_insert_rowid(mDb);
+		for (SCatalogParams::const_iterator it = params.begin(); it != params.end(); ++it) {
+			param->Reset().Bind(1, runId).Bind(2, it->first).Bind(3, it->second).BindNumber(4, it->second);
+			if (!Done(param, "Cannot add the parameters"))
+				return false;
+		}
+		for (std::map<std::string, double>::const_iterator it = results.begin(); it != results.end(); ++it) {
+			result->Reset().Bind(1, runId).Bind(2, it->first).Bind(3, it->second);
+			if (!Done(result, "Cannot add the results"))
+				return false;
+		}
+
+		return true;
+	}
+
+	//	the latest run of kind with these parameters on the recording, if it ended with status (any status when empty)
+	bool FindRun(const std::string &path, const std::string &kind, const SCatalogParams &params, const std::string &status,
+		int64_t &runId, std::map<std::string, double> &results)
+	{
+		CSqliteStatement	*run = Statement("SELECT runs.id, runs.status FROM runs JOIN recordings ON recordings.id = runs.recording "
+			"WHERE recordings.path = ? AND runs.kind = ? AND runs.params = ? ORDER BY runs.id DESC LIMIT 1");
+		CSqliteStatement	*result;
+
+		results.clear();
+		if (run == NULL)
+			return false;
+		run->Bind(1, path).Bind(2, kind).Bind(3, CatalogParamsKey(params));
+		if (run->Step() != SQLITE_ROW || (!status.empty() && run->Text(1) != status)) {
+			run->Reset();
+			return false;
+		}
+		runId = run->Integer(0);
+		run->Reset();
+		result = Statement("SELECT name, value FROM results WHERE run = ?");
+		if (result == NULL)
+			return false;
+		result->Bind(1, runId);
+		while (result->Step() == SQLITE_ROW)
+			results[result->Text(0)] = result->Double(1);
+
+		return true;
+	}
+
+	//	any sql with ? bound to args in order (numbers when they parse as one), the column names and the rows
+	bool Query(const std::string &sql, const std::vector<std::string> &args, std::vector<std::string> &columns,
+		std::vector<std::vector<SCatalogValue>> &rows)
+	{
+		CSqliteStatement	*query = Statement(sql);
+		int					code;
+
+		columns.clear();
+		rows.clear();
+		if (query == NULL)
+			return false;
+		for (size_t i = 0; i < args.size(); ++i) {
+			char		*end = NULL;
+			double		number = strtod(args[i].c_str(), &end);
+
+			if (!args[i].empty() && end != NULL && *end == 0)
+				query->Bind((int)i + 1, number);
+			else
+				query->Bind((int)i + 1, args[i]);
+		}
+		for (int c = 0; c < query->columns(); ++c)
+			columns.push_back(query->name(c));
+		while ((code = query->Step()) == SQLITE_ROW) {
+			rows.emplace_back();
+			for (int c = 0; c < query->columns(); ++c)
+				rows.back().push_back(query->Value(c));
+		}
+		if (code != SQLITE_DONE) {
+			Fail("Query failed");
+			//	a one-off query should not stay prepared after an error
+			mStatements.erase(sql);
+			return false;
+		}
+
+		return true;
+	}
+
+	const std::string &error() const
+	{
+		return mError;
+	}
+};
@@ -0,0 +1,250 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "mex.h"
+#include "MexHelpers.h"
+#include "CatalogScanner.h"
+#include "ThermoBatch.h"
+#include <cctype>
+#include <set>
+
+//	mex ThermoCatalogMex.cpp -I%FILESDKDIR%include -L%FILESDKDIR%bin/x64/Release -ltc.lib -ltc.file.lib -ltc.reduce.lib -lsqlite3.lib
+//	(sqlite3.h of the sqlite amalgamation in the include path, sqlite3.lib made from sqlite3.dll with lib /def:sqlite3.def)
+
+//	h = ThermoCatalogMex('open', file)					the campaign catalog (ThermoCatalog.h), created the first time
+//	[n, errors] = ThermoCatalogMex('scan', h, files, force)	indexes the recordings (a pattern like D:\prove\*.ats or a
+//														cell of them) from their header, the ones already indexed and
+//														unchanged are skipped unless force. n are the ones read
+//	id = ThermoCatalogMex('addRun', h, file, kind, params, results, status, seconds)	a run on the recording, params and
+//														results are structs (numbers or strings, numbers), status 'ok'
+//														when omitted
+//	[results, id] = ThermoCatalogMex('findRun', h, file, kind, params)	results of the latest ok run with these
+//														parameters, [] when there is none
+//	T = ThermoCatalogMex('query', h, sql, args...)		struct array with a field per column, args bind the ? in order
+//	ThermoCatalogMex('delete', h)
+//
+//	e.g. all 2 Hz tests with Davg < 12 mm^2/s (see ThermoCatalog.h for the tables):
+//		T = struct2table(ThermoCatalogMex('query', h, ['SELECT rec.name, res.value AS Davg FROM runs ' ...
+//			'JOIN recordings rec ON rec.id = runs.recording JOIN params p ON p.run = runs.id AND p.key = ''freq'' ' ...
+//			'JOIN results res ON res.run = runs.id AND res.name = ''Davg'' WHERE p.number = ? AND res.value < ?'], 2, 12));
+
+class CMatThermoCatalog
+{
+private:
+	CThermoCatalog		mCatalog;
+
+	//	15 digits for parameters, so 0.1 is "0.1" like in ThermoBatch
+	static std::string Number(double value, int digits = 17)
+	{
+		char	text[32];
+
+		snprintf(text, sizeof(text), "%.*g", digits, value);
+
+		return text;
+	}
+
+	//	a struct of numbers and strings as key = value text
+	static SCatalogParams Params(const mxArray *params)
+	{
+		SCatalogParams	ret;
+
+		if (params == NULL || mxIsEmpty(params))
+			return ret;
+		if (!mxIsStruct(params) || mxGetNumberOfElements(params) != 1)
+			mexErrMsgTxt("params must be a scalar struct.");
+		for (int f = 0; f < mxGetNumberOfFields(params); ++f) {
+			const char		*name = mxGetFieldNameByNumber(params, f);
+			const mxArray	*value = mxGetFieldByNumber(params, 0, f);
+
+			ret[name] = value != NULL && mxIsChar(value) ? mxGetStdString(value, name) : Number(mxGetScalarInput(value, name), 15);
+		}
+
+		return ret;
+	}
+
+	//	a column name as a matlab field name, unique among names
+	static std::string FieldName(const std::string &column, std::set<std::string> &names)
+	{
+		std::string		base, name;
+
+		for (size_t i = 0; i < column.size() && base.size() < 56; ++i)
+			base += isalnum((unsigned char)column[i]) ? column[i] : '_';
+		if (base.empty() || !isalpha((unsigned char)base[0]))
+			base = "c" + base;
+		name = base;
+		for (int k = 2; names.count(name) != 0; ++k)
+			name = base + "_" + std::to_string(k);
+		names.insert(name);
+
+		return name;
+	}
+
+public:
+	bool Open(const std::string &fileName)
+	{
+		return mCatalog.Open(fileName);
+	}
+
+	const std::string &error() const
+	{
+		return mCatalog.error();
+	}
+
+	void Scan(const mxArray *files, bool force, int nlhs, mxArray *plhs[])
+	{
+		std::vector<std::string>	patterns, found;
+		std::string					errors;
+		size_t						numIndexed;
+
+		if (mxIsCell(files)) {
+			for (size_t i = 0; i < mxGetNumberOfElements(files); ++i)
+				patterns.push_back(mxGetStdString(mxGetCell(files, i), "files"));
+		}
+		else
+			patterns.push_back(mxGetStdString(files, "files"));
+		for (size_t i = 0; i < patterns.size(); ++i) {
+			std::vector<std::string>	list = ListFiles(patterns[i]);
+
+			found.insert(found.end(), list.begin(), list.end());
+		}
+		if (!ScanRecordings(mCatalog, found, force, numIndexed, errors) && nlhs < 2)
+			mexErrMsgTxt(errors.c_str());
+		plhs[0] = mxCreateDoubleScalar((double)numIndexed);
+		if (nlhs > 1)
+			plhs[1] = mxCreateString(errors.c_str());
+	}
+
+	mxArray *AddRun(const mxArray *file, const mxArray *kind, const mxArray *params, const mxArray *results,
+		const mxArray *status, const mxArray *seconds)
+	{
+		std::map<std::string, double>	values;
+		int64_t							runId;
+		//	converted before the transaction opens, a bad input must not leave it open
+		std::string						path = mxGetStdString(file, "file"), what = mxGetStdString(kind, "kind");
+		SCatalogParams					key = Params(params);
+		std::string						state = status != NULL ? mxGetStdString(status, "status") : std::string("ok");
+		double							elapsed = seconds != NULL ? mxGetScalarInput(seconds, "seconds") : NAN;
+
+		if (results != NULL && !mxIsEmpty(results)) {
+			if (!mxIsStruct(results) || mxGetNumberOfElements(results) != 1)
+				mexErrMsgTxt("results must be a scalar struct.");
+			for (int f = 0; f < mxGetNumberOfFields(results); ++f) {
+				const char		*name = mxGetFieldNameByNumber(results, f);
+
+				values[name] = mxGetScalarInput(mxGetFieldByNumber(results, 0, f), name);
+			}
+		}
+		if (!mCatalog.Begin() || !mCatalog.AddRun(path, what, key, state, elapsed, values, runId) || !mCatalog.Commit()) {
+			std::string		message = mCatalog.error();
+
+			mCatalog.Rollback();
+			mexErrMsgTxt(message.c_str());
+		}
+
+		return mxCreateDoubleScalar((double)runId);
+	}
+
+	void FindRun(const mxArray *file, const mxArray *kind, const mxArray *params, int nlhs, mxArray *plhs[])
+	{
+		std::map<std::string, double>	results;
+		std::vector<const char *>		fields;
+		int64_t							runId = -1;
+
+		if (!mCatalog.FindRun(mxGetStdString(file, "file"), mxGetStdString(kind, "kind"), Params(params), "ok", runId, results)) {
+			plhs[0] = mxCreateDoubleMatrix(0, 0, mxREAL);
+			if (nlhs > 1)
+				plhs[1] = mxCreateDoubleMatrix(0, 0, mxREAL);
+			return;
+		}
+		for (std::map<std::string, double>::const_iterator it = results.begin(); it != results.end(); ++it)
+			fields.push_back(it->first.c_str());
+		plhs[0] = mxCreateStructMatrix(1, 1, (int)fields.size(), fields.data());
+		for (size_t f = 0; f < fields.size(); ++f)
+			mxSetFieldByNumber(plhs[0], 0, (int)f, mxCreateDoubleScalar(results[fields[f]]));
+		if (nlhs > 1)
+			plhs[1] = mxCreateDoubleScalar((double)runId);
+	}
+
+	mxArray *Query(const mxArray *sql, int numArgs, const mxArray *args[])
+	{
+		std::vector<std::string>					bound, columns, names;
+		std::vector<std::vector<SCatalogValue>>		rows;
+		std::vector<const char *>					fields;
+		std::set<std::string>						used;
+		mxArray										*ret;
+
+		for (int i = 0; i < numArgs; ++i)
+			bound.push_back(mxIsChar(args[i]) ? mxGetStdString(args[i], "args") : Number(mxGetScalarInput(args[i], "args")));
+		if (!mCatalog.Query(mxGetStdString(sql, "sql"), bound, columns, rows))
+			mexErrMsgTxt(mCatalog.error().c_str());
+		for (size_t c = 0; c < columns.size(); ++c)
+			names.push_back(FieldName(columns[c], used));
+		for (size_t c = 0; c < names.size(); ++c)
+			fields.push_back(names[c].c_str());
+		ret = mxCreateStructMatrix(rows.size(), 1, (int)fields.size(), fields.data());
+		for (size_t r = 0; r < rows.size(); ++r)
+			for (size_t c = 0; c < columns.size(); ++c) {
+				const SCatalogValue		&value = rows[r][c];
+
+				if (value.type == SQLITE_INTEGER || value.type == SQLITE_FLOAT)
+					mxSetFieldByNumber(ret, r, (int)c, mxCreateDoubleScalar(value.number));
+				else if (value.type == SQLITE_TEXT)
+					mxSetFieldByNumber(ret, r, (int)c, mxCreateString(value.text.c_str()));
+				else
+					mxSetFieldByNumber(ret, r, (int)c, mxCreateDoubleMatrix(0, 0, mxREAL));
+			}
+
+		return ret;
+	}
+};
+
+//	the mex entry point
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	char				command[64];
+	CMatThermoCatalog	*catalog;
+
+	if (nrhs < 1 || mxGetString(prhs[0], command, sizeof(command)) != 0)
+		mexErrMsgTxt("First argument must be a command string.");
+
+	if (strcmp(command, "open") == 0) {
+		if (nlhs != 1 || nrhs != 2)
+			mexErrMsgTxt("Must have 2 inputs and 1 output.");
+		catalog = new CMatThermoCatalog;
+		if (!catalog->Open(mxGetStdString(prhs[1], "file"))) {
+			std::string		message = catalog->error();
+
+			delete catalog;
+			mexErrMsgTxt(message.c_str());
+		}
+		plhs[0] = WrapObject(catalog);
+		return;
+	}
+
+	if (nrhs < 2)
+		mexErrMsgTxt("Second argument must be a handle.");
+
+	catalog = GetObject<CMatThermoCatalog>(prhs[1]);		//	won't get past here if GetObject fails
+
+	if (strcmp(command, "delete") == 0) {
+		UnwrapObject<CMatThermoCatalog>(prhs[1]);
+		delete catalog;
+	} else if (strcmp(command, "scan") == 0) {
+		if (nlhs > 2 || nrhs < 3 || nrhs > 4)
+			mexErrMsgTxt("Must have 3-4 inputs and 0-2 outputs.");
+		catalog->Scan(prhs[2], nrhs > 3 && mxGetScalarInput(prhs[3], "force") != 0.0, nlhs, plhs);
+	} else if (strcmp(command, "addRun") == 0) {
+		if (nlhs > 1 || nrhs < 6 || nrhs > 8)
+			mexErrMsgTxt("Must have 6-8 inputs and 0-1 outputs.");
+		plhs[0] = catalog->AddRun(prhs[2], prhs[3], prhs[4], prhs[5], nrhs > 6 ? prhs[6] : NULL, nrhs > 7 ? prhs[7] : NULL);
+	} else if (strcmp(command, "findRun") == 0) {
+		if (nlhs > 2 || nrhs != 5)
+			mexErrMsgTxt("Must have 5 inputs and 0-2 outputs.");
+		catalog->FindRun(prhs[2], prhs[3], prhs[4], nlhs, plhs);
+	} else if (strcmp(command, "query") == 0) {
+		if (nlhs > 1 || nrhs < 3)
+			mexErrMsgTxt("Must have at least 3 inputs and 0-1 outputs.");
+		plhs[0] = catalog->Query(prhs[2], nrhs - 3, prhs + 3);
+	} else {
+		mexErrMsgTxt("Unknown command.");
+	}
+}
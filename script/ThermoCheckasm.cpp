@@ -0,0 +1,293 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "ThermoKernels.h"
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+
+#ifdef THERMO_KERNELS_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+//	cl /O2 /EHsc /std:c++17 ThermoCheckasm.cpp
+//	g++ -O3 -std=c++17 ThermoCheckasm.cpp -o ThermoCheckasm
+
+//	ThermoCheckasm [--bench] [--seed n] [--runs n] [kernel ...]
+//
+//	checks every simd variant of ThermoKernels.h against the scalar reference, after ffmpeg's tests/checkasm: random
+//	sizes (odd, for the tails) and data, pointers off alignment by one element, --runs (100) draws per kernel. levels
+//	the cpu lacks are skipped and a level that keeps the variant of the level below is not checked again. the
+//	transposes must match bit for bit, the lock-in kernels within a few ulp. --bench then times the reference and each
+//	variant on a 382 x 288 frame (the optris sensor) and prints cycles per element (rdtsc, nanoseconds where there is
+//	none). kernels: transposeF32 transposeU16 lockInMac lockInIirF32 lockInIirU16 (all by default). the exit code is
+//	the number of failures.
+
+struct SCheckKernel
+{
+	const char		*name;
+	const void		*(*variant)(const SThermoKernels &k);
+	bool			(*check)(const SThermoKernels &k, std::mt19937 &rng, std::string &message);
+	void			(*run)(const SThermoKernels &k, size_t width, size_t height);		//	one call on a width x height frame
+};
+
+//	buffers of the benchmark, filled once
+struct SBenchData
+{
+	std::vector<float>		f32;
+	std::vector<uint16_t>	u16;
+	std::vector<float>		dest;
+	std::vector<float>		planes[3];
+	std::vector<double>		sums[3];
+};
+
+static SBenchData	gBench;
+
+static double Ticks()
+{
+#ifdef THERMO_KERNELS_X86
+	return (double)__rdtsc();
+#else
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+//	true when a and b are within ulps float steps of the larger magnitude (or scale, if larger)
+static bool Near(double a, double b, double ulps, double epsilon, double scale)
+{
+	return fabs(a - b) <= ulps * epsilon * std::max(std::max(fabs(a), fabs(b)), scale);
+}
+
+template <typename kind>
+static void Fill(kind *data, size_t n, std::mt19937 &rng, double lo, double hi)
+{
+	std::uniform_real_distribution<double>	dist(lo, hi);
+
+	for (size_t i = 0; i < n; ++i)
+		data[i] = (kind)dist(rng);
+}
+
+template <typename kind>
+static bool CheckTranspose(void (*ref)(float *, const kind *, size_t, size_t), void (*test)(float *, const kind *, size_t, size_t),
+	std::mt19937 &rng, std::string &message, double hi)
+{
+	size_t					width = 1 + rng() % 67, height = 1 + rng() % 67;
+	std::vector<kind>		src(width * height + 1);
+	std::vector<float>		a(width * height + 1, -1.0f), b(width * height + 1, -1.0f);
+
+	Fill(src.data(), src.size(), rng, 0.0, hi);
+	ref(a.data() + 1, src.data() + 1, width, height);
+	test(b.data() + 1, src.data() + 1, width, height);
+	if (memcmp(a.data(), b.data(), a.size() * sizeof(float)) != 0) {
+		message = std::to_string(width) + " x " + std::to_string(height) + " differs";
+		return false;
+	}
+
+	return true;
+}
+
+static bool CheckMac(const SThermoKernels &k, std::mt19937 &rng, std::string &message)
+{
+	size_t					n = 1 + rng() % 1000;
+	std::vector<float>		x(n + 1);
+	std::vector<double>		a[3], b[3], start[3];
+	double					c = std::uniform_real_distribution<double>(-2.0, 2.0)(rng), s = std::uniform_real_distribution<double>(-2.0, 2.0)(rng);
+
+	Fill(x.data(), x.size(), rng, 20.0, 40.0);
+	for (size_t i = 0; i < 3; ++i) {
+		a[i].resize(n + 1);
+		Fill(a[i].data(), a[i].size(), rng, -1e4, 1e4);
+		b[i] = start[i] = a[i];
+	}
+	KernelLockInMac(x.data() + 1, n, c, s, a[0].data() + 1, a[1].data() + 1, a[2].data() + 1);
+	k.lockInMac(x.data() + 1, n, c, s, b[0].data() + 1, b[1].data() + 1, b[2].data() + 1);
+	for (size_t i = 0; i < 3; ++i) {
+		for (size_t p = 0; p <= n; ++p) {
+			//	a fused multiply-add rounds once, within an ulp of the terms however much they cancel
+			double		term = p > 0 ? fabs((double)x[p]) * std::max(fabs(c), fabs(s)) : 0.0;
+
+			if (!Near(a[i][p], b[i][p], 2.0, DBL_EPSILON, fabs(start[i][p]) + term)) {
+				message = "n " + std::to_string(n) + ", sum " + std::to_string(i) + " at " + std::to_string(p) + ": " + std::to_string(a[i][p]) +
+					" != " + std::to_string(b[i][p]);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+template <typename kind>
+static bool CheckIir(void (*test)(const kind *, size_t, float, float, float, float *, float *, float *), std::mt19937 &rng,
+	std::string &message, double hi)
+{
+	size_t					n = 1 + rng() % 1000;
+	std::vector<kind>		frame(n + 1);
+	std::vector<float>		a[3], b[3];
+	float					w = std::uniform_real_distribution<float>(0.0f, 1.0f)(rng);
+	float					c = std::uniform_real_distribution<float>(-2.0f, 2.0f)(rng), s = std::uniform_real_distribution<float>(-2.0f, 2.0f)(rng);
+
+	Fill(frame.data(), frame.size(), rng, 0.5 * hi, hi);
+	for (size_t i = 0; i < 3; ++i) {
+		a[i].resize(n + 1);
+		Fill(a[i].data(), a[i].size(), rng, i == 0 ? 0.5 * hi : -0.1 * hi, i == 0 ? hi : 0.1 * hi);
+		b[i] = a[i];
+	}
+	KernelLockInIir(frame.data() + 1, n, w, c, s, a[0].data() + 1, a[1].data() + 1, a[2].data() + 1);
+	test(frame.data() + 1, n, w, c, s, b[0].data() + 1, b[1].data() + 1, b[2].data() + 1);
+	for (size_t i = 0; i < 3; ++i) {
+		for (size_t p = 0; p <= n; ++p) {
+			//	X and Y are differences of terms of the size of the samples
+			if (!Near(a[i][p], b[i][p], 4.0, FLT_EPSILON, hi)) {
+				message = "n " + std::to_string(n) + ", plane " + std::to_string(i) + " at " + std::to_string(p) + ": " + std::to_string(a[i][p]) +
+					" != " + std::to_string(b[i][p]);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	bool						bench = false;
+	unsigned					seed = (unsigned)std::chrono::steady_clock::now().time_since_epoch().count();
+	size_t						runs = 100;
+	std::vector<std::string>	selected;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string		arg = argv[i];
+		bool			value = i + 1 < argc;
+
+		if (arg == "--bench")
+			bench = true;
+		else if (arg == "--seed" && value)
+			seed = (unsigned)strtoul(argv[++i], NULL, 10);
+		else if (arg == "--runs" && value)
+			runs = (size_t)atol(argv[++i]);
+		else if (arg.compare(0, 2, "--") == 0) {
+			fprintf(stderr, "unknown option %s\n", arg.c_str());
+			return -1;
+		}
+		else
+			selected.push_back(arg);
+	}
+
+	SCheckKernel	kernels[] = {
+		{ "transposeF32",
+			[](const SThermoKernels &k) { return (const void *)k.transposeF32; },
+			[](const SThermoKernels &k, std::mt19937 &rng, std::string &message) {
+				return CheckTranspose<float>(KernelTransposeF32, k.transposeF32, rng, message, 100.0);
+			},
+			[](const SThermoKernels &k, size_t width, size_t height) { k.transposeF32(gBench.dest.data(), gBench.f32.data(), width, height); } },
+		{ "transposeU16",
+			[](const SThermoKernels &k) { return (const void *)k.transposeU16; },
+			[](const SThermoKernels &k, std::mt19937 &rng, std::string &message) {
+				return CheckTranspose<uint16_t>(KernelTransposeU16, k.transposeU16, rng, message, 65535.0);
+			},
+			[](const SThermoKernels &k, size_t width, size_t height) { k.transposeU16(gBench.dest.data(), gBench.u16.data(), width, height); } },
+		{ "lockInMac",
+			[](const SThermoKernels &k) { return (const void *)k.lockInMac; },
+			CheckMac,
+			[](const SThermoKernels &k, size_t width, size_t height) {
+				k.lockInMac(gBench.f32.data(), width * height, 0.5, -1.2, gBench.sums[0].data(), gBench.sums[1].data(), gBench.sums[2].data());
+			} },
+		{ "lockInIirF32",
+			[](const SThermoKernels &k) { return (const void *)k.lockInIirF32; },
+			[](const SThermoKernels &k, std::mt19937 &rng, std::string &message) { return CheckIir<float>(k.lockInIirF32, rng, message, 40.0); },
+			[](const SThermoKernels &k, size_t width, size_t height) {
+				k.lockInIirF32(gBench.f32.data(), width * height, 0.01f, 0.5f, -1.2f, gBench.planes[0].data(), gBench.planes[1].data(),
+					gBench.planes[2].data());
+			} },
+		{ "lockInIirU16",
+			[](const SThermoKernels &k) { return (const void *)k.lockInIirU16; },
+			[](const SThermoKernels &k, std::mt19937 &rng, std::string &message) { return CheckIir<uint16_t>(k.lockInIirU16, rng, message, 65535.0); },
+			[](const SThermoKernels &k, size_t width, size_t height) {
+				k.lockInIirU16(gBench.u16.data(), width * height, 0.01f, 0.5f, -1.2f, gBench.planes[0].data(), gBench.planes[1].data(),
+					gBench.planes[2].data());
+			} },
+	};
+	size_t			numKernels = sizeof(kernels) / sizeof(kernels[0]);
+	EThermoSimd		detected = ThermoSimdDetect();
+	int				failures = 0, tests = 0;
+
+	printf("checkasm: cpu up to %s, dispatching %s, seed %u\n", ThermoSimdName(detected), ThermoSimdName(ThermoSimdLevel()), seed);
+
+	for (size_t i = 0; i < numKernels; ++i) {
+		if (!selected.empty() && std::find(selected.begin(), selected.end(), kernels[i].name) == selected.end())
+			continue;
+		for (int level = tsSse2; level <= (int)detected; ++level) {
+			SThermoKernels		k = ThermoKernelsFor((EThermoSimd)level);
+			std::mt19937		rng(seed);
+			std::string			message;
+			bool				ok = true;
+
+			if (kernels[i].variant(k) == kernels[i].variant(ThermoKernelsFor((EThermoSimd)(level - 1))))
+				continue;
+			for (size_t r = 0; r < runs && ok; ++r)
+				ok = kernels[i].check(k, rng, message);
+			++tests;
+			failures += ok ? 0 : 1;
+			printf(" - %-14s %-8s [%s]%s%s\n", kernels[i].name, ThermoSimdName((EThermoSimd)level), ok ? "OK" : "FAILED", ok ? "" : " ",
+				message.c_str());
+		}
+	}
+	if (failures == 0)
+		printf("checkasm: all %d tests passed\n", tests);
+	else
+		printf("checkasm: %d of %d tests FAILED\n", failures, tests);
+
+	if (bench) {
+		size_t			width = 382, height = 288, n = width * height;
+		std::mt19937	rng(seed);
+
+		gBench.f32.resize(n);
+		gBench.u16.resize(n);
+		gBench.dest.resize(n);
+		Fill(gBench.f32.data(), n, rng, 20.0, 40.0);
+		Fill(gBench.u16.data(), n, rng, 7000.0, 9000.0);
+		for (size_t k = 0; k < 3; ++k) {
+			gBench.planes[k].assign(n, 0.0f);
+			gBench.sums[k].assign(n, 0.0);
+		}
+
+		printf("\n%-14s %-8s %14s %8s\n", "kernel", "variant", "cycles/elem", "speedup");
+		for (size_t i = 0; i < numKernels; ++i) {
+			if (!selected.empty() && std::find(selected.begin(), selected.end(), kernels[i].name) == selected.end())
+				continue;
+
+			double		reference = NAN;
+
+			for (int level = tsScalar; level <= (int)detected; ++level) {
+				SThermoKernels		k = ThermoKernelsFor((EThermoSimd)level);
+				double				best = INFINITY;
+
+				if (level > tsScalar && kernels[i].variant(k) == kernels[i].variant(ThermoKernelsFor((EThermoSimd)(level - 1))))
+					continue;
+				kernels[i].run(k, width, height);
+				for (size_t r = 0; r < 50; ++r) {
+					double		start = Ticks();
+
+					kernels[i].run(k, width, height);
+					best = std::min(best, Ticks() - start);
+				}
+				best /= (double)n;
+				if (level == tsScalar)
+					reference = best;
+				printf("%-14s %-8s %14.3f %8.2f\n", kernels[i].name, ThermoSimdName((EThermoSimd)level), best, reference / best);
+			}
+		}
+	}
+
+	return failures;
+}
@@ -0,0 +1,554 @@
+#pragma once
+
+#include <vector>
+#include <list>
+#include <iterator>
+#include <string>
+#include <mutex>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//	frame cube within a memory budget
+//
+//	the frames (rows x cols elements of elementSize bytes, matlab column major) are kept in blocks of blockFrames
+//	frames. blocks live on the heap while the budget allows it; past it the least recently used block goes to a scratch
+//	file and every block from then on is reached through a memory mapped view of its part of the file, so resident
+//	blocks (heap or mapped) never take more than the budget and the rest is page cache the system can drop without
+//	swapping. views are mapped for sequential access and, when blocks are read in order, the next block is mapped
+//	ahead with a willneed hint so the disk reads overlap the work on the current one. the scratch file is opened
+//	deleted (unlinked, or delete on close on windows) and goes away with the cube or the process.
+//
+//	the cube grows as frames are written past its end. Acquire pins a block until Release; pinned blocks are never
+//	evicted, the budget is exceeded instead when all of them are pinned. failures return false (NULL) with error(),
+//	the cube never calls back into matlab.
+
+struct SThermoCubeParams
+{
+	size_t			rows;
+	size_t			cols;
+	size_t			elementSize;		//	bytes
+	size_t			blockFrames;		//	0, blocks of about 16 MB
+	size_t			budget;				//	bytes of resident blocks, 0 no limit
+	std::string		scratchDir;			//	empty, TMPDIR (the user temp folder on windows)
+};
+
+struct SThermoCubeStats
+{
+	size_t			residentBytes;
+	size_t			peakResidentBytes;
+	size_t			fileBytes;			//	size of the scratch file, 0 before the first spill
+	size_t			evictions;
+	size_t			maps;				//	views mapped, prefetches included
+	size_t			prefetches;
+};
+
+class CThermoCube
+{
+private:
+	enum EState
+	{
+		bsEmpty,			//	never written, reads as zeros
+		bsHeap,
+		bsMapped,
+		bsFile				//	on the scratch file only
+	};
+
+	struct SBlock
+	{
+		EState						state;
+		bool						onFile;			//	the file holds the block (or zeros where it never did)
+		char						*data;
+		int							pins;
+		std::list<size_t>::iterator	lru;
+	};
+
+	SThermoCubeParams		mParams;
+	size_t					mFrameBytes;
+	size_t					mBlockBytes;
+	size_t					mStride;			//	bytes per block in the file, a multiple of the mapping granularity
+	size_t					mNumFrames;
+	std::vector<SBlock>		mBlocks;
+	std::list<size_t>		mLru;				//	resident blocks, most recent first
+	size_t					mLast;				//	last block acquired, for the sequential prefetch
+	SThermoCubeStats		mStats;
+	std::mutex				mMutex;
+	std::string				mError;
+#ifdef _WIN32
+	HANDLE					mFile;
+	HANDLE					mMapping;
+#else
+	int						mFile;
+#endif
+
+	bool Fail(const std::string &message)
+	{
+		mError = message;
+
+		return false;
+	}
+
+	static size_t Granularity()
+	{
+#ifdef _WIN32
+		SYSTEM_INFO		info;
+
+		GetSystemInfo(&info);
+
+		return info.dwAllocationGranularity;
+#else
+		return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+	}
+
+	bool fileOpen() const
+	{
+#ifdef _WIN32
+		return mFile != INVALID_HANDLE_VALUE;
+#else
+		return mFile >= 0;
+#endif
+	}
+
+	bool OpenFile()
+	{
+		std::string		dir = mParams.scratchDir;
+
+#ifdef _WIN32
+		char			path[MAX_PATH];
+
+		if (dir.empty()) {
+			if (GetTempPathA(MAX_PATH, path) == 0)
+				return Fail("Cannot find the temp folder.");
+			dir = path;
+		}
+		if (GetTempFileNameA(dir.c_str(), "tcb", 0, path) == 0)
+			return Fail("Cannot create a scratch file in " + dir + ".");
+		mFile = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+			FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+		if (mFile == INVALID_HANDLE_VALUE)
+			return Fail("Cannot create a scratch file in " + dir + ".");
+#else
+		if (dir.empty())
+			dir = getenv("TMPDIR") != NULL && getenv("TMPDIR")[0] != 0 ? getenv("TMPDIR") : "/tmp";
+
+		std::string			name = dir + "/thermocube-XXXXXX";
+		std::vector<char>	path(name.begin(), name.end());
+
+		path.push_back(0);
+		mFile = mkstemp(path.data());
+		if (mFile < 0)
+			return Fail("Cannot create a scratch file in " + dir + ".");
+		unlink(path.data());
+#endif
+
+		return true;
+	}
+
+	//	the file covers numBlocks blocks, grown by halves to keep the remaps few
+	bool GrowFile(size_t numBlocks)
+	{
+		size_t		bytes = numBlocks * mStride;
+
+		if (!fileOpen() && !OpenFile())
+			return false;
+		if (bytes <= mStats.fileBytes)
+			return true;
+		bytes = std::max(bytes, mStats.fileBytes + mStats.fileBytes / 2);
+
+#ifdef _WIN32
+		LARGE_INTEGER	size;
+
+		size.QuadPart = (LONGLONG)bytes;
+		if (!SetFilePointerEx(mFile, size, NULL, FILE_BEGIN) || !SetEndOfFile(mFile))
+			return Fail("Cannot grow the scratch file, is the disk full?");
+		//	views keep the mapping they come from alive, a new one covers the new size
+		if (mMapping != NULL)
+			CloseHandle(mMapping);
+		mMapping = CreateFileMappingA(mFile, NULL, PAGE_READWRITE, (DWORD)(bytes >> 32), (DWORD)bytes, NULL);
+		if (mMapping == NULL)
+			return Fail("Cannot map the scratch file.");
+#else
+		if (ftruncate(mFile, (off_t)bytes) != 0)
+			return Fail("Cannot grow the scratch file, is the disk full?");
+#endif
+		mStats.fileBytes = bytes;
+
+		return true;
+	}
+
+	char *MapView(size_t block)
+	{
+		uint64_t	offset = (uint64_t)block * mStride;
+
+		++mStats.maps;
+#ifdef _WIN32
+		return (char *)MapViewOfFile(mMapping, FILE_MAP_ALL_ACCESS, (DWORD)(offset >> 32), (DWORD)offset, mBlockBytes);
+#else
+		void		*view = mmap(NULL, mBlockBytes, PROT_READ | PROT_WRITE, MAP_SHARED, mFile, (off_t)offset);
+
+		if (view == MAP_FAILED)
+			return NULL;
+		madvise(view, mBlockBytes, MADV_SEQUENTIAL);
+
+		return (char *)view;
+#endif
+	}
+
+	void UnmapView(char *view)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(view);
+#else
+		//	dirty pages stay in the page cache and the system writes them back in its own time
+		munmap(view, mBlockBytes);
+#endif
+	}
+
+	void Touch(size_t block)
+	{
+		mLru.splice(mLru.begin(), mLru, mBlocks[block].lru);
+	}
+
+	void MakeResident(size_t block, EState state, char *data)
+	{
+		SBlock		&b = mBlocks[block];
+
+		b.state = state;
+		b.data = data;
+		mLru.push_front(block);
+		b.lru = mLru.begin();
+		mStats.residentBytes += mBlockBytes;
+		mStats.peakResidentBytes = std::max(mStats.peakResidentBytes, mStats.residentBytes);
+	}
+
+	bool Evict(size_t block)
+	{
+		SBlock		&b = mBlocks[block];
+
+		if (b.state == bsHeap) {
+			char		*view;
+
+			if (!GrowFile(mBlocks.size()) || (view = MapView(block)) == NULL)
+				return Fail("Cannot spill a block to the scratch file.");
+			memcpy(view, b.data, mBlockBytes);
+			UnmapView(view);
+			free(b.data);
+		}
+		else
+			UnmapView(b.data);
+		mLru.erase(b.lru);
+		b.state = bsFile;
+		b.onFile = true;
+		b.data = NULL;
+		mStats.residentBytes -= mBlockBytes;
+		++mStats.evictions;
+
+		return true;
+	}
+
+	//	evicts least recently used blocks until bytes more fit in the budget, false only on a failed spill
+	bool MakeRoom(size_t bytes)
+	{
+		if (mParams.budget == 0)
+			return true;
+
+		std::list<size_t>::iterator		it = mLru.end();
+
+		while (mStats.residentBytes + bytes > mParams.budget && it != mLru.begin()) {
+			size_t		block = *--it;
+
+			if (mBlocks[block].pins > 0)
+				continue;
+			++it;
+			if (!Evict(block))
+				return false;
+		}
+
+		return true;
+	}
+
+	bool Load(size_t block)
+	{
+		SBlock		&b = mBlocks[block];
+		char		*data;
+
+		if (!MakeRoom(mBlockBytes))
+			return false;
+		//	the heap while nothing has gone to the file and the budget allows it, a view from then on
+		if (!b.onFile && !fileOpen() && (mParams.budget == 0 || mStats.residentBytes + mBlockBytes <= mParams.budget)) {
+			data = (char *)calloc(1, mBlockBytes);
+			if (data == NULL)
+				return Fail("Out of memory.");
+			MakeResident(block, bsHeap, data);
+			return true;
+		}
+		if (!GrowFile(mBlocks.size()) || (data = MapView(block)) == NULL)
+			return Fail("Cannot map a block of the scratch file.");
+		b.onFile = true;
+		MakeResident(block, bsMapped, data);
+
+		return true;
+	}
+
+	//	maps the block after a sequential read ahead of time, the one being read is pinned and stays
+	void Prefetch(size_t block)
+	{
+		SBlock		&b = mBlocks[block];
+		char		*data;
+
+		if (b.state != bsFile || !MakeRoom(mBlockBytes) ||
+			(mParams.budget != 0 && mStats.residentBytes + mBlockBytes > mParams.budget) || (data = MapView(block)) == NULL)
+			return;
+#ifdef _WIN32
+#if _WIN32_WINNT >= 0x0602
+		WIN32_MEMORY_RANGE_ENTRY	range = { data, mBlockBytes };
+
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+#else
+		madvise(data, mBlockBytes, MADV_WILLNEED);
+#endif
+		MakeResident(block, bsMapped, data);
+		//	behind the block being read, so it is not the next to go
+		if (mLru.size() > 1)
+			mLru.splice(std::next(mLru.begin(), 2), mLru, b.lru);
+		++mStats.prefetches;
+	}
+
+	template <class kfn>
+	bool ForFrames(size_t first, size_t count, bool write, kfn fn)
+	{
+		size_t		done = 0;
+
+		while (done < count) {
+			size_t		frame = first + done, block = frame / mParams.blockFrames, offset = frame % mParams.blockFrames;
+			size_t		n = std::min(count - done, mParams.blockFrames - offset);
+			char		*data = (char *)Acquire(block, write);
+
+			if (data == NULL)
+				return false;
+			fn(data + offset * mFrameBytes, done, n);
+			Release(block);
+			done += n;
+		}
+
+		return true;
+	}
+
+public:
+	CThermoCube() :
+		mFrameBytes(0),
+		mBlockBytes(0),
+		mStride(0),
+		mNumFrames(0),
+		mLast(SIZE_MAX),
+#ifdef _WIN32
+		mFile(INVALID_HANDLE_VALUE),
+		mMapping(NULL)
+#else
+		mFile(-1)
+#endif
+	{
+		memset(&mStats, 0, sizeof(mStats));
+	}
+
+	~CThermoCube()
+	{
+		Close();
+	}
+
+	bool Open(const SThermoCubeParams &params)
+	{
+		Close();
+		mParams = params;
+		mFrameBytes = params.rows * params.cols * params.elementSize;
+		if (mFrameBytes == 0)
+			return Fail("Need frames of at least one element.");
+		if (mParams.blockFrames == 0)
+			mParams.blockFrames = std::max<size_t>(1, (16 << 20) / mFrameBytes);
+		mBlockBytes = mParams.blockFrames * mFrameBytes;
+
+		size_t		granularity = Granularity();
+
+		mStride = (mBlockBytes + granularity - 1) / granularity * granularity;
+		mError.clear();
+
+		return true;
+	}
+
+	void Close()
+	{
+		for (size_t i = 0; i < mBlocks.size(); ++i) {
+			if (mBlocks[i].state == bsHeap)
+				free(mBlocks[i].data);
+			else if (mBlocks[i].state == bsMapped) {
+#ifdef _WIN32
+				UnmapViewOfFile(mBlocks[i].data);
+#else
+				munmap(mBlocks[i].data, mBlockBytes);
+#endif
+			}
+		}
+		mBlocks.clear();
+		mLru.clear();
+#ifdef _WIN32
+		if (mMapping != NULL)
+			CloseHandle(mMapping);
+		if (mFile != INVALID_HANDLE_VALUE)
+			CloseHandle(mFile);
+		mMapping = NULL;
+		mFile = INVALID_HANDLE_VALUE;
+#else
+		if (mFile >= 0)
+			close(mFile);
+		mFile = -1;
+#endif
+		mNumFrames = 0;
+		mLast = SIZE_MAX;
+		memset(&mStats, 0, sizeof(mStats));
+	}
+
+	size_t rows() const
+	{
+		return mParams.rows;
+	}
+
+	size_t cols() const
+	{
+		return mParams.cols;
+	}
+
+	size_t elementSize() const
+	{
+		return mParams.elementSize;
+	}
+
+	size_t blockFrames() const
+	{
+		return mParams.blockFrames;
+	}
+
+	size_t numFrames() const
+	{
+		return mNumFrames;
+	}
+
+	size_t numBlocks() const
+	{
+		return mBlocks.size();
+	}
+
+	SThermoCubeStats stats()
+	{
+		std::lock_guard<std::mutex>		lock(mMutex);
+
+		return mStats;
+	}
+
+	const std::string &error() const
+	{
+		return mError;
+	}
+
+	//	pins the block and returns its blockFrames frames, NULL on failure. write lets the cube grow to the block, frames
+	//	written through the pointer count once SetNumFrames (or Write) covers them
+	void *Acquire(size_t block, bool write = false)
+	{
+		std::lock_guard<std::mutex>		lock(mMutex);
+
+		if (block >= mBlocks.size()) {
+			if (!write) {
+				Fail("Block past the end of the cube.");
+				return NULL;
+			}
+
+			SBlock		empty = { bsEmpty, false, NULL, 0, mLru.end() };
+
+			mBlocks.resize(block + 1, empty);
+		}
+
+		SBlock		&b = mBlocks[block];
+
+		if (b.state == bsHeap || b.state == bsMapped)
+			Touch(block);
+		else if (!Load(block))
+			return NULL;
+		++b.pins;
+		if (block == mLast + 1 && block + 1 < mBlocks.size())
+			Prefetch(block + 1);
+		mLast = block;
+
+		return b.data;
+	}
+
+	void Release(size_t block)
+	{
+		std::lock_guard<std::mutex>		lock(mMutex);
+
+		if (block < mBlocks.size() && mBlocks[block].pins > 0)
+			--mBlocks[block].pins;
+	}
+
+	void SetNumFrames(size_t numFrames)
+	{
+		std::lock_guard<std::mutex>		lock(mMutex);
+
+		mNumFrames = std::max(mNumFrames, numFrames);
+	}
+
+	//	count frames from first (0 based), the cube grows to hold them
+	bool Write(size_t first, size_t count, const void *frames)
+	{
+		const char		*src = (const char *)frames;
+
+		if (!ForFrames(first, count, true, [&](char *dst, size_t done, size_t n) {
+			memcpy(dst, src + done * mFrameBytes, n * mFrameBytes);
+		}))
+			return false;
+		SetNumFrames(first + count);
+
+		return true;
+	}
+
+	bool Read(size_t first, size_t count, void *frames)
+	{
+		char		*dst = (char *)frames;
+
+		if (first + count > mNumFrames)
+			return Fail("Frames past the end of the cube.");
+
+		return ForFrames(first, count, false, [&](const char *src, size_t done, size_t n) {
+			memcpy(dst + done * mFrameBytes, src, n * mFrameBytes);
+		});
+	}
+
+	//	the numFrames values of one pixel (column major index), one element each
+	bool ReadPixel(size_t pixel, void *values)
+	{
+		char		*dst = (char *)values;
+		size_t		size = mParams.elementSize;
+
+		if (pixel >= mParams.rows * mParams.cols)
+			return Fail("Pixel outside the frame.");
+
+		return ForFrames(0, mNumFrames, false, [&](const char *src, size_t done, size_t n) {
+			for (size_t f = 0; f < n; ++f)
+				memcpy(dst + (done + f) * size, src + f * mFrameBytes + pixel * size, size);
+		});
+	}
+};
@@ -0,0 +1,200 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "mex.h"
+#include "MexHelpers.h"
+#include "ThermoCube.h"
+#include <cmath>
+
+//	mex ThermoCubeMex.cpp
+
+//	h = ThermoCubeMex('new', rows, cols, opts)		empty cube. opts (optional): class ('double', 'single', 'uint16' or
+//													'int16'), memory [MB] of resident frames (1024, 0 no limit),
+//													blockFrames (0, blocks of about 16 MB), scratchDir (the temp folder)
+//	ThermoCubeMex('write', h, first, frames)		frames rows x cols x n of the cube class from frame first (1 based),
+//													the cube grows to hold them
+//	frames = ThermoCubeMex('read', h, first, count)	count frames from first
+//	v = ThermoCubeMex('pixel', h, r, c)				numFrames x 1 time series of a pixel
+//	info = ThermoCubeMex('info', h)					rows, cols, numFrames, class, blockFrames, residentMB, peakMB (of
+//													resident frames), scratchMB (size of the scratch file), evictions
+//	ThermoCubeMex('delete', h)
+//
+//	frames past the budget go to a scratch file, memory mapped, see ThermoCube.h
+
+class CMatThermoCube
+{
+private:
+	mxClassID		mClass;
+	CThermoCube		mCube;
+
+public:
+	CMatThermoCube(mxClassID classId) :
+		mClass(classId)
+	{
+	}
+
+	CThermoCube &cube()
+	{
+		return mCube;
+	}
+
+	void Write(const mxArray *first, const mxArray *frames)
+	{
+		const mwSize	*dims = mxGetDimensions(frames);
+		size_t			framePixels = mCube.rows() * mCube.cols();
+		size_t			numFrames = mxGetNumberOfElements(frames) / framePixels;
+		double			start = mxGetScalarInput(first, "first");
+
+		if (dims[0] != mCube.rows() || dims[1] != mCube.cols() || numFrames * framePixels != mxGetNumberOfElements(frames))
+			mexErrMsgTxt("Frames do not match the cube size.");
+		if (mxGetClassID(frames) != mClass || mxIsComplex(frames))
+			mexErrMsgTxt("Frames must be real and of the cube class.");
+		if (!(start >= 1.0) || start != floor(start))
+			mexErrMsgTxt("first must be a frame index, 1 based.");
+		if (!mCube.Write((size_t)start - 1, numFrames, mxGetData(frames)))
+			mexErrMsgTxt(mCube.error().c_str());
+	}
+
+	mxArray *Read(const mxArray *first, const mxArray *count)
+	{
+		double		start = mxGetScalarInput(first, "first"), n = mxGetScalarInput(count, "count");
+		mwSize		dims[3] = { mCube.rows(), mCube.cols(), 0 };
+		mxArray		*ret;
+
+		if (!(start >= 1.0) || !(n >= 0.0) || start != floor(start) || n != floor(n) || start - 1.0 + n > (double)mCube.numFrames())
+			mexErrMsgTxt("Frames past the end of the cube.");
+		dims[2] = (mwSize)n;
+		ret = mxCreateNumericArray(3, dims, mClass, mxREAL);
+		if (!mCube.Read((size_t)start - 1, (size_t)n, mxGetData(ret)))
+			mexErrMsgTxt(mCube.error().c_str());
+
+		return ret;
+	}
+
+	mxArray *Pixel(const mxArray *row, const mxArray *col)
+	{
+		double		r = mxGetScalarInput(row, "r"), c = mxGetScalarInput(col, "c");
+		mxArray		*ret;
+
+		if (!(r >= 1.0) || !(c >= 1.0) || r > (double)mCube.rows() || c > (double)mCube.cols())
+			mexErrMsgTxt("Pixel outside the frame.");
+		ret = mxCreateNumericMatrix(mCube.numFrames(), 1, mClass, mxREAL);
+		if (!mCube.ReadPixel(((size_t)c - 1) * mCube.rows() + (size_t)r - 1, mxGetData(ret)))
+			mexErrMsgTxt(mCube.error().c_str());
+
+		return ret;
+	}
+
+	mxArray *info()
+	{
+		const char			*fields[] = { "rows", "cols", "numFrames", "class", "blockFrames", "residentMB", "peakMB", "scratchMB",
+								"evictions" };
+		mxArray				*ret = mxCreateStructMatrix(1, 1, sizeof(fields) / sizeof(fields[0]), fields);
+		SThermoCubeStats	stats = mCube.stats();
+		double				mb = 1024.0 * 1024.0;
+
+		mxSetFieldByNumber(ret, 0, 0, mxCreateDoubleScalar((double)mCube.rows()));
+		mxSetFieldByNumber(ret, 0, 1, mxCreateDoubleScalar((double)mCube.cols()));
+		mxSetFieldByNumber(ret, 0, 2, mxCreateDoubleScalar((double)mCube.numFrames()));
+		mxSetFieldByNumber(ret, 0, 3, mxCreateString(ClassName(mClass)));
+		mxSetFieldByNumber(ret, 0, 4, mxCreateDoubleScalar((double)mCube.blockFrames()));
+		mxSetFieldByNumber(ret, 0, 5, mxCreateDoubleScalar((double)stats.residentBytes / mb));
+		mxSetFieldByNumber(ret, 0, 6, mxCreateDoubleScalar((double)stats.peakResidentBytes / mb));
+		mxSetFieldByNumber(ret, 0, 7, mxCreateDoubleScalar((double)stats.fileBytes / mb));
+		mxSetFieldByNumber(ret, 0, 8, mxCreateDoubleScalar((double)stats.evictions));
+
+		return ret;
+	}
+
+	static const char *ClassName(mxClassID classId)
+	{
+		switch (classId) {
+			case mxDOUBLE_CLASS:
+				return "double";
+			case mxSINGLE_CLASS:
+				return "single";
+			case mxUINT16_CLASS:
+				return "uint16";
+			default:
+				return "int16";
+		}
+	}
+};
+
+//	the mex entry point
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	char			command[64];
+	CMatThermoCube	*cube;
+
+	if (nrhs < 1 || mxGetString(prhs[0], command, sizeof(command)) != 0)
+		mexErrMsgTxt("First argument must be a command string.");
+
+	if (strcmp(command, "new") == 0) {
+		if (nlhs != 1 || nrhs < 3 || nrhs > 4)
+			mexErrMsgTxt("Must have 3-4 inputs and 1 output.");
+
+		const mxArray			*opts = nrhs > 3 ? prhs[3] : NULL;
+		std::string				className = mxGetOption(opts, "class", "double");
+		double					memory = mxGetOption(opts, "memory", 1024.0);
+		SThermoCubeParams		params;
+		mxClassID				classId;
+
+		if (className == "double")
+			classId = mxDOUBLE_CLASS;
+		else if (className == "single")
+			classId = mxSINGLE_CLASS;
+		else if (className == "uint16")
+			classId = mxUINT16_CLASS;
+		else if (className == "int16")
+			classId = mxINT16_CLASS;
+		else
+			mexErrMsgTxt("class must be 'double', 'single', 'uint16' or 'int16'.");
+		if (!(memory >= 0.0))
+			mexErrMsgTxt("memory must not be negative.");
+
+		params.rows = (size_t)mxGetScalarInput(prhs[1], "rows");
+		params.cols = (size_t)mxGetScalarInput(prhs[2], "cols");
+		params.elementSize = classId == mxDOUBLE_CLASS ? 8 : classId == mxSINGLE_CLASS ? 4 : 2;
+		params.blockFrames = (size_t)mxGetOption(opts, "blockFrames", 0.0);
+		params.budget = (size_t)(memory * 1024.0 * 1024.0);
+		params.scratchDir = mxGetOption(opts, "scratchDir", "");
+
+		cube = new CMatThermoCube(classId);
+		if (!cube->cube().Open(params)) {
+			std::string		message = cube->cube().error();
+
+			delete cube;
+			mexErrMsgTxt(message.c_str());
+		}
+		plhs[0] = WrapObject(cube);
+		return;
+	}
+
+	if (nrhs < 2)
+		mexErrMsgTxt("Second argument must be a handle.");
+
+	cube = GetObject<CMatThermoCube>(prhs[1]);		//	won't get past here if GetObject fails
+
+	if (strcmp(command, "delete") == 0) {
+		UnwrapObject<CMatThermoCube>(prhs[1]);
+		delete cube;
+	} else if (strcmp(command, "write") == 0) {
+		if (nlhs != 0 || nrhs != 4)
+			mexErrMsgTxt("Must have 4 inputs and 0 outputs.");
+		cube->Write(prhs[2], prhs[3]);
+	} else if (strcmp(command, "read") == 0) {
+		if (nlhs != 1 || nrhs != 4)
+			mexErrMsgTxt("Must have 4 inputs and 1 outputs.");
+		plhs[0] = cube->Read(prhs[2], prhs[3]);
+	} else if (strcmp(command, "pixel") == 0) {
+		if (nlhs != 1 || nrhs != 4)
+			mexErrMsgTxt("Must have 4 inputs and 1 outputs.");
+		plhs[0] = cube->Pixel(prhs[2], prhs[3]);
+	} else if (strcmp(command, "info") == 0) {
+		if (nlhs != 1 || nrhs != 2)
+			mexErrMsgTxt("Must have 2 inputs and 1 outputs.");
+		plhs[0] = cube->info();
+	} else {
+		mexErrMsgTxt("Unknown command.");
+	}
+}
@@ -0,0 +1,538 @@
+#pragma once
+
+//	include before anything that pulls in windows.h, winsock2.h has to come first
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <afunix.h>
+#include <windows.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#endif
+
+#include <string>
+#include <map>
+#include <vector>
+#include <atomic>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+
+//	local ipc of the analysis server (ThermoServer.h)
+//
+//	a unix domain socket (AF_UNIX, on windows from 10 1803) carries small text messages and bulk data goes through
+//	named shared memory, written once by the server and mapped read only by every client that asks for it. a message
+//	is an 8 byte header (magic, body size) and a text body: the command, or "ok" / "error <message>" in a reply, on the
+//	first line, then key=value lines (values without newlines).
+
+struct SIpcMessage
+{
+	std::string							command;
+	std::map<std::string, std::string>	fields;
+
+	SIpcMessage(const std::string &cmd = "") :
+		command(cmd)
+	{
+	}
+
+	bool Has(const std::string &key) const
+	{
+		return fields.count(key) != 0;
+	}
+
+	std::string Get(const std::string &key, const std::string &def = "") const
+	{
+		std::map<std::string, std::string>::const_iterator	it = fields.find(key);
+
+		return it == fields.end() ? def : it->second;
+	}
+
+	double GetNumber(const std::string &key, double def) const
+	{
+		std::map<std::string, std::string>::const_iterator	it = fields.find(key);
+
+		return it == fields.end() || it->second.empty() ? def : atof(it->second.c_str());
+	}
+
+	void Set(const std::string &key, const std::string &value)
+	{
+		fields[key] = value;
+	}
+
+	void Set(const std::string &key, double value)
+	{
+		char	text[32];
+
+		snprintf(text, sizeof(text), "%.17g", value);
+		fields[key] = text;
+	}
+
+	bool ok() const
+	{
+		return command == "ok";
+	}
+
+	//	the message of an error reply
+	std::string error() const
+	{
+		return command.compare(0, 6, "error ") == 0 ? command.substr(6) : command;
+	}
+
+	std::string Serialize() const
+	{
+		std::string		text = command + "\n";
+
+		for (std::map<std::string, std::string>::const_iterator it = fields.begin(); it != fields.end(); ++it)
+			text += it->first + "=" + it->second + "\n";
+
+		return text;
+	}
+
+	bool Parse(const std::string &text)
+	{
+		size_t		start = 0, end;
+
+		fields.clear();
+		end = text.find('\n');
+		if (end == std::string::npos)
+			return false;
+		command = text.substr(0, end);
+		for (start = end + 1; start < text.size(); start = end + 1) {
+			size_t		eq;
+
+			end = text.find('\n', start);
+			if (end == std::string::npos)
+				end = text.size();
+			eq = text.find('=', start);
+			if (eq == std::string::npos || eq > end)
+				return false;
+			fields[text.substr(start, eq - start)] = text.substr(eq + 1, end - eq - 1);
+		}
+
+		return true;
+	}
+};
+
+//	THERMO_SERVER, or thermo-server.sock in the temp folder
+inline std::string ThermoServerPath()
+{
+	const char		*env = getenv("THERMO_SERVER");
+
+	if (env != NULL && env[0] != 0)
+		return env;
+#ifdef _WIN32
+	char			dir[MAX_PATH];
+
+	if (GetTempPathA(MAX_PATH, dir) == 0)
+		return "thermo-server.sock";
+
+	return std::string(dir) + "thermo-server.sock";
+#else
+	const char		*tmp = getenv("TMPDIR");
+
+	return std::string(tmp != NULL && tmp[0] != 0 ? tmp : "/tmp") + "/thermo-server.sock";
+#endif
+}
+
+class CIpcSocket
+{
+private:
+#ifdef _WIN32
+	typedef SOCKET	socket_t;
+	static socket_t invalid()
+	{
+		return INVALID_SOCKET;
+	}
+#else
+	typedef int		socket_t;
+	static socket_t invalid()
+	{
+		return -1;
+	}
+#endif
+
+	static const uint32_t	kMagic = 0x56525354;	//	TSRV
+	static const uint32_t	kMaxBody = 1 << 20;
+
+	socket_t		mSocket;
+
+	static bool Startup()
+	{
+#ifdef _WIN32
+		static bool		started = false;
+		WSADATA			data;
+
+		if (!started)
+			started = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+
+		return started;
+#else
+		return true;
+#endif
+	}
+
+	static bool Address(const std::string &path, sockaddr_un &addr, std::string &error)
+	{
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(addr.sun_path)) {
+			error = "Socket path too long: " + path + ".";
+			return false;
+		}
+		memcpy(addr.sun_path, path.c_str(), path.size());
+
+		return true;
+	}
+
+	bool SendAll(const char *data, size_t size)
+	{
+		while (size > 0) {
+#ifdef _WIN32
+			int		n = send(mSocket, data, (int)std::min<size_t>(size, 1 << 30), 0);
+#else
+			ssize_t	n = send(mSocket, data, size, MSG_NOSIGNAL);
+#endif
+			if (n <= 0)
+				return false;
+			data += n;
+			size -= (size_t)n;
+		}
+
+		return true;
+	}
+
+	bool ReceiveAll(char *data, size_t size)
+	{
+		while (size > 0) {
+#ifdef _WIN32
+			int		n = recv(mSocket, data, (int)std::min<size_t>(size, 1 << 30), 0);
+#else
+			ssize_t	n = recv(mSocket, data, size, 0);
+#endif
+			if (n <= 0)
+				return false;
+			data += n;
+			size -= (size_t)n;
+		}
+
+		return true;
+	}
+
+	//	true when readable (or closed) within timeoutMs
+	bool Wait(int timeoutMs)
+	{
+#ifdef _WIN32
+		WSAPOLLFD		fd = { mSocket, POLLRDNORM, 0 };
+
+		return WSAPoll(&fd, 1, timeoutMs) > 0;
+#else
+		pollfd			fd = { mSocket, POLLIN, 0 };
+
+		return poll(&fd, 1, timeoutMs) > 0;
+#endif
+	}
+
+public:
+	CIpcSocket() :
+		mSocket(invalid())
+	{
+	}
+
+	CIpcSocket(CIpcSocket &&other) :
+		mSocket(other.mSocket)
+	{
+		other.mSocket = invalid();
+	}
+
+	CIpcSocket &operator=(CIpcSocket &&other)
+	{
+		if (this != &other) {
+			Close();
+			mSocket = other.mSocket;
+			other.mSocket = invalid();
+		}
+
+		return *this;
+	}
+
+	CIpcSocket(const CIpcSocket &) = delete;
+	CIpcSocket &operator=(const CIpcSocket &) = delete;
+
+	~CIpcSocket()
+	{
+		Close();
+	}
+
+	bool valid() const
+	{
+		return mSocket != invalid();
+	}
+
+	void Close()
+	{
+		if (!valid())
+			return;
+#ifdef _WIN32
+		closesocket(mSocket);
+#else
+		close(mSocket);
+#endif
+		mSocket = invalid();
+	}
+
+	//	fails when a server already answers on path, a socket file left by one that died is replaced
+	bool Listen(const std::string &path, std::string &error)
+	{
+		sockaddr_un		addr;
+		CIpcSocket		probe;
+		std::string		ignored;
+
+		if (!Startup() || !Address(path, addr, error))
+			return false;
+		if (probe.Connect(path, ignored)) {
+			error = "A server is already running on " + path + ".";
+			return false;
+		}
+		Close();
+		mSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (!valid()) {
+			error = "Cannot create a socket.";
+			return false;
+		}
+#ifdef _WIN32
+		DeleteFileA(path.c_str());
+#else
+		unlink(path.c_str());
+#endif
+		if (bind(mSocket, (const sockaddr *)&addr, sizeof(addr)) != 0 || listen(mSocket, 64) != 0) {
+			error = "Cannot listen on " + path + ".";
+			Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	bool Connect(const std::string &path, std::string &error)
+	{
+		sockaddr_un		addr;
+
+		if (!Startup() || !Address(path, addr, error))
+			return false;
+		Close();
+		mSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (!valid() || connect(mSocket, (const sockaddr *)&addr, sizeof(addr)) != 0) {
+			error = "Cannot connect to the server on " + path + ", is it running?";
+			Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	//	the next client, an invalid socket after timeoutMs without one
+	CIpcSocket Accept(int timeoutMs)
+	{
+		CIpcSocket		client;
+
+		if (Wait(timeoutMs))
+			client.mSocket = accept(mSocket, NULL, NULL);
+
+		return client;
+	}
+
+	bool WaitReadable(int timeoutMs)
+	{
+		return Wait(timeoutMs);
+	}
+
+	bool Send(const SIpcMessage &message)
+	{
+		std::string		body = message.Serialize();
+		uint32_t		header[2] = { kMagic, (uint32_t)body.size() };
+
+		return SendAll((const char *)header, sizeof(header)) && SendAll(body.data(), body.size());
+	}
+
+	bool Receive(SIpcMessage &message)
+	{
+		uint32_t		header[2];
+		std::string		body;
+
+		if (!ReceiveAll((char *)header, sizeof(header)) || header[0] != kMagic || header[1] > kMaxBody)
+			return false;
+		body.resize(header[1]);
+
+		return ReceiveAll(&body[0], body.size()) && message.Parse(body);
+	}
+};
+
+class CSharedMemory
+{
+private:
+	std::string		mName;
+	void			*mData;
+	size_t			mSize;
+	bool			mOwner;
+#ifdef _WIN32
+	HANDLE			mMapping;
+#endif
+
+public:
+	CSharedMemory() :
+		mData(NULL),
+		mSize(0),
+		mOwner(false)
+#ifdef _WIN32
+		, mMapping(NULL)
+#endif
+	{
+	}
+
+	CSharedMemory(const CSharedMemory &) = delete;
+	CSharedMemory &operator=(const CSharedMemory &) = delete;
+
+	~CSharedMemory()
+	{
+		Close();
+	}
+
+	//	a name no other segment of this process uses
+	static std::string UniqueName()
+	{
+		static std::atomic<unsigned>	counter(0);
+		char							name[64];
+
+#ifdef _WIN32
+		snprintf(name, sizeof(name), "Local\\thermo-%lu-%u", (unsigned long)GetCurrentProcessId(), ++counter);
+#else
+		snprintf(name, sizeof(name), "/thermo-%lu-%u", (unsigned long)getpid(), ++counter);
+#endif
+
+		return name;
+	}
+
+	//	a new read write segment of size bytes, removed by Close (clients that mapped it keep their view)
+	bool Create(const std::string &name, size_t size, std::string &error)
+	{
+		Close();
+		size = std::max<size_t>(size, 1);
+#ifdef _WIN32
+		mMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size,
+			name.c_str());
+		if (mMapping == NULL || GetLastError() == ERROR_ALREADY_EXISTS) {
+			error = "Cannot create the shared memory " + name + ".";
+			Close();
+			return false;
+		}
+		mData = MapViewOfFile(mMapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+#else
+		int		fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+
+		if (fd < 0) {
+			error = "Cannot create the shared memory " + name + ".";
+			return false;
+		}
+		if (ftruncate(fd, (off_t)size) == 0) {
+			mData = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (mData == MAP_FAILED)
+				mData = NULL;
+		}
+		close(fd);
+		if (mData == NULL)
+			shm_unlink(name.c_str());
+#endif
+		if (mData == NULL) {
+			error = "Out of shared memory for " + name + ".";
+			Close();
+			return false;
+		}
+		mName = name;
+		mSize = size;
+		mOwner = true;
+
+		return true;
+	}
+
+	//	maps an existing segment read only
+	bool Open(const std::string &name, std::string &error)
+	{
+		Close();
+#ifdef _WIN32
+		MEMORY_BASIC_INFORMATION	info;
+
+		mMapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+		if (mMapping != NULL)
+			mData = MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+		if (mData != NULL && VirtualQuery(mData, &info, sizeof(info)) != 0)
+			mSize = info.RegionSize;
+#else
+		int				fd = shm_open(name.c_str(), O_RDONLY, 0);
+		struct stat		st;
+
+		if (fd >= 0) {
+			if (fstat(fd, &st) == 0 && st.st_size > 0) {
+				mSize = (size_t)st.st_size;
+				mData = mmap(NULL, mSize, PROT_READ, MAP_SHARED, fd, 0);
+				if (mData == MAP_FAILED)
+					mData = NULL;
+			}
+			close(fd);
+		}
+#endif
+		if (mData == NULL) {
+			error = "Cannot map the shared memory " + name + ".";
+			Close();
+			return false;
+		}
+		mName = name;
+
+		return true;
+	}
+
+	void Close()
+	{
+#ifdef _WIN32
+		if (mData != NULL)
+			UnmapViewOfFile(mData);
+		if (mMapping != NULL)
+			CloseHandle(mMapping);
+		mMapping = NULL;
+#else
+		if (mData != NULL)
+			munmap(mData, mSize);
+		if (mOwner && !mName.empty())
+			shm_unlink(mName.c_str());
+#endif
+		mData = NULL;
+		mSize = 0;
+		mOwner = false;
+		mName.clear();
+	}
+
+	const std::string &name() const
+	{
+		return mName;
+	}
+
+	void *data() const
+	{
+		return mData;
+	}
+
+	size_t size() const
+	{
+		return mSize;
+	}
+};
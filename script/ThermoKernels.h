@@ -0,0 +1,430 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define THERMO_KERNELS_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define THERMO_TARGET(isa)
+#else
+#define THERMO_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+//	runtime dispatched simd kernels
+//
+//	the inner loops shared by the analysis code, each with a scalar reference and sse2, avx2 and avx-512 variants
+//	compiled side by side (per function target attributes, no global /arch or -m flag, so one binary runs on the lab
+//	pcs and on the servers). ThermoKernels() holds the best variant of each kernel for the cpu, found once with cpuid
+//	(avx and avx-512 also need the os to save their registers, checked with xgetbv); THERMO_SIMD (scalar, sse2, avx2,
+//	avx512) caps the choice. a kernel without a variant for a level uses the one below, ThermoKernelsFor(level) gives
+//	the table of any level so ThermoCheckasm can test each variant against the reference:
+//		transposeF32, transposeU16	row major width x height frame to column major float (sensor order to matlab),
+//						bit exact
+//		lockInMac		sumX += x, sumXC += x c, sumXS += x s in double (CLockInAccumulator), bit exact unless the
+//						compiler fuses the multiply-adds
+//		lockInIirF32, lockInIirU16	exponential lock-in update of CRecursiveLockIn in float, m += a (x - m),
+//						X += a ((x - m) c - X), Y += a ((x - m) s - Y), within a few ulp of the reference
+//	pointers may be unaligned, n any size.
+
+enum EThermoSimd
+{
+	tsScalar = 0,
+	tsSse2,
+	tsAvx2,
+	tsAvx512,
+	tsCount
+};
+
+struct SThermoKernels
+{
+	void	(*transposeF32)(float *dest, const float *src, size_t width, size_t height);
+	void	(*transposeU16)(float *dest, const uint16_t *src, size_t width, size_t height);
+	void	(*lockInMac)(const float *x, size_t n, double c, double s, double *sumX, double *sumXC, double *sumXS);
+	void	(*lockInIirF32)(const float *frame, size_t n, float a, float c, float s, float *mean, float *x, float *y);
+	void	(*lockInIirU16)(const uint16_t *frame, size_t n, float a, float c, float s, float *mean, float *x, float *y);
+};
+
+inline const char *ThermoSimdName(EThermoSimd level)
+{
+	static const char	*names[tsCount] = { "scalar", "sse2", "avx2", "avx512" };
+
+	return names[level];
+}
+
+//	highest level the cpu and the os support
+inline EThermoSimd ThermoSimdDetect()
+{
+#ifdef THERMO_KERNELS_X86
+	unsigned	leaf1[4] = { 0, 0, 0, 0 }, leaf7[4] = { 0, 0, 0, 0 }, maxLeaf;
+	uint64_t	xcr0 = 0;
+
+#ifdef _MSC_VER
+	int			regs[4];
+
+	__cpuid(regs, 0);
+	maxLeaf = (unsigned)regs[0];
+	__cpuid(regs, 1);
+	for (int i = 0; i < 4; ++i)
+		leaf1[i] = (unsigned)regs[i];
+	if (maxLeaf >= 7) {
+		__cpuidex(regs, 7, 0);
+		for (int i = 0; i < 4; ++i)
+			leaf7[i] = (unsigned)regs[i];
+	}
+	if (leaf1[2] & (1u << 27))
+		xcr0 = _xgetbv(0);
+#else
+	maxLeaf = __get_cpuid_max(0, NULL);
+	__get_cpuid(1, &leaf1[0], &leaf1[1], &leaf1[2], &leaf1[3]);
+	if (maxLeaf >= 7)
+		__cpuid_count(7, 0, leaf7[0], leaf7[1], leaf7[2], leaf7[3]);
+	if (leaf1[2] & (1u << 27)) {
+		unsigned	lo, hi;
+
+		__asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+		xcr0 = ((uint64_t)hi << 32) | lo;
+	}
+#endif
+
+	bool		sse2 = (leaf1[3] & (1u << 26)) != 0;
+	bool		avx2 = (leaf1[2] & (1u << 28)) && (xcr0 & 0x6) == 0x6 && (leaf7[1] & (1u << 5));
+	bool		avx512 = avx2 && (xcr0 & 0xe6) == 0xe6 && (leaf7[1] & (1u << 16));
+
+	return avx512 ? tsAvx512 : avx2 ? tsAvx2 : sse2 ? tsSse2 : tsScalar;
+#else
+	return tsScalar;
+#endif
+}
+
+//	the detected level capped by THERMO_SIMD
+inline EThermoSimd ThermoSimdLevel()
+{
+	EThermoSimd		level = ThermoSimdDetect();
+	const char		*cap = getenv("THERMO_SIMD");
+
+	for (int k = 0; cap != NULL && k < (int)level; ++k)
+		if (std::string(cap) == ThermoSimdName((EThermoSimd)k))
+			return (EThermoSimd)k;
+
+	return level;
+}
+
+//	scalar references
+
+inline void KernelTransposeF32(float *dest, const float *src, size_t width, size_t height)
+{
+	for (size_t y = 0; y < height; ++y)
+		for (size_t x = 0; x < width; ++x)
+			dest[x * height + y] = src[y * width + x];
+}
+
+inline void KernelTransposeU16(float *dest, const uint16_t *src, size_t width, size_t height)
+{
+	for (size_t y = 0; y < height; ++y)
+		for (size_t x = 0; x < width; ++x)
+			dest[x * height + y] = (float)src[y * width + x];
+}
+
+inline void KernelLockInMac(const float *x, size_t n, double c, double s, double *sumX, double *sumXC, double *sumXS)
+{
+	for (size_t p = 0; p < n; ++p) {
+		double		v = (double)x[p];
+
+		sumX[p] += v;
+		sumXC[p] += v * c;
+		sumXS[p] += v * s;
+	}
+}
+
+template <typename kind>
+inline void KernelLockInIir(const kind *frame, size_t n, float a, float c, float s, float *mean, float *x, float *y)
+{
+	for (size_t p = 0; p < n; ++p) {
+		float		d = (float)frame[p] - mean[p];
+
+		mean[p] += a * d;
+		x[p] += a * (d * c - x[p]);
+		y[p] += a * (d * s - y[p]);
+	}
+}
+
+inline void KernelLockInIirF32(const float *frame, size_t n, float a, float c, float s, float *mean, float *x, float *y)
+{
+	KernelLockInIir(frame, n, a, c, s, mean, x, y);
+}
+
+inline void KernelLockInIirU16(const uint16_t *frame, size_t n, float a, float c, float s, float *mean, float *x, float *y)
+{
+	KernelLockInIir(frame, n, a, c, s, mean, x, y);
+}
+
+#ifdef THERMO_KERNELS_X86
+
+//	sse2
+
+THERMO_TARGET("sse2") inline __m128 LoadSse2(const float *p)
+{
+	return _mm_loadu_ps(p);
+}
+
+THERMO_TARGET("sse2") inline __m128 LoadSse2(const uint16_t *p)
+{
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)p), _mm_setzero_si128()));
+}
+
+//	4 x 4 blocks, the rest scalar
+template <typename kind>
+THERMO_TARGET("sse2") inline void TransposeSse2(float *dest, const kind *src, size_t width, size_t height)
+{
+	size_t		y = 0;
+
+	for (; y + 4 <= height; y += 4) {
+		size_t		x = 0;
+
+		for (; x + 4 <= width; x += 4) {
+			__m128		r0 = LoadSse2(src + y * width + x), r1 = LoadSse2(src + (y + 1) * width + x);
+			__m128		r2 = LoadSse2(src + (y + 2) * width + x), r3 = LoadSse2(src + (y + 3) * width + x);
+
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(dest + x * height + y, r0);
+			_mm_storeu_ps(dest + (x + 1) * height + y, r1);
+			_mm_storeu_ps(dest + (x + 2) * height + y, r2);
+			_mm_storeu_ps(dest + (x + 3) * height + y, r3);
+		}
+		for (; x < width; ++x)
+			for (size_t k = 0; k < 4; ++k)
+				dest[x * height + y + k] = (float)src[(y + k) * width + x];
+	}
+	for (; y < height; ++y)
+		for (size_t x = 0; x < width; ++x)
+			dest[x * height + y] = (float)src[y * width + x];
+}
+
+THERMO_TARGET("sse2") inline void KernelTransposeF32Sse2(float *dest, const float *src, size_t width, size_t height)
+{
+	TransposeSse2(dest, src, width, height);
+}
+
+THERMO_TARGET("sse2") inline void KernelTransposeU16Sse2(float *dest, const uint16_t *src, size_t width, size_t height)
+{
+	TransposeSse2(dest, src, width, height);
+}
+
+THERMO_TARGET("sse2") inline void KernelLockInMacSse2(const float *x, size_t n, double c, double s, double *sumX, double *sumXC,
+	double *sumXS)
+{
+	__m128d		vc = _mm_set1_pd(c), vs = _mm_set1_pd(s);
+	size_t		p = 0;
+
+	for (; p + 4 <= n; p += 4) {
+		__m128		v = _mm_loadu_ps(x + p);
+		__m128d		v2[2] = { _mm_cvtps_pd(v), _mm_cvtps_pd(_mm_movehl_ps(v, v)) };
+
+		for (size_t h = 0; h < 2; ++h) {
+			size_t		q = p + 2 * h;
+
+			_mm_storeu_pd(sumX + q, _mm_add_pd(_mm_loadu_pd(sumX + q), v2[h]));
+			_mm_storeu_pd(sumXC + q, _mm_add_pd(_mm_loadu_pd(sumXC + q), _mm_mul_pd(v2[h], vc)));
+			_mm_storeu_pd(sumXS + q, _mm_add_pd(_mm_loadu_pd(sumXS + q), _mm_mul_pd(v2[h], vs)));
+		}
+	}
+	KernelLockInMac(x + p, n - p, c, s, sumX + p, sumXC + p, sumXS + p);
+}
+
+template <typename kind>
+THERMO_TARGET("sse2") inline void LockInIirSse2(const kind *frame, size_t n, float a, float c, float s, float *mean, float *x, float *y)
+{
+	__m128		va = _mm_set1_ps(a), vc = _mm_set1_ps(c), vs = _mm_set1_ps(s);
+	size_t		p = 0;
+
+	for (; p + 4 <= n; p += 4) {
+		__m128		m = _mm_loadu_ps(mean + p);
+		__m128		d = _mm_sub_ps(LoadSse2(frame + p), m);
+		__m128		xp = _mm_loadu_ps(x + p), yp = _mm_loadu_ps(y + p);
+
+		_mm_storeu_ps(mean + p, _mm_add_ps(m, _mm_mul_ps(va, d)));
+		_mm_storeu_ps(x + p, _mm_add_ps(xp, _mm_mul_ps(va, _mm_sub_ps(_mm_mul_ps(d, vc), xp))));
+		_mm_storeu_ps(y + p, _mm_add_ps(yp, _mm_mul_ps(va, _mm_sub_ps(_mm_mul_ps(d, vs), yp))));
+	}
+	KernelLockInIir(frame + p, n - p, a, c, s, mean + p, x + p, y + p);
+}
+
+THERMO_TARGET("sse2") inline void KernelLockInIirF32Sse2(const float *frame, size_t n, float a, float c, float s, float *mean,
+	float *x, float *y)
+{
+	LockInIirSse2(frame, n, a, c, s, mean, x, y);
+}
+
+THERMO_TARGET("sse2") inline void KernelLockInIirU16Sse2(const uint16_t *frame, size_t n, float a, float c, float s, float *mean,
+	float *x, float *y)
+{
+	LockInIirSse2(frame, n, a, c, s, mean, x, y);
+}
+
+//	avx2, the element wise kernels only: the transpose is bound by the strided stores, an 8 x 8 one was slower than
+//	the 4 x 4 of sse2 in ThermoCheckasm --bench
+
+THERMO_TARGET("avx2") inline __m256 LoadAvx2(const float *p)
+{
+	return _mm256_loadu_ps(p);
+}
+
+THERMO_TARGET("avx2") inline __m256 LoadAvx2(const uint16_t *p)
+{
+	return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)p)));
+}
+
+THERMO_TARGET("avx2") inline void KernelLockInMacAvx2(const float *x, size_t n, double c, double s, double *sumX, double *sumXC,
+	double *sumXS)
+{
+	__m256d		vc = _mm256_set1_pd(c), vs = _mm256_set1_pd(s);
+	size_t		p = 0;
+
+	for (; p + 4 <= n; p += 4) {
+		__m256d		v = _mm256_cvtps_pd(_mm_loadu_ps(x + p));
+
+		_mm256_storeu_pd(sumX + p, _mm256_add_pd(_mm256_loadu_pd(sumX + p), v));
+		_mm256_storeu_pd(sumXC + p, _mm256_add_pd(_mm256_loadu_pd(sumXC + p), _mm256_mul_pd(v, vc)));
+		_mm256_storeu_pd(sumXS + p, _mm256_add_pd(_mm256_loadu_pd(sumXS + p), _mm256_mul_pd(v, vs)));
+	}
+	KernelLockInMac(x + p, n - p, c, s, sumX + p, sumXC + p, sumXS + p);
+}
+
+template <typename kind>
+THERMO_TARGET("avx2") inline void LockInIirAvx2(const kind *frame, size_t n, float a, float c, float s, float *mean, float *x, float *y)
+{
+	__m256		va = _mm256_set1_ps(a), vc = _mm256_set1_ps(c), vs = _mm256_set1_ps(s);
+	size_t		p = 0;
+
+	for (; p + 8 <= n; p += 8) {
+		__m256		m = _mm256_loadu_ps(mean + p);
+		__m256		d = _mm256_sub_ps(LoadAvx2(frame + p), m);
+		__m256		xp = _mm256_loadu_ps(x + p), yp = _mm256_loadu_ps(y + p);
+
+		_mm256_storeu_ps(mean + p, _mm256_add_ps(m, _mm256_mul_ps(va, d)));
+		_mm256_storeu_ps(x + p, _mm256_add_ps(xp, _mm256_mul_ps(va, _mm256_sub_ps(_mm256_mul_ps(d, vc), xp))));
+		_mm256_storeu_ps(y + p, _mm256_add_ps(yp, _mm256_mul_ps(va, _mm256_sub_ps(_mm256_mul_ps(d, vs), yp))));
+	}
+	KernelLockInIir(frame + p, n - p, a, c, s, mean + p, x + p, y + p);
+}
+
+THERMO_TARGET("avx2") inline void KernelLockInIirF32Avx2(const float *frame, size_t n, float a, float c, float s, float *mean,
+	float *x, float *y)
+{
+	LockInIirAvx2(frame, n, a, c, s, mean, x, y);
+}
+
+THERMO_TARGET("avx2") inline void KernelLockInIirU16Avx2(const uint16_t *frame, size_t n, float a, float c, float s, float *mean,
+	float *x, float *y)
+{
+	LockInIirAvx2(frame, n, a, c, s, mean, x, y);
+}
+
+//	avx-512, the element wise kernels only as well
+
+THERMO_TARGET("avx512f") inline __m512 LoadAvx512(const float *p)
+{
+	return _mm512_loadu_ps(p);
+}
+
+THERMO_TARGET("avx512f") inline __m512 LoadAvx512(const uint16_t *p)
+{
+	return _mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i *)p)));
+}
+
+THERMO_TARGET("avx512f") inline void KernelLockInMacAvx512(const float *x, size_t n, double c, double s, double *sumX, double *sumXC,
+	double *sumXS)
+{
+	__m512d		vc = _mm512_set1_pd(c), vs = _mm512_set1_pd(s);
+	size_t		p = 0;
+
+	for (; p + 8 <= n; p += 8) {
+		__m512d		v = _mm512_cvtps_pd(_mm256_loadu_ps(x + p));
+
+		_mm512_storeu_pd(sumX + p, _mm512_add_pd(_mm512_loadu_pd(sumX + p), v));
+		_mm512_storeu_pd(sumXC + p, _mm512_add_pd(_mm512_loadu_pd(sumXC + p), _mm512_mul_pd(v, vc)));
+		_mm512_storeu_pd(sumXS + p, _mm512_add_pd(_mm512_loadu_pd(sumXS + p), _mm512_mul_pd(v, vs)));
+	}
+	KernelLockInMac(x + p, n - p, c, s, sumX + p, sumXC + p, sumXS + p);
+}
+
+template <typename kind>
+THERMO_TARGET("avx512f") inline void LockInIirAvx512(const kind *frame, size_t n, float a, float c, float s, float *mean, float *x,
+	float *y)
+{
+	__m512		va = _mm512_set1_ps(a), vc = _mm512_set1_ps(c), vs = _mm512_set1_ps(s);
+	size_t		p = 0;
+
+	for (; p + 16 <= n; p += 16) {
+		__m512		m = _mm512_loadu_ps(mean + p);
+		__m512		d = _mm512_sub_ps(LoadAvx512(frame + p), m);
+		__m512		xp = _mm512_loadu_ps(x + p), yp = _mm512_loadu_ps(y + p);
+
+		_mm512_storeu_ps(mean + p, _mm512_add_ps(m, _mm512_mul_ps(va, d)));
+		_mm512_storeu_ps(x + p, _mm512_add_ps(xp, _mm512_mul_ps(va, _mm512_sub_ps(_mm512_mul_ps(d, vc), xp))));
+		_mm512_storeu_ps(y + p, _mm512_add_ps(yp, _mm512_mul_ps(va, _mm512_sub_ps(_mm512_mul_ps(d, vs), yp))));
+	}
+	KernelLockInIir(frame + p, n - p, a, c, s, mean + p, x + p, y + p);
+}
+
+THERMO_TARGET("avx512f") inline void KernelLockInIirF32Avx512(const float *frame, size_t n, float a, float c, float s, float *mean,
+	float *x, float *y)
+{
+	LockInIirAvx512(frame, n, a, c, s, mean, x, y);
+}
+
+THERMO_TARGET("avx512f") inline void KernelLockInIirU16Avx512(const uint16_t *frame, size_t n, float a, float c, float s, float *mean,
+	float *x, float *y)
+{
+	LockInIirAvx512(frame, n, a, c, s, mean, x, y);
+}
+
+#endif
+
+//	best variant of every kernel up to level
+inline SThermoKernels ThermoKernelsFor(EThermoSimd level)
+{
+	SThermoKernels		k = { KernelTransposeF32, KernelTransposeU16, KernelLockInMac, KernelLockInIirF32, KernelLockInIirU16 };
+
+#ifdef THERMO_KERNELS_X86
+	if (level >= tsSse2) {
+		k.transposeF32 = KernelTransposeF32Sse2;
+		k.transposeU16 = KernelTransposeU16Sse2;
+		k.lockInMac = KernelLockInMacSse2;
+		k.lockInIirF32 = KernelLockInIirF32Sse2;
+		k.lockInIirU16 = KernelLockInIirU16Sse2;
+	}
+	if (level >= tsAvx2) {
+		k.lockInMac = KernelLockInMacAvx2;
+		k.lockInIirF32 = KernelLockInIirF32Avx2;
+		k.lockInIirU16 = KernelLockInIirU16Avx2;
+	}
+	if (level >= tsAvx512) {
+		k.lockInMac = KernelLockInMacAvx512;
+		k.lockInIirF32 = KernelLockInIirF32Avx512;
+		k.lockInIirU16 = KernelLockInIirU16Avx512;
+	}
+#else
+	(void)level;
+#endif
+
+	return k;
+}
+
+inline const SThermoKernels &ThermoKernels()
+{
+	static const SThermoKernels		kernels = ThermoKernelsFor(ThermoSimdLevel());
+
+	return kernels;
+}
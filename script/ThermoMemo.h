@@ -0,0 +1,611 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <ctime>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+//	content addressed memoisation of analysis stages across runs
+//
+//	every stage (load, resample, filters, lock-in, fit, ...) is keyed by the hash of what it depends on: the key of the
+//	stage before it and its own parameters, or for the first one the recording (path, size and modification time) and
+//	how it is read. a chain of keys identifies a result without hashing the frames, so changing tol only changes the
+//	keys of the fit and the stages up to the lock-in are found in the cache. the results are opaque bytes (the mex side
+//	stores matlab values, MexMemo.h) in one file per key:
+//		dir/ab/ab....memo		"TMEM", version (uint32 1), size (uint64), checksum (uint64), then the bytes
+//	files are written under a temporary name and renamed, so a reader sees a whole entry or none, and several matlab
+//	sessions can share the folder. a hit touches the file, the cache keeps its size within the budget evicting the
+//	entries used least recently, by modification time. a damaged entry is a miss and is removed.
+//	THERMO_MEMO names the folder and turns the memoisation on, THERMO_MEMO_MB is the budget (8192 MB).
+//	the hash is MurmurHash3 x64 128, fast on frames and plenty against accidental collisions but not cryptographic.
+
+struct SMemoKey
+{
+	uint64_t	h[2];
+
+	SMemoKey()
+	{
+		h[0] = h[1] = 0;
+	}
+
+	bool operator==(const SMemoKey &other) const
+	{
+		return h[0] == other.h[0] && h[1] == other.h[1];
+	}
+
+	//	32 hex digits
+	std::string hex() const
+	{
+		char	text[33];
+
+		snprintf(text, sizeof(text), "%016llx%016llx", (unsigned long long)h[0], (unsigned long long)h[1]);
+
+		return text;
+	}
+
+	static bool Parse(const std::string &text, SMemoKey &key)
+	{
+		if (text.size() != 32 || text.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+			return false;
+		key.h[0] = strtoull(text.substr(0, 16).c_str(), NULL, 16);
+		key.h[1] = strtoull(text.substr(16).c_str(), NULL, 16);
+
+		return true;
+	}
+};
+
+//	MurmurHash3 x64 128 over everything added, in blocks of 16 bytes
+class CMemoHasher
+{
+private:
+	uint64_t		mH1, mH2;
+	uint8_t			mTail[16];
+	size_t			mFill;
+	uint64_t		mLength;
+
+	static uint64_t Rotl(uint64_t x, int r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+
+	static uint64_t Mix(uint64_t k)
+	{
+		k ^= k >> 33;
+		k *= 0xff51afd7ed558ccdULL;
+		k ^= k >> 33;
+		k *= 0xc4ceb9fe1a85ec53ULL;
+		k ^= k >> 33;
+
+		return k;
+	}
+
+	void Block(const uint8_t *data)
+	{
+		const uint64_t	c1 = 0x87c37b91114253d5ULL, c2 = 0x4cf5ad432745937fULL;
+		uint64_t		k1, k2;
+
+		memcpy(&k1, data, 8);
+		memcpy(&k2, data + 8, 8);
+		k1 *= c1; k1 = Rotl(k1, 31); k1 *= c2; mH1 ^= k1;
+		mH1 = Rotl(mH1, 27); mH1 += mH2; mH1 = mH1 * 5 + 0x52dce729;
+		k2 *= c2; k2 = Rotl(k2, 33); k2 *= c1; mH2 ^= k2;
+		mH2 = Rotl(mH2, 31); mH2 += mH1; mH2 = mH2 * 5 + 0x38495ab5;
+	}
+
+public:
+	CMemoHasher(uint64_t seed = 0) :
+		mH1(seed),
+		mH2(seed),
+		mFill(0),
+		mLength(0)
+	{
+	}
+
+	CMemoHasher &Add(const void *data, size_t bytes)
+	{
+		const uint8_t	*p = (const uint8_t *)data;
+
+		mLength += bytes;
+		if (mFill > 0) {
+			size_t		n = std::min(bytes, 16 - mFill);
+
+			memcpy(mTail + mFill, p, n);
+			mFill += n;
+			p += n;
+			bytes -= n;
+			if (mFill < 16)
+				return *this;
+			Block(mTail);
+			mFill = 0;
+		}
+		for (; bytes >= 16; p += 16, bytes -= 16)
+			Block(p);
+		memcpy(mTail, p, bytes);
+		mFill = bytes;
+
+		return *this;
+	}
+
+	//	values are added with their size or type in front, so "ab" + "c" and "a" + "bc" differ
+	CMemoHasher &Add(const std::string &text)
+	{
+		uint64_t	length = text.size();
+
+		return Add(&length, sizeof(length)).Add(text.data(), text.size());
+	}
+
+	CMemoHasher &Add(const char *text)
+	{
+		return Add(std::string(text));
+	}
+
+	CMemoHasher &Add(double value)
+	{
+		uint8_t		tag = 'd';
+
+		//	-0 and 0 are the same parameter
+		if (value == 0.0)
+			value = 0.0;
+
+		return Add(&tag, 1).Add(&value, sizeof(value));
+	}
+
+	CMemoHasher &Add(int64_t value)
+	{
+		uint8_t		tag = 'i';
+
+		return Add(&tag, 1).Add(&value, sizeof(value));
+	}
+
+	CMemoHasher &Add(const SMemoKey &key)
+	{
+		uint8_t		tag = 'k';
+
+		return Add(&tag, 1).Add(key.h, sizeof(key.h));
+	}
+
+	SMemoKey Finish() const
+	{
+		const uint64_t	c1 = 0x87c37b91114253d5ULL, c2 = 0x4cf5ad432745937fULL;
+		uint64_t		h1 = mH1, h2 = mH2, k1 = 0, k2 = 0;
+		SMemoKey		key;
+
+		for (size_t i = mFill; i-- > 8;)
+			k2 = (k2 << 8) | mTail[i];
+		for (size_t i = std::min<size_t>(mFill, 8); i-- > 0;)
+			k1 = (k1 << 8) | mTail[i];
+		if (mFill > 8) {
+			k2 *= c2; k2 = Rotl(k2, 33); k2 *= c1; h2 ^= k2;
+		}
+		if (mFill > 0) {
+			k1 *= c1; k1 = Rotl(k1, 31); k1 *= c2; h1 ^= k1;
+		}
+		h1 ^= mLength;
+		h2 ^= mLength;
+		h1 += h2;
+		h2 += h1;
+		h1 = Mix(h1);
+		h2 = Mix(h2);
+		h1 += h2;
+		h2 += h1;
+		key.h[0] = h1;
+		key.h[1] = h2;
+
+		return key;
+	}
+};
+
+//	the key of a recording as found on disk: a file rewritten in place gets a new key, false when it cannot be read. the
+//	modification time is taken at full resolution (100 ns on windows, ns here), a re-export within the same second
+//	with the same size is a new recording too
+inline bool MemoFileKey(const std::string &path, SMemoKey &key)
+{
+	int64_t		size, mtime;
+
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA	data;
+
+	if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data))
+		return false;
+	size = ((int64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	mtime = ((int64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat		st;
+
+	if (stat(path.c_str(), &st) != 0)
+		return false;
+	size = (int64_t)st.st_size;
+	mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + (int64_t)st.st_mtim.tv_nsec;
+#endif
+	key = CMemoHasher().Add("file").Add(path).Add(size).Add(mtime).Finish();
+
+	return true;
+}
+
+//	the THERMO_MEMO folder, empty when the memoisation is off
+inline std::string ThermoMemoDir()
+{
+	const char	*dir = getenv("THERMO_MEMO");
+
+	return dir != NULL ? dir : "";
+}
+
+inline size_t ThermoMemoBudget()
+{
+	const char	*mb = getenv("THERMO_MEMO_MB");
+	double		value = mb != NULL ? atof(mb) : 0.0;
+
+	return (size_t)((value > 0.0 ? value : 8192.0) * 1024.0 * 1024.0);
+}
+
+//	values go to and come from the files in pieces, so an entry is never held whole in memory: a write appends bytes,
+//	a read fills data with the next bytes and is false past the end of the entry
+typedef std::function<void(const void *data, size_t bytes)>		FMemoWrite;
+typedef std::function<bool(void *data, size_t bytes)>			FMemoRead;
+
+struct SMemoStats
+{
+	size_t		hits;
+	size_t		misses;
+	size_t		puts;
+	size_t		evictions;
+	size_t		entries;			//	at the last scan of the folder
+	size_t		bytes;				//	estimate, exact after a scan
+	size_t		budget;
+};
+
+class CMemoCache
+{
+private:
+	struct SFile
+	{
+		std::string		path;
+		size_t			bytes;
+		double			used;				//	[s] of the last use, the modification time
+	};
+
+	std::string			mDir;
+	SMemoStats			mStats;
+	bool				mScanned;
+	unsigned			mCounter;
+	std::mutex			mMutex;
+
+	static const uint32_t	kVersion = 1;
+	static const size_t		kHeader = 4 + 4 + 8 + 8;
+	static const uint64_t	kSeed = 0x544d454dULL;			//	of the checksum
+
+	static bool MakeDir(const std::string &dir)
+	{
+#ifdef _WIN32
+		return _mkdir(dir.c_str()) == 0 || errno == EEXIST;
+#else
+		return mkdir(dir.c_str(), 0777) == 0 || errno == EEXIST;
+#endif
+	}
+
+	std::string SubDir(const SMemoKey &key) const
+	{
+		return mDir + "/" + key.hex().substr(0, 2);
+	}
+
+	std::string PathOf(const SMemoKey &key) const
+	{
+		return SubDir(key) + "/" + key.hex() + ".memo";
+	}
+
+	static uint64_t FileBytes(FILE *file)
+	{
+#ifdef _WIN32
+		struct _stati64		st;
+
+		return _fstati64(_fileno(file), &st) == 0 ? (uint64_t)st.st_size : 0;
+#else
+		struct stat			st;
+
+		return fstat(fileno(file), &st) == 0 ? (uint64_t)st.st_size : 0;
+#endif
+	}
+
+	static void Touch(const std::string &path)
+	{
+#ifdef _WIN32
+		_utime(path.c_str(), NULL);
+#else
+		utime(path.c_str(), NULL);
+#endif
+	}
+
+	static bool Replace(const std::string &from, const std::string &to)
+	{
+#ifdef _WIN32
+		return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		return rename(from.c_str(), to.c_str()) == 0;
+#endif
+	}
+
+	//	the .memo files of the folder with their size and last use
+	std::vector<SFile> List() const
+	{
+		std::vector<SFile>		files;
+		std::vector<std::string>	dirs;
+
+#ifdef _WIN32
+		WIN32_FIND_DATAA		data;
+		HANDLE					find = FindFirstFileA((mDir + "/*").c_str(), &data);
+
+		if (find != INVALID_HANDLE_VALUE) {
+			do {
+				if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0 && strlen(data.cFileName) == 2 && data.cFileName[0] != '.')
+					dirs.push_back(mDir + "/" + data.cFileName);
+			} while (FindNextFileA(find, &data));
+			FindClose(find);
+		}
+		for (size_t d = 0; d < dirs.size(); ++d) {
+			find = FindFirstFileA((dirs[d] + "/*.memo").c_str(), &data);
+			if (find == INVALID_HANDLE_VALUE)
+				continue;
+			do {
+				SFile		file;
+				ULARGE_INTEGER	t;
+
+				t.LowPart = data.ftLastWriteTime.dwLowDateTime;
+				t.HighPart = data.ftLastWriteTime.dwHighDateTime;
+				file.path = dirs[d] + "/" + data.cFileName;
+				file.bytes = ((size_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+				file.used = (double)t.QuadPart * 1e-7;
+				files.push_back(file);
+			} while (FindNextFileA(find, &data));
+			FindClose(find);
+		}
+#else
+		DIR						*top = opendir(mDir.c_str()), *sub;
+		struct dirent			*entry;
+
+		if (top == NULL)
+			return files;
+		while ((entry = readdir(top)) != NULL)
+			if (strlen(entry->d_name) == 2 && entry->d_name[0] != '.')
+				dirs.push_back(mDir + "/" + entry->d_name);
+		closedir(top);
+		for (size_t d = 0; d < dirs.size(); ++d) {
+			if ((sub = opendir(dirs[d].c_str())) == NULL)
+				continue;
+			while ((entry = readdir(sub)) != NULL) {
+				std::string		name = entry->d_name;
+				struct stat		st;
+				SFile			file;
+
+				if (name.size() < 5 || name.compare(name.size() - 5, 5, ".memo") != 0)
+					continue;
+				file.path = dirs[d] + "/" + name;
+				if (stat(file.path.c_str(), &st) != 0)
+					continue;
+				file.bytes = (size_t)st.st_size;
+				file.used = (double)st.st_mtim.tv_sec + 1e-9 * (double)st.st_mtim.tv_nsec;
+				files.push_back(file);
+			}
+			closedir(sub);
+		}
+#endif
+
+		return files;
+	}
+
+	//	rescans the folder (other sessions write to it too) and evicts the least recently used entries down to 90% of
+	//	the budget
+	void Trim()
+	{
+		std::vector<SFile>	files = List();
+		size_t				total = 0;
+
+		for (size_t i = 0; i < files.size(); ++i)
+			total += files[i].bytes;
+		mScanned = true;
+		if (total > mStats.budget) {
+			std::sort(files.begin(), files.end(), [](const SFile &a, const SFile &b) { return a.used < b.used; });
+			for (size_t i = 0; i < files.size() && total > mStats.budget / 10 * 9; ++i)
+				if (remove(files[i].path.c_str()) == 0) {
+					total -= files[i].bytes;
+					++mStats.evictions;
+					files[i].bytes = 0;
+				}
+		}
+		mStats.entries = (size_t)std::count_if(files.begin(), files.end(), [](const SFile &f) { return f.bytes > 0; });
+		mStats.bytes = total;
+	}
+
+public:
+	CMemoCache(const std::string &dir, size_t budget) :
+		mDir(dir),
+		mScanned(false),
+		mCounter(0)
+	{
+		memset(&mStats, 0, sizeof(mStats));
+		mStats.budget = budget;
+		while (mDir.size() > 1 && (mDir[mDir.size() - 1] == '/' || mDir[mDir.size() - 1] == '\\'))
+			mDir.erase(mDir.size() - 1);
+	}
+
+	const std::string &dir() const
+	{
+		return mDir;
+	}
+
+	//	hands the entry of key to read(bytes, source), false on a miss or when read fails. the size in the header is
+	//	checked against the file before anything is read, and the checksum once read has taken all the bytes
+	bool Get(const SMemoKey &key, const std::function<bool(size_t bytes, const FMemoRead &source)> &read)
+	{
+		std::lock_guard<std::mutex>		lock(mMutex);
+		std::string						path = PathOf(key);
+		FILE							*file = fopen(path.c_str(), "rb");
+		char							magic[4];
+		uint32_t						version = 0;
+		uint64_t						size = 0, checksum = 0, left;
+		CMemoHasher						hasher(kSeed);
+		bool							ok;
+
+		if (file == NULL) {
+			++mStats.misses;
+			return false;
+		}
+		ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, "TMEM", 4) == 0 && fread(&version, sizeof(version), 1, file) == 1 &&
+			version == kVersion && fread(&size, sizeof(size), 1, file) == 1 && fread(&checksum, sizeof(checksum), 1, file) == 1 &&
+			size == FileBytes(file) - kHeader;
+		left = size;
+		ok = ok && read((size_t)size, [&](void *data, size_t bytes) {
+			if (bytes > left || fread(data, 1, bytes, file) != bytes)
+				return false;
+			hasher.Add(data, bytes);
+			left -= bytes;
+			return true;
+		}) && left == 0 && hasher.Finish().h[0] == checksum;
+		fclose(file);
+		if (!ok) {
+			remove(path.c_str());
+			++mStats.misses;
+			return false;
+		}
+		Touch(path);
+		++mStats.hits;
+
+		return true;
+	}
+
+	bool Get(const SMemoKey &key, std::vector<uint8_t> &data)
+	{
+		bool	ok = Get(key, [&](size_t bytes, const FMemoRead &source) {
+			data.resize(bytes);
+			return source(data.data(), bytes);
+		});
+
+		if (!ok)
+			data.clear();
+
+		return ok;
+	}
+
+	//	stores under key the bytes write(sink) appends, which must be bytes in all. an entry larger than half the
+	//	budget is not kept. false when it cannot be written
+	bool Put(const SMemoKey &key, size_t bytes, const std::function<bool(const FMemoWrite &sink)> &write)
+	{
+		std::lock_guard<std::mutex>		lock(mMutex);
+		std::string						path = PathOf(key), temp;
+		FILE							*file;
+		uint32_t						version = kVersion;
+		uint64_t						size = bytes, checksum = 0, written = 0;
+		CMemoHasher						hasher(kSeed);
+		bool							ok, failed = false;
+
+		if (bytes + kHeader > mStats.budget / 2)
+			return false;
+		if (!MakeDir(mDir) || !MakeDir(SubDir(key)))
+			return false;
+#ifdef _WIN32
+		temp = path + ".tmp" + std::to_string(_getpid()) + "_" + std::to_string(++mCounter);
+#else
+		temp = path + ".tmp" + std::to_string(getpid()) + "_" + std::to_string(++mCounter);
+#endif
+		if ((file = fopen(temp.c_str(), "wb")) == NULL)
+			return false;
+		//	the checksum goes in once the bytes have gone through
+		ok = fwrite("TMEM", 1, 4, file) == 4 && fwrite(&version, sizeof(version), 1, file) == 1 &&
+			fwrite(&size, sizeof(size), 1, file) == 1 && fwrite(&checksum, sizeof(checksum), 1, file) == 1;
+		ok = ok && write([&](const void *data, size_t n) {
+			failed = failed || fwrite(data, 1, n, file) != n;
+			hasher.Add(data, n);
+			written += n;
+		}) && !failed && written == size;
+		checksum = hasher.Finish().h[0];
+		ok = ok && fseek(file, (long)(kHeader - sizeof(checksum)), SEEK_SET) == 0 && fwrite(&checksum, sizeof(checksum), 1, file) == 1;
+		ok = fclose(file) == 0 && ok;
+		if (!ok || !Replace(temp, path)) {
+			remove(temp.c_str());
+			return false;
+		}
+		++mStats.puts;
+		mStats.bytes += bytes + kHeader;
+		if (!mScanned || mStats.bytes > mStats.budget)
+			Trim();
+
+		return true;
+	}
+
+	bool Put(const SMemoKey &key, const void *data, size_t bytes)
+	{
+		return Put(key, bytes, [&](const FMemoWrite &sink) {
+			sink(data, bytes);
+			return true;
+		});
+	}
+
+	bool Put(const SMemoKey &key, const std::vector<uint8_t> &data)
+	{
+		return Put(key, data.data(), data.size());
+	}
+
+	//	removes every entry
+	void Clear()
+	{
+		std::lock_guard<std::mutex>		lock(mMutex);
+		std::vector<SFile>				files = List();
+
+		for (size_t i = 0; i < files.size(); ++i)
+			remove(files[i].path.c_str());
+		mStats.entries = 0;
+		mStats.bytes = 0;
+		mScanned = true;
+	}
+
+	SMemoStats stats()
+	{
+		std::lock_guard<std::mutex>		lock(mMutex);
+
+		if (!mScanned)
+			Trim();
+
+		return mStats;
+	}
+};
+
+//	the cache of THERMO_MEMO and THERMO_MEMO_MB for the process, NULL when the memoisation is off. made again when the
+//	variables change, not to be kept across calls
+inline CMemoCache *ThermoMemoCache()
+{
+	static std::unique_ptr<CMemoCache>	cache;
+	static std::string					dir;
+	static size_t						budget = 0;
+	static std::mutex					mutex;
+	std::lock_guard<std::mutex>			lock(mutex);
+
+	if (ThermoMemoDir().empty())
+		cache.reset();
+	else if (cache == NULL || dir != ThermoMemoDir() || budget != ThermoMemoBudget()) {
+		dir = ThermoMemoDir();
+		budget = ThermoMemoBudget();
+		cache.reset(new CMemoCache(dir, budget));
+	}
+
+	return cache.get();
+}
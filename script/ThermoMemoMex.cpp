@@ -0,0 +1,100 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "mex.h"
+#include "MexHelpers.h"
+#include "MexMemo.h"
+
+//	mex ThermoMemoMex.cpp
+
+//	key = ThermoMemoMex('key', parts...)		the key of a stage from the key of the stage before it and its parameters
+//												(numbers, strings, logicals, structs or cells of them, arrays too)
+//	key = ThermoMemoMex('file', fileName)		the key of a recording from its path, size and modification time
+//	[hit, value] = ThermoMemoMex('get', key)	the value stored under key, [] on a miss or with the memoisation off
+//	ok = ThermoMemoMex('put', key, value)		stores the value (same kinds as the key parts), false when it is not kept
+//	stats = ThermoMemoMex('stats')				dir, entries, MB, budgetMB, hits, misses, puts and evictions
+//	ThermoMemoMex('clear')						removes every entry
+//
+//	keys are 32 hex digits. the cache is the THERMO_MEMO folder, with THERMO_MEMO_MB as its budget (ThermoMemo.h);
+//	without THERMO_MEMO every get is a miss and nothing is stored, the keys are computed all the same.
+
+static SMemoKey GetKey(const mxArray *ar)
+{
+	SMemoKey	key;
+
+	if (!SMemoKey::Parse(mxGetStdString(ar, "key"), key))
+		mexErrMsgTxt("key must be 32 hex digits.");
+
+	return key;
+}
+
+//	the mex entry point
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	char			command[64];
+	CMemoCache		*cache = ThermoMemoCache();
+
+	if (nrhs < 1 || mxGetString(prhs[0], command, sizeof(command)) != 0)
+		mexErrMsgTxt("First argument must be a command string.");
+
+	if (strcmp(command, "key") == 0) {
+		CMemoHasher		hasher;
+
+		if (nlhs > 1)
+			mexErrMsgTxt("Must have 0-1 outputs.");
+		hasher.Add("key");
+		for (int i = 1; i < nrhs; ++i)
+			if (!MemoHashArray(hasher, prhs[i]))
+				mexErrMsgTxt("Key parts must be real numeric, logical or char arrays, or structs and cells of them.");
+		plhs[0] = mxCreateString(hasher.Finish().hex().c_str());
+	} else if (strcmp(command, "file") == 0) {
+		SMemoKey		key;
+		std::string		fileName;
+
+		if (nlhs > 1 || nrhs != 2)
+			mexErrMsgTxt("Must have 2 inputs and 0-1 outputs.");
+		fileName = mxGetStdString(prhs[1], "fileName");
+		if (!MemoFileKey(fileName, key))
+			mexErrMsgTxt(("Cannot read " + fileName + ".").c_str());
+		plhs[0] = mxCreateString(key.hex().c_str());
+	} else if (strcmp(command, "get") == 0) {
+		mxArray			*value;
+
+		if (nlhs > 2 || nrhs != 2)
+			mexErrMsgTxt("Must have 2 inputs and 0-2 outputs.");
+		value = MemoGet(cache, GetKey(prhs[1]));
+		plhs[0] = mxCreateLogicalScalar(value != NULL);
+		if (nlhs > 1)
+			plhs[1] = value != NULL ? value : mxCreateDoubleMatrix(0, 0, mxREAL);
+		else if (value != NULL)
+			mxDestroyArray(value);
+	} else if (strcmp(command, "put") == 0) {
+		if (nlhs > 1 || nrhs != 3)
+			mexErrMsgTxt("Must have 3 inputs and 0-1 outputs.");
+		plhs[0] = mxCreateLogicalScalar(MemoPut(cache, GetKey(prhs[1]), prhs[2]));
+	} else if (strcmp(command, "stats") == 0) {
+		const char		*fields[] = { "dir", "entries", "MB", "budgetMB", "hits", "misses", "puts", "evictions" };
+		SMemoStats		stats;
+
+		if (nlhs > 1 || nrhs != 1)
+			mexErrMsgTxt("Must have 1 input and 0-1 outputs.");
+		memset(&stats, 0, sizeof(stats));
+		if (cache != NULL)
+			stats = cache->stats();
+		plhs[0] = mxCreateStructMatrix(1, 1, sizeof(fields) / sizeof(fields[0]), fields);
+		mxSetFieldByNumber(plhs[0], 0, 0, mxCreateString(ThermoMemoDir().c_str()));
+		mxSetFieldByNumber(plhs[0], 0, 1, mxCreateDoubleScalar((double)stats.entries));
+		mxSetFieldByNumber(plhs[0], 0, 2, mxCreateDoubleScalar((double)stats.bytes / (1024.0 * 1024.0)));
+		mxSetFieldByNumber(plhs[0], 0, 3, mxCreateDoubleScalar((double)stats.budget / (1024.0 * 1024.0)));
+		mxSetFieldByNumber(plhs[0], 0, 4, mxCreateDoubleScalar((double)stats.hits));
+		mxSetFieldByNumber(plhs[0], 0, 5, mxCreateDoubleScalar((double)stats.misses));
+		mxSetFieldByNumber(plhs[0], 0, 6, mxCreateDoubleScalar((double)stats.puts));
+		mxSetFieldByNumber(plhs[0], 0, 7, mxCreateDoubleScalar((double)stats.evictions));
+	} else if (strcmp(command, "clear") == 0) {
+		if (nlhs != 0 || nrhs != 1)
+			mexErrMsgTxt("Must have 1 input and 0 outputs.");
+		if (cache != NULL)
+			cache->Clear();
+	} else {
+		mexErrMsgTxt("Unknown command.");
+	}
+}
@@ -0,0 +1,526 @@
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+//	shared work-stealing pool for the analysis kernels. workers must not call back into matlab (mexErrMsgTxt, mxCreate*),
+//	kernels report failures through their return values and the mex side raises the error.
+//
+//	one pool per module (each mex, ThermoBench, the executables): ThermoNumThreads() threads counting the caller, which
+//	works on its own loop instead of waiting. a loop is a range task split in halves down to grain items, the halves go
+//	to the deque of the thread that split them, which takes them back newest first while idle threads steal the oldest
+//	(largest) ones from the other deques. a ParallelFor inside a ParallelFor (a kernel called from a pipeline node or
+//	from a loop of another kernel) queues its halves on the same pool and its caller helps until it is done, so
+//	chained kernels never run more threads than the pool has. the pool follows THERMO_NUM_THREADS (threads, the number
+//	of cores when unset) and THERMO_AFFINITY (cpus the workers are pinned to in turn, as 0-3,8,10) whenever a loop
+//	starts with no other running, so setenv from matlab reconfigures every loaded mex; ThermoSetNumThreads and
+//	ThermoSetAffinity override them. workers leave after a second without work, a mex cleared from matlab has none
+//	left to join under the loader lock.
+
+//	cpu time of the calling thread [s]
+inline double ThermoThreadCpu()
+{
+#ifdef _WIN32
+	FILETIME		created, exited, kernel, user;
+	ULARGE_INTEGER	k, u;
+
+	if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user))
+		return 0.0;
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+
+	return (double)(k.QuadPart + u.QuadPart) * 1e-7;
+#else
+	struct timespec		ts;
+
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+		return 0.0;
+
+	return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+#endif
+}
+
+//	cpu time the pool threads spend on the loops of a profiled stage (CThermoStage, ThermoProfiler.h), also charged to
+//	the stages it runs in. a loop belongs to the account of the thread that starts it, a thread running a part of a
+//	loop of another account moves the time it takes from its own account to that one
+class CThermoCpuAccount
+{
+private:
+	std::atomic<int64_t>	mNs;
+	CThermoCpuAccount		*mParent;
+
+public:
+	CThermoCpuAccount(CThermoCpuAccount *parent) :
+		mNs(0),
+		mParent(parent)
+	{
+	}
+
+	//	of the calling thread, NULL outside a profiled stage
+	static CThermoCpuAccount *&Current()
+	{
+		static thread_local CThermoCpuAccount	*current = NULL;
+
+		return current;
+	}
+
+	void Charge(double seconds)
+	{
+		for (CThermoCpuAccount *account = this; account != NULL; account = account->mParent)
+			account->mNs += (int64_t)(seconds * 1e9);
+	}
+
+	double seconds() const
+	{
+		return (double)mNs.load() * 1e-9;
+	}
+};
+
+class CThermoPool
+{
+public:
+	class CJob
+	{
+	public:
+		std::atomic<size_t>		remaining;			//	items not yet run
+		size_t					grain;
+		CThermoCpuAccount		*account;			//	of the thread that started the loop
+
+		CJob(size_t count, size_t grainSize) :
+			remaining(count),
+			grain(grainSize),
+			account(CThermoCpuAccount::Current())
+		{
+		}
+
+		virtual ~CJob()
+		{
+		}
+
+		virtual void Run(size_t begin, size_t end) = 0;
+	};
+
+private:
+	struct STask
+	{
+		CJob		*job;
+		size_t		begin;
+		size_t		end;
+	};
+
+	struct SQueue
+	{
+		std::mutex			lock;
+		std::deque<STask>	tasks;
+	};
+
+	std::mutex								mConfigLock;
+	std::vector<std::unique_ptr<SQueue>>	mQueues;			//	0 for threads outside the pool, then one per worker
+	std::vector<std::thread>				mWorkers;
+	std::vector<char>						mRunning;			//	per worker, cleared when it leaves idle
+	std::atomic<size_t>						mQueued;
+	std::atomic<size_t>						mSleeping;
+	std::atomic<size_t>						mActive;			//	top level loops running
+	std::mutex								mSleepLock;
+	std::condition_variable					mWake;
+	bool									mStop;
+	unsigned								mNumThreads;
+	std::vector<int>						mAffinity;
+	unsigned								mSetThreads;		//	ThermoSetNumThreads, 0 for the environment
+	std::vector<int>						mSetCpus;			//	ThermoSetAffinity, empty for the environment
+
+	static size_t &Slot()
+	{
+		static thread_local size_t	slot = 0;
+
+		return slot;
+	}
+
+	static CThermoPool *&Owner()
+	{
+		static thread_local CThermoPool		*owner = NULL;
+
+		return owner;
+	}
+
+	static std::string GetEnv(const char *name)
+	{
+		const char	*value = getenv(name);
+
+		return value != NULL ? value : "";
+	}
+
+	//	"0-3,8,10"
+	static std::vector<int> ParseCpus(const std::string &text)
+	{
+		std::vector<int>	cpus;
+		size_t				pos = 0;
+
+		while (pos < text.size()) {
+			size_t		end = text.find(',', pos);
+			std::string	item = text.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+			size_t		dash = item.find('-');
+			int			lo = atoi(item.c_str()), hi = dash != std::string::npos ? atoi(item.c_str() + dash + 1) : lo;
+
+			for (int cpu = lo; cpu <= hi && cpu >= 0; ++cpu)
+				cpus.push_back(cpu);
+			if (end == std::string::npos)
+				break;
+			pos = end + 1;
+		}
+
+		return cpus;
+	}
+
+	static void Pin(std::thread &thread, int cpu)
+	{
+#ifdef _WIN32
+		if (cpu < (int)(8 * sizeof(DWORD_PTR)))
+			SetThreadAffinityMask((HANDLE)thread.native_handle(), (DWORD_PTR)1 << cpu);
+#elif defined(__linux__)
+		cpu_set_t	set;
+
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+		(void)thread;
+		(void)cpu;
+#endif
+	}
+
+	void Push(size_t slot, const STask &task)
+	{
+		{
+			std::lock_guard<std::mutex>		guard(mQueues[slot]->lock);
+
+			mQueues[slot]->tasks.push_back(task);
+		}
+		++mQueued;
+		if (mSleeping.load() > 0) {
+			std::lock_guard<std::mutex>		guard(mSleepLock);
+
+			mWake.notify_one();
+		}
+	}
+
+	//	newest task of the own deque, else the oldest of another one
+	bool Take(size_t slot, STask &task)
+	{
+		if (mQueued.load() == 0)
+			return false;
+		for (size_t i = 0; i < mQueues.size(); ++i) {
+			SQueue							&queue = *mQueues[(slot + i) % mQueues.size()];
+			std::lock_guard<std::mutex>		guard(queue.lock);
+
+			if (queue.tasks.empty())
+				continue;
+			if (i == 0) {
+				task = queue.tasks.back();
+				queue.tasks.pop_back();
+			}
+			else {
+				task = queue.tasks.front();
+				queue.tasks.pop_front();
+			}
+			--mQueued;
+			return true;
+		}
+
+		return false;
+	}
+
+	//	runs a task, moving its cpu time to the account of its loop when the thread works for another one
+	static void RunTask(const STask &task)
+	{
+		CThermoCpuAccount	*&current = CThermoCpuAccount::Current(), *own = current;
+		double				start;
+
+		if (task.job->account == own) {
+			task.job->Run(task.begin, task.end);
+			return;
+		}
+		start = ThermoThreadCpu();
+		current = task.job->account;
+		task.job->Run(task.begin, task.end);
+		current = own;
+
+		double		used = ThermoThreadCpu() - start;
+
+		if (task.job->account != NULL)
+			task.job->account->Charge(used);
+		if (own != NULL)
+			own->Charge(-used);
+	}
+
+	//	splits the task down to its grain, queueing the upper halves, and runs the rest
+	void Execute(size_t slot, STask task)
+	{
+		size_t		grain = task.job->grain;
+
+		while (task.end - task.begin > grain && mNumThreads > 1) {
+			size_t		half = (task.end - task.begin + grain - 1) / grain / 2 * grain;
+			STask		upper = { task.job, task.begin + std::max(half, grain), task.end };
+
+			Push(slot, upper);
+			task.end = upper.begin;
+		}
+		RunTask(task);
+		task.job->remaining.fetch_sub(task.end - task.begin, std::memory_order_acq_rel);
+	}
+
+	void Work(size_t slot)
+	{
+		Slot() = slot;
+		Owner() = this;
+
+		STask		task;
+
+		for (;;) {
+			if (Take(slot, task)) {
+				Execute(slot, task);
+				continue;
+			}
+
+			std::unique_lock<std::mutex>	guard(mSleepLock);
+
+			++mSleeping;
+
+			bool		woken = mWake.wait_for(guard, std::chrono::seconds(1), [this]() { return mStop || mQueued.load() > 0; });
+
+			--mSleeping;
+			if (mStop || (!woken && mActive.load() == 0)) {
+				mRunning[slot - 1] = 0;
+				return;
+			}
+		}
+	}
+
+	void StopWorkers()
+	{
+		{
+			std::lock_guard<std::mutex>		guard(mSleepLock);
+
+			mStop = true;
+			mWake.notify_all();
+		}
+		for (size_t i = 0; i < mWorkers.size(); ++i)
+			if (mWorkers[i].joinable())
+				mWorkers[i].join();
+		mWorkers.clear();
+		mRunning.clear();
+		mStop = false;
+	}
+
+	unsigned DesiredThreads() const
+	{
+		unsigned	n = mSetThreads > 0 ? mSetThreads : (unsigned)atoi(GetEnv("THERMO_NUM_THREADS").c_str());
+
+		if (n == 0)
+			n = std::thread::hardware_concurrency();
+
+		return n == 0 ? 1 : n;
+	}
+
+	//	numThreads threads counting the caller, the workers pinned to cpus in turn (none when empty)
+	void Configure(unsigned numThreads, const std::vector<int> &cpus)
+	{
+		StopWorkers();
+		mNumThreads = numThreads;
+		mAffinity = cpus;
+		mQueues.clear();
+		for (unsigned i = 0; i < mNumThreads; ++i)
+			mQueues.emplace_back(new SQueue());
+		mWorkers.resize(mNumThreads - 1);
+		mRunning.assign(mNumThreads - 1, 0);
+	}
+
+	//	follows the settings and (re)starts the workers that left. the caller is the only loop running
+	void Prepare()
+	{
+		unsigned			numThreads = DesiredThreads();
+		std::vector<int>	cpus = !mSetCpus.empty() ? mSetCpus : ParseCpus(GetEnv("THERMO_AFFINITY"));
+
+		if (mQueues.empty() || numThreads != mNumThreads || cpus != mAffinity)
+			Configure(numThreads, cpus);
+
+		std::lock_guard<std::mutex>		guard(mSleepLock);
+
+		for (size_t i = 0; i < mWorkers.size(); ++i) {
+			if (mRunning[i])
+				continue;
+			if (mWorkers[i].joinable())
+				mWorkers[i].join();
+			mRunning[i] = 1;
+			mWorkers[i] = std::thread(&CThermoPool::Work, this, i + 1);
+			if (!mAffinity.empty())
+				Pin(mWorkers[i], mAffinity[i % mAffinity.size()]);
+		}
+	}
+
+	CThermoPool() :
+		mQueued(0),
+		mSleeping(0),
+		mActive(0),
+		mStop(false),
+		mNumThreads(1),
+		mSetThreads(0)
+	{
+	}
+
+public:
+	~CThermoPool()
+	{
+		StopWorkers();
+	}
+
+	static CThermoPool &Instance()
+	{
+		static CThermoPool	pool;
+
+		return pool;
+	}
+
+	//	threads of the running loops, else of the next one
+	unsigned numThreads()
+	{
+		std::lock_guard<std::mutex>		guard(mConfigLock);
+
+		return mActive.load() > 0 ? mNumThreads : DesiredThreads();
+	}
+
+	//	applied when the next loop starts
+	void SetThreads(unsigned numThreads)
+	{
+		std::lock_guard<std::mutex>		guard(mConfigLock);
+
+		mSetThreads = numThreads;
+	}
+
+	void SetAffinity(const std::vector<int> &cpus)
+	{
+		std::lock_guard<std::mutex>		guard(mConfigLock);
+
+		mSetCpus = cpus;
+	}
+
+	//	runs the job over [0, count) and returns when all of it has run, helping with any queued task meanwhile
+	void Run(CJob &job, size_t count)
+	{
+		bool		inside = Owner() == this;
+		size_t		slot = inside ? Slot() : 0;
+
+		if (!inside) {
+			std::lock_guard<std::mutex>		guard(mConfigLock);
+
+			if (mActive++ == 0)
+				Prepare();
+		}
+
+		STask		task = { &job, 0, count };
+
+		Execute(slot, task);
+		while (job.remaining.load(std::memory_order_acquire) > 0) {
+			if (Take(slot, task))
+				Execute(slot, task);
+			else
+				std::this_thread::yield();
+		}
+
+		if (!inside)
+			--mActive;
+	}
+};
+
+//	number of threads of the pool, the caller included
+inline unsigned ThermoNumThreads()
+{
+	return CThermoPool::Instance().numThreads();
+}
+
+//	0 goes back to THERMO_NUM_THREADS, from the next loop on
+inline void ThermoSetNumThreads(unsigned numThreads)
+{
+	CThermoPool::Instance().SetThreads(numThreads);
+}
+
+//	pins the workers to the cpus in turn, empty goes back to THERMO_AFFINITY, from the next loop on
+inline void ThermoSetAffinity(const std::vector<int> &cpus)
+{
+	CThermoPool::Instance().SetAffinity(cpus);
+}
+
+//	calls fn(begin, end) on chunks of [0, count), chunks are at least grain items and balanced by stealing
+template <class kfn>
+void ParallelFor(size_t count, size_t grain, kfn fn)
+{
+	class CRangeJob : public CThermoPool::CJob
+	{
+	private:
+		kfn		&mFn;
+
+	public:
+		CRangeJob(kfn &fn, size_t count, size_t grain) :
+			CJob(count, grain),
+			mFn(fn)
+		{
+		}
+
+		void Run(size_t begin, size_t end)
+		{
+			mFn(begin, end);
+		}
+	};
+
+	if (grain == 0)
+		grain = 1;
+	if (count <= grain || ThermoNumThreads() <= 1) {
+		if (count > 0)
+			fn((size_t)0, count);
+		return;
+	}
+
+	CRangeJob		job(fn, count, grain);
+
+	CThermoPool::Instance().Run(job, count);
+}
+
+//	calls fn(r0, r1, c0, c1) on tiles of at most tileRows x tileCols of a rows x cols map ([r0, r1) x [c0, c1)), a
+//	tile at a time
+template <class kfn>
+void ParallelForTiles(size_t rows, size_t cols, size_t tileRows, size_t tileCols, kfn fn)
+{
+	size_t		tilesDown = (rows + tileRows - 1) / tileRows, tilesAcross = (cols + tileCols - 1) / tileCols;
+
+	ParallelFor(tilesDown * tilesAcross, 1, [&](size_t begin, size_t end) {
+		for (size_t t = begin; t < end; ++t) {
+			size_t		r0 = (t % tilesDown) * tileRows, c0 = (t / tilesDown) * tileCols;
+
+			fn(r0, std::min(r0 + tileRows, rows), c0, std::min(c0 + tileCols, cols));
+		}
+	});
+}
@@ -0,0 +1,387 @@
+#pragma once
+
+#include "ThermoParallel.h"
+#include "ThermoProfiler.h"
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+//	out-of-core streaming operator graph
+//
+//	a source decodes the recording in blocks of frames (single precision, matlab column major frames) and the blocks
+//	flow through a DAG of operators: transforms (window, resample, filters, registration) hand a new block to their
+//	children, sinks (lock-in, TSR, statistics, ...) only accumulate. blocks are immutable and shared, so every branch
+//	reading the same input shares a single decode and a transform that does not change a block forwards it as is.
+//	each operator sees its blocks in order, one at a time. the graph runs in rounds on the shared pool (ThermoParallel.h):
+//	a round takes the next block of every operator that has one and the next read, runs them as one ParallelFor and
+//	then hands the outputs on, so operators, their kernels and the reader share ThermoNumThreads() threads and a chain
+//	of operators works on consecutive blocks at once.
+//	every block in flight is charged to a global memory budget and the source only decodes the next block while the
+//	budget allows it, which is the backpressure: a slow branch holds its blocks and stops the reader. operators report
+//	failures through their return value and error(), like the other kernels they never call back into matlab.
+//	with THERMO_PROFILE set every read and every block through a node is a stage of the profile (ThermoProfiler.h),
+//	named after the node.
+
+struct SFrameBlock
+{
+	size_t					rows;
+	size_t					cols;
+	size_t					numFrames;
+	int64_t					first;			//	index of the first frame in the source
+	std::vector<float>		data;			//	numFrames frames of rows x cols
+	std::vector<double>		time;			//	[s]
+
+	size_t numPixels() const
+	{
+		return rows * cols;
+	}
+
+	const float *frame(size_t f) const
+	{
+		return &data[f * rows * cols];
+	}
+};
+
+typedef std::shared_ptr<const SFrameBlock>	SFrameBlockPtr;
+
+//	hands out blocks charged to the memory budget, the charge goes away with the last reference to the block
+class CBlockAllocator
+{
+private:
+	std::atomic<size_t>			mBytes;
+
+public:
+	CBlockAllocator() :
+		mBytes(0)
+	{
+	}
+
+	size_t bytes() const
+	{
+		return mBytes;
+	}
+
+	std::shared_ptr<SFrameBlock> Allocate(size_t rows, size_t cols, size_t numFrames, int64_t first)
+	{
+		size_t		size = rows * cols * numFrames * sizeof(float) + numFrames * sizeof(double);
+
+		mBytes += size;
+
+		std::shared_ptr<SFrameBlock>	block(new SFrameBlock, [this, size](SFrameBlock *p) {
+			delete p;
+			mBytes -= size;
+		});
+
+		block->rows = rows;
+		block->cols = cols;
+		block->numFrames = numFrames;
+		block->first = first;
+		block->data.resize(rows * cols * numFrames);
+		block->time.resize(numFrames);
+
+		return block;
+	}
+};
+
+class CFrameSource
+{
+protected:
+	std::string		mError;
+
+public:
+	virtual ~CFrameSource()
+	{
+	}
+
+	virtual size_t rows() const = 0;
+	virtual size_t cols() const = 0;
+
+	//	frames left to read as far as the source knows, 0 when it cannot tell
+	virtual size_t numFrames() const
+	{
+		return 0;
+	}
+
+	//	next block of at most maxFrames frames, NULL at the end (check error() for failures)
+	virtual SFrameBlockPtr Read(CBlockAllocator &alloc, size_t maxFrames) = 0;
+
+	const std::string &error() const
+	{
+		return mError;
+	}
+};
+
+//	a cube already in memory, mostly to run the graph on data loaded in matlab
+template <typename kind>
+class CArraySource : public CFrameSource
+{
+private:
+	const kind		*mData;
+	const double	*mTime;
+	size_t			mRows;
+	size_t			mCols;
+	size_t			mNumFrames;
+	size_t			mNext;
+
+public:
+	CArraySource(const kind *data, const double *time, size_t rows, size_t cols, size_t numFrames) :
+		mData(data),
+		mTime(time),
+		mRows(rows),
+		mCols(cols),
+		mNumFrames(numFrames),
+		mNext(0)
+	{
+	}
+
+	size_t rows() const
+	{
+		return mRows;
+	}
+
+	size_t cols() const
+	{
+		return mCols;
+	}
+
+	size_t numFrames() const
+	{
+		return mNumFrames - mNext;
+	}
+
+	SFrameBlockPtr Read(CBlockAllocator &alloc, size_t maxFrames)
+	{
+		size_t		n = std::min(maxFrames, mNumFrames - mNext), pixels = mRows * mCols;
+
+		if (n == 0)
+			return SFrameBlockPtr();
+
+		std::shared_ptr<SFrameBlock>	block = alloc.Allocate(mRows, mCols, n, (int64_t)mNext);
+
+		std::transform(mData + mNext * pixels, mData + (mNext + n) * pixels, block->data.begin(), [](kind v) { return (float)v; });
+		std::copy(mTime + mNext, mTime + mNext + n, block->time.begin());
+		mNext += n;
+
+		return block;
+	}
+};
+
+class COperator
+{
+protected:
+	std::string		mError;
+
+public:
+	virtual ~COperator()
+	{
+	}
+
+	//	out stays NULL for sinks, or when a transform has nothing to hand on yet
+	virtual bool Process(const SFrameBlockPtr &in, CBlockAllocator &alloc, SFrameBlockPtr &out) = 0;
+
+	//	called once after the last block, transforms may flush what they held back
+	virtual bool Finish(CBlockAllocator &alloc, SFrameBlockPtr &out)
+	{
+		(void)alloc;
+		out.reset();
+
+		return true;
+	}
+
+	const std::string &error() const
+	{
+		return mError;
+	}
+};
+
+class CPipeline
+{
+private:
+	struct SNode
+	{
+		std::unique_ptr<COperator>		op;
+		std::string						name;
+		std::vector<size_t>				children;
+		std::deque<SFrameBlockPtr>		queue;
+		bool							inputDone;
+		bool							finished;
+	};
+
+	//	one block through a node (Finish without one), or a read when node is the number of nodes
+	struct SStep
+	{
+		size_t				node;
+		SFrameBlockPtr		in;
+		SFrameBlockPtr		out;
+		bool				ok;
+	};
+
+	std::vector<SNode>			mNodes;
+	std::vector<size_t>			mSourceChildren;
+	std::string					mError;
+
+	void RunStep(SStep &step, CFrameSource &source, CBlockAllocator &alloc, size_t blockSize)
+	{
+		if (step.node == mNodes.size()) {
+			CThermoStage	stage("read", "ThermoPipeline");
+
+			step.out = source.Read(alloc, std::max<size_t>(blockSize, 1));
+			if (step.out != NULL)
+				stage.SetBytes((double)step.out->data.size() * sizeof(float));
+			return;
+		}
+
+		SNode			&node = mNodes[step.node];
+		bool			last = step.in == NULL;
+		CThermoStage	stage(last ? node.name + ".finish" : node.name, "ThermoPipeline",
+			last ? 0.0 : (double)step.in->data.size() * sizeof(float));
+
+		step.ok = last ? node.op->Finish(alloc, step.out) : node.op->Process(step.in, alloc, step.out);
+	}
+
+	//	hands out to the children of a node (or of the source)
+	void Deliver(const std::vector<size_t> &children, const SFrameBlockPtr &block)
+	{
+		if (block == NULL)
+			return;
+		for (size_t i = 0; i < children.size(); ++i)
+			mNodes[children[i]].queue.push_back(block);
+	}
+
+	void CloseInputs(const std::vector<size_t> &children)
+	{
+		for (size_t i = 0; i < children.size(); ++i)
+			mNodes[children[i]].inputDone = true;
+	}
+
+public:
+	CPipeline()
+	{
+	}
+
+	//	input is 0 for the source or 1 + the index of an earlier node, returns the index of the new node. name is for
+	//	the profile only
+	size_t Add(COperator *op, size_t input, const std::string &name = "operator")
+	{
+		SNode		node;
+
+		node.op.reset(op);
+		node.name = name;
+		node.inputDone = false;
+		node.finished = false;
+		if (input == 0)
+			mSourceChildren.push_back(mNodes.size());
+		else
+			mNodes[input - 1].children.push_back(mNodes.size());
+		mNodes.push_back(std::move(node));
+
+		return mNodes.size() - 1;
+	}
+
+	size_t numNodes() const
+	{
+		return mNodes.size();
+	}
+
+	COperator *op(size_t node) const
+	{
+		return mNodes[node].op.get();
+	}
+
+	//	a single pass over the source, blockSize frames at a time within budget bytes (a block is always let through
+	//	when nothing else can run). false on the first failure, see error()
+	bool Run(CFrameSource &source, size_t blockSize, size_t budget)
+	{
+		CBlockAllocator		alloc;
+		bool				sourceDone = false;
+		size_t				blockBytes = source.rows() * source.cols() * std::max<size_t>(blockSize, 1) * sizeof(float);
+
+		mError.clear();
+		for (;;) {
+			std::vector<SStep>	steps;
+			bool				all = sourceDone;
+
+			for (size_t i = 0; i < mNodes.size(); ++i) {
+				SNode	&node = mNodes[i];
+
+				all = all && node.finished;
+				if (node.finished || (node.queue.empty() && !node.inputDone))
+					continue;
+
+				SStep	step = { i, SFrameBlockPtr(), SFrameBlockPtr(), true };
+
+				if (!node.queue.empty()) {
+					step.in = node.queue.front();
+					node.queue.pop_front();
+				}
+				steps.push_back(step);
+			}
+			if (all)
+				return true;
+
+			//	one read per round while the budget allows it, or when the operators have nothing to do
+			bool	read = !sourceDone && (steps.empty() || alloc.bytes() + blockBytes <= budget || alloc.bytes() == 0);
+
+			if (steps.empty() && !read) {
+				mError = "The pipeline stalled.";
+				return false;
+			}
+			if (read) {
+				SStep	step = { mNodes.size(), SFrameBlockPtr(), SFrameBlockPtr(), true };
+
+				steps.push_back(step);
+			}
+
+			ParallelFor(steps.size(), 1, [&](size_t begin, size_t end) {
+				for (size_t k = begin; k < end; ++k)
+					RunStep(steps[k], source, alloc, blockSize);
+			});
+
+			//	children get the outputs in node order, so every operator still sees its blocks in order
+			for (size_t k = 0; k < steps.size(); ++k) {
+				SStep	&step = steps[k];
+
+				if (step.node == mNodes.size()) {
+					if (step.out == NULL) {
+						sourceDone = true;
+						if (!source.error().empty())
+							mError = source.error();
+						CloseInputs(mSourceChildren);
+					}
+					else
+						Deliver(mSourceChildren, step.out);
+					continue;
+				}
+
+				SNode	&node = mNodes[step.node];
+
+				if (!step.ok) {
+					if (mError.empty())
+						mError = node.op->error();
+					continue;
+				}
+				Deliver(node.children, step.out);
+				if (step.in == NULL) {
+					node.finished = true;
+					CloseInputs(node.children);
+				}
+			}
+			steps.clear();
+			if (!mError.empty()) {
+				for (size_t i = 0; i < mNodes.size(); ++i)
+					mNodes[i].queue.clear();
+				return false;
+			}
+		}
+	}
+
+	const std::string &error() const
+	{
+		return mError;
+	}
+};
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "ThermoParallel.h"
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+//	per stage profile of the analysis
+//
+//	when THERMO_PROFILE names a file, every CThermoStage appends one line of json to it when it ends:
+//		{"name":"lockin","source":"LockInSweepMex","pid":1234,"tid":5678,"ts":1718000000000000,"dur":120000,
+//		 "cpu":0.42,"bytes":9.8e7,"rssMB":812.5,"peakMB":1630.2,"threads":8}
+//	ts is the start (microseconds since 1970, one clock for every mex and for matlab), dur the wall time [us], cpu the
+//	cpu time [s] of the thread of the stage and of the pool threads while they ran its loops (CThermoCpuAccount, nested
+//	stages included), so cpu / (dur threads) is the use of the pool by that stage even when stages overlap, bytes the
+//	data the stage went through, rssMB and peakMB the resident and peak resident memory of the process at its end. the file is opened for
+//	every line, so each mex, the executables and TermoAnalizer (stageEnd) add to the same log, and
+//	TermoAnalizer.profileReport turns it into the json report and the chrome trace. without THERMO_PROFILE a stage
+//	costs a getenv.
+
+struct SThermoProcessStats
+{
+	double		rssMB;
+	double		peakMB;
+};
+
+inline SThermoProcessStats ThermoProcessStats()
+{
+	SThermoProcessStats		stats = { 0.0, 0.0 };
+
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS		counters;
+
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		stats.rssMB = (double)counters.WorkingSetSize / (1024.0 * 1024.0);
+		stats.peakMB = (double)counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+	}
+#else
+	struct rusage		usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+		stats.peakMB = (double)usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+		stats.peakMB = (double)usage.ru_maxrss / 1024.0;
+#endif
+	}
+
+	FILE		*statm = fopen("/proc/self/statm", "r");
+	long		size, resident;
+
+	if (statm != NULL) {
+		if (fscanf(statm, "%ld %ld", &size, &resident) == 2)
+			stats.rssMB = (double)resident * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+		fclose(statm);
+	}
+#endif
+
+	return stats;
+}
+
+inline bool ThermoProfiling()
+{
+	const char	*file = getenv("THERMO_PROFILE");
+
+	return file != NULL && file[0] != 0;
+}
+
+class CThermoStage
+{
+private:
+	std::string				mName;
+	const char				*mSource;
+	double					mBytes;
+	bool					mOn;
+	int64_t					mStart;				//	[us] since 1970
+	double					mCpu;				//	of the thread at the start
+	CThermoCpuAccount		mAccount;			//	the other threads
+	CThermoCpuAccount		*mOuter;			//	account of the thread before the stage
+
+	static int64_t Now()
+	{
+		return (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+
+	static std::mutex &Lock()
+	{
+		static std::mutex	lock;
+
+		return lock;
+	}
+
+	//	names are ours or operator names, only quotes and backslashes need escaping
+	static std::string Escape(const std::string &text)
+	{
+		std::string		out;
+
+		for (size_t i = 0; i < text.size(); ++i) {
+			if (text[i] == '"' || text[i] == '\\')
+				out += '\\';
+			if ((unsigned char)text[i] >= 0x20)
+				out += text[i];
+		}
+
+		return out;
+	}
+
+public:
+	//	source is the module (mex or executable) the stage runs in
+	CThermoStage(const std::string &name, const char *source, double bytes = 0.0) :
+		mName(name),
+		mSource(source),
+		mBytes(bytes),
+		mOn(ThermoProfiling()),
+		mStart(0),
+		mCpu(0.0),
+		mAccount(CThermoCpuAccount::Current()),
+		mOuter(CThermoCpuAccount::Current())
+	{
+		if (mOn) {
+			mStart = Now();
+			mCpu = ThermoThreadCpu();
+			CThermoCpuAccount::Current() = &mAccount;
+		}
+	}
+
+	~CThermoStage()
+	{
+		if (!mOn)
+			return;
+		CThermoCpuAccount::Current() = mOuter;
+
+		int64_t					end = Now();
+		double					cpu = ThermoThreadCpu() - mCpu + mAccount.seconds();
+		SThermoProcessStats		stats = ThermoProcessStats();
+		const char				*file = getenv("THERMO_PROFILE");
+		std::lock_guard<std::mutex>		guard(Lock());
+		FILE					*out = file != NULL ? fopen(file, "a") : NULL;
+
+		if (out == NULL)
+			return;
+		fprintf(out, "{\"name\":\"%s\",\"source\":\"%s\",\"pid\":%lu,\"tid\":%lu,\"ts\":%lld,\"dur\":%lld,\"cpu\":%.6f,\"bytes\":%.17g,"
+			"\"rssMB\":%.1f,\"peakMB\":%.1f,\"threads\":%u}\n", Escape(mName).c_str(), Escape(mSource).c_str(),
+#ifdef _WIN32
+			(unsigned long)GetCurrentProcessId(),
+#else
+			(unsigned long)getpid(),
+#endif
+			(unsigned long)(std::hash<std::thread::id>()(std::this_thread::get_id()) & 0xffffffffu), (long long)mStart,
+			(long long)(end - mStart), cpu, mBytes, stats.rssMB, stats.peakMB, ThermoNumThreads());
+		fclose(out);
+	}
+
+	void SetBytes(double bytes)
+	{
+		mBytes = bytes;
+	}
+
+	void AddBytes(double bytes)
+	{
+		mBytes += bytes;
+	}
+};
@@ -0,0 +1,103 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "ThermoServer.h"
+#include "ImagerFileSource.h"
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+//	cl /O2 /EHsc /std:c++17 /I%FILESDKDIR%include ThermoServer.cpp /link /LIBPATH:%FILESDKDIR%bin\x64\Release tc.lib tc.file.lib tc.reduce.lib ws2_32.lib psapi.lib
+
+//	ThermoServer [options]
+//
+//	the local analysis server (ThermoServer.h) on ATS recordings: each recording is decoded once and stays in memory
+//	with the maps computed from it while the budget allows, for every matlab session (ThermoServerMex) and tool on the
+//	machine. the recording fields of a request are source (the file), unit (temperatureFactory), temperatureType
+//	(celsius), first and last (frames, 1 based, the whole movie by default) and fs (frame rate when frames carry no
+//	time). options:
+//		--socket path		(THERMO_SERVER, thermo-server.sock in the temp folder)
+//		--memory MB			of recordings and results (4096)
+//		--threads n			of the pool (THERMO_NUM_THREADS)
+//	it runs until ctrl-c or a shutdown request.
+
+static std::atomic<bool>	gStop(false);
+
+static void OnSignal(int)
+{
+	gStop = true;
+}
+
+static CFrameSource *OpenRecording(const SIpcMessage &request, std::string &error)
+{
+	tc::EUnit			unit = ImagerUnit(request.Get("unit", "temperatureFactory"));
+	tc::ETempType		tempType = ImagerTempType(request.Get("temperatureType", "celsius"));
+	double				first = request.GetNumber("first", 1.0), last = request.GetNumber("last", INFINITY);
+	CImagerFileSource	*source;
+
+	if (unit == tc::unitError) {
+		error = "Unknown unit.";
+		return NULL;
+	}
+	if (tempType == tc::ttError) {
+		error = "Unknown temperatureType.";
+		return NULL;
+	}
+
+	source = new CImagerFileSource(request.Get("source").c_str(), unit, tempType,
+		(tc::UInt32)std::max(first - 1.0, 0.0), std::isinf(last) ? 0xFFFFFFFF : (tc::UInt32)std::max(last - 1.0, 0.0),
+		request.GetNumber("fs", 0.0));
+	if (!source->isOpen()) {
+		error = source->error();
+		delete source;
+		return NULL;
+	}
+
+	return source;
+}
+
+int main(int argc, char **argv)
+{
+	std::string		path = ThermoServerPath();
+	double			memory = 4096.0;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string		arg = argv[i];
+		bool			value = i + 1 < argc;
+
+		if (arg == "--socket" && value)
+			path = argv[++i];
+		else if (arg == "--memory" && value)
+			memory = atof(argv[++i]);
+		else if (arg == "--threads" && value)
+			ThermoSetNumThreads((unsigned)atoi(argv[++i]));
+		else {
+			fprintf(stderr, "usage: %s [--socket path] [--memory MB] [--threads n]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (!(memory > 0.0)) {
+		fprintf(stderr, "--memory must be positive\n");
+		return 1;
+	}
+
+	CThermoServer	server(OpenRecording, (size_t)(memory * 1024.0 * 1024.0));
+
+	if (!server.Start(path)) {
+		fprintf(stderr, "%s\n", server.error().c_str());
+		return 1;
+	}
+	signal(SIGINT, OnSignal);
+	signal(SIGTERM, OnSignal);
+	printf("listening on %s, %.0f MB, %u threads\n", path.c_str(), memory, ThermoNumThreads());
+	fflush(stdout);
+
+	while (!gStop && !server.stopped())
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	server.Stop();
+
+	return 0;
+}
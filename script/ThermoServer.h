@@ -0,0 +1,547 @@
+#pragma once
+
+#include "ThermoIpc.h"
+#include "ThermoPipeline.h"
+#include "LockInAccumulator.h"
+#include "ThermoParallel.h"
+#include <functional>
+#include <future>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cmath>
+
+//	local analysis server
+//
+//	recordings are decoded once into shared memory (float frames, matlab column major, then the double frame times at
+//	timeOffset) and kept with the maps derived from them in one LRU cache within a memory budget. requests are
+//	stateless, each names its recording (source, unit, temperatureType, first, last, fs), so a recording evicted in
+//	between is just decoded again, and clients asking together for the same missing entry wait for a single decode or
+//	computation. every connection has a thread, the analyses run on the shared pool (ThermoParallel.h), and replies
+//	carry the name of the segment holding the result, which the client maps read only (ThermoServerClient.h): frames
+//	and maps never go through the socket. an entry evicted while a client maps it stays valid for that client.
+//
+//	requests, frames 1 based and inclusive:
+//		open		recording fields						-> rows, cols, frames, timeOffset; the cube
+//		lockin		recording fields, freqs (comma list)	-> rows, cols, count; amplitude then phase maps, count each
+//		reduce		recording fields, op (mean, min, max, std)	-> rows, cols, count (1); the map
+//		roi			recording fields, r0, r1, c0, c1		-> rows (frames), cols, count (1); mean of the rectangle per frame
+//		stats											-> entries, cachedMB, budgetMB, hits, misses, decodes, requests,
+//															clients
+//		shutdown
+//	results are doubles but for the cube. a reply is "ok" with the fields above and shm, bytes and cached (1 when it
+//	came from the cache), or "error <message>".
+
+//	a frame source for the request (its source field and the other recording fields), NULL with error set on failure
+typedef std::function<CFrameSource *(const SIpcMessage &request, std::string &error)>	FThermoSourceFactory;
+
+struct SServerEntry
+{
+	CSharedMemory		shm;
+	SIpcMessage			reply;				//	fields handed to every client
+	size_t				bytes;
+	std::string			error;				//	not cached when set
+};
+
+typedef std::shared_ptr<SServerEntry>	SServerEntryPtr;
+
+class CServerCache
+{
+private:
+	typedef std::list<std::pair<std::string, SServerEntryPtr>>	LruList;
+
+	size_t														mBudget;
+	size_t														mBytes;
+	LruList														mLru;
+	std::unordered_map<std::string, LruList::iterator>			mIndex;
+	std::unordered_map<std::string, std::shared_future<SServerEntryPtr>>	mPending;
+	std::mutex													mMutex;
+
+public:
+	std::atomic<size_t>											hits;
+	std::atomic<size_t>											misses;
+
+	CServerCache(size_t budget) :
+		mBudget(budget),
+		mBytes(0),
+		hits(0),
+		misses(0)
+	{
+	}
+
+	//	the entry of key, made by make when missing (once, the other callers wait for it)
+	SServerEntryPtr Get(const std::string &key, const std::function<SServerEntryPtr()> &make, bool &cached)
+	{
+		std::unique_lock<std::mutex>			lock(mMutex);
+		std::promise<SServerEntryPtr>			promise;
+		SServerEntryPtr							entry;
+
+		cached = false;
+		if (mIndex.count(key) != 0) {
+			LruList::iterator		it = mIndex[key];
+
+			mLru.splice(mLru.begin(), mLru, it);
+			++hits;
+			cached = true;
+			return it->second;
+		}
+		if (mPending.count(key) != 0) {
+			std::shared_future<SServerEntryPtr>		pending = mPending[key];
+
+			lock.unlock();
+			++hits;
+			cached = true;
+			return pending.get();
+		}
+		mPending[key] = promise.get_future().share();
+		++misses;
+		lock.unlock();
+
+		entry = make();
+
+		lock.lock();
+		mPending.erase(key);
+		if (entry->error.empty()) {
+			mLru.emplace_front(key, entry);
+			mIndex[key] = mLru.begin();
+			mBytes += entry->bytes;
+			//	least recently used first, never the new entry
+			while (mBytes > mBudget && mLru.size() > 1) {
+				mBytes -= mLru.back().second->bytes;
+				mIndex.erase(mLru.back().first);
+				mLru.pop_back();
+			}
+		}
+		lock.unlock();
+		promise.set_value(entry);
+
+		return entry;
+	}
+
+	void Stats(size_t &entries, size_t &bytes)
+	{
+		std::lock_guard<std::mutex>		lock(mMutex);
+
+		entries = mLru.size();
+		bytes = mBytes;
+	}
+
+	size_t budget() const
+	{
+		return mBudget;
+	}
+};
+
+class CThermoServer
+{
+private:
+	struct SConnection
+	{
+		std::thread				thread;
+		std::atomic<bool>		done;
+	};
+
+	FThermoSourceFactory					mFactory;
+	CServerCache							mCache;
+	CIpcSocket								mListener;
+	std::string								mPath;
+	std::thread								mAcceptThread;
+	std::list<std::unique_ptr<SConnection>>	mConnections;
+	std::atomic<bool>						mStop;
+	std::atomic<size_t>						mDecodes;
+	std::atomic<size_t>						mRequests;
+	std::atomic<size_t>						mClients;
+	std::string								mError;
+
+	static SServerEntryPtr Failed(const std::string &message)
+	{
+		SServerEntryPtr		entry(new SServerEntry);
+
+		entry->bytes = 0;
+		entry->error = message;
+
+		return entry;
+	}
+
+	//	the fields naming the recording, the key of its cube
+	static std::string RecordingKey(const SIpcMessage &request)
+	{
+		SIpcMessage		key("open");
+		const char		*names[] = { "source", "unit", "temperatureType", "first", "last", "fs" };
+
+		for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+			if (request.Has(names[i]))
+				key.Set(names[i], request.Get(names[i]));
+
+		return key.Serialize();
+	}
+
+	static size_t TimeOffset(size_t pixels, size_t capacity)
+	{
+		return (pixels * capacity * sizeof(float) + 7) / 8 * 8;
+	}
+
+	//	an entry with a segment for capacity frames holding the first numFrames frames and times of from (if any), NULL
+	//	with error set when the segment cannot be made
+	static SServerEntryPtr Reserve(const SServerEntryPtr &from, size_t pixels, size_t numFrames, size_t fromCapacity,
+		size_t capacity, std::string &error)
+	{
+		SServerEntryPtr		entry(new SServerEntry);
+		size_t				timeOffset = TimeOffset(pixels, capacity);
+
+		if (!entry->shm.Create(CSharedMemory::UniqueName(), timeOffset + capacity * sizeof(double), error))
+			return SServerEntryPtr();
+		if (from != NULL) {
+			memcpy(entry->shm.data(), from->shm.data(), numFrames * pixels * sizeof(float));
+			memcpy((char *)entry->shm.data() + timeOffset, (const char *)from->shm.data() + TimeOffset(pixels, fromCapacity),
+				numFrames * sizeof(double));
+		}
+
+		return entry;
+	}
+
+	//	decodes block by block straight into the segment, sized from the frames the source announces (grown by half when
+	//	it does not know or has more), so the recording is never held twice
+	SServerEntryPtr Decode(const SIpcMessage &request)
+	{
+		std::string							error;
+		std::unique_ptr<CFrameSource>		source(mFactory(request, error));
+		CBlockAllocator						alloc;
+		SServerEntryPtr						entry;
+		size_t								numFrames = 0, capacity = 0, pixels;
+
+		if (source == NULL)
+			return Failed(error.empty() ? "Cannot open " + request.Get("source") + "." : error);
+		pixels = source->rows() * source->cols();
+		for (;;) {
+			SFrameBlockPtr		block = source->Read(alloc, 64);
+
+			if (block == NULL)
+				break;
+			if (numFrames + block->numFrames > capacity) {
+				size_t		grown = std::max(numFrames + block->numFrames + source->numFrames(), capacity + capacity / 2);
+
+				entry = Reserve(entry, pixels, numFrames, capacity, grown, error);
+				if (entry == NULL)
+					return Failed(error);
+				capacity = grown;
+			}
+			memcpy((float *)entry->shm.data() + numFrames * pixels, block->data.data(), block->data.size() * sizeof(float));
+			memcpy((char *)entry->shm.data() + TimeOffset(pixels, capacity) + numFrames * sizeof(double), block->time.data(),
+				block->numFrames * sizeof(double));
+			numFrames += block->numFrames;
+		}
+		if (!source->error().empty())
+			return Failed(source->error());
+		if (numFrames == 0)
+			return Failed("No frames in " + request.Get("source") + ".");
+		++mDecodes;
+
+		entry->bytes = TimeOffset(pixels, capacity) + capacity * sizeof(double);
+		entry->reply.Set("rows", (double)source->rows());
+		entry->reply.Set("cols", (double)source->cols());
+		entry->reply.Set("frames", (double)numFrames);
+		entry->reply.Set("timeOffset", (double)TimeOffset(pixels, capacity));
+
+		return entry;
+	}
+
+	SServerEntryPtr Recording(const SIpcMessage &request, bool &cached)
+	{
+		return mCache.Get(RecordingKey(request), [&]() { return Decode(request); }, cached);
+	}
+
+	//	planes maps of rows x cols doubles, count of them per kind
+	static SServerEntryPtr NewResult(size_t rows, size_t cols, size_t count, size_t planes, std::string &error)
+	{
+		SServerEntryPtr		entry(new SServerEntry);
+
+		entry->bytes = rows * cols * planes * sizeof(double);
+		if (!entry->shm.Create(CSharedMemory::UniqueName(), entry->bytes, error))
+			return Failed(error);
+		entry->reply.Set("rows", (double)rows);
+		entry->reply.Set("cols", (double)cols);
+		entry->reply.Set("count", (double)count);
+
+		return entry;
+	}
+
+	SServerEntryPtr LockIn(const SIpcMessage &request, const SServerEntryPtr &cube)
+	{
+		size_t					rows = (size_t)cube->reply.GetNumber("rows", 0), cols = (size_t)cube->reply.GetNumber("cols", 0);
+		size_t					numFrames = (size_t)cube->reply.GetNumber("frames", 0), n = rows * cols;
+		const float				*frames = (const float *)cube->shm.data();
+		const double			*time = (const double *)((const char *)cube->shm.data() + (size_t)cube->reply.GetNumber("timeOffset", 0));
+		std::vector<double>		freqs, x(n), y(n);
+		std::string				list = request.Get("freqs"), error;
+
+		for (size_t start = 0; start < list.size(); ) {
+			size_t		end = std::min(list.find(',', start), list.size());
+			double		f = atof(list.substr(start, end - start).c_str());
+
+			if (!(f > 0.0))
+				return Failed("Frequencies must be positive.");
+			freqs.push_back(f);
+			start = end + 1;
+		}
+		if (freqs.empty())
+			return Failed("Need at least one frequency.");
+
+		CLockInAccumulator		lockin(n, freqs);
+		SServerEntryPtr			entry = NewResult(rows, cols, freqs.size(), 2 * freqs.size(), error);
+		double					*out = (double *)entry->shm.data();
+
+		if (!entry->error.empty())
+			return entry;
+		lockin.Push(frames, time, numFrames);
+		for (size_t k = 0; k < freqs.size(); ++k)
+			lockin.Result(k, x.data(), y.data(), out + k * n, out + (freqs.size() + k) * n);
+
+		return entry;
+	}
+
+	SServerEntryPtr Reduce(const SIpcMessage &request, const SServerEntryPtr &cube)
+	{
+		size_t					rows = (size_t)cube->reply.GetNumber("rows", 0), cols = (size_t)cube->reply.GetNumber("cols", 0);
+		size_t					numFrames = (size_t)cube->reply.GetNumber("frames", 0), n = rows * cols;
+		const float				*frames = (const float *)cube->shm.data();
+		std::string				op = request.Get("op", "mean"), error;
+
+		if (op != "mean" && op != "min" && op != "max" && op != "std")
+			return Failed("op must be mean, min, max or std.");
+
+		SServerEntryPtr			entry = NewResult(rows, cols, 1, 1, error);
+		double					*out = (double *)entry->shm.data();
+
+		if (!entry->error.empty())
+			return entry;
+		//	frame after frame over a range of pixels, so every frame is read in order
+		ParallelFor(n, 4096, [&](size_t begin, size_t end) {
+			std::vector<double>		sum(end - begin, 0.0), sum2(end - begin, 0.0);
+			std::vector<float>		lo(end - begin, INFINITY), hi(end - begin, -INFINITY);
+
+			for (size_t f = 0; f < numFrames; ++f) {
+				const float		*frame = frames + f * n;
+
+				for (size_t p = begin; p < end; ++p) {
+					sum[p - begin] += frame[p];
+					sum2[p - begin] += (double)frame[p] * frame[p];
+					lo[p - begin] = std::min(lo[p - begin], frame[p]);
+					hi[p - begin] = std::max(hi[p - begin], frame[p]);
+				}
+			}
+			for (size_t p = begin; p < end; ++p) {
+				double		mean = sum[p - begin] / (double)numFrames;
+
+				if (op == "mean")
+					out[p] = mean;
+				else if (op == "min")
+					out[p] = lo[p - begin];
+				else if (op == "max")
+					out[p] = hi[p - begin];
+				else
+					out[p] = numFrames > 1 ? sqrt(std::max(0.0, (sum2[p - begin] - numFrames * mean * mean) / (double)(numFrames - 1))) : 0.0;
+			}
+		});
+
+		return entry;
+	}
+
+	SServerEntryPtr Roi(const SIpcMessage &request, const SServerEntryPtr &cube)
+	{
+		size_t					rows = (size_t)cube->reply.GetNumber("rows", 0), cols = (size_t)cube->reply.GetNumber("cols", 0);
+		size_t					numFrames = (size_t)cube->reply.GetNumber("frames", 0), n = rows * cols;
+		const float				*frames = (const float *)cube->shm.data();
+		double					r0 = request.GetNumber("r0", 1.0), r1 = request.GetNumber("r1", (double)rows);
+		double					c0 = request.GetNumber("c0", 1.0), c1 = request.GetNumber("c1", (double)cols);
+		std::string				error;
+
+		if (!(r0 >= 1.0 && r0 <= r1 && r1 <= (double)rows && c0 >= 1.0 && c0 <= c1 && c1 <= (double)cols))
+			return Failed("The rectangle must be inside the frame, 1 based.");
+
+		SServerEntryPtr			entry = NewResult(numFrames, 1, 1, 1, error);
+		double					*out = (double *)entry->shm.data();
+		size_t					ra = (size_t)r0 - 1, rb = (size_t)r1, ca = (size_t)c0 - 1, cb = (size_t)c1;
+
+		if (!entry->error.empty())
+			return entry;
+		ParallelFor(numFrames, 16, [&](size_t begin, size_t end) {
+			for (size_t f = begin; f < end; ++f) {
+				const float		*frame = frames + f * n;
+				double			sum = 0.0;
+
+				for (size_t c = ca; c < cb; ++c)
+					for (size_t r = ra; r < rb; ++r)
+						sum += frame[c * rows + r];
+				out[f] = sum / (double)((rb - ra) * (cb - ca));
+			}
+		});
+
+		return entry;
+	}
+
+	//	held keeps the segment of the reply alive (evicted or not) until the client has mapped it, that is until its next
+	//	request
+	SIpcMessage Handle(const SIpcMessage &request, SServerEntryPtr &held)
+	{
+		SIpcMessage			reply("ok");
+		SServerEntryPtr		entry;
+		bool				cached = false;
+
+		held.reset();
+		++mRequests;
+		if (request.command == "stats" || request.command == "shutdown") {
+			size_t		entries, bytes;
+
+			mCache.Stats(entries, bytes);
+			reply.Set("entries", (double)entries);
+			reply.Set("cachedMB", (double)bytes / (1024.0 * 1024.0));
+			reply.Set("budgetMB", (double)mCache.budget() / (1024.0 * 1024.0));
+			reply.Set("hits", (double)mCache.hits);
+			reply.Set("misses", (double)mCache.misses);
+			reply.Set("decodes", (double)mDecodes);
+			reply.Set("requests", (double)mRequests);
+			reply.Set("clients", (double)mClients);
+			return reply;
+		}
+		if (!request.Has("source"))
+			return SIpcMessage("error Need a source.");
+
+		entry = Recording(request, cached);
+		if (entry->error.empty() && request.command != "open") {
+			SServerEntryPtr		cube = entry;
+			std::function<SServerEntryPtr()>	make;
+
+			if (request.command == "lockin")
+				make = [&]() { return LockIn(request, cube); };
+			else if (request.command == "reduce")
+				make = [&]() { return Reduce(request, cube); };
+			else if (request.command == "roi")
+				make = [&]() { return Roi(request, cube); };
+			else
+				return SIpcMessage("error Unknown command " + request.command + ".");
+			entry = mCache.Get(request.Serialize(), make, cached);
+		}
+		if (!entry->error.empty())
+			return SIpcMessage("error " + entry->error);
+
+		reply.fields = entry->reply.fields;
+		reply.Set("shm", entry->shm.name());
+		reply.Set("bytes", (double)entry->bytes);
+		reply.Set("cached", cached ? 1.0 : 0.0);
+		held = entry;
+
+		return reply;
+	}
+
+	void Serve(CIpcSocket socket, SConnection *connection)
+	{
+		SIpcMessage		request;
+		SServerEntryPtr	held;
+
+		++mClients;
+		while (!mStop) {
+			if (!socket.WaitReadable(200))
+				continue;
+			if (!socket.Receive(request) || !socket.Send(Handle(request, held)))
+				break;
+			if (request.command == "shutdown") {
+				Shutdown();
+				break;
+			}
+		}
+		--mClients;
+		connection->done = true;
+	}
+
+	void AcceptLoop()
+	{
+		while (!mStop) {
+			CIpcSocket		client = mListener.Accept(200);
+
+			//	joins the connections that have ended
+			for (std::list<std::unique_ptr<SConnection>>::iterator it = mConnections.begin(); it != mConnections.end(); ) {
+				if ((*it)->done) {
+					(*it)->thread.join();
+					it = mConnections.erase(it);
+				}
+				else
+					++it;
+			}
+			if (!client.valid())
+				continue;
+
+			std::unique_ptr<SConnection>	connection(new SConnection);
+			SConnection						*c = connection.get();
+
+			c->done = false;
+			c->thread = std::thread([this, c](CIpcSocket &&s) { Serve(std::move(s), c); }, std::move(client));
+			mConnections.push_back(std::move(connection));
+		}
+	}
+
+public:
+	//	budget in bytes of decoded recordings and results
+	CThermoServer(const FThermoSourceFactory &factory, size_t budget) :
+		mFactory(factory),
+		mCache(budget),
+		mStop(false),
+		mDecodes(0),
+		mRequests(0),
+		mClients(0)
+	{
+	}
+
+	~CThermoServer()
+	{
+		Stop();
+	}
+
+	bool Start(const std::string &path)
+	{
+		if (!mListener.Listen(path, mError))
+			return false;
+		mPath = path;
+		mStop = false;
+		mAcceptThread = std::thread([this]() { AcceptLoop(); });
+
+		return true;
+	}
+
+	//	asks the server to stop, Stop joins its threads
+	void Shutdown()
+	{
+		mStop = true;
+	}
+
+	bool stopped() const
+	{
+		return mStop;
+	}
+
+	void Stop()
+	{
+		Shutdown();
+		if (mAcceptThread.joinable())
+			mAcceptThread.join();
+		for (std::list<std::unique_ptr<SConnection>>::iterator it = mConnections.begin(); it != mConnections.end(); ++it)
+			(*it)->thread.join();
+		mConnections.clear();
+		if (mListener.valid()) {
+			mListener.Close();
+#ifdef _WIN32
+			DeleteFileA(mPath.c_str());
+#else
+			unlink(mPath.c_str());
+#endif
+		}
+	}
+
+	const std::string &error() const
+	{
+		return mError;
+	}
+};
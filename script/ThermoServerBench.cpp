@@ -0,0 +1,299 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "ThermoServer.h"
+#include "ThermoServerClient.h"
+#include "SyntheticThermal.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+//	cl /O2 /EHsc /std:c++17 ThermoServerBench.cpp ws2_32.lib
+//	g++ -O3 -std=c++17 -pthread ThermoServerBench.cpp -o ThermoServerBench -lrt
+
+//	ThermoServerBench [options]
+//
+//	the analysis server (ThermoServer.h) in process on synthetic recordings (modulated spots, SyntheticThermal.h,
+//	sources "synthetic:k"), with simulated clients each on its own connection sending a mix of requests over the socket
+//	and mapping the results: lock-in at one or two frequencies, reductions, rectangle series and whole cubes. it prints
+//	the throughput in requests/s and in MB/s of results mapped, the latency percentiles, cold (decode or compute) and
+//	cached, the hit rate and the number of decodes, then checks one lock-in from the server against the lock-in
+//	computed here on the same sequence. the exit code is 1 when they differ. options: --clients (8) --requests (per
+//	client, 50) --recordings (4) --memory (MB, 256) --rows (120) --cols (160) --frames (250) --threads
+//	(THERMO_NUM_THREADS) --socket (a path in the temp folder)
+
+static SSyntheticFormat		gFormat;
+
+static double LockInFrequency(const SSyntheticFormat &format)
+{
+	double		duration = (double)format.numFrames / format.fs;
+
+	return std::max(1.0, floor(duration + 0.5)) / duration;
+}
+
+//	the sequence of recording k, a spot moved by k pixels
+static CSyntheticSequence *NewSequence(size_t k)
+{
+	SSyntheticFormat		format = gFormat;
+	CSyntheticSequence		*seq;
+
+	format.seed = (uint32_t)(k + 1);
+	seq = new CSyntheticSequence(format);
+	seq->ModulatedSpot(0.3, 4.0, LockInFrequency(format), 10.0, 1.0 + 0.1 * (double)k, 1.0, 0, NULL, NULL);
+	seq->Degrade();
+
+	return seq;
+}
+
+//	a synthetic recording as a frame source, generating it is the decode
+class CSyntheticSource : public CFrameSource
+{
+private:
+	std::unique_ptr<CSyntheticSequence>		mSeq;
+	std::unique_ptr<CArraySource<float>>	mArray;
+
+public:
+	CSyntheticSource(size_t k) :
+		mSeq(NewSequence(k)),
+		mArray(new CArraySource<float>(mSeq->frames(), mSeq->time(), gFormat.rows, gFormat.cols, gFormat.numFrames))
+	{
+	}
+
+	size_t rows() const
+	{
+		return gFormat.rows;
+	}
+
+	size_t cols() const
+	{
+		return gFormat.cols;
+	}
+
+	size_t numFrames() const
+	{
+		return mArray->numFrames();
+	}
+
+	SFrameBlockPtr Read(CBlockAllocator &alloc, size_t maxFrames)
+	{
+		return mArray->Read(alloc, maxFrames);
+	}
+};
+
+static CFrameSource *OpenSynthetic(const SIpcMessage &request, std::string &error)
+{
+	std::string		source = request.Get("source");
+
+	if (source.compare(0, 10, "synthetic:") != 0) {
+		error = "Only synthetic:k sources here.";
+		return NULL;
+	}
+
+	return new CSyntheticSource((size_t)atol(source.c_str() + 10));
+}
+
+struct SRequestTime
+{
+	double		seconds;
+	bool		cached;
+	double		bytes;
+};
+
+static void RunClient(const std::string &path, size_t id, size_t numRequests, size_t numRecordings,
+	std::vector<SRequestTime> &times, size_t &failures)
+{
+	CThermoServerClient			client;
+	std::mt19937				random((uint32_t)(1000 + id));
+	double						freq = LockInFrequency(gFormat);
+	const char					*ops[] = { "mean", "min", "max", "std" };
+	char						text[64];
+
+	failures = 0;
+	if (!client.Connect(path)) {
+		failures = numRequests;
+		return;
+	}
+	for (size_t i = 0; i < numRequests; ++i) {
+		SIpcMessage			request, reply;
+		CSharedMemory		data;
+		unsigned			kind = random() % 10;
+
+		request.Set("source", "synthetic:" + std::to_string(random() % numRecordings));
+		if (kind < 4) {
+			request.command = "lockin";
+			snprintf(text, sizeof(text), kind == 0 ? "%.17g,%.17g" : "%.17g", freq, 2.0 * freq);
+			request.Set("freqs", text);
+		}
+		else if (kind < 7) {
+			request.command = "reduce";
+			request.Set("op", ops[random() % 4]);
+		}
+		else if (kind < 9) {
+			size_t		r = 1 + random() % 4 * (gFormat.rows / 8), c = 1 + random() % 4 * (gFormat.cols / 8);
+
+			request.command = "roi";
+			request.Set("r0", (double)r);
+			request.Set("r1", (double)(r + gFormat.rows / 8));
+			request.Set("c0", (double)c);
+			request.Set("c1", (double)(c + gFormat.cols / 8));
+		}
+		else
+			request.command = "open";
+
+		std::chrono::steady_clock::time_point	start = std::chrono::steady_clock::now();
+		double									sum = 0.0;
+
+		if (!client.Fetch(request, reply, data)) {
+			fprintf(stderr, "client %zu: %s\n", id, client.error().c_str());
+			++failures;
+			continue;
+		}
+		//	touches the result as a client would
+		for (size_t b = 0; b < data.size(); b += 4096)
+			sum += ((const unsigned char *)data.data())[b];
+		times.push_back({ std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+			reply.GetNumber("cached", 0.0) != 0.0, reply.GetNumber("bytes", 0.0) + 0.0 * sum });
+	}
+}
+
+static double Percentile(std::vector<double> values, double p)
+{
+	if (values.empty())
+		return NAN;
+	std::sort(values.begin(), values.end());
+
+	return values[std::min(values.size() - 1, (size_t)(p * (double)(values.size() - 1) + 0.5))];
+}
+
+int main(int argc, char **argv)
+{
+	size_t			numClients = 8, numRequests = 50, numRecordings = 4;
+	double			memory = 256.0;
+	std::string		path;
+
+	gFormat.rows = 120;
+	gFormat.cols = 160;
+	gFormat.numFrames = 250;
+	gFormat.fs = 50.0;
+	gFormat.mmpx = 0.075;
+	gFormat.ambient = 25.0;
+	gFormat.noise = 0.05;
+	gFormat.deadFraction = 0.001;
+	gFormat.seed = 1;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string		arg = argv[i];
+		bool			value = i + 1 < argc;
+
+		if (arg == "--clients" && value)
+			numClients = (size_t)atol(argv[++i]);
+		else if (arg == "--requests" && value)
+			numRequests = (size_t)atol(argv[++i]);
+		else if (arg == "--recordings" && value)
+			numRecordings = std::max<size_t>(1, (size_t)atol(argv[++i]));
+		else if (arg == "--memory" && value)
+			memory = atof(argv[++i]);
+		else if (arg == "--rows" && value)
+			gFormat.rows = (size_t)atol(argv[++i]);
+		else if (arg == "--cols" && value)
+			gFormat.cols = (size_t)atol(argv[++i]);
+		else if (arg == "--frames" && value)
+			gFormat.numFrames = (size_t)atol(argv[++i]);
+		else if (arg == "--threads" && value)
+			ThermoSetNumThreads((unsigned)atoi(argv[++i]));
+		else if (arg == "--socket" && value)
+			path = argv[++i];
+		else {
+			fprintf(stderr, "usage: %s [--clients n] [--requests n] [--recordings n] [--memory MB] [--rows n] [--cols n] "
+				"[--frames n] [--threads n] [--socket path]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (path.empty()) {
+		path = ThermoServerPath();
+		path.insert(path.size() - 5, "-bench-" + std::to_string((unsigned long)
+#ifdef _WIN32
+			GetCurrentProcessId()
+#else
+			getpid()
+#endif
+			));
+	}
+
+	CThermoServer		server(OpenSynthetic, (size_t)(memory * 1024.0 * 1024.0));
+
+	if (!server.Start(path)) {
+		fprintf(stderr, "%s\n", server.error().c_str());
+		return 1;
+	}
+
+	std::vector<std::vector<SRequestTime>>	times(numClients);
+	std::vector<size_t>						failures(numClients, 0);
+	std::vector<std::thread>				clients;
+	std::chrono::steady_clock::time_point	start = std::chrono::steady_clock::now();
+
+	for (size_t c = 0; c < numClients; ++c)
+		clients.emplace_back(RunClient, path, c, numRequests, numRecordings, std::ref(times[c]), std::ref(failures[c]));
+	for (size_t c = 0; c < numClients; ++c)
+		clients[c].join();
+
+	double					seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::vector<double>		cold, warm;
+	double					bytes = 0.0;
+	size_t					failed = 0;
+
+	for (size_t c = 0; c < numClients; ++c) {
+		failed += failures[c];
+		for (size_t i = 0; i < times[c].size(); ++i) {
+			(times[c][i].cached ? warm : cold).push_back(1e3 * times[c][i].seconds);
+			bytes += times[c][i].bytes;
+		}
+	}
+
+	//	the server lock-in of recording 0 against the one computed here
+	CThermoServerClient						client;
+	SIpcMessage								request("lockin"), reply, stats;
+	CSharedMemory							data;
+	std::unique_ptr<CSyntheticSequence>		seq(NewSequence(0));
+	size_t									n = gFormat.rows * gFormat.cols;
+	CLockInAccumulator						lockin(n, std::vector<double>(1, LockInFrequency(gFormat)));
+	std::vector<double>						x(n), y(n), amp(n), phase(n);
+	double									diff = NAN;
+	char									text[32];
+
+	snprintf(text, sizeof(text), "%.17g", LockInFrequency(gFormat));
+	request.Set("source", "synthetic:0");
+	request.Set("freqs", text);
+	lockin.Push(seq->frames(), seq->time(), gFormat.numFrames);
+	lockin.Result(0, x.data(), y.data(), amp.data(), phase.data());
+	if (client.Connect(path) && client.Fetch(request, reply, data) && client.Request(SIpcMessage("stats"), stats)) {
+		const double	*remote = (const double *)data.data();
+
+		diff = 0.0;
+		for (size_t p = 0; p < n; ++p)
+			diff = std::max(diff, std::max(fabs(remote[p] - amp[p]), fabs(remote[n + p] - phase[p])));
+	}
+	client.Disconnect();
+	server.Stop();
+
+	size_t		total = cold.size() + warm.size();
+
+	printf("%zu clients, %zu recordings of %zu x %zu x %zu (%.1f MB each), %.0f MB of cache, %u threads\n", numClients,
+		numRecordings, gFormat.rows, gFormat.cols, gFormat.numFrames,
+		(double)(n * gFormat.numFrames) * sizeof(float) / (1024.0 * 1024.0), memory, ThermoNumThreads());
+	printf("%zu requests in %.3f s: %.1f requests/s, %.1f MB/s of results mapped, %zu failed\n", total, seconds,
+		(double)total / seconds, bytes / seconds / (1024.0 * 1024.0), failed);
+	printf("latency [ms]   cold (%zu): p50 %.2f p95 %.2f p99 %.2f   cached (%zu): p50 %.3f p95 %.3f p99 %.3f\n",
+		cold.size(), Percentile(cold, 0.5), Percentile(cold, 0.95), Percentile(cold, 0.99),
+		warm.size(), Percentile(warm, 0.5), Percentile(warm, 0.95), Percentile(warm, 0.99));
+	printf("hit rate %.1f %%, %.0f decodes, %.0f entries (%.1f MB) in the cache at the end\n",
+		100.0 * stats.GetNumber("hits", 0.0) / std::max(1.0, stats.GetNumber("hits", 0.0) + stats.GetNumber("misses", 0.0)),
+		stats.GetNumber("decodes", NAN), stats.GetNumber("entries", NAN), stats.GetNumber("cachedMB", NAN));
+	printf("lock-in of the server against the local one: max difference %g\n", diff);
+
+	return failed == 0 && diff == 0.0 ? 0 : 1;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "ThermoIpc.h"
+
+//	client of the analysis server (ThermoServer.h)
+//
+//	Request sends a request and waits for its reply, Fetch also maps the segment named by the reply read only: the
+//	data is the server's, written once, and stays valid until the CSharedMemory is closed even if the server evicts it
+//	meanwhile. a segment evicted between the reply and the mapping is asked for again (the server decodes or computes it
+//	once more).
+
+class CThermoServerClient
+{
+private:
+	CIpcSocket		mSocket;
+	std::string		mError;
+
+public:
+	bool Connect(const std::string &path = ThermoServerPath())
+	{
+		return mSocket.Connect(path, mError);
+	}
+
+	void Disconnect()
+	{
+		mSocket.Close();
+	}
+
+	bool connected() const
+	{
+		return mSocket.valid();
+	}
+
+	//	false when the server cannot be reached or replies with an error (in error())
+	bool Request(const SIpcMessage &request, SIpcMessage &reply)
+	{
+		if (!mSocket.valid()) {
+			mError = "Not connected to the server.";
+			return false;
+		}
+		if (!mSocket.Send(request) || !mSocket.Receive(reply)) {
+			mError = "The server closed the connection.";
+			mSocket.Close();
+			return false;
+		}
+		if (!reply.ok()) {
+			mError = reply.error();
+			return false;
+		}
+
+		return true;
+	}
+
+	bool Fetch(const SIpcMessage &request, SIpcMessage &reply, CSharedMemory &data)
+	{
+		for (int attempt = 0; attempt < 2; ++attempt) {
+			if (!Request(request, reply))
+				return false;
+			if (data.Open(reply.Get("shm"), mError) && data.size() >= (size_t)reply.GetNumber("bytes", 0.0))
+				return true;
+		}
+
+		return false;
+	}
+
+	const std::string &error() const
+	{
+		return mError;
+	}
+};
@@ -0,0 +1,256 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "ThermoServerClient.h"
+#include "mex.h"
+#include "MexHelpers.h"
+#include <cmath>
+
+//	mex ThermoServerMex.cpp ws2_32.lib
+
+//	h = ThermoServerMex('connect', path)				connects to the analysis server (ThermoServer), path optional
+//														(THERMO_SERVER, thermo-server.sock in the temp folder)
+//	info = ThermoServerMex('open', h, source, opts)		decodes the recording once on the server: rows, cols, frames,
+//														cached (true when it was already in memory)
+//	[frames, t] = ThermoServerMex('frames', h, source, opts)	single rows x cols x n frames and numFrames x 1 times [s]
+//	[amp, phase] = ThermoServerMex('lockin', h, source, freqs, opts)	rows x cols x numel(freqs) maps
+//	map = ThermoServerMex('reduce', h, source, op, opts)	'mean', 'min', 'max' or 'std' over the frames
+//	v = ThermoServerMex('roi', h, source, [r0 r1 c0 c1], opts)	numFrames x 1 mean of the rectangle (1 based)
+//	stats = ThermoServerMex('stats', h)					cache and request counters of the server
+//	ThermoServerMex('shutdown', h)						stops the server
+//	ThermoServerMex('delete', h)
+//
+//	opts (optional) name the recording: unit ('temperatureFactory'), temperatureType ('celsius'), frames ([first last],
+//	1 based) and fs (frame rate when frames carry no time). results are computed once for every client and mapped from
+//	the server memory, the only copy is the one into the matlab array.
+
+class CMatThermoServer
+{
+private:
+	CThermoServerClient		mClient;
+
+	static SIpcMessage NewRequest(const char *command, const mxArray *source, const mxArray *opts)
+	{
+		SIpcMessage			request(command);
+		const mxArray		*frames = mxGetOptionField(opts, "frames");
+
+		request.Set("source", mxGetStdString(source, "source"));
+		request.Set("unit", mxGetOption(opts, "unit", "temperatureFactory"));
+		request.Set("temperatureType", mxGetOption(opts, "temperatureType", "celsius"));
+		if (frames != NULL) {
+			if (mxGetNumberOfElements(frames) != 2)
+				mexErrMsgTxt("frames must be [first last].");
+			request.Set("first", mxGetDoubleInput(frames, "frames")[0]);
+			if (!std::isinf(mxGetDoubleInput(frames, "frames")[1]))
+				request.Set("last", mxGetDoubleInput(frames, "frames")[1]);
+		}
+		if (mxGetOptionField(opts, "fs") != NULL)
+			request.Set("fs", mxGetOption(opts, "fs", 0.0));
+
+		return request;
+	}
+
+	void Fetch(const SIpcMessage &request, SIpcMessage &reply, CSharedMemory &data)
+	{
+		if (!mClient.Fetch(request, reply, data))
+			mexErrMsgTxt(mClient.error().c_str());
+	}
+
+	static mxArray *Maps(const double *data, size_t rows, size_t cols, size_t count)
+	{
+		mwSize		dims[3] = { rows, cols, count };
+		mxArray		*ret = mxCreateNumericArray(3, dims, mxDOUBLE_CLASS, mxREAL);
+
+		memcpy(mxGetData(ret), data, rows * cols * count * sizeof(double));
+
+		return ret;
+	}
+
+public:
+	bool Connect(const std::string &path)
+	{
+		return mClient.Connect(path);
+	}
+
+	const std::string &error() const
+	{
+		return mClient.error();
+	}
+
+	mxArray *Open(const mxArray *source, const mxArray *opts)
+	{
+		const char		*fields[] = { "rows", "cols", "frames", "cached" };
+		mxArray			*ret = mxCreateStructMatrix(1, 1, sizeof(fields) / sizeof(fields[0]), fields);
+		SIpcMessage		reply;
+
+		if (!mClient.Request(NewRequest("open", source, opts), reply))
+			mexErrMsgTxt(mClient.error().c_str());
+		mxSetFieldByNumber(ret, 0, 0, mxCreateDoubleScalar(reply.GetNumber("rows", 0.0)));
+		mxSetFieldByNumber(ret, 0, 1, mxCreateDoubleScalar(reply.GetNumber("cols", 0.0)));
+		mxSetFieldByNumber(ret, 0, 2, mxCreateDoubleScalar(reply.GetNumber("frames", 0.0)));
+		mxSetFieldByNumber(ret, 0, 3, mxCreateLogicalScalar(reply.GetNumber("cached", 0.0) != 0.0));
+
+		return ret;
+	}
+
+	void Frames(const mxArray *source, const mxArray *opts, int nlhs, mxArray *plhs[])
+	{
+		SIpcMessage		reply;
+		CSharedMemory	data;
+
+		Fetch(NewRequest("open", source, opts), reply, data);
+
+		mwSize			dims[3] = { (mwSize)reply.GetNumber("rows", 0.0), (mwSize)reply.GetNumber("cols", 0.0),
+							(mwSize)reply.GetNumber("frames", 0.0) };
+		size_t			timeOffset = (size_t)reply.GetNumber("timeOffset", 0.0);
+
+		plhs[0] = mxCreateNumericArray(3, dims, mxSINGLE_CLASS, mxREAL);
+		memcpy(mxGetData(plhs[0]), data.data(), dims[0] * dims[1] * dims[2] * sizeof(float));
+		if (nlhs > 1) {
+			plhs[1] = mxCreateDoubleMatrix(dims[2], 1, mxREAL);
+			memcpy(mxGetPr(plhs[1]), (const char *)data.data() + timeOffset, dims[2] * sizeof(double));
+		}
+	}
+
+	void LockIn(const mxArray *source, const mxArray *freqs, const mxArray *opts, int nlhs, mxArray *plhs[])
+	{
+		SIpcMessage		request = NewRequest("lockin", source, opts), reply;
+		CSharedMemory	data;
+		const double	*f = mxGetDoubleInput(freqs, "freqs");
+		std::string		list;
+		char			text[32];
+
+		if (mxGetNumberOfElements(freqs) == 0)
+			mexErrMsgTxt("freqs must not be empty.");
+		for (size_t k = 0; k < mxGetNumberOfElements(freqs); ++k) {
+			snprintf(text, sizeof(text), k == 0 ? "%.17g" : ",%.17g", f[k]);
+			list += text;
+		}
+		request.Set("freqs", list);
+		Fetch(request, reply, data);
+
+		size_t			rows = (size_t)reply.GetNumber("rows", 0.0), cols = (size_t)reply.GetNumber("cols", 0.0);
+		size_t			count = (size_t)reply.GetNumber("count", 0.0);
+
+		plhs[0] = Maps((const double *)data.data(), rows, cols, count);
+		if (nlhs > 1)
+			plhs[1] = Maps((const double *)data.data() + rows * cols * count, rows, cols, count);
+	}
+
+	mxArray *Reduce(const mxArray *source, const mxArray *op, const mxArray *opts)
+	{
+		SIpcMessage		request = NewRequest("reduce", source, opts), reply;
+		CSharedMemory	data;
+
+		request.Set("op", mxGetStdString(op, "op"));
+		Fetch(request, reply, data);
+
+		return Maps((const double *)data.data(), (size_t)reply.GetNumber("rows", 0.0), (size_t)reply.GetNumber("cols", 0.0), 1);
+	}
+
+	mxArray *Roi(const mxArray *source, const mxArray *rect, const mxArray *opts)
+	{
+		SIpcMessage		request = NewRequest("roi", source, opts), reply;
+		CSharedMemory	data;
+		const double	*r = mxGetDoubleInput(rect, "rect");
+
+		if (mxGetNumberOfElements(rect) != 4)
+			mexErrMsgTxt("The rectangle must be [r0 r1 c0 c1].");
+		request.Set("r0", r[0]);
+		request.Set("r1", r[1]);
+		request.Set("c0", r[2]);
+		request.Set("c1", r[3]);
+		Fetch(request, reply, data);
+
+		return Maps((const double *)data.data(), (size_t)reply.GetNumber("rows", 0.0), 1, 1);
+	}
+
+	mxArray *Stats()
+	{
+		const char		*fields[] = { "entries", "cachedMB", "budgetMB", "hits", "misses", "decodes", "requests", "clients" };
+		const size_t	numFields = sizeof(fields) / sizeof(fields[0]);
+		mxArray			*ret = mxCreateStructMatrix(1, 1, numFields, fields);
+		SIpcMessage		reply;
+
+		if (!mClient.Request(SIpcMessage("stats"), reply))
+			mexErrMsgTxt(mClient.error().c_str());
+		for (size_t i = 0; i < numFields; ++i)
+			mxSetFieldByNumber(ret, 0, (int)i, mxCreateDoubleScalar(reply.GetNumber(fields[i], NAN)));
+
+		return ret;
+	}
+
+	void Shutdown()
+	{
+		SIpcMessage		reply;
+
+		if (!mClient.Request(SIpcMessage("shutdown"), reply))
+			mexErrMsgTxt(mClient.error().c_str());
+	}
+};
+
+//	the mex entry point
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	char				command[64];
+	CMatThermoServer	*server;
+
+	if (nrhs < 1 || mxGetString(prhs[0], command, sizeof(command)) != 0)
+		mexErrMsgTxt("First argument must be a command string.");
+
+	if (strcmp(command, "connect") == 0) {
+		if (nlhs != 1 || nrhs > 2)
+			mexErrMsgTxt("Must have 1-2 inputs and 1 output.");
+
+		std::string		path = nrhs > 1 ? mxGetStdString(prhs[1], "path") : ThermoServerPath();
+
+		server = new CMatThermoServer;
+		if (!server->Connect(path)) {
+			std::string		message = server->error();
+
+			delete server;
+			mexErrMsgTxt(message.c_str());
+		}
+		plhs[0] = WrapObject(server);
+		return;
+	}
+
+	if (nrhs < 2)
+		mexErrMsgTxt("Second argument must be a handle.");
+
+	server = GetObject<CMatThermoServer>(prhs[1]);		//	won't get past here if GetObject fails
+
+	if (strcmp(command, "delete") == 0) {
+		UnwrapObject<CMatThermoServer>(prhs[1]);
+		delete server;
+	} else if (strcmp(command, "open") == 0) {
+		if (nlhs != 1 || nrhs < 3 || nrhs > 4)
+			mexErrMsgTxt("Must have 3-4 inputs and 1 output.");
+		plhs[0] = server->Open(prhs[2], nrhs > 3 ? prhs[3] : NULL);
+	} else if (strcmp(command, "frames") == 0) {
+		if (nlhs < 1 || nlhs > 2 || nrhs < 3 || nrhs > 4)
+			mexErrMsgTxt("Must have 3-4 inputs and 1-2 outputs.");
+		server->Frames(prhs[2], nrhs > 3 ? prhs[3] : NULL, nlhs, plhs);
+	} else if (strcmp(command, "lockin") == 0) {
+		if (nlhs < 1 || nlhs > 2 || nrhs < 4 || nrhs > 5)
+			mexErrMsgTxt("Must have 4-5 inputs and 1-2 outputs.");
+		server->LockIn(prhs[2], prhs[3], nrhs > 4 ? prhs[4] : NULL, nlhs, plhs);
+	} else if (strcmp(command, "reduce") == 0) {
+		if (nlhs != 1 || nrhs < 4 || nrhs > 5)
+			mexErrMsgTxt("Must have 4-5 inputs and 1 output.");
+		plhs[0] = server->Reduce(prhs[2], prhs[3], nrhs > 4 ? prhs[4] : NULL);
+	} else if (strcmp(command, "roi") == 0) {
+		if (nlhs != 1 || nrhs < 4 || nrhs > 5)
+			mexErrMsgTxt("Must have 4-5 inputs and 1 output.");
+		plhs[0] = server->Roi(prhs[2], prhs[3], nrhs > 4 ? prhs[4] : NULL);
+	} else if (strcmp(command, "stats") == 0) {
+		if (nlhs != 1 || nrhs != 2)
+			mexErrMsgTxt("Must have 2 inputs and 1 outputs.");
+		plhs[0] = server->Stats();
+	} else if (strcmp(command, "shutdown") == 0) {
+		if (nlhs != 0 || nrhs != 2)
+			mexErrMsgTxt("Must have 2 inputs and 0 outputs.");
+		server->Shutdown();
+	} else {
+		mexErrMsgTxt("Unknown command.");
+	}
+}
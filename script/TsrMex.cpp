@@ -0,0 +1,116 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "mex.h"
+#include "MexHelpers.h"
+#include "ThermalSignalReconstruction.h"
+#include "ThermoProfiler.h"
+
+//	mex TsrMex.cpp
+
+//	res = TsrMex(cube, t, opts)
+//	cube is the rows x cols x n post pulse sequence (double or single), t the n times from the pulse [s]. opts is an
+//	optional struct with degree (default 5), baseline (rows x cols map or scalar subtracted before the log, default
+//	0), minDelta (smallest dT, default 1e-3) and evalTimes (times of the derivative maps, default none).
+//	res has coeffs (rows x cols x degree+1, in x = (log(t) - mu) / scale), mu, scale, rms (fit residual in log dT),
+//	peakD2 (the time among t of the maximum second derivative of each pixel), t (the evaluation times) and logT, d1,
+//	d2 (rows x cols x numel(evalTimes): reconstruction and first and second derivatives of log dT against log t, []
+//	without evalTimes). the coefficients are the compressed sequence, the derivative cubes are rebuilt only for the
+//	times asked for
+
+//	the mex entry point
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	if (nrhs < 2 || nrhs > 3 || nlhs > 1)
+		mexErrMsgTxt("Must have 2-3 inputs and 0-1 outputs.");
+
+	CThermoStage		stage("tsr", "TsrMex", (double)mxGetElementSize(prhs[0]) * mxGetNumberOfElements(prhs[0]));
+
+	const mxArray			*cube = prhs[0];
+	const mxArray			*opts = nrhs > 2 ? prhs[2] : NULL;
+	const mwSize			*dims = mxGetDimensions(cube);
+	size_t					rows = dims[0], cols = dims[1];
+	size_t					numPixels = rows * cols;
+	size_t					numFrames = numPixels > 0 ? mxGetNumberOfElements(cube) / numPixels : 0;
+	const double			*t = mxGetDoubleInput(prhs[1], "t");
+	std::vector<double>		times(t, t + mxGetNumberOfElements(prhs[1]));
+	size_t					degree = (size_t)mxGetOption(opts, "degree", 5.0);
+	const mxArray			*baseline = mxGetOptionField(opts, "baseline");
+	const mxArray			*eval = mxGetOptionField(opts, "evalTimes");
+	std::vector<double>		evalTimes;
+
+	if (mxIsComplex(cube) || (!mxIsDouble(cube) && !mxIsSingle(cube)) || mxGetNumberOfDimensions(cube) > 3)
+		mexErrMsgTxt("cube must be a real double or single rows x cols x n array.");
+	if (times.size() != numFrames)
+		mexErrMsgTxt("Need one time per frame.");
+	if (eval != NULL && !mxIsEmpty(eval)) {
+		const double	*data = mxGetDoubleInput(eval, "evalTimes");
+
+		evalTimes.assign(data, data + mxGetNumberOfElements(eval));
+	}
+	for (size_t k = 0; k < evalTimes.size(); ++k)
+		if (!(evalTimes[k] > 0.0))
+			mexErrMsgTxt("Times must be positive.");
+
+	CTsrAccumulator		tsr(numPixels, times, degree, mxGetOption(opts, "minDelta", 1e-3));
+
+	if (!tsr.valid())
+		mexErrMsgTxt("Times must be positive and more than the polynomial degree.");
+
+	if (baseline != NULL && !mxIsEmpty(baseline)) {
+		const double			*data = mxGetDoubleInput(baseline, "baseline");
+		std::vector<double>		plane(numPixels, data[0]);
+
+		if (mxGetNumberOfElements(baseline) == numPixels)
+			plane.assign(data, data + numPixels);
+		else if (mxGetNumberOfElements(baseline) != 1)
+			mexErrMsgTxt("baseline must be a scalar or a rows x cols map.");
+		tsr.SetBaseline(plane.data());
+	}
+
+	if (mxIsDouble(cube))
+		tsr.Push((const double *)mxGetData(cube), numFrames);
+	else
+		tsr.Push((const float *)mxGetData(cube), numFrames);
+
+	const char		*fields[] = { "coeffs", "mu", "scale", "rms", "t", "logT", "d1", "d2", "peakD2" };
+	mxArray			*res = mxCreateStructMatrix(1, 1, sizeof(fields) / sizeof(fields[0]), fields);
+	mwSize			coeffDims[3] = { rows, cols, tsr.numCoeffs() };
+	mwSize			evalDims[3] = { rows, cols, evalTimes.size() };
+	mxArray			*coeffs = mxCreateNumericArray(3, coeffDims, mxDOUBLE_CLASS, mxREAL);
+	mxArray			*rms = mxCreateDoubleMatrix(rows, cols, mxREAL);
+	mxArray			*logT = mxCreateNumericArray(3, evalDims, mxDOUBLE_CLASS, mxREAL);
+	mxArray			*d1 = mxCreateNumericArray(3, evalDims, mxDOUBLE_CLASS, mxREAL);
+	mxArray			*d2 = mxCreateNumericArray(3, evalDims, mxDOUBLE_CLASS, mxREAL);
+	mxArray			*peak = mxCreateDoubleMatrix(rows, cols, mxREAL);
+	double			*peakTime = mxGetPr(peak);
+	std::vector<double>	peakValue(numPixels, -INFINITY), second(numPixels);
+
+	for (size_t j = 0; j < tsr.numCoeffs(); ++j)
+		memcpy(mxGetPr(coeffs) + j * numPixels, tsr.coeffs(j), numPixels * sizeof(double));
+	tsr.Residual(mxGetPr(rms));
+
+	//	the peak on the sample times, one plane at a time
+	for (size_t k = 0; k < times.size(); ++k) {
+		tsr.Evaluate(times[k], NULL, NULL, second.data());
+		for (size_t p = 0; p < numPixels; ++p) {
+			if (second[p] > peakValue[p]) {
+				peakValue[p] = second[p];
+				peakTime[p] = times[k];
+			}
+		}
+	}
+	for (size_t k = 0; k < evalTimes.size(); ++k)
+		tsr.Evaluate(evalTimes[k], mxGetPr(logT) + k * numPixels, mxGetPr(d1) + k * numPixels, mxGetPr(d2) + k * numPixels);
+
+	mxSetFieldByNumber(res, 0, 0, coeffs);
+	mxSetFieldByNumber(res, 0, 1, mxCreateDoubleScalar(tsr.mu()));
+	mxSetFieldByNumber(res, 0, 2, mxCreateDoubleScalar(tsr.scale()));
+	mxSetFieldByNumber(res, 0, 3, rms);
+	mxSetFieldByNumber(res, 0, 4, mxCreateDoubleColumn(evalTimes));
+	mxSetFieldByNumber(res, 0, 5, logT);
+	mxSetFieldByNumber(res, 0, 6, d1);
+	mxSetFieldByNumber(res, 0, 7, d2);
+	mxSetFieldByNumber(res, 0, 8, peak);
+
+	plhs[0] = res;
+}
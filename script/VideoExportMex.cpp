@@ -0,0 +1,205 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "mex.h"
+#include "MexHelpers.h"
+#include "VideoExporter.h"
+
+//	mex VideoExportMex.cpp -I../RaviReader/ffmpeg -L<ffmpeg lib dir> -lavformat -lavcodec -lavutil
+
+//	h = VideoExportMex('new', fileName, rows, cols, opts)
+//		opts (optional struct): codec 'h264' (default) or 'ffv1' (lossless, use .avi or .mkv), fps (default 25),
+//		crf (default 18), preset (default 'veryfast'), palette (as MapRenderMex, default 'ironblack'), range [lo hi]
+//		(fixed colour range), percentile [lo hi] (default [2 98], range from the first pushed block if no range),
+//		batch (frames coloured together, default 64)
+//	VideoExportMex('push', h, frames)		frames rows x cols x n (double, single, uint16 or int16)
+//	info = VideoExportMex('close', h)		flushes the encoder and frees the handle, info has numFrames, lo and hi
+//	VideoExportMex('delete', h)				same without the info
+
+SEnumInfo	PaletteEnumInfo[] = {
+	{ "parula",					palParula },
+	{ "jet",					palJet },
+	{ "hot",					palHot },
+	{ "gray",					palGray },
+	{ "ironblack",				palIronBlack },
+	{ NULL,						-1 },
+};
+
+SEnumInfo	CodecEnumInfo[] = {
+	{ "h264",					SVideoParams::vcH264 },
+	{ "ffv1",					SVideoParams::vcFfv1 },
+	{ NULL,						-1 },
+};
+
+//	keeps the frame size next to the exporter to check the pushed blocks
+class CMatVideoExport
+{
+private:
+	size_t				mRows;
+	size_t				mCols;
+	CVideoExporter		mExporter;
+
+	void Check(bool ok)
+	{
+		if (!ok)
+			mexErrMsgTxt(mExporter.error().c_str());
+	}
+
+public:
+	CMatVideoExport(size_t rows, size_t cols) :
+		mRows(rows),
+		mCols(cols)
+	{
+	}
+
+	bool Open(const std::string &fileName, const SVideoParams &params, std::string &error)
+	{
+		bool	ok = mExporter.Open(fileName.c_str(), mRows, mCols, params);
+
+		error = mExporter.error();
+
+		return ok;
+	}
+
+	void Push(const mxArray *frames)
+	{
+		const mwSize	*dims = mxGetDimensions(frames);
+		size_t			numFrames = mxGetNumberOfElements(frames) / (mRows * mCols);
+
+		if (dims[0] != mRows || dims[1] != mCols || numFrames * mRows * mCols != mxGetNumberOfElements(frames))
+			mexErrMsgTxt("Frames do not match the video size.");
+		if (mxIsComplex(frames))
+			mexErrMsgTxt("Must not be complex.");
+
+		switch (mxGetClassID(frames)) {
+			case mxDOUBLE_CLASS:
+				Check(mExporter.Push((const double *)mxGetData(frames), numFrames));
+				break;
+			case mxSINGLE_CLASS:
+				Check(mExporter.Push((const float *)mxGetData(frames), numFrames));
+				break;
+			case mxUINT16_CLASS:
+				Check(mExporter.Push((const uint16_t *)mxGetData(frames), numFrames));
+				break;
+			case mxINT16_CLASS:
+				Check(mExporter.Push((const int16_t *)mxGetData(frames), numFrames));
+				break;
+			default:
+				mexErrMsgTxt("Unsupported type.");
+				break;
+		}
+	}
+
+	bool Close(std::string &error)
+	{
+		bool	ok = mExporter.Close();
+
+		error = mExporter.error();
+
+		return ok;
+	}
+
+	mxArray *info() const
+	{
+		const char	*fields[] = { "numFrames", "lo", "hi" };
+		mxArray		*ret = mxCreateStructMatrix(1, 1, sizeof(fields) / sizeof(fields[0]), fields);
+
+		mxSetFieldByNumber(ret, 0, 0, mxCreateDoubleScalar((double)mExporter.numFrames()));
+		mxSetFieldByNumber(ret, 0, 1, mxCreateDoubleScalar(mExporter.lo()));
+		mxSetFieldByNumber(ret, 0, 2, mxCreateDoubleScalar(mExporter.hi()));
+
+		return ret;
+	}
+};
+
+static void GetParams(const mxArray *opts, SVideoParams &params)
+{
+	const mxArray	*range = mxGetOptionField(opts, "range");
+	const mxArray	*percentile = mxGetOptionField(opts, "percentile");
+	std::string		codec = mxGetOption(opts, "codec", "h264");
+	std::string		palette = mxGetOption(opts, "palette", "ironblack");
+	int				value;
+
+	value = ParseEnum(CodecEnumInfo, codec.c_str());
+	if (value < 0)
+		mexErrMsgTxt("Unknown codec.");
+	params.codec = (SVideoParams::ECodec)value;
+	value = ParseEnum(PaletteEnumInfo, palette.c_str());
+	if (value < 0)
+		mexErrMsgTxt("Unknown palette.");
+	params.palette = (EPalette)value;
+
+	params.fps = mxGetOption(opts, "fps", 25.0);
+	params.crf = (int)mxGetOption(opts, "crf", 18.0);
+	params.preset = mxGetOption(opts, "preset", "veryfast");
+	params.batch = (size_t)mxGetOption(opts, "batch", 64.0);
+	params.lo = params.hi = mxGetNaN();
+	params.percentileLo = 2.0;
+	params.percentileHi = 98.0;
+	if (range != NULL && !mxIsEmpty(range)) {
+		if (mxGetNumberOfElements(range) != 2)
+			mexErrMsgTxt("range must be [lo hi].");
+		params.lo = mxGetDoubleInput(range, "range")[0];
+		params.hi = mxGetDoubleInput(range, "range")[1];
+	}
+	if (percentile != NULL && !mxIsEmpty(percentile)) {
+		if (mxGetNumberOfElements(percentile) != 2)
+			mexErrMsgTxt("percentile must be [lo hi].");
+		params.percentileLo = mxGetDoubleInput(percentile, "percentile")[0];
+		params.percentileHi = mxGetDoubleInput(percentile, "percentile")[1];
+	}
+}
+
+//	the mex entry point
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	char				command[64];
+	CMatVideoExport		*video;
+	std::string			error;
+
+	if (nrhs < 1 || mxGetString(prhs[0], command, sizeof(command)) != 0)
+		mexErrMsgTxt("First argument must be a command string.");
+
+	if (strcmp(command, "new") == 0) {
+		if (nlhs != 1 || nrhs < 4 || nrhs > 5)
+			mexErrMsgTxt("Must have 4-5 inputs and 1 output.");
+
+		std::string		fileName = mxGetStdString(prhs[1], "fileName");
+		size_t			rows = (size_t)mxGetScalarInput(prhs[2], "rows");
+		size_t			cols = (size_t)mxGetScalarInput(prhs[3], "cols");
+		SVideoParams	params;
+
+		GetParams(nrhs > 4 ? prhs[4] : NULL, params);
+		video = new CMatVideoExport(rows, cols);
+		if (!video->Open(fileName, params, error)) {
+			delete video;
+			mexErrMsgTxt(error.c_str());
+		}
+		plhs[0] = WrapObject(video);
+		return;
+	}
+
+	if (nrhs < 2)
+		mexErrMsgTxt("Second argument must be a handle.");
+
+	video = GetObject<CMatVideoExport>(prhs[1]);		//	won't get past here if GetObject fails
+
+	if (strcmp(command, "delete") == 0 || strcmp(command, "close") == 0) {
+		bool	ok;
+
+		if (nlhs > 1 || nrhs != 2)
+			mexErrMsgTxt("Must have 2 inputs and 0-1 outputs.");
+		UnwrapObject<CMatVideoExport>(prhs[1]);
+		ok = video->Close(error);
+		if (nlhs > 0)
+			plhs[0] = video->info();
+		delete video;
+		if (!ok && strcmp(command, "close") == 0)
+			mexErrMsgTxt(error.c_str());
+	} else if (strcmp(command, "push") == 0) {
+		if (nlhs != 0 || nrhs != 3)
+			mexErrMsgTxt("Must have 3 inputs and 0 outputs.");
+		video->Push(prhs[2]);
+	} else {
+		mexErrMsgTxt("Unknown command.");
+	}
+}
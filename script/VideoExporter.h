@@ -0,0 +1,413 @@
+#pragma once
+
+#include "Palette.h"
+#include "ThermoParallel.h"
+#include <vector>
+#include <string>
+#include <thread>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+extern "C" {
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/opt.h"
+}
+
+//	pseudo colour video export with the vendored ffmpeg libraries (RaviReader/ffmpeg)
+//
+//	frames go through a palette lookup table with a fixed range, or with the range taken from percentiles of the
+//	first pushed block (like stretchlim in RAVIreader.m, but kept for the whole video so colours do not flicker).
+//	the palette is converted once to the encoder pixel format: BT.601 YUV 4:2:0 for H.264, BGR0 for the lossless
+//	FFV1, so colouring is a table lookup per pixel. pushed blocks are split in batches, the next batch is coloured
+//	on all cores while the current one is fed to the encoder. NaN pixels are black.
+//	frames are matlab column major rows x cols (x along the columns), they come out upright.
+
+struct SVideoParams
+{
+	enum ECodec
+	{
+		vcH264 = 0,
+		vcFfv1
+	};
+
+	ECodec			codec;
+	double			fps;
+	int				crf;				//	H.264 quality, lower is better
+	std::string		preset;				//	x264 preset
+	EPalette		palette;
+	double			lo;					//	colour range, NaN for the percentiles of the first block
+	double			hi;
+	double			percentileLo;		//	[%]
+	double			percentileHi;
+	size_t			batch;				//	frames coloured together
+};
+
+class CVideoExporter
+{
+private:
+	SVideoParams		mParams;
+	size_t				mRows;
+	size_t				mCols;
+	AVFormatContext		*mFormat;
+	AVCodecContext		*mCodec;
+	AVStream			*mStream;
+	AVPacket			*mPacket;
+	int64_t				mNumFrames;
+	bool				mHeaderWritten;
+	bool				mRangeReady;
+	uint8_t				mLut[257 * 4];		//	Y U V or B G R 0 per palette entry, entry 256 is NaN
+	std::string			mError;
+
+	bool Fail(const char *what, int err = 0)
+	{
+		char	buffer[AV_ERROR_MAX_STRING_SIZE] = "";
+
+		if (err < 0)
+			av_strerror(err, buffer, sizeof(buffer));
+		mError = err < 0 ? std::string(what) + ": " + buffer : std::string(what);
+
+		return false;
+	}
+
+	void BuildLut()
+	{
+		CPalette	palette(mParams.palette);
+
+		for (int i = 0; i < 257; ++i) {
+			const uint8_t	*rgb = palette.Color(std::min(i, 255));
+			double			r = i < 256 ? rgb[0] : 0.0, g = i < 256 ? rgb[1] : 0.0, b = i < 256 ? rgb[2] : 0.0;
+			uint8_t			*e = &mLut[i * 4];
+
+			if (mParams.codec == SVideoParams::vcFfv1) {
+				e[0] = (uint8_t)b;
+				e[1] = (uint8_t)g;
+				e[2] = (uint8_t)r;
+				e[3] = 0;
+			}
+			else {
+				e[0] = (uint8_t)lround(16.0 + (65.738 * r + 129.057 * g + 25.064 * b) / 256.0);
+				e[1] = (uint8_t)lround(128.0 + (-37.945 * r - 74.494 * g + 112.439 * b) / 256.0);
+				e[2] = (uint8_t)lround(128.0 + (112.439 * r - 94.154 * g - 18.285 * b) / 256.0);
+				e[3] = 0;
+			}
+		}
+	}
+
+	template <typename kind>
+	void Range(const kind *frames, size_t numFrames)
+	{
+		size_t					total = mRows * mCols * numFrames;
+		size_t					step = std::max<size_t>(1, total / 1000000);
+		std::vector<double>		values;
+
+		for (size_t i = 0; i < total; i += step)
+			if (std::isfinite((double)frames[i]))
+				values.push_back((double)frames[i]);
+
+		if (!values.empty()) {
+			auto percentile = [&](double p) {
+				size_t		k = std::min(values.size() - 1, (size_t)(p / 100.0 * (double)(values.size() - 1) + 0.5));
+
+				std::nth_element(values.begin(), values.begin() + k, values.end());
+				return values[k];
+			};
+
+			if (std::isnan(mParams.lo))
+				mParams.lo = percentile(mParams.percentileLo);
+			if (std::isnan(mParams.hi))
+				mParams.hi = percentile(mParams.percentileHi);
+		}
+		mRangeReady = true;
+	}
+
+	//	one frame into a writable AVFrame, the edges are repeated up to the even encoder size
+	template <typename kind>
+	void Colorize(const kind *frame, AVFrame *out, std::vector<uint16_t> &index) const
+	{
+		size_t		width = (size_t)out->width, height = (size_t)out->height;
+		double		scale = mParams.hi > mParams.lo ? 255.0 / (mParams.hi - mParams.lo) : 0.0;
+
+		index.resize(width * height);
+		for (size_t x = 0; x < width; ++x) {
+			const kind	*column = frame + std::min(x, mCols - 1) * mRows;
+
+			for (size_t y = 0; y < height; ++y) {
+				double		v = (double)column[std::min(y, mRows - 1)];
+				double		t = (v - mParams.lo) * scale;
+
+				index[y * width + x] = std::isnan(v) ? 256 : t <= 0.0 ? 0 : t >= 255.0 ? 255 : (uint16_t)(t + 0.5);
+			}
+		}
+
+		if (mParams.codec == SVideoParams::vcFfv1) {
+			for (size_t y = 0; y < height; ++y) {
+				uint8_t		*row = out->data[0] + y * out->linesize[0];
+
+				for (size_t x = 0; x < width; ++x)
+					memcpy(row + x * 4, &mLut[index[y * width + x] * 4], 4);
+			}
+			return;
+		}
+
+		for (size_t y = 0; y < height; ++y) {
+			uint8_t		*row = out->data[0] + y * out->linesize[0];
+
+			for (size_t x = 0; x < width; ++x)
+				row[x] = mLut[index[y * width + x] * 4];
+		}
+		for (size_t y = 0; y < height / 2; ++y) {
+			uint8_t			*u = out->data[1] + y * out->linesize[1];
+			uint8_t			*v = out->data[2] + y * out->linesize[2];
+			const uint16_t	*i0 = &index[2 * y * width], *i1 = i0 + width;
+
+			for (size_t x = 0; x < width / 2; ++x) {
+				const uint8_t	*a = &mLut[i0[2 * x] * 4], *b = &mLut[i0[2 * x + 1] * 4];
+				const uint8_t	*c = &mLut[i1[2 * x] * 4], *d = &mLut[i1[2 * x + 1] * 4];
+
+				u[x] = (uint8_t)((a[1] + b[1] + c[1] + d[1] + 2) >> 2);
+				v[x] = (uint8_t)((a[2] + b[2] + c[2] + d[2] + 2) >> 2);
+			}
+		}
+	}
+
+	template <typename kind>
+	bool ColorizeBatch(const kind *frames, size_t numFrames, std::vector<AVFrame *> &out)
+	{
+		bool	ok = true;
+
+		out.assign(numFrames, NULL);
+		for (size_t f = 0; f < numFrames && ok; ++f) {
+			out[f] = av_frame_alloc();
+			ok = out[f] != NULL;
+			if (ok) {
+				out[f]->format = mCodec->pix_fmt;
+				out[f]->width = mCodec->width;
+				out[f]->height = mCodec->height;
+				ok = av_frame_get_buffer(out[f], 0) >= 0;
+			}
+		}
+		if (!ok)
+			return false;
+
+		ParallelFor(numFrames, 1, [&](size_t begin, size_t end) {
+			std::vector<uint16_t>	index;
+
+			for (size_t f = begin; f < end; ++f)
+				Colorize(frames + f * mRows * mCols, out[f], index);
+		});
+
+		return true;
+	}
+
+	//	frame NULL drains the encoder
+	bool Encode(AVFrame *frame)
+	{
+		int		ret = avcodec_send_frame(mCodec, frame);
+
+		if (ret < 0)
+			return Fail("Cannot send a frame to the encoder", ret);
+
+		while ((ret = avcodec_receive_packet(mCodec, mPacket)) >= 0) {
+			av_packet_rescale_ts(mPacket, mCodec->time_base, mStream->time_base);
+			mPacket->stream_index = mStream->index;
+			ret = av_interleaved_write_frame(mFormat, mPacket);
+			if (ret < 0)
+				return Fail("Cannot write the video", ret);
+		}
+
+		return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? true : Fail("Encoder error", ret);
+	}
+
+	static void FreeFrames(std::vector<AVFrame *> &frames)
+	{
+		for (size_t f = 0; f < frames.size(); ++f)
+			av_frame_free(&frames[f]);
+		frames.clear();
+	}
+
+public:
+	CVideoExporter() :
+		mRows(0),
+		mCols(0),
+		mFormat(NULL),
+		mCodec(NULL),
+		mStream(NULL),
+		mPacket(NULL),
+		mNumFrames(0),
+		mHeaderWritten(false),
+		mRangeReady(false)
+	{
+	}
+
+	~CVideoExporter()
+	{
+		Close();
+	}
+
+	const std::string &error() const
+	{
+		return mError;
+	}
+
+	int64_t numFrames() const
+	{
+		return mNumFrames;
+	}
+
+	double lo() const
+	{
+		return mParams.lo;
+	}
+
+	double hi() const
+	{
+		return mParams.hi;
+	}
+
+	//	container from the file extension (.mp4, .mkv, .avi, ...)
+	bool Open(const char *fileName, size_t rows, size_t cols, const SVideoParams &params)
+	{
+		const AVCodec	*codec = NULL;
+		AVRational		rate = av_d2q(params.fps, 100000);
+		int				ret;
+
+		Close();
+		mParams = params;
+		mRows = rows;
+		mCols = cols;
+		mNumFrames = 0;
+		mRangeReady = !std::isnan(params.lo) && !std::isnan(params.hi);
+		mParams.batch = std::max<size_t>(params.batch, 1);
+		BuildLut();
+
+		if (rows == 0 || cols == 0 || !(params.fps > 0.0))
+			return Fail("Invalid frame size or frame rate");
+
+		if (params.codec == SVideoParams::vcH264) {
+			codec = avcodec_find_encoder_by_name("libx264");
+			if (codec == NULL)
+				codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+		}
+		else
+			codec = avcodec_find_encoder(AV_CODEC_ID_FFV1);
+		if (codec == NULL)
+			return Fail("Encoder not available in this ffmpeg build");
+
+		ret = avformat_alloc_output_context2(&mFormat, NULL, NULL, fileName);
+		if (ret < 0)
+			return Fail("Unknown container", ret);
+
+		mStream = avformat_new_stream(mFormat, NULL);
+		mCodec = avcodec_alloc_context3(codec);
+		mPacket = av_packet_alloc();
+		if (mStream == NULL || mCodec == NULL || mPacket == NULL)
+			return Fail("Out of memory");
+
+		mCodec->width = (int)(params.codec == SVideoParams::vcH264 ? (cols + 1) & ~(size_t)1 : cols);
+		mCodec->height = (int)(params.codec == SVideoParams::vcH264 ? (rows + 1) & ~(size_t)1 : rows);
+		mCodec->pix_fmt = params.codec == SVideoParams::vcH264 ? AV_PIX_FMT_YUV420P : AV_PIX_FMT_0RGB32;
+		mCodec->time_base = av_inv_q(rate);
+		mCodec->framerate = rate;
+		mCodec->gop_size = 250;
+		mCodec->thread_count = 0;
+		if (params.codec == SVideoParams::vcH264) {
+			mCodec->color_range = AVCOL_RANGE_MPEG;
+			mCodec->colorspace = AVCOL_SPC_SMPTE170M;
+			av_opt_set(mCodec->priv_data, "preset", params.preset.c_str(), 0);
+			av_opt_set_int(mCodec->priv_data, "crf", params.crf, 0);
+		}
+		if (mFormat->oformat->flags & AVFMT_GLOBALHEADER)
+			mCodec->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+		ret = avcodec_open2(mCodec, codec, NULL);
+		if (ret < 0)
+			return Fail("Cannot open the encoder", ret);
+		ret = avcodec_parameters_from_context(mStream->codecpar, mCodec);
+		if (ret < 0)
+			return Fail("Cannot set the stream parameters", ret);
+		mStream->time_base = mCodec->time_base;
+		mStream->avg_frame_rate = rate;
+
+		if (!(mFormat->oformat->flags & AVFMT_NOFILE)) {
+			ret = avio_open(&mFormat->pb, fileName, AVIO_FLAG_WRITE);
+			if (ret < 0)
+				return Fail("Cannot create the file", ret);
+		}
+		ret = avformat_write_header(mFormat, NULL);
+		if (ret < 0)
+			return Fail("Cannot write the header", ret);
+		mHeaderWritten = true;
+
+		return true;
+	}
+
+	//	numFrames frames of rows x cols samples, one after the other
+	template <typename kind>
+	bool Push(const kind *frames, size_t numFrames)
+	{
+		size_t					frameSize = mRows * mCols, batch = mParams.batch;
+		std::vector<AVFrame *>	current, next;
+		bool					ok = true, nextOk = true;
+
+		if (!mHeaderWritten)
+			return Fail("The video is not open");
+		if (numFrames == 0)
+			return true;
+		if (!mRangeReady)
+			Range(frames, std::min(numFrames, batch));
+
+		if (!ColorizeBatch(frames, std::min(batch, numFrames), current)) {
+			FreeFrames(current);
+			return Fail("Out of memory");
+		}
+
+		for (size_t first = 0; first < numFrames && ok; first += batch) {
+			size_t			count = std::min(batch, numFrames - first);
+			size_t			nextFirst = first + count;
+			std::thread		worker;
+
+			//	colour the next batch while this one is encoded
+			if (nextFirst < numFrames)
+				worker = std::thread([&]() { nextOk = ColorizeBatch(frames + nextFirst * frameSize, std::min(batch, numFrames - nextFirst), next); });
+
+			for (size_t f = 0; f < count && ok; ++f) {
+				current[f]->pts = mNumFrames++;
+				ok = Encode(current[f]);
+			}
+
+			if (worker.joinable())
+				worker.join();
+			FreeFrames(current);
+			current.swap(next);
+			if (!nextOk)
+				ok = Fail("Out of memory");
+		}
+		FreeFrames(current);
+
+		return ok;
+	}
+
+	//	flushes the encoder and writes the trailer, safe to call more than once
+	bool Close()
+	{
+		bool	ok = true;
+
+		if (mHeaderWritten) {
+			ok = Encode(NULL);
+			ok = av_write_trailer(mFormat) >= 0 && ok;
+			mHeaderWritten = false;
+		}
+		if (mFormat != NULL && !(mFormat->oformat->flags & AVFMT_NOFILE))
+			avio_closep(&mFormat->pb);
+		avcodec_free_context(&mCodec);
+		av_packet_free(&mPacket);
+		avformat_free_context(mFormat);
+		mFormat = NULL;
+		mStream = NULL;
+
+		return ok;
+	}
+};
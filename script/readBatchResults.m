@@ -0,0 +1,39 @@
+function T = readBatchResults(fileName)
+%readBatchResults risultati di ThermoBatch come table, una riga per file
+%   fileName e' il .tcol (formato a colonne, vedi ThermoBatch.h) o il .csv
+%   scritto alla fine del batch. Le colonne sono file, status ('ok' o
+%   l'errore), onset, last, frames, xc, yc (1 based), Dx, Dy, Davg, r2,
+%   dMax, dMin, theta e i tempi delle fasi in secondi
+
+[~,~,ext] = fileparts(fileName);
+if ~strcmpi(ext, '.tcol')
+    T = readtable(fileName, 'Delimiter', ',', 'TextType', 'string');
+    return
+end
+
+fid = fopen(fileName, 'r', 'ieee-le');
+if fid < 0
+    error('Impossibile aprire %s', fileName);
+end
+chiudi = onCleanup(@() fclose(fid));
+
+if ~strcmp(fread(fid, [1 4], '*char'), 'TCOL') || fread(fid, 1, 'uint32') ~= 1
+    error('%s non e'' un file .tcol', fileName);
+end
+numRows = fread(fid, 1, 'uint64');
+numCols = fread(fid, 1, 'uint32');
+
+T = table();
+for cc = 1:numCols
+    name = fread(fid, [1 fread(fid, 1, 'uint32')], '*char');
+    if fread(fid, 1, 'uint8') == 0
+        T.(name) = fread(fid, numRows, 'double');
+    else
+        values = strings(numRows, 1);
+        for rr = 1:numRows
+            values(rr) = string(fread(fid, [1 fread(fid, 1, 'uint32')], '*char'));
+        end
+        T.(name) = values;
+    end
+end
+end